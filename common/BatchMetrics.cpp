@@ -0,0 +1,383 @@
+/*
+ * BatchMetrics.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#include "BatchMetrics.h"
+
+using namespace std;
+
+// The upper bounds in seconds of the latency buckets, from the Sobel of a small cover to a
+// timed out localization of a huge one.
+static const double bucketBounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+static const size_t cntBuckets = sizeof(bucketBounds)/sizeof(bucketBounds[0]);
+
+static double GetTimestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+static void AppendMetric(
+    string& text,
+    const string& name,
+    const string& labels,
+    const double value)
+{
+    char valueStr[64];
+    snprintf(valueStr, sizeof(valueStr), "%.17g", value);
+
+    text += name;
+    if (!labels.empty())
+    {
+        text += '{' + labels + '}';
+    }
+    text += ' ';
+    text += valueStr;
+    text += '\n';
+}
+
+static void AppendHeader(
+    string& text,
+    const string& name,
+    const string& type,
+    const string& help)
+{
+    text += "# HELP " + name + ' ' + help + '\n';
+    text += "# TYPE " + name + ' ' + type + '\n';
+}
+
+BatchMetrics::BatchMetrics(
+    const string& metricsFile,
+    const string& prefix,
+    const double intervalSec) :
+    m_metricsFile(metricsFile),
+    m_prefix(prefix),
+    m_interval(static_cast<long>(max(intervalSec, 0.1)*1000.0)),
+    m_stopping(false),
+    m_startTime(chrono::steady_clock::now()),
+    m_startTimestamp(GetTimestamp()),
+    m_lastProgressTimestamp(m_startTimestamp),
+    m_cntProcessed(0)
+{
+    m_imageHistogram.counts.assign(cntBuckets, 0);
+    m_imageHistogram.sum = 0.0;
+    m_imageHistogram.count = 0;
+}
+
+BatchMetrics::~BatchMetrics()
+{
+    Stop();
+}
+
+void BatchMetrics::Start()
+{
+    if (m_writer.joinable())
+    {
+        return;
+    }
+
+    m_stopping = false;
+    m_writer = thread([this]()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_stopCond.wait_for(lock, m_interval, [this]() { return m_stopping; }))
+        {
+            lock.unlock();
+            WriteSnapshot();
+            lock.lock();
+        }
+    });
+}
+
+void BatchMetrics::Stop()
+{
+    if (!m_writer.joinable())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_stopCond.notify_all();
+    m_writer.join();
+    WriteSnapshot();
+}
+
+string BatchMetrics::EscapeLabel(const string& value)
+{
+    string escaped;
+    for (const char c: value)
+    {
+        if (c == '\\')
+        {
+            escaped += "\\\\";
+        }
+        else if (c == '"')
+        {
+            escaped += "\\\"";
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+void BatchMetrics::Observe(
+    Histogram& histogram,
+    const double seconds)
+{
+    const size_t bucketIndex = lower_bound(bucketBounds, bucketBounds + cntBuckets, seconds) - bucketBounds;
+    if (bucketIndex < cntBuckets)
+    {
+        ++histogram.counts[bucketIndex];
+    }
+
+    histogram.sum += seconds;
+    ++histogram.count;
+}
+
+BatchMetrics::Histogram& BatchMetrics::GetStageHistogram(const string& stage)
+{
+    auto itHistogram = m_stageHistograms.find(stage);
+    if (itHistogram == m_stageHistograms.end())
+    {
+        Histogram histogram;
+        histogram.counts.assign(cntBuckets, 0);
+        histogram.sum = 0.0;
+        histogram.count = 0;
+        itHistogram = m_stageHistograms.insert(make_pair(stage, histogram)).first;
+    }
+
+    return itHistogram->second;
+}
+
+void BatchMetrics::RecordImage(
+    const ImageResult result,
+    const string& method,
+    const string& reason,
+    const vector<pair<string, double> >& stageTimesMs,
+    const double totalMs)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    ++m_cntProcessed;
+    m_lastProgressTimestamp = GetTimestamp();
+
+    switch (result)
+    {
+    case ImageResult::Succeeded:
+        ++m_successCounts[method];
+        break;
+
+    case ImageResult::Failed:
+        ++m_failureCounts[reason];
+        break;
+
+    case ImageResult::Skipped:
+        ++m_skipCounts[reason];
+        break;
+    }
+
+    for (const auto& stageTime: stageTimesMs)
+    {
+        Observe(GetStageHistogram(stageTime.first), stageTime.second/1000.0);
+    }
+
+    Observe(m_imageHistogram, totalMs/1000.0);
+}
+
+void BatchMetrics::RecordStage(
+    const string& stage,
+    const double timeMs)
+{
+    lock_guard<mutex> lock(m_mutex);
+    Observe(GetStageHistogram(stage), timeMs/1000.0);
+}
+
+void BatchMetrics::SetQueueDepth(
+    const string& queue,
+    const double depth)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_queueDepths[queue] = depth;
+}
+
+void BatchMetrics::SetQueueDepthFunc(
+    const string& queue,
+    const GaugeFunc& func)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_queueDepthFuncs.push_back(make_pair(queue, func));
+}
+
+void BatchMetrics::ClearQueueDepthFuncs()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_queueDepthFuncs.clear();
+}
+
+void BatchMetrics::AppendHistogram(
+    string& text,
+    const string& name,
+    const string& labels,
+    const Histogram& histogram) const
+{
+    const string labelsPrefix = labels.empty() ? "" : labels + ',';
+
+    uint64_t cumulativeCount = 0;
+    for (size_t bucketIndex = 0; bucketIndex < cntBuckets; ++bucketIndex)
+    {
+        char bound[32];
+        snprintf(bound, sizeof(bound), "%g", bucketBounds[bucketIndex]);
+        cumulativeCount += histogram.counts[bucketIndex];
+        AppendMetric(text, name + "_bucket", labelsPrefix + "le=\"" + bound + '"', static_cast<double>(cumulativeCount));
+    }
+
+    AppendMetric(text, name + "_bucket", labelsPrefix + "le=\"+Inf\"", static_cast<double>(histogram.count));
+    AppendMetric(text, name + "_sum", labels, histogram.sum);
+    AppendMetric(text, name + "_count", labels, static_cast<double>(histogram.count));
+}
+
+string BatchMetrics::Format() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    const double elapsedSec = chrono::duration<double>(chrono::steady_clock::now() - m_startTime).count();
+
+    string text;
+    string name = m_prefix + "_images_processed_total";
+    AppendHeader(text, name, "counter", "The images finished with any outcome.");
+    AppendMetric(text, name, "", static_cast<double>(m_cntProcessed));
+
+    name = m_prefix + "_images_succeeded_total";
+    AppendHeader(text, name, "counter", "The images succeeded, by method.");
+    for (const auto& successCount: m_successCounts)
+    {
+        AppendMetric(text, name, "method=\"" + EscapeLabel(successCount.first) + '"', static_cast<double>(successCount.second));
+    }
+
+    name = m_prefix + "_images_failed_total";
+    AppendHeader(text, name, "counter", "The images which failed, by reason.");
+    for (const auto& failureCount: m_failureCounts)
+    {
+        AppendMetric(text, name, "reason=\"" + EscapeLabel(failureCount.first) + '"', static_cast<double>(failureCount.second));
+    }
+
+    name = m_prefix + "_images_skipped_total";
+    AppendHeader(text, name, "counter", "The images skipped, by reason.");
+    for (const auto& skipCount: m_skipCounts)
+    {
+        AppendMetric(text, name, "reason=\"" + EscapeLabel(skipCount.first) + '"', static_cast<double>(skipCount.second));
+    }
+
+    name = m_prefix + "_images_per_second";
+    AppendHeader(text, name, "gauge", "The images finished per second since the start of the run.");
+    AppendMetric(text, name, "", (elapsedSec > 0.0) ? m_cntProcessed/elapsedSec : 0.0);
+
+    name = m_prefix + "_queue_depth";
+    AppendHeader(text, name, "gauge", "The images waiting in or taken from each queue.");
+    map<string, double> queueDepths = m_queueDepths;
+    for (const auto& queueDepthFunc: m_queueDepthFuncs)
+    {
+        queueDepths[queueDepthFunc.first] = queueDepthFunc.second();
+    }
+
+    for (const auto& queueDepth: queueDepths)
+    {
+        AppendMetric(text, name, "queue=\"" + EscapeLabel(queueDepth.first) + '"', queueDepth.second);
+    }
+
+    name = m_prefix + "_stage_duration_seconds";
+    AppendHeader(text, name, "histogram", "The time of each stage of an image.");
+    for (const auto& stageHistogram: m_stageHistograms)
+    {
+        AppendHistogram(text, name, "stage=\"" + EscapeLabel(stageHistogram.first) + '"', stageHistogram.second);
+    }
+
+    name = m_prefix + "_image_duration_seconds";
+    AppendHeader(text, name, "histogram", "The total time of an image.");
+    AppendHistogram(text, name, "", m_imageHistogram);
+
+    name = m_prefix + "_start_timestamp_seconds";
+    AppendHeader(text, name, "gauge", "The start of the run in seconds since the epoch.");
+    AppendMetric(text, name, "", m_startTimestamp);
+
+    name = m_prefix + "_last_progress_timestamp_seconds";
+    AppendHeader(text, name, "gauge", "The time the last image finished in seconds since the epoch.");
+    AppendMetric(text, name, "", m_lastProgressTimestamp);
+
+    name = m_prefix + "_resident_memory_bytes";
+    AppendHeader(text, name, "gauge", "The resident set size of the process.");
+    AppendMetric(text, name, "", GetResidentBytes());
+
+    return text;
+}
+
+bool BatchMetrics::WriteSnapshot() const
+{
+    const string text = Format();
+
+    // Write the whole snapshot beside the metrics file and rename it over the file.
+    const string tempFile = m_metricsFile + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "w");
+    if (file == nullptr)
+    {
+        printf("[ERROR]: fopen(%s) for the metrics file %s.\n\n", strerror(errno), tempFile.c_str());
+        return false;
+    }
+
+    const bool written = (fwrite(text.data(), 1, text.size(), file) == text.size());
+    if ((fclose(file) != 0) || !written)
+    {
+        printf("[ERROR]: Failed to write the metrics file %s.\n\n", tempFile.c_str());
+        unlink(tempFile.c_str());
+        return false;
+    }
+
+    if (rename(tempFile.c_str(), m_metricsFile.c_str()) != 0)
+    {
+        printf("[ERROR]: rename(%s) for the metrics file %s.\n\n", strerror(errno), m_metricsFile.c_str());
+        unlink(tempFile.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+double BatchMetrics::GetResidentBytes()
+{
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == nullptr)
+    {
+        return 0.0;
+    }
+
+    unsigned long cntPages = 0;
+    unsigned long cntResidentPages = 0;
+    const int cntRead = fscanf(file, "%lu %lu", &cntPages, &cntResidentPages);
+    fclose(file);
+
+    return (cntRead == 2) ? static_cast<double>(cntResidentPages)*sysconf(_SC_PAGESIZE) : 0.0;
+}
@@ -0,0 +1,136 @@
+/*
+ * BatchMetrics.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef COMMON_BATCHMETRICS_H_
+#define COMMON_BATCHMETRICS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+// Collect the progress of a batch run and write it every few seconds into a file in the
+// Prometheus text exposition format, for the textfile collector of the node exporter.
+//
+// Each snapshot is written into a temporary file next to the metrics file and renamed over
+// it, so that the collector never reads half a snapshot. The counters, the per-stage latency
+// histograms and the queue depths are updated by the workers under a mutex, and the queue
+// depths which only the owner of a queue knows can be provided as functions instead, which
+// are called at each snapshot.
+class BatchMetrics
+{
+public:
+    enum class ImageResult {
+        Succeeded,
+        Failed,
+        Skipped
+    };
+
+    typedef std::function<double()> GaugeFunc;
+
+private:
+    struct Histogram
+    {
+        std::vector<uint64_t> counts;   // Per bucket, not cumulative
+        double sum;
+        uint64_t count;
+    };
+
+    std::string m_metricsFile;
+    std::string m_prefix;
+    std::chrono::milliseconds m_interval;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stopCond;
+    bool m_stopping;
+    std::thread m_writer;
+
+    std::chrono::steady_clock::time_point m_startTime;
+    double m_startTimestamp;
+    double m_lastProgressTimestamp;
+    uint64_t m_cntProcessed;
+    std::map<std::string, uint64_t> m_successCounts;   // By method
+    std::map<std::string, uint64_t> m_failureCounts;   // By reason
+    std::map<std::string, uint64_t> m_skipCounts;      // By reason
+    std::map<std::string, Histogram> m_stageHistograms;
+    Histogram m_imageHistogram;
+    std::map<std::string, double> m_queueDepths;
+    std::vector<std::pair<std::string, GaugeFunc> > m_queueDepthFuncs;
+
+    BatchMetrics(const BatchMetrics&) = delete;
+    BatchMetrics& operator=(const BatchMetrics&) = delete;
+
+    void Observe(
+        Histogram& histogram,
+        const double seconds);
+
+    Histogram& GetStageHistogram(const std::string& stage);
+
+    static std::string EscapeLabel(const std::string& value);
+
+    void AppendHistogram(
+        std::string& text,
+        const std::string& name,
+        const std::string& labels,
+        const Histogram& histogram) const;
+
+    std::string Format() const;
+
+public:
+    // The metric names start with prefix, e.g., "ocr_circled_digits".
+    BatchMetrics(
+        const std::string& metricsFile,
+        const std::string& prefix,
+        const double intervalSec = 5.0);
+
+    // Stop the writer and write the last snapshot.
+    ~BatchMetrics();
+
+    // Start writing a snapshot every interval.
+    void Start();
+
+    void Stop();
+
+    // Record one finished image. A success is counted by the method which recognized it,
+    // and a failure or a skip by its reason. The times are in milliseconds.
+    void RecordImage(
+        const ImageResult result,
+        const std::string& method,
+        const std::string& reason,
+        const std::vector<std::pair<std::string, double> >& stageTimesMs,
+        const double totalMs);
+
+    // Record the time of a stage which isn't part of an image, e.g., one run on the results
+    // of the batch afterwards.
+    void RecordStage(
+        const std::string& stage,
+        const double timeMs);
+
+    void SetQueueDepth(
+        const std::string& queue,
+        const double depth);
+
+    void SetQueueDepthFunc(
+        const std::string& queue,
+        const GaugeFunc& func);
+
+    void ClearQueueDepthFuncs();
+
+    // Write a snapshot now. Return false if it can't be written.
+    bool WriteSnapshot() const;
+
+    // The resident set size of this process in bytes, or 0 if unknown.
+    static double GetResidentBytes();
+};
+
+#endif /* COMMON_BATCHMETRICS_H_ */
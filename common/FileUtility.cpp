@@ -0,0 +1,59 @@
+/*
+ * FileUtility.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "FileUtility.h"
+
+using namespace std;
+
+int FileUtility::GetDirFiles(const string& dir, vector<string>& files)
+{
+    DIR *dp = nullptr;
+    struct dirent *dirp = nullptr;
+
+    dp = opendir(dir.c_str());
+    if (dp == nullptr)
+    {
+        printf("Error: opendir(%s) opening %s.\n", strerror(errno), dir.c_str());
+        return errno;
+    }
+
+    struct stat info;
+
+    files.clear();
+    string completedDir(dir);
+    if (completedDir.back() != '/')
+    {
+        completedDir.push_back('/');
+    }
+
+    while ((dirp = readdir(dp)) != nullptr)
+    {
+        string fileFullPath = completedDir + string(dirp->d_name);
+
+        if (stat(fileFullPath.c_str(), &info) != 0)
+        {
+            printf("Error: stat(%s) for %s.\n", strerror(errno), dirp->d_name);
+            continue;
+        }
+
+        if (S_ISREG(info.st_mode))
+        {
+            files.push_back(fileFullPath);
+        }
+    }
+
+    closedir(dp);
+    return 0;
+}
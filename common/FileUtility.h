@@ -0,0 +1,23 @@
+/*
+ * FileUtility.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef COMMON_FILEUTILITY_H_
+#define COMMON_FILEUTILITY_H_
+
+#include <string>
+#include <vector>
+
+// The file helpers shared by the batch tools.
+class FileUtility
+{
+public:
+    // Get the paths of the regular files in the given directory. Return 0, or the errno
+    // of opendir.
+    static int GetDirFiles(const std::string& dir, std::vector<std::string>& files);
+};
+
+#endif /* COMMON_FILEUTILITY_H_ */
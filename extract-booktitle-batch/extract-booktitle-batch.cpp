@@ -7,15 +7,21 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
-#include <sys/stat.h>
-#include <dirent.h>
-#include <errno.h>
+#include <unistd.h>
 
 #include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <functional>
 
 #include <boost/program_options.hpp>
 
@@ -27,52 +33,16 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/xfeatures2d.hpp>
 
+#include <tesseract/baseapi.h>
+
+#include "BatchMetrics.h"
+#include "FileUtility.h"
+
 using namespace std;
 using namespace cv;
 using namespace cv::xfeatures2d;
 namespace po = boost::program_options;
 
-int GetDirFiles(const string& dir, vector<string>& files)
-{
-    DIR *dp = nullptr;
-    struct dirent *dirp = nullptr;
-
-    dp = opendir(dir.c_str());
-    if (dp == nullptr)
-    {
-        printf("Error: opendir(%s) opening %s.\n", strerror(errno), dir.c_str());
-        return errno;
-    }
-
-    struct stat info;
-
-    files.clear();
-    string completedDir(dir);
-    if (completedDir.back() != '/')
-    {
-        completedDir.push_back('/');
-    }
-
-    while ((dirp = readdir(dp)) != nullptr)
-    {
-        string fileFullPath = completedDir + string(dirp->d_name);
-
-        if (stat(fileFullPath.c_str(), &info) != 0)
-        {
-            printf("Error: stat(%s) for %s.\n", strerror(errno), dirp->d_name);
-            continue;
-        }
-
-        if (S_ISREG(info.st_mode))
-        {
-            files.push_back(fileFullPath);
-        }
-    }
-
-    closedir(dp);
-    return 0;
-}
-
 Mat PreprocessImg(const Mat& srcImg)
 {
     // Sharpen the image using Unsharp Masking with a Gaussian blurred version of the image. Note that
@@ -112,91 +82,70 @@ Point GetTemplateMatchingPoint(
     return maxLoc;
 }
 
-void ExtractTitleViaTemplateMatching(
+Mat ExtractTitleViaTemplateMatching(
     const Mat& titleImgSobel,
-    const vector<Mat>& bookCoverImgSobels,
-    const vector<Mat>& bookCoverImgs,
-    vector<Mat>& croppedTitleImgs)
+    const Mat& bookCoverImgSobel,
+    const Mat& bookCoverImg)
 {
-    for (size_t imgIndex = 0; imgIndex < bookCoverImgSobels.size(); ++imgIndex)
-    {
-        // Do the template matching and find the best match point.
-        Mat result;
-        Point matchPoint = GetTemplateMatchingPoint(bookCoverImgSobels[imgIndex], titleImgSobel, result);
-
-        // Crop the patch of the source image which best matches the template image.
-        Mat croppedImg = bookCoverImgs[imgIndex](Rect(matchPoint.x, matchPoint.y, titleImgSobel.cols, titleImgSobel.rows));
+    // Do the template matching and find the best match point.
+    Mat result;
+    Point matchPoint = GetTemplateMatchingPoint(bookCoverImgSobel, titleImgSobel, result);
 
-        croppedTitleImgs.push_back(croppedImg);
-    }
+    // Crop the patch of the source image which best matches the template image.
+    return bookCoverImg(Rect(matchPoint.x, matchPoint.y, titleImgSobel.cols, titleImgSobel.rows));
 }
 
-void ExtractTitleViaHomography(
-    const Mat& titleImg,
-    const vector<Mat>& bookCoverImgs,
-    vector<Mat>& croppedTitleImgs)
+Mat ExtractTitleViaHomography(
+    const vector<KeyPoint>& titleImgKeyPoints,
+    const Mat& titleImgDescriptors,
+    const Size& titleImgSize,
+    const vector<KeyPoint>& bookCoverImgKeyPoints,
+    const Mat& bookCoverImgDescriptors,
+    const Mat& bookCoverImg)
 {
-    BFMatcher bfMatcher;
-    vector<DMatch> matches;
-
-    // Compute the keypoints and the descriptors of titleImg.
-    const int minHessian = 400;
-    Ptr<SurfFeatureDetector> detector = SURF::create(minHessian);
-
-    vector<KeyPoint> titleImgKeyPoints;
-    Mat titleImgDescriptors;
-    detector->detectAndCompute(titleImg, noArray(), titleImgKeyPoints, titleImgDescriptors);
-
     // List the four corners of the title image clockwisely.
     vector<Point2f> titleImgCorners(4);
-    titleImgCorners[0] = Point2f(0, 0);                                 // top-left corner
-    titleImgCorners[1] = Point2f(titleImg.cols - 1, 0);                 // top-right corner
-    titleImgCorners[2] = Point2f(titleImg.cols - 1, titleImg.rows - 1); // bottom-right corner
-    titleImgCorners[3] = Point2f(0, titleImg.rows - 1);                 // bottom-left corner
+    titleImgCorners[0] = Point2f(0, 0);                                             // top-left corner
+    titleImgCorners[1] = Point2f(titleImgSize.width - 1, 0);                        // top-right corner
+    titleImgCorners[2] = Point2f(titleImgSize.width - 1, titleImgSize.height - 1);  // bottom-right corner
+    titleImgCorners[3] = Point2f(0, titleImgSize.height - 1);                       // bottom-left corner
 
-    for (const Mat& bookCoverImg : bookCoverImgs)
-    {
-        // Compute the keypoints and the descriptors of bookCoverImg.
-        vector<KeyPoint> bookCoverImgKeyPoints;
-        Mat bookCoverImgDescriptors;
-        detector->detectAndCompute(bookCoverImg, noArray(), bookCoverImgKeyPoints, bookCoverImgDescriptors);
-
-        // Use the brute-force matcher to find the matched descriptors for all the descriptors
-        // of titleImg.
-        matches.clear();
-        bfMatcher.match(titleImgDescriptors, bookCoverImgDescriptors, matches);
+    // Use the brute-force matcher to find the matched descriptors for all the descriptors
+    // of titleImg.
+    BFMatcher bfMatcher;
+    vector<DMatch> matches;
+    bfMatcher.match(titleImgDescriptors, bookCoverImgDescriptors, matches);
 
-        // Sort the matches based on the distance and filter out the first few "good" matches to
-        // find the homography.
-        sort(matches.begin(), matches.end());
+    // Sort the matches based on the distance and filter out the first few "good" matches to
+    // find the homography.
+    sort(matches.begin(), matches.end());
 
-        size_t cntGoodMatches = min(static_cast<size_t>(50), static_cast<size_t>(matches.size()*0.3));
-        if (cntGoodMatches < 5)
-        {
-            printf("[ERROR]: Unable to find enough (%ld < 5) good matches for computing the homography.\n\n",
-                cntGoodMatches);
-            continue;
-        }
+    size_t cntGoodMatches = min(static_cast<size_t>(50), static_cast<size_t>(matches.size()*0.3));
+    if (cntGoodMatches < 5)
+    {
+        printf("[ERROR]: Unable to find enough (%ld < 5) good matches for computing the homography.\n\n",
+            cntGoodMatches);
+        return Mat();
+    }
 
-        vector<DMatch> goodMatches(matches.begin(), matches.begin() + cntGoodMatches);
+    vector<DMatch> goodMatches(matches.begin(), matches.begin() + cntGoodMatches);
 
-        // Find the homography and do the perspective transformation.
-        vector<Point2f> titleImgPoints;
-        vector<Point2f> bookCoverPoints;
-        for (size_t goodMatchIndex = 0; goodMatchIndex < cntGoodMatches; ++goodMatchIndex)
-        {
-            titleImgPoints.push_back(titleImgKeyPoints[goodMatches[goodMatchIndex].queryIdx].pt);
-            bookCoverPoints.push_back(bookCoverImgKeyPoints[goodMatches[goodMatchIndex].trainIdx].pt);
-        }
+    // Find the homography and do the perspective transformation.
+    vector<Point2f> titleImgPoints;
+    vector<Point2f> bookCoverPoints;
+    for (size_t goodMatchIndex = 0; goodMatchIndex < cntGoodMatches; ++goodMatchIndex)
+    {
+        titleImgPoints.push_back(titleImgKeyPoints[goodMatches[goodMatchIndex].queryIdx].pt);
+        bookCoverPoints.push_back(bookCoverImgKeyPoints[goodMatches[goodMatchIndex].trainIdx].pt);
+    }
 
-        Mat homo = findHomography(titleImgPoints, bookCoverPoints, RANSAC);
+    Mat homo = findHomography(titleImgPoints, bookCoverPoints, RANSAC);
 
-        vector<Point2f> bookCoverCorners(4);
-        perspectiveTransform(titleImgCorners, bookCoverCorners, homo);
+    vector<Point2f> bookCoverCorners(4);
+    perspectiveTransform(titleImgCorners, bookCoverCorners, homo);
 
-        Rect rect = boundingRect(bookCoverCorners);
-        croppedTitleImgs.push_back(bookCoverImg(rect));
-    }
+    Rect rect = boundingRect(bookCoverCorners);
+    return bookCoverImg(rect);
 }
 
 void SegmentFullFilename(
@@ -225,6 +174,357 @@ void SegmentFullFilename(
     }
 }
 
+// Compute either the mixed Sobel derivative of the image in CV_32F of each channel, or
+// the gradient magnitude (|dx| + |dy|)/8 of the grayscale image saturated into CV_8U,
+// which matchTemplate correlates on one channel instead of three.
+Mat ComputeSobel(const Mat& img, const bool magnitude8U)
+{
+    Mat sobelImg;
+    if (!magnitude8U)
+    {
+        Sobel(img, sobelImg, CV_32F, 1, 1);
+        return sobelImg;
+    }
+
+    Mat grayImg;
+    cvtColor(img, grayImg, COLOR_BGR2GRAY);
+
+    Mat dxImg;
+    Mat dyImg;
+    Sobel(grayImg, dxImg, CV_16S, 1, 0);
+    Sobel(grayImg, dyImg, CV_16S, 0, 1);
+
+    Mat absDxImg;
+    Mat absDyImg;
+    convertScaleAbs(dxImg, absDxImg, 0.25);
+    convertScaleAbs(dyImg, absDyImg, 0.25);
+    addWeighted(absDxImg, 0.5, absDyImg, 0.5, 0.0, sobelImg);
+    return sobelImg;
+}
+
+// The output of a stage: an image, or the keypoints with their descriptors in img.
+struct StageOutput
+{
+    Mat img;
+    vector<KeyPoint> keyPoints;
+};
+
+// The intermediates of one image as a small graph of named stages, each computed from the
+// stages it depends on. A stage is computed only when it is asked for, directly or by a
+// later stage, and at most once per image, so the extraction method decides which of the
+// intermediates are computed at all. The graph is reused for the next image after Reset().
+class StageGraph
+{
+public:
+    typedef function<void(StageGraph&, StageOutput&)> ComputeFunc;
+    typedef function<void(const string& name, const double timeMs)> ObserveFunc;
+
+private:
+    struct Stage
+    {
+        vector<string> deps;
+        ComputeFunc compute;
+        double opsPerPixel;     // A rough estimate of the operations per pixel of the image
+        double bytesPerPixel;   // The memory of the output per pixel of the image
+        size_t cntComputed;
+        double totalMs;
+    };
+
+    map<string, Stage> m_stages;
+    vector<string> m_stageNames;        // In the order the stages are added
+    map<string, StageOutput> m_outputs;
+    ObserveFunc m_observe;
+
+    void Plan(
+        const string& name,
+        vector<string>& plan) const
+    {
+        if (find(plan.begin(), plan.end(), name) != plan.end())
+        {
+            return;
+        }
+
+        const auto itStage = m_stages.find(name);
+        if (itStage == m_stages.end())
+        {
+            return;
+        }
+
+        for (const auto& dep: itStage->second.deps)
+        {
+            Plan(dep, plan);
+        }
+
+        plan.push_back(name);
+    }
+
+public:
+    void AddStage(
+        const string& name,
+        const vector<string>& deps,
+        const ComputeFunc& compute,
+        const double opsPerPixel,
+        const double bytesPerPixel)
+    {
+        Stage stage;
+        stage.deps = deps;
+        stage.compute = compute;
+        stage.opsPerPixel = opsPerPixel;
+        stage.bytesPerPixel = bytesPerPixel;
+        stage.cntComputed = 0;
+        stage.totalMs = 0.0;
+
+        m_stages[name] = stage;
+        m_stageNames.push_back(name);
+    }
+
+    // Observe the time of each stage computed, e.g., for the metrics.
+    void SetObserver(const ObserveFunc& observe)
+    {
+        m_observe = observe;
+    }
+
+    // Get the output of the stage, computing it and the stages it depends on if needed.
+    const StageOutput& Get(const string& name)
+    {
+        const auto itOutput = m_outputs.find(name);
+        if (itOutput != m_outputs.end())
+        {
+            return itOutput->second;
+        }
+
+        auto itStage = m_stages.find(name);
+        if (itStage == m_stages.end())
+        {
+            printf("[ERROR]: Unknown stage %s.\n\n", name.c_str());
+            return m_outputs[name];
+        }
+
+        // Compute the dependencies first, so that the time of each stage is its own.
+        Stage& stage = itStage->second;
+        for (const auto& dep: stage.deps)
+        {
+            Get(dep);
+        }
+
+        const int64 startTick = getTickCount();
+        StageOutput& output = m_outputs[name];
+        stage.compute(*this, output);
+        const double timeMs = (getTickCount() - startTick)*1000.0/getTickFrequency();
+        stage.totalMs += timeMs;
+        ++stage.cntComputed;
+
+        if (m_observe)
+        {
+            m_observe(name, timeMs);
+        }
+
+        return output;
+    }
+
+    // Drop the outputs of the current image.
+    void Reset()
+    {
+        m_outputs.clear();
+    }
+
+    // Print the stages computed for the target on each of cntImgs images of imgSize, with
+    // the estimated memory and operations, and the stages which are skipped.
+    void PrintPlan(
+        const string& target,
+        const Size& imgSize,
+        const size_t cntImgs) const
+    {
+        vector<string> plan;
+        Plan(target, plan);
+
+        const double cntPixels = static_cast<double>(imgSize.area());
+        double totalMB = 0.0;
+        double totalMops = 0.0;
+        for (const auto& name: plan)
+        {
+            const Stage& stage = m_stages.at(name);
+            const double mb = stage.bytesPerPixel*cntPixels/(1024.0*1024.0);
+            const double mops = stage.opsPerPixel*cntPixels/1e6;
+            printf("[INFO]:   %-10s after {", name.c_str());
+            for (size_t depIndex = 0; depIndex < stage.deps.size(); ++depIndex)
+            {
+                printf("%s%s", (depIndex > 0) ? ", " : "", stage.deps[depIndex].c_str());
+            }
+            printf("}: ~%.1f MB, ~%.0f Mops\n", mb, mops);
+
+            totalMB += mb;
+            totalMops += mops;
+        }
+
+        for (const auto& name: m_stageNames)
+        {
+            if (find(plan.begin(), plan.end(), name) == plan.end())
+            {
+                printf("[INFO]:   %-10s skipped\n", name.c_str());
+            }
+        }
+
+        printf("[INFO]:   Total of %ld image(s) of %d x %d: ~%.1f MB per image, ~%.0f Mops\n",
+            cntImgs, imgSize.width, imgSize.height, totalMB, totalMops*cntImgs);
+    }
+
+    void PrintStats() const
+    {
+        for (const auto& name: m_stageNames)
+        {
+            const Stage& stage = m_stages.at(name);
+            printf("[INFO]:   %-10s computed %ld times in %f ms\n", name.c_str(), stage.cntComputed, stage.totalMs);
+        }
+    }
+};
+
+// Add the stages shared by the title image and the book covers, which decode the image
+// file currently named by imgFile.
+void AddImageStages(
+    StageGraph& graph,
+    const string& imgFile,
+    const bool magnitude8USobel,
+    const Ptr<SURF>& detector)
+{
+    graph.AddStage("decode", {}, [&imgFile](StageGraph&, StageOutput& output)
+    {
+        output.img = imread(imgFile, IMREAD_COLOR);
+    }, 10.0, 3.0);
+
+    graph.AddStage("sharpen", {"decode"}, [](StageGraph& g, StageOutput& output)
+    {
+        output.img = PreprocessImg(g.Get("decode").img);
+    }, 40.0, 3.0);
+
+    // The float32 Sobel has 3 channels of 4 bytes.
+    graph.AddStage("sobel", {"sharpen"}, [magnitude8USobel](StageGraph& g, StageOutput& output)
+    {
+        output.img = ComputeSobel(g.Get("sharpen").img, magnitude8USobel);
+    }, 20.0, magnitude8USobel ? 1.0 : 12.0);
+
+    graph.AddStage("keypoints", {"sharpen"}, [detector](StageGraph& g, StageOutput& output)
+    {
+        detector->detectAndCompute(g.Get("sharpen").img, noArray(), output.keyPoints, output.img);
+    }, 300.0, 0.1);
+}
+
+// Initialize one Tesseract engine per worker. Loading the language models (e.g., chi_sim)
+// takes seconds, so the engines are created once for the whole batch and in parallel.
+bool CreateTesseractEngines(
+    const size_t cntEngines,
+    const string& dataPath,
+    const string& lang,
+    vector<unique_ptr<tesseract::TessBaseAPI> >& engines)
+{
+    engines.clear();
+    for (size_t engineIndex = 0; engineIndex < cntEngines; ++engineIndex)
+    {
+        engines.push_back(unique_ptr<tesseract::TessBaseAPI>(new tesseract::TessBaseAPI()));
+    }
+
+    vector<int> errors(cntEngines, 0);
+    vector<thread> threads;
+    for (size_t engineIndex = 0; engineIndex < cntEngines; ++engineIndex)
+    {
+        threads.push_back(thread([&, engineIndex]()
+        {
+            errors[engineIndex] = engines[engineIndex]->Init(
+                dataPath.empty() ? nullptr : dataPath.c_str(),
+                lang.c_str(),
+                tesseract::OEM_DEFAULT);
+        }));
+    }
+
+    for (auto& t: threads)
+    {
+        t.join();
+    }
+
+    for (size_t engineIndex = 0; engineIndex < cntEngines; ++engineIndex)
+    {
+        if (errors[engineIndex] != 0)
+        {
+            printf("[ERROR]: Cannot initialize Tesseract with the language %s.\n\n", lang.c_str());
+            return false;
+        }
+
+        engines[engineIndex]->SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
+    }
+
+    return true;
+}
+
+// Binarize the cropped title with Otsu's threshold, which is the input Tesseract
+// would otherwise compute from the image file by itself.
+Mat BinarizeTitleImg(const Mat& croppedImg)
+{
+    Mat grayImg;
+    cvtColor(croppedImg, grayImg, COLOR_BGR2GRAY);
+
+    Mat blackWhiteImg;
+    threshold(grayImg, blackWhiteImg, 0, 255, THRESH_BINARY | THRESH_OTSU);
+    return blackWhiteImg;
+}
+
+// Recognize the text of the cropped titles with the engines, each of which is used by
+// one worker thread. The binarized crops are passed to Tesseract directly from memory.
+// The time of each title and the titles left are recorded in the metrics if any.
+void RecognizeTitles(
+    const vector<unique_ptr<tesseract::TessBaseAPI> >& engines,
+    const vector<Mat>& croppedTitleImgs,
+    BatchMetrics* metrics,
+    vector<string>& titleTexts)
+{
+    titleTexts.assign(croppedTitleImgs.size(), string());
+
+    atomic<size_t> nextImgIndex(0);
+    vector<thread> workers;
+    for (const auto& engine: engines)
+    {
+        tesseract::TessBaseAPI* api = engine.get();
+        workers.push_back(thread([&, api]()
+        {
+            for (size_t imgIndex = nextImgIndex++; imgIndex < croppedTitleImgs.size(); imgIndex = nextImgIndex++)
+            {
+                if (metrics != nullptr)
+                {
+                    metrics->SetQueueDepth("ocr",
+                        static_cast<double>(croppedTitleImgs.size() - min(nextImgIndex.load(), croppedTitleImgs.size())));
+                }
+
+                if (croppedTitleImgs[imgIndex].empty())
+                {
+                    continue;
+                }
+
+                const int64 startTick = getTickCount();
+                Mat blackWhiteImg = BinarizeTitleImg(croppedTitleImgs[imgIndex]);
+                api->SetImage(blackWhiteImg.data, blackWhiteImg.cols, blackWhiteImg.rows, 1, static_cast<int>(blackWhiteImg.step));
+
+                char* text = api->GetUTF8Text();
+                if (text != nullptr)
+                {
+                    titleTexts[imgIndex] = text;
+                    delete [] text;
+                }
+
+                api->Clear();
+
+                if (metrics != nullptr)
+                {
+                    metrics->RecordStage("ocr", (getTickCount() - startTick)*1000.0/getTickFrequency());
+                }
+            }
+        }));
+    }
+
+    for (auto& worker: workers)
+    {
+        worker.join();
+    }
+}
+
 int main(int argc, char** argv)
 {
     po::options_description opt("Options");
@@ -233,7 +533,14 @@ int main(int argc, char** argv)
         ("imgDir,d", po::value<string>()->required(), "The directory containing all the book cover images")
         ("help,h", "Display the help information")
         ("method,m", po::value<string>(), "The method (homo | templ) of extracting the book title from its cover. If not specified, default homo.")
-        ("outputDir,o", po::value<string>()->required(), "The output directory containing the title images extracted from the book cover images.");
+        ("sobel", po::value<string>(), "The representation (float32 | mag8u) of the Sobel derivatives matched against the title (templ only): the mixed derivative of the three channels in 32-bit float, or the gradient magnitude of the grayscale image saturated into 8 bits. If not specified, default float32.")
+        ("outputDir,o", po::value<string>()->required(), "The output directory containing the title images extracted from the book cover images.")
+        ("ocrLang", po::value<string>(), "Recognize the text of the cropped titles with Tesseract in the given languages (e.g., eng+chi_sim), and write it into [image]_title.txt.")
+        ("tessdata", po::value<string>(), "The directory of the Tesseract language models. If not specified, default TESSDATA_PREFIX.")
+        ("jobs,j", po::value<size_t>(), "The number of Tesseract engines recognizing the titles in parallel. If not specified, default the number of cores.")
+        ("metrics", po::value<string>(), "Write the progress, the throughput, the per-stage latency histograms, the queue depths and the memory of the run into this file in the Prometheus text format, e.g., for the textfile collector of the node exporter. Name it *.prom.")
+        ("metricsInterval", po::value<double>(), "The seconds between two snapshots of the metrics. If not specified, default 5.")
+        ("dryRun", "Print the stages which the method computes for the title image and each book cover with their estimated memory and operations, and exit.");
 
     po::variables_map vm;
     try
@@ -276,76 +583,183 @@ int main(int argc, char** argv)
         printf("[INFO]: No extract method is specified and use the default method homography.\n");
     }
 
-    Mat titleImg = imread(titleImgFile, IMREAD_COLOR);
-    if (titleImg.empty())
+    if ((extractMethod != "homo") && (extractMethod != "templ"))
     {
-        printf("[ERROR]: Cannot load image %s.\n\n", titleImgFile.c_str());
+        printf("[ERROR]: Unsupported extract method = %s.\n\n", extractMethod.c_str());
         return -1;
     }
 
-    titleImg = PreprocessImg(titleImg);
+    const string sobelPrecision = (vm.count("sobel") > 0) ? vm["sobel"].as<string>() : "float32";
+    if ((sobelPrecision != "float32") && (sobelPrecision != "mag8u"))
+    {
+        printf("[ERROR]: Unsupported Sobel precision %s.\n\n", sobelPrecision.c_str());
+        return -1;
+    }
 
     // Get all the image file names in the given directory.
     vector<string> bookCoverImgFiles;
-    int error = GetDirFiles(bookCoverImgDir, bookCoverImgFiles);
+    int error = FileUtility::GetDirFiles(bookCoverImgDir, bookCoverImgFiles);
     if (error != 0)
     {
         printf("[ERROR]: Cannot get the image file names in %s with error = %d", bookCoverImgDir.c_str(), error);
         return error;
     }
 
-    vector<Mat> bookCoverImgs;
-    for (const auto& imgFile: bookCoverImgFiles)
+    // The title image and each book cover are processed by the same stages, of which the
+    // method only asks for the Sobel derivative (templ) or the keypoints (homo).
+    const bool magnitude8USobel = (sobelPrecision == "mag8u");
+    const int minHessian = 400;
+    Ptr<SurfFeatureDetector> detector = SURF::create(minHessian);
+
+    StageGraph titleGraph;
+    AddImageStages(titleGraph, titleImgFile, magnitude8USobel, detector);
+    const string titleTarget = (extractMethod == "homo") ? "keypoints" : "sobel";
+
+    string bookCoverImgFile;
+    StageGraph coverGraph;
+    AddImageStages(coverGraph, bookCoverImgFile, magnitude8USobel, detector);
+    if (extractMethod == "homo")
     {
-        Mat img = imread(imgFile, IMREAD_COLOR);
-        if (img.empty())
+        coverGraph.AddStage("title", {"keypoints", "sharpen"}, [&titleGraph](StageGraph& g, StageOutput& output)
+        {
+            const StageOutput& titleKeyPoints = titleGraph.Get("keypoints");
+            const StageOutput& coverKeyPoints = g.Get("keypoints");
+            output.img = ExtractTitleViaHomography(
+                titleKeyPoints.keyPoints,
+                titleKeyPoints.img,
+                titleGraph.Get("decode").img.size(),
+                coverKeyPoints.keyPoints,
+                coverKeyPoints.img,
+                g.Get("sharpen").img);
+        }, 50.0, 0.0);
+    }
+    else
+    {
+        // Do the template matching, find the best match point, and then crop the patch of the
+        // book cover image which best matches the template image.
+        coverGraph.AddStage("title", {"sobel", "sharpen"}, [&titleGraph](StageGraph& g, StageOutput& output)
+        {
+            output.img = ExtractTitleViaTemplateMatching(titleGraph.Get("sobel").img, g.Get("sobel").img, g.Get("sharpen").img);
+        }, 100.0, 4.0);
+    }
+
+    // Print the stages which the method needs with their estimated cost, measured on the
+    // size of the title image and of the first book cover, and exit.
+    if (vm.count("dryRun") > 0)
+    {
+        Mat titleImg = imread(titleImgFile, IMREAD_COLOR);
+        Mat firstImg = bookCoverImgFiles.empty() ? Mat() : imread(bookCoverImgFiles[0], IMREAD_COLOR);
+
+        printf("[INFO]: The plan of the title image for method %s:\n", extractMethod.c_str());
+        titleGraph.PrintPlan(titleTarget, titleImg.size(), 1);
+        printf("[INFO]: The plan of each book cover for method %s:\n", extractMethod.c_str());
+        coverGraph.PrintPlan("title", firstImg.size(), bookCoverImgFiles.size());
+        return 0;
+    }
+
+    if (titleGraph.Get("decode").img.empty())
+    {
+        printf("[ERROR]: Cannot load image %s.\n\n", titleImgFile.c_str());
+        return -1;
+    }
+
+    titleGraph.Get(titleTarget);
+
+    // Initialize the Tesseract engines before the images are processed, so that a missing
+    // language model fails the batch early.
+    vector<unique_ptr<tesseract::TessBaseAPI> > tessEngines;
+    if (vm.count("ocrLang") > 0)
+    {
+        size_t cntEngines = (vm.count("jobs") > 0) ? vm["jobs"].as<size_t>() : thread::hardware_concurrency();
+        cntEngines = max(cntEngines, static_cast<size_t>(1));
+
+        const int64 startTick = getTickCount();
+        if (!CreateTesseractEngines(cntEngines,
+            (vm.count("tessdata") > 0) ? vm["tessdata"].as<string>() : "",
+            vm["ocrLang"].as<string>(),
+            tessEngines))
         {
-            printf("[ERROR]: Cannot load image %s.\n\n", imgFile.c_str());
             return -1;
         }
 
-        bookCoverImgs.push_back(PreprocessImg(img));
+        printf("[INFO]: Initialize %ld Tesseract engines with the language %s in %f ms.\n",
+            cntEngines, vm["ocrLang"].as<string>().c_str(), (getTickCount() - startTick)*1000.0/getTickFrequency());
+    }
+
+    // The metrics are written until the end of the run, when the last snapshot is written.
+    // The stages of each cover are collected from the graph and recorded with the cover.
+    unique_ptr<BatchMetrics> metrics;
+    vector<pair<string, double> > coverStageTimesMs;
+    if (vm.count("metrics") > 0)
+    {
+        const double intervalSec = (vm.count("metricsInterval") > 0) ? vm["metricsInterval"].as<double>() : 5.0;
+        metrics.reset(new BatchMetrics(vm["metrics"].as<string>(), "extract_booktitle", intervalSec));
+        metrics->Start();
+
+        coverGraph.SetObserver([&coverStageTimesMs](const string& name, const double timeMs)
+        {
+            coverStageTimesMs.push_back(make_pair(name, timeMs));
+        });
     }
 
-    printf("[INFO]: Load %ld images of book covers.\n", bookCoverImgs.size());
+    printf("[INFO]: Crop the book cover images to get the titles via %s.\n",
+        (extractMethod == "homo") ? "homography" : "template matching");
+
+    // Only the crop of each cover is kept, since its intermediates are dropped for the next one.
+    vector<Mat> croppedTitleImgs;
+    for (const auto& imgFile: bookCoverImgFiles)
+    {
+        if (metrics)
+        {
+            metrics->SetQueueDepth("covers", static_cast<double>(bookCoverImgFiles.size() - croppedTitleImgs.size()));
+        }
+
+        const int64 startTick = getTickCount();
+        bookCoverImgFile = imgFile;
+        coverStageTimesMs.clear();
+        coverGraph.Reset();
+        if (coverGraph.Get("decode").img.empty())
+        {
+            printf("[ERROR]: Cannot load image %s.\n\n", imgFile.c_str());
+            if (metrics)
+            {
+                metrics->RecordImage(BatchMetrics::ImageResult::Failed, "", "loadfailed", coverStageTimesMs,
+                    (getTickCount() - startTick)*1000.0/getTickFrequency());
+            }
+            return -1;
+        }
+
+        croppedTitleImgs.push_back(coverGraph.Get("title").img.clone());
 
-    // Get the Sobel derivative of images.
-    Mat titleImgSobel;
-    Sobel(titleImg, titleImgSobel, CV_32F, 1, 1);
+        if (metrics)
+        {
+            metrics->RecordImage(
+                croppedTitleImgs.back().empty() ? BatchMetrics::ImageResult::Failed : BatchMetrics::ImageResult::Succeeded,
+                extractMethod,
+                "notfound",
+                coverStageTimesMs,
+                (getTickCount() - startTick)*1000.0/getTickFrequency());
+        }
+    }
 
-    vector<Mat> bookCoverImgSobels;
-    for (const auto& img: bookCoverImgs)
+    if (metrics)
     {
-        Mat bookCoverImgSobel;
-        Sobel(img, bookCoverImgSobel, CV_32F, 1, 1);
-        bookCoverImgSobels.push_back(bookCoverImgSobel);
+        metrics->SetQueueDepth("covers", 0.0);
     }
 
-    vector<Mat> croppedTitleImgs;
-    if (extractMethod == "homo")
+    printf("[INFO]: Process %ld images of book covers with the stages:\n", bookCoverImgFiles.size());
+    coverGraph.PrintStats();
+
+    vector<string> titleTexts;
+    if (!tessEngines.empty())
     {
-        printf("[INFO]: Crop the book cover images to get the titles via homography.\n");
-        ExtractTitleViaHomography(
-            titleImg,
-            bookCoverImgs,
-            croppedTitleImgs);
-    }
-    else if (extractMethod == "templ")
-    {
-        printf("[INFO]: Crop the book cover images to get the titles via template matching.\n");
-        // Do the template matching, find the best match point, and then crop the patch of the book cover
-        // images which best matches the template image.
-        ExtractTitleViaTemplateMatching(
-            titleImgSobel,
-            bookCoverImgSobels,
-            bookCoverImgs,
-            croppedTitleImgs);
-    } else {
-        printf("[ERROR]: Unsupported extract method = %s.\n\n", extractMethod.c_str());
-        return -1;
+        const int64 startTick = getTickCount();
+        RecognizeTitles(tessEngines, croppedTitleImgs, metrics.get(), titleTexts);
+        printf("[INFO]: Recognize the text of %ld titles in %f ms.\n",
+            croppedTitleImgs.size(), (getTickCount() - startTick)*1000.0/getTickFrequency());
     }
 
-    for (size_t imgIndex = 0; imgIndex < bookCoverImgSobels.size(); ++imgIndex)
+    for (size_t imgIndex = 0; imgIndex < bookCoverImgFiles.size(); ++imgIndex)
     {
         if (croppedTitleImgs[imgIndex].empty())
         {
@@ -370,6 +784,21 @@ int main(int argc, char** argv)
             printf("[ERROR]: Failed to write the cropped title image into %s.\n\n", croppedImgFile.c_str());
             return -1;
         }
+
+        // Write the recognized text next to the cropped title image.
+        if (!titleTexts.empty())
+        {
+            string textFile = outputImgDir + '/' + filename + "_title.txt";
+            ofstream textStream(textFile);
+            textStream << titleTexts[imgIndex];
+            if (!textStream)
+            {
+                printf("[ERROR]: Failed to write the title text into %s.\n\n", textFile.c_str());
+                return -1;
+            }
+
+            printf("[INFO]: Successfully write the title text into %s.\n", textFile.c_str());
+        }
     }
 
     return 0;
@@ -12,10 +12,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "TemplateBank.h"
+#include "Workspace.h"
+
+// The match result of a template pruned by the signature pre-filter without being
+// matched. The real scores of TM_CCOEFF_NORMED are in [-1, 1].
+const float prunedMatchRes = -2.0f;
+
 struct OcrResult
 {
     std::string evaluatedDigits;
@@ -64,12 +72,102 @@ class CircledDigitsOCRer
 private:
     std::vector<std::pair<std::string, cv::Mat> > m_templDigitImgPairs;
 
+    // All the templates matched in one pass if they are of the same size. It is only
+    // used if enabled, since matchTemplate is faster on the sizes benchmarked so far.
+    TemplateBank m_templBank;
+    bool m_useTemplBank;
+
+    // The compact signature of the ink of a black-white image, which is compared in
+    // the pre-filter before the templates are matched exactly. The cropped images have
+    // margins around the digits which the templates don't have, so the signature of both
+    // is computed on the ink bounding box resampled to signatureSide x signatureSide.
+    static const int cntProfileBins = 16;
+    static const int signatureSide = 32;
+    static const int gridSide = 8;
+    struct DigitSignature
+    {
+        double rowProfile[cntProfileBins];    // The ink of the rows of the ink bounding box.
+        double colProfile[cntProfileBins];    // The ink of the columns of the ink bounding box.
+        double inkGrid[gridSide*gridSide];    // The ink of the cells of the ink bounding box.
+    };
+
+    std::vector<DigitSignature> m_templSignatures;
+
+    // Only the topK templates nearest to the image by signature are matched. 0 means all.
+    size_t m_topK;
+
+    // If m_verifyTopK is true, all the templates are matched as well, and the images whose
+    // best template is among the topK ones are counted.
+    bool m_verifyTopK;
+    mutable std::atomic<size_t> m_cntVerified;
+    mutable std::atomic<size_t> m_cntRecalled;
+
+    static std::vector<cv::Mat> GetTemplImgs(const std::vector<std::pair<std::string, cv::Mat> >& templDigitImgPairs);
+
+    static void ComputeSignature(
+        const cv::Mat& img,
+        DigitSignature& signature,
+        Workspace& workspace);
+
+    // Get the profile of the ink of the rows or the columns in lineInk (Nx1 or 1xN).
+    static void ComputeProfile(
+        const cv::Mat& lineInk,
+        const double inkCount,
+        double* profile);
+
+    static double GetSignatureDistance(
+        const DigitSignature& signature1,
+        const DigitSignature& signature2);
+
+    void SelectCandidates(
+        const cv::Mat& circledDigitsImg,
+        std::vector<int>& candidates,
+        Workspace& workspace) const;
+
+    // Get the maximum score of each given template over the image, maxVals[i] being that
+    // of templIndices[i].
+    void MatchTemplates(
+        const cv::Mat& circledDigitsImg,
+        const std::vector<int>& templIndices,
+        std::vector<double>& maxVals,
+        Workspace& workspace) const;
+
+    // Match all the templates and count whether the best one is among the candidates.
+    void VerifyCandidates(
+        const cv::Mat& circledDigitsImg,
+        const std::vector<int>& candidates,
+        Workspace& workspace) const;
+
 public:
     CircledDigitsOCRer(const std::vector<std::pair<std::string, cv::Mat> >& templDigitImgPairs);
 
+    // Match the templates with the template bank instead of matchTemplate. Return false
+    // if they are not of the same size. See tests/TemplateBankBenchmark.cpp.
+    bool SetTemplateBank(const bool enable);
+
+    // Match only the topK templates whose projection profiles and ink grid are nearest
+    // to those of the image. The others get prunedMatchRes. 0 disables it.
+    // If verify is true, also match all the templates to measure the recall of topK.
+    void SetPrefilter(
+        const size_t topK,
+        const bool verify = false);
+
+    // The number of images verified against all the templates, and of those whose best
+    // template was among the topK ones.
+    size_t GetVerifiedCount() const;
+    size_t GetRecalledCount() const;
+
     void OCR(
         const cv::Mat& circledDigitsImg,
         OcrResult& res);
+
+    // The same as above, but take the matching results from the workspace of the calling
+    // worker. Since the templates are read only, the concurrent workers can share one
+    // CircledDigitsOCRer as long as each of them has its own workspace.
+    void OCR(
+        const cv::Mat& circledDigitsImg,
+        OcrResult& res,
+        Workspace& workspace) const;
 };
 
 #endif /* INCLUDES_CIRCLEDDIGITSOCRER_H_ */
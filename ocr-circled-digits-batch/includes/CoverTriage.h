@@ -0,0 +1,85 @@
+/*
+ * CoverTriage.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_COVERTRIAGE_H_
+#define INCLUDES_COVERTRIAGE_H_
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Workspace.h"
+
+// The thresholds of CoverTriage. A negative threshold disables its check.
+struct TriageThresholds
+{
+    double minStdDev;       // The standard deviation of the gray levels, low for blank pages
+    double minEntropy;      // The entropy of the gray levels in bits, low for blank and overexposed pages
+    double minEdgeDensity;  // The fraction of edge pixels, low for back covers and blurred frames
+    double minAspectRatio;  // The width over the height of the image
+    double maxAspectRatio;
+    double minTitleScore;   // The TM_CCOEFF_NORMED score of the best title, low for non-covers
+
+    TriageThresholds() :
+        minStdDev(10.0),
+        minEntropy(3.0),
+        minEdgeDensity(0.01),
+        minAspectRatio(0.4),
+        maxAspectRatio(1.2),
+        minTitleScore(0.3)
+    {
+    }
+};
+
+struct TriageReport
+{
+    bool passed;
+    std::string reason;     // Which check failed and by how much, empty if passed
+    double stdDev;
+    double entropy;
+    double edgeDensity;
+    double aspectRatio;
+    double titleScore;      // 1 if there is no title small enough to check
+
+    TriageReport() :
+        passed(true),
+        stdDev(0.0),
+        entropy(0.0),
+        edgeDensity(0.0),
+        aspectRatio(0.0),
+        titleScore(1.0)
+    {
+    }
+};
+
+// Reject the blank pages, the back covers, the non-covers and the badly exposed frames of a
+// scanner batch before the expensive stages. All the checks run on a thumbnail of at most
+// thumbMaxSide pixels on the longer side, on which the series titles are matched at the same
+// scale, so the triage costs a small fraction of the localization.
+class CoverTriage
+{
+private:
+    TriageThresholds m_thresholds;
+    std::vector<cv::Mat> m_grayTitleImgs;
+    int m_thumbMaxSide;
+
+public:
+    CoverTriage(
+        const TriageThresholds& thresholds,
+        const std::vector<cv::Mat>& titleImgs,
+        const int thumbMaxSide = 160);
+
+    // Return whether the image passes all the checks.
+    bool Check(
+        const cv::Mat& img,
+        Workspace& workspace,
+        TriageReport& report) const;
+};
+
+#endif /* INCLUDES_COVERTRIAGE_H_ */
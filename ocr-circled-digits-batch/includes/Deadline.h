@@ -0,0 +1,30 @@
+/*
+ * Deadline.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_DEADLINE_H_
+#define INCLUDES_DEADLINE_H_
+
+#include <opencv2/core.hpp>
+
+// The time budget of processing one image. The processing stages check Expired()
+// at their cancellation points and give up the image once the budget is exceeded.
+// Note that a single OpenCV call, e.g., HoughCircles, can't be interrupted, so the
+// budget may be exceeded by the duration of the longest call.
+class Deadline
+{
+private:
+    int64 m_startTick;
+    double m_budgetMs;  // A non-positive budget means no deadline.
+
+public:
+    explicit Deadline(const double budgetMs = 0.0);
+
+    double ElapsedMs() const;
+    bool Expired() const;
+};
+
+#endif /* INCLUDES_DEADLINE_H_ */
@@ -0,0 +1,48 @@
+/*
+ * DirWatcher.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_DIRWATCHER_H_
+#define INCLUDES_DIRWATCHER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Watch a directory with inotify for the files which are completely written into it,
+// i.e., closed after writing or moved into it, so that they can be processed as they
+// arrive without listing the directory again.
+class DirWatcher
+{
+private:
+    std::string m_dir;
+    int m_inotifyFd;
+    int m_watchDescriptor;
+
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+
+    // Read the pending events and append the paths of the new files to files.
+    bool ReadEvents(std::vector<std::string>& files);
+
+public:
+    DirWatcher();
+
+    ~DirWatcher();
+
+    bool Open(const std::string& dir);
+
+    // Wait up to timeoutMs (-1 for ever) for new files. Once a file arrives, keep
+    // collecting the files of the same burst until none arrives for debounceMs or
+    // maxBatchSize files are collected. files is empty on timeout.
+    bool WaitForFiles(
+        std::vector<std::string>& files,
+        const int timeoutMs,
+        const int debounceMs,
+        const size_t maxBatchSize);
+};
+
+#endif /* INCLUDES_DIRWATCHER_H_ */
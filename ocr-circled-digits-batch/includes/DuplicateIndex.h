@@ -0,0 +1,88 @@
+/*
+ * DuplicateIndex.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_DUPLICATEINDEX_H_
+#define INCLUDES_DUPLICATEINDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "CircledDigitsOCRer.h"
+#include "Workspace.h"
+
+// A processed book cover whose results are reused for its near-duplicates.
+struct DuplicateEntry
+{
+    std::string imgFile;
+    int seriesIndex;
+    double routeScore;
+    cv::Size coverSize;
+    cv::Rect circledDigitsRect;     // In the coordinates of the cover of coverSize
+    OcrResult ocrResult;
+
+    DuplicateEntry() :
+        seriesIndex(0),
+        routeScore(0.0)
+    {
+    }
+};
+
+// Find the processed book covers which are near-duplicates of a cover, e.g., reprints and
+// rescans, by the Hamming distance of their perceptual hashes.
+//
+// The 64-bit hash is the sign of the low frequencies of the DCT of a 32 x 32 grayscale
+// downsample relative to their median, which survives recompression, rescaling and small
+// changes of brightness. The hashes are kept in a BK-tree, whose children are keyed by
+// their distance to the parent, so that the triangle inequality prunes the subtrees
+// which can't be within maxDistance. The index is shared by the workers.
+class DuplicateIndex
+{
+private:
+    struct Node
+    {
+        uint64_t hash;
+        size_t entryIndex;
+        std::vector<std::pair<int, size_t> > children;  // (distance, node index)
+    };
+
+    int m_maxDistance;
+    std::vector<Node> m_nodes;
+    std::vector<DuplicateEntry> m_entries;
+    mutable std::mutex m_mutex;
+
+public:
+    explicit DuplicateIndex(const int maxDistance = 6);
+
+    int GetMaxDistance() const;
+
+    static uint64_t ComputeHash(
+        const cv::Mat& img,
+        Workspace& workspace);
+
+    static int HammingDistance(
+        const uint64_t lhs,
+        const uint64_t rhs);
+
+    // Find the nearest entry within the maximum distance. Return false if there is none.
+    bool Find(
+        const uint64_t hash,
+        DuplicateEntry& entry,
+        int& distance) const;
+
+    // Add an entry unless one with the same hash exists.
+    void Insert(
+        const uint64_t hash,
+        const DuplicateEntry& entry);
+};
+
+#endif /* INCLUDES_DUPLICATEINDEX_H_ */
@@ -0,0 +1,72 @@
+/*
+ * KeyPointCache.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_KEYPOINTCACHE_H_
+#define INCLUDES_KEYPOINTCACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+#include "Workspace.h"
+
+// An on-disk cache of the keypoints and the descriptors of the book covers, so that a rerun
+// which only changes the matching or cropping parameters, or the series title, skips the
+// detection of Homography and goes straight to the matching.
+//
+// The key hashes the pixels of the searched region of the sharpened cover together with the
+// detector parameters, so that a changed cover, search region, deskew, downscale or detector
+// misses the cache instead of returning stale keypoints. Each entry is a file <key>.kpc in
+// the cache directory, with a header (magic, version, key, keypoint count and descriptor
+// layout) and two 64-byte aligned sections: the keypoints as rows of (x, y, size, angle,
+// response, octave, class_id) in float32, relative to the searched region, and the
+// descriptors. An entry is written into a temporary file and renamed, so that the workers,
+// threads or processes, never read half an entry, and it is mapped read only when loaded.
+class KeyPointCache
+{
+private:
+    std::string m_cacheDir;
+    mutable std::atomic<size_t> m_cntHits;
+    mutable std::atomic<size_t> m_cntMisses;
+
+    KeyPointCache(const KeyPointCache&) = delete;
+    KeyPointCache& operator=(const KeyPointCache&) = delete;
+
+    std::string GetEntryFile(const uint64_t key) const;
+
+public:
+    explicit KeyPointCache(const std::string& cacheDir);
+
+    // Hash the pixels of the image, e.g., a region of a larger one, and the parameters.
+    static uint64_t ComputeKey(
+        const cv::Mat& img,
+        const std::string& detectorParams);
+
+    // Load the keypoints and the descriptors of the key. The descriptors are the workspace
+    // buffer "cachedDesc". Return false if there is no entry or it is corrupted.
+    bool Load(
+        const uint64_t key,
+        Workspace& workspace,
+        std::vector<cv::KeyPoint>& keyPoints,
+        cv::Mat& descriptors) const;
+
+    // Write the entry of the key, replacing any existing one.
+    bool Store(
+        const uint64_t key,
+        const std::vector<cv::KeyPoint>& keyPoints,
+        const cv::Mat& descriptors) const;
+
+    size_t GetHitCount() const;
+
+    size_t GetMissCount() const;
+};
+
+#endif /* INCLUDES_KEYPOINTCACHE_H_ */
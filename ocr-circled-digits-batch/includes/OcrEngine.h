@@ -0,0 +1,236 @@
+/*
+ * OcrEngine.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_OCRENGINE_H_
+#define INCLUDES_OCRENGINE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+#include "OcrPreprocessor.h"
+#include "CircledDigitsOCRer.h"
+#include "TemplateBankFile.h"
+#include "Workspace.h"
+#include "Deadline.h"
+
+// The settings of the extraction and the recognition, which are the options of
+// ocr-circled-digits-batch with the same names.
+struct OcrEngineOptions
+{
+    std::string method;             // homo | templ | hough
+    std::string bankFile;           // The template bank, or else the title image and the templates
+    std::string titleImgFile;
+    std::string templImgDir;
+
+    int priorMargin;                // Negative disables the series prior (homo | templ)
+    double priorMinScore;
+    int priorTolerance;             // Negative doesn't verify the series prior
+    std::string sobelPrecision;     // float32 | mag8u, empty for the default (templ)
+    int tileSize;                   // Zero processes the whole cover at once (templ)
+    cv::Rect detectRegion;          // Empty for the whole cover (homo)
+    int maxKeyPoints;               // Zero keeps all (homo)
+    cv::Rect houghRegion;           // The region of the circle centers (hough)
+    unsigned int circleBufferWidth; // (hough)
+    bool houghAlt;                  // (hough)
+
+    double maxSkewAngle;            // Zero disables deskewing
+    size_t maxPixels;               // Zero means no limit
+    bool downscaleOversized;
+    bool templateBank;              // Match the digit templates of the same size in one pass
+    size_t digitTopK;               // Zero matches all the templates
+    bool verifyDigitTopK;           // Also match all the templates to measure the recall of digitTopK
+    double timeBudgetMs;            // Zero means no budget
+    double scaleFactor;             // The scale of the black-white image of the circled digits
+
+    OcrEngineOptions() :
+        method("homo"),
+        priorMargin(-1),
+        priorMinScore(0.6),
+        priorTolerance(-1),
+        tileSize(0),
+        maxKeyPoints(0),
+        houghRegion(OcrPreprocessor::DefaultHoughSearchRegion()),
+        circleBufferWidth(10),
+        houghAlt(false),
+        maxSkewAngle(0.0),
+        maxPixels(0),
+        downscaleOversized(false),
+        templateBank(false),
+        digitTopK(0),
+        verifyDigitTopK(false),
+        timeBudgetMs(0.0),
+        scaleFactor(4.0)
+    {
+    }
+};
+
+enum class OcrStatus {
+    Success,
+    DecodeFailed,   // The encoded image can't be decoded.
+    InvalidInput,   // The pixel buffer has an unsupported layout.
+    NotFound,       // The circled digits are not found.
+    Timeout,        // The time budget of the image is exceeded.
+    Rejected,       // The image has too many pixels.
+    InternalError   // An exception was thrown, e.g., out of memory.
+};
+
+struct OcrOutput
+{
+    OcrStatus status;
+    OcrResult result;
+    ExtractReport report;
+    cv::Mat circledDigitsImg;   // Valid until the session is used again
+    cv::Mat blackWhiteImg;      // Valid until the session is used again
+
+    // The times of the extraction stages of the report followed by threshold and ocr.
+    std::vector<std::pair<std::string, double> > stageTimesMs;
+
+    OcrOutput() :
+        status(OcrStatus::NotFound)
+    {
+    }
+};
+
+class OcrSession;
+
+// The immutable title data, templates and settings shared by the sessions of the
+// threads of an embedding process. An engine is set up by Init() and the setters
+// before the first session, and then never changes, so any number of threads can
+// create and use their own sessions.
+class OcrEngine
+{
+private:
+    friend class OcrSession;
+
+    OcrEngineOptions m_options;
+    TemplateBankFile m_bankFile;    // Must outlive the title data and the templates
+    std::unique_ptr<OcrPreprocessor> m_preprocessor;
+    std::unique_ptr<CircledDigitsOCRer> m_ocrer;
+
+    OcrEngine(const OcrEngine&) = delete;
+    OcrEngine& operator=(const OcrEngine&) = delete;
+
+    // Create a preprocessor by the options from the title data computed in advance.
+    static std::unique_ptr<OcrPreprocessor> CreatePreprocessor(
+        const OcrEngineOptions& options,
+        const TitleFeatures& titleFeatures);
+
+public:
+    OcrEngine();
+
+    // Load the template bank or the title image and the templates, and set up the
+    // preprocessor and the ocrer by the options.
+    bool Init(const OcrEngineOptions& options);
+
+    // Set up the preprocessor and the ocrer by the options from the title data and the
+    // templates loaded by the caller, e.g., of one of many book series. The files named
+    // by the options are ignored.
+    bool Init(
+        const OcrEngineOptions& options,
+        const TitleFeatures& titleFeatures,
+        const std::vector<std::pair<std::string, cv::Mat> >& templDigitImgPairs);
+
+    bool IsInitialized() const;
+
+    const OcrEngineOptions& GetOptions() const;
+
+    // The preprocessor which the sessions copy, e.g., for its title image.
+    const OcrPreprocessor& GetPreprocessor() const;
+
+    // The ocrer shared by the sessions, e.g., for its counters.
+    const CircledDigitsOCRer& GetOcrer() const;
+
+    // Share the keypoint cache with the sessions created afterwards.
+    void SetKeyPointCache(const KeyPointCache* keyPointCache);
+
+    // Learn the detection region of Homography from a sample of book covers for the
+    // sessions created afterwards, or else detect the keypoints in the whole covers.
+    bool CalibrateDetectionRegion(
+        const std::vector<cv::Mat>& sampleBookCoverImgs,
+        const int margin);
+
+    // Create a session for one thread, which has its own preprocessor (and hence its own
+    // series prior) and workspace, or else uses the caller's workspace, e.g., shared by
+    // the sessions of many engines in one thread. The engine and the caller's workspace
+    // must outlive the session.
+    std::unique_ptr<OcrSession> CreateSession(Workspace* workspace = nullptr) const;
+
+    // Load the gray template images in the directory, each named after its digits.
+    static int LoadTemplImgs(
+        const std::string& templImgDir,
+        std::vector<std::string>& templImgFiles,
+        std::vector<std::pair<std::string, cv::Mat> >& templDigitImgPairs);
+};
+
+// The handle of one thread to an engine. A session must not be used by concurrent threads.
+class OcrSession
+{
+private:
+    friend class OcrEngine;
+
+    const OcrEngine& m_engine;
+    std::unique_ptr<OcrPreprocessor> m_preprocessor;
+    Workspace m_ownWorkspace;
+    Workspace& m_workspace;     // The own workspace or the caller's
+
+    OcrSession(
+        const OcrEngine& engine,
+        Workspace* workspace);
+
+    OcrSession(const OcrSession&) = delete;
+    OcrSession& operator=(const OcrSession&) = delete;
+
+public:
+    // Recognize the circled digits of a BGR book cover image.
+    bool Recognize(
+        const cv::Mat& bookCoverImg,
+        OcrOutput& output);
+
+    // The same as above, within a deadline started by the caller, e.g., before decoding.
+    bool Recognize(
+        const cv::Mat& bookCoverImg,
+        const Deadline& deadline,
+        OcrOutput& output);
+
+    // The steps of Recognize for the callers which act between them. Extract starts a new
+    // output with the crop of the circled digits, Threshold turns the crop into the
+    // black-white image, which may also be cropped by the caller, e.g., at a known place,
+    // and RecognizeThresholded recognizes the digits of the black-white image.
+    bool Extract(
+        const cv::Mat& bookCoverImg,
+        const Deadline& deadline,
+        OcrOutput& output);
+
+    bool Threshold(OcrOutput& output);
+
+    bool RecognizeThresholded(OcrOutput& output);
+
+    // Recognize the circled digits of a book cover in the caller's pixel buffer of
+    // 1 (gray), 3 (BGR) or 4 (BGRA) channels of 8 bits, whose rows are stride bytes
+    // apart. A BGR buffer is used in place without copying.
+    bool RecognizePixels(
+        const unsigned char* pixels,
+        const int width,
+        const int height,
+        const size_t stride,
+        const int channels,
+        OcrOutput& output);
+
+    // Recognize the circled digits of a book cover encoded in any format imread reads,
+    // decoding it straight from the caller's bytes.
+    bool RecognizeEncoded(
+        const unsigned char* bytes,
+        const size_t size,
+        OcrOutput& output);
+};
+
+#endif /* INCLUDES_OCRENGINE_H_ */
@@ -0,0 +1,132 @@
+/*
+ * OcrEngineC.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_OCRENGINEC_H_
+#define INCLUDES_OCRENGINEC_H_
+
+#include <stddef.h>
+
+/*
+ * The plain C API of OcrEngine for the callers which can't link C++ directly. An engine
+ * is shared by the threads of the caller, and each thread creates its own session.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ocr_engine ocr_engine;
+typedef struct ocr_session ocr_session;
+
+enum
+{
+    OCR_STATUS_SUCCESS = 0,
+    OCR_STATUS_DECODE_FAILED = 1,
+    OCR_STATUS_INVALID_INPUT = 2,
+    OCR_STATUS_NOT_FOUND = 3,
+    OCR_STATUS_TIMEOUT = 4,
+    OCR_STATUS_REJECTED = 5,
+    OCR_STATUS_INTERNAL_ERROR = 6   /* An exception was caught, e.g., out of memory */
+};
+
+/* A rectangle of pixels, which is empty if its width or height is 0. */
+typedef struct ocr_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} ocr_rect;
+
+/*
+ * The options of OcrEngineOptions. The strings are copied by ocr_engine_create.
+ * ocr_engine_options_init sets struct_size to the size of the options which the caller
+ * is compiled with, so that the options added later keep their defaults for the caller.
+ * The keypoint cache, the calibration of the detection region and the routing among
+ * many book series are only available from the C++ API.
+ */
+typedef struct ocr_engine_options
+{
+    size_t struct_size;             /* sizeof(ocr_engine_options) */
+    const char* method;             /* homo | templ | hough */
+    const char* bank_file;          /* NULL to load title_img_file and templ_img_dir */
+    const char* title_img_file;
+    const char* templ_img_dir;
+    int prior_margin;               /* Negative disables the series prior */
+    double prior_min_score;
+    int tile_size;
+    ocr_rect detect_region;         /* Empty for the whole cover (homo) */
+    int max_key_points;
+    ocr_rect hough_region;          /* The region of the circle centers (hough) */
+    unsigned int circle_buffer_width;
+    int hough_alt;
+    double max_skew_angle;          /* Zero disables deskewing */
+    size_t max_pixels;              /* Zero means no limit */
+    int downscale_oversized;
+    size_t digit_top_k;             /* Zero matches all the templates */
+    int verify_digit_top_k;         /* Also match all the templates to count the recall of digit_top_k */
+    double time_budget_ms;          /* Zero means no budget */
+    double scale_factor;            /* The scale of the black-white image of the circled digits */
+    int template_bank;              /* Match the digit templates of the same size in one pass */
+    const char* sobel_precision;    /* float32 | mag8u, NULL for the default (templ) */
+    int prior_tolerance;            /* Negative doesn't verify the series prior */
+} ocr_engine_options;
+
+typedef struct ocr_result
+{
+    int status;                     /* OCR_STATUS_* */
+    char digits[64];                /* The recognized digits, NUL terminated */
+    double score;                   /* The match score of the recognized digits */
+    double skew_angle;              /* The estimated skew in degrees if deskewing is enabled */
+} ocr_result;
+
+/* Fill the options with the defaults of ocr-circled-digits-batch. */
+void ocr_engine_options_init(ocr_engine_options* options);
+
+/* Create an engine, or return NULL on error. */
+ocr_engine* ocr_engine_create(const ocr_engine_options* options);
+void ocr_engine_destroy(ocr_engine* engine);
+
+/*
+ * Get the number of images matched against all the templates with verify_digit_top_k,
+ * and of those whose best template was among the top digit_top_k by signature.
+ */
+void ocr_engine_get_digit_recall(
+    const ocr_engine* engine,
+    size_t* cnt_verified,
+    size_t* cnt_recalled);
+
+/* Create a session of the calling thread, or return NULL on error. */
+ocr_session* ocr_session_create(const ocr_engine* engine);
+void ocr_session_destroy(ocr_session* session);
+
+/*
+ * Recognize the circled digits of a book cover in the caller's buffer of 8-bit pixels
+ * with 1 (gray), 3 (BGR) or 4 (BGRA) channels, whose rows are stride bytes apart. A BGR
+ * buffer isn't copied. Return the status, which is also put into the result.
+ */
+int ocr_session_recognize_pixels(
+    ocr_session* session,
+    const unsigned char* pixels,
+    int width,
+    int height,
+    size_t stride,
+    int channels,
+    ocr_result* result);
+
+/* The same as above, but for an encoded image (PNG, JPEG, ...) decoded from the caller's bytes. */
+int ocr_session_recognize_encoded(
+    ocr_session* session,
+    const unsigned char* bytes,
+    size_t size,
+    ocr_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDES_OCRENGINEC_H_ */
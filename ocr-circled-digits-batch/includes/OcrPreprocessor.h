@@ -11,6 +11,9 @@
 #include <cstdio>
 #include <string>
 #include <algorithm>
+#include <vector>
+#include <utility>
+#include <memory>
 
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core.hpp>
@@ -20,6 +23,102 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/xfeatures2d.hpp>
 
+#include "Deadline.h"
+#include "Workspace.h"
+#include "KeyPointCache.h"
+
+enum class ExtractStatus {
+    Success,
+    NotFound,   // The circled digits are not found.
+    Timeout,    // The time budget of the image is exceeded.
+    Rejected    // The image has too many pixels.
+};
+
+// The per-image report of OcrPreprocessor::ExtractCircledDigits.
+struct ExtractReport
+{
+    ExtractStatus status;
+    double skewAngle;       // The estimated counter-clockwise skew of the scan in degrees
+    bool deskewed;          // Whether the cover was rotated back by skewAngle
+    double deskewTimeMs;    // The time spent on estimating the skew and deskewing
+    double downscaleFactor; // The factor by which an oversized cover was downscaled
+    cv::Rect circledDigitsRect; // The crop of the circled digits in the downscaled and deskewed cover
+    bool priorVerified;     // Whether the match around the series prior was checked against the whole cover
+    bool priorMismatched;   // Whether the two were farther apart than the tolerance, so the whole cover won
+    int priorOffset;        // The largest difference between their sides in pixels, -1 if the whole cover failed
+
+    // The time spent in each stage in the processing order.
+    std::vector<std::pair<std::string, double> > stageTimesMs;
+
+    ExtractReport() :
+        status(ExtractStatus::Success),
+        skewAngle(0.0),
+        deskewed(false),
+        deskewTimeMs(0.0),
+        downscaleFactor(1.0),
+        priorVerified(false),
+        priorMismatched(false),
+        priorOffset(0)
+    {
+    }
+
+    void AddStageTime(const std::string& stage, const int64 startTick)
+    {
+        stageTimesMs.push_back(std::make_pair(stage, (cv::getTickCount() - startTick)*1000.0/cv::getTickFrequency()));
+    }
+
+    const char* StatusStr() const
+    {
+        switch (status)
+        {
+        case ExtractStatus::Success:
+            return "success";
+
+        case ExtractStatus::NotFound:
+            return "notfound";
+
+        case ExtractStatus::Timeout:
+            return "timeout";
+
+        case ExtractStatus::Rejected:
+            return "rejected";
+
+        default:
+            return "invalid";
+        }
+    }
+};
+
+// The title found in one book cover with both representations of the Sobel derivatives,
+// and the time spent differentiating the cover and matching the title with each.
+struct SobelComparison
+{
+    cv::Point float32MatchPoint;
+    double float32Score;
+    double float32Ms;
+    cv::Point magnitude8UMatchPoint;
+    double magnitude8UScore;
+    double magnitude8UMs;
+
+    SobelComparison() :
+        float32Score(-1.0),
+        float32Ms(0.0),
+        magnitude8UScore(-1.0),
+        magnitude8UMs(0.0)
+    {
+    }
+};
+
+// The data of the series title derived when the preprocessor is built. It can be
+// computed once and stored in a template bank file instead of at every launch.
+struct TitleFeatures
+{
+    cv::Mat sharpenedImg;
+    cv::Mat sobel;                       // The float32 Sobel derivative of sharpenedImg
+    std::vector<cv::KeyPoint> keyPoints; // The SURF keypoints of the original title image
+    cv::Mat descriptors;
+};
+
 class OcrPreprocessor
 {
 private:
@@ -30,12 +129,22 @@ private:
         HoughCircleTransform
     };
 
-    std::string ExtractMethod2Str(const ExtractMethod method);
-    ExtractMethod Str2ExtractMethod(const std::string& str);
+    // The representation of the Sobel derivatives in Template Matching. Float32 is the
+    // mixed derivative of the three channels in CV_32F. Magnitude8U is the gradient
+    // magnitude (|dx| + |dy|)/8 of the grayscale image saturated into CV_8U, which takes
+    // 1/12 of the memory and is matched by matchTemplate on one channel instead of three.
+    enum class SobelPrecision {
+        Float32,
+        Magnitude8U
+    };
+
+    static std::string ExtractMethod2Str(const ExtractMethod method);
+    static ExtractMethod Str2ExtractMethod(const std::string& str);
 
     ExtractMethod m_method;
     cv::Mat m_titleImg;
-    cv::Mat m_titleImgSobel; // The Sobel derivative of the title image
+    cv::Mat m_titleImgSobel; // The Sobel derivative of the title image in m_sobelPrecision
+    SobelPrecision m_sobelPrecision;
 
     // The circled digits may be outside the series title. After we find
     // the rectangular region of the series title in the book cover, we
@@ -54,29 +163,174 @@ private:
     cv::Mat m_titleImgDescriptors;
     std::vector<cv::Point2f> m_titleImgCorners;
 
+    // The region of the book cover in which we detect the keypoints for Homography,
+    // e.g., the band of the cover where the series title is printed. An empty region
+    // means the whole cover. If m_maxKeyPoints is positive, we only keep the strongest
+    // m_maxKeyPoints keypoints by their response before computing the descriptors.
+    cv::Rect m_detectionRegion;
+    int m_maxKeyPoints;
+
+    // The on-disk cache of the keypoints and the descriptors of the book covers for
+    // Homography, which is shared by the workers. Null means no cache.
+    const KeyPointCache* m_keyPointCache;
+
     // The minimum and maximum radius to consider in the Hough Circle Transform
     unsigned int m_minRadius;
     unsigned int m_maxRadius;
 
-    cv::Mat SharpenImg(const cv::Mat& img);
+    // The region of the book cover in which the circle centers are searched. We only
+    // equalize and transform this region expanded by m_maxRadius, and then crop the
+    // largest circle found in it with a buffer of m_circleBufferWidth pixels.
+    // If m_useAltGradient is true, use the more accurate HOUGH_GRADIENT_ALT accumulator
+    // (OpenCV 4.3+), whose resolution is chosen based on [m_minRadius, m_maxRadius].
+    cv::Rect m_houghSearchRegion;
+    unsigned int m_circleBufferWidth;
+    bool m_useAltGradient;
+
+    // Covers of one series share almost the same layout, so the title rectangles
+    // found in the recent covers predict where the title is in the next one. If the
+    // series prior is enabled, we first search only the window of m_priorMargin pixels
+    // around the prior and accept the result if its score is at least m_priorMinScore,
+    // where the score is the TM_CCOEFF_NORMED value for Template Matching and the RANSAC
+    // inlier ratio for Homography. Otherwise we fall back to searching the whole cover.
+    // Note that the history belongs to this instance, so each worker should own its
+    // own OcrPreprocessor when the covers are processed in parallel. An accepted match
+    // depends on the covers processed before, so if m_priorTolerance is not negative, we
+    // search the whole cover as well and take its match instead if the two are farther
+    // apart than m_priorTolerance pixels.
+    bool m_priorEnabled;
+    int m_priorMargin;
+    double m_priorMinScore;
+    int m_priorTolerance;
+    size_t m_priorHistoryLen;
+    std::vector<cv::Rect> m_priorTitleRects;   // A ring buffer of at most m_priorHistoryLen rectangles
+    size_t m_priorNextIndex;
+
+    // If deskewing is enabled, we estimate the skew of each cover within
+    // [-m_maxSkewAngle, m_maxSkewAngle] degrees from a downsampled image, and rotate the
+    // cover back if the skew is at least m_minSkewAngle, so that the axis-aligned template
+    // matching still works for slightly tilted scans.
+    bool m_deskewEnabled;
+    double m_maxSkewAngle;
+    double m_minSkewAngle;
+
+    // The covers with more than m_maxPixels pixels are either rejected or downscaled
+    // to m_maxPixels pixels up front. Zero means no limit.
+    size_t m_maxPixels;
+    bool m_downscaleOversized;
+
+    // If m_tileSize is positive, Template Matching sharpens, differentiates and searches
+    // the whole cover in tiles of at most m_tileSize x m_tileSize match positions instead
+    // of the whole image at once, so that the peak memory depends on the tile size rather
+    // than on the cover size. Each tile is read with a halo of the title size and the
+    // Sobel kernel, and the blur of the sharpening reads the pixels around the tile, so
+    // the result is the same as that of the whole image. The tiles run in parallel.
+    int m_tileSize;
+
+    bool CheckDeadline(
+        const Deadline& deadline,
+        const char* stage,
+        ExtractReport& report);
+
+    double EstimateSkewAngle(
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace);
+    cv::Rect GetReadRegion(const cv::Size& bookCoverSize) const;
+
+    static cv::Mat SharpenImg(
+        const cv::Mat& img,
+        Workspace& workspace);
+
+    // The same as the corresponding part of SharpenImg on the whole image, but only
+    // sharpen the rect with the halo read by the blur.
+    static cv::Mat SharpenRegion(
+        const cv::Mat& img,
+        const cv::Rect& rect,
+        const std::string& bufferName,
+        Workspace& workspace);
+
+    static cv::Mat ComputeSobel(
+        const cv::Mat& img,
+        const cv::Rect& rect,
+        const SobelPrecision precision,
+        const std::string& bufferName,
+        Workspace& workspace);
+
+    // The same as ComputeSobel on the sharpened image, but only sharpen the rect with
+    // the one-pixel border read by the Sobel kernel.
+    static cv::Mat ComputeSharpenedSobel(
+        const cv::Mat& img,
+        const cv::Rect& rect,
+        const SobelPrecision precision,
+        const std::string& bufferName,
+        Workspace& workspace);
+
+    // Find the best match of the title Sobel derivative in the unsharpened cover tile by
+    // tile. Return false if the cover is smaller than the title.
+    bool FindTitleInTiles(
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        cv::Point& matchPoint);
 
     cv::Point GetTemplateMatchingPoint(
         const cv::Mat& srcImg,
         const cv::Mat& templImg,
-        cv::OutputArray result);
+        Workspace& workspace,
+        cv::OutputArray result,
+        double* maxScore = nullptr);
+
+    // Find the title Sobel derivative in srcImg. Return false if srcImg is smaller than
+    // the title.
+    bool MatchTitleSobel(
+        const cv::Mat& srcImg,
+        Workspace& workspace,
+        cv::Point& matchPoint,
+        double* maxScore = nullptr);
+
+    bool GetPriorSearchRect(
+        const cv::Size& bookCoverSize,
+        Workspace& workspace,
+        cv::Rect& searchRect) const;
+    void UpdatePrior(const cv::Rect& titleRect);
+
+    // Record the comparison of the match around the series prior with the match in the
+    // whole cover in the report. Return true if the former is within m_priorTolerance.
+    bool VerifyPriorMatch(
+        const cv::Rect& priorTitleRect,
+        const cv::Rect& titleRect,
+        ExtractReport& report) const;
+
+    bool FindTitleRectViaHomography(
+        const cv::Mat& bookCoverImg,
+        const cv::Rect& searchRect,
+        const bool logErrors,
+        Workspace& workspace,
+        const Deadline& deadline,
+        ExtractReport& report,
+        cv::Rect& titleRect,
+        double& inlierRatio);
 
     cv::Rect ShiftAndResizeRect(
         const int topLeftX,
         const int topLeftY);
 
     cv::Mat ExtractCircledDigitsViaTemplateMatching(
-        const cv::Mat& bookCoverImg);
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        const Deadline& deadline,
+        ExtractReport& report);
 
     cv::Mat ExtractCircledDigitsViaHomography(
-        const cv::Mat& bookCoverImg);
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        const Deadline& deadline,
+        ExtractReport& report);
 
     cv::Mat ExtractCircledDigitsViaHoughTransform(
-        const cv::Mat& bookCoverImg);
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        const Deadline& deadline,
+        ExtractReport& report);
 
 public:
 
@@ -89,6 +343,22 @@ public:
         const unsigned int width = 0,
         const unsigned int height = 0);
 
+    // The same as above, but with the title data computed in advance.
+    OcrPreprocessor(
+        const std::string& method,
+        const TitleFeatures& titleFeatures,
+        const int centerDisplacementX = 0,
+        const int centerDisplacementY = 0,
+        const unsigned int width = 0,
+        const unsigned int height = 0);
+
+    // Compute the title data needed by Homography (the keypoints and the descriptors)
+    // and / or Template Matching (the Sobel derivative).
+    static TitleFeatures ComputeTitleFeatures(
+        const cv::Mat& titleImg,
+        const bool withKeyPoints,
+        const bool withSobel);
+
     // Constructor for the extraction method of Hough Circle Transform
     OcrPreprocessor(
         const std::string& method,
@@ -97,10 +367,107 @@ public:
 
     ~OcrPreprocessor();
 
-    cv::Mat ExtractCircledDigits(const cv::Mat& bookCoverImg);
+    // Create a copy for another worker, which shares the immutable title data but has its
+    // own detector, matcher and series prior.
+    std::unique_ptr<OcrPreprocessor> CloneForWorker() const;
+
+    // The sharpened title image, which is empty for Hough Circle Transform.
+    const cv::Mat& GetTitleImg() const;
+
+    // The name of the extraction method, e.g., homo.
+    std::string GetMethodName() const;
+
+    // Enable the series prior (only for Template Matching and Homography).
+    void EnableSeriesPrior(
+        const int margin,
+        const double minScore,
+        const size_t historyLen = 5);
+    void ResetSeriesPrior();
+
+    // Also search the whole cover when the match around the series prior is accepted, and
+    // take the match in the whole cover if they are more than tolerance pixels apart.
+    // Negative disables the verification.
+    void SetPriorTolerance(const int tolerance);
+
+    // The default region of the circle centers, i.e., the rows [0, 170] of the cover.
+    static cv::Rect DefaultHoughSearchRegion();
+
+    // Set the region of the circle centers and the buffer width around the found circle
+    // for Hough Circle Transform. A center is inside the region if its coordinates are
+    // between the first and the last pixel of the region, both inclusive.
+    void SetHoughSearchRegion(
+        const cv::Rect& region,
+        const unsigned int circleBufferWidth = 10,
+        const bool useAltGradient = false);
+
+    // Restrict the keypoint detection of Homography to the given region of the book cover
+    // and cap the number of keypoints (0 means no cap).
+    void SetDetectionRegion(
+        const cv::Rect& region,
+        const int maxKeyPoints = 0);
+
+    // Load the keypoints and the descriptors of the book covers from the cache instead of
+    // detecting them, and store those detected (only for Homography). The cache must
+    // outlive the preprocessor and its clones.
+    void SetKeyPointCache(const KeyPointCache* keyPointCache);
+
+    // Learn the detection region of Homography from a calibration sample of book covers,
+    // i.e., the union of the title rectangles found in the whole covers, expanded by margin.
+    bool CalibrateDetectionRegion(
+        const std::vector<cv::Mat>& sampleBookCoverImgs,
+        const int margin,
+        const int maxKeyPoints = 0);
+
+    // Enable the skew estimation and deskewing of the book covers.
+    void EnableDeskew(
+        const double maxSkewAngle = 10.0,
+        const double minSkewAngle = 0.2);
+
+    // Reject or downscale the covers with more than maxPixels pixels.
+    void SetMaxPixels(
+        const size_t maxPixels,
+        const bool downscale);
+
+    // Process the covers in tiles of at most tileSize x tileSize match positions (Template
+    // Matching only). Zero processes the whole cover at once.
+    bool SetTileSize(const int tileSize);
+
+    // Set the representation (float32 | mag8u) of the Sobel derivatives in Template Matching.
+    bool SetSobelPrecision(const std::string& precision);
+
+    // Find the title in the whole cover with both Sobel representations, for validating
+    // mag8u against float32 (Template Matching only).
+    bool CompareSobelPrecisions(
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        SobelComparison& comparison) const;
+
+    cv::Mat ExtractCircledDigits(
+        const cv::Mat& bookCoverImg,
+        ExtractReport* report = nullptr,
+        const Deadline& deadline = Deadline());
     cv::Mat BlackWhiteThresholding(
         const double scaleFactor,
         const cv::Mat& circledDigitsImg);
+
+    // The same as above, but take the intermediate images from the workspace of the
+    // calling worker. The returned image is only valid until the workspace is used again.
+    cv::Mat ExtractCircledDigits(
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        ExtractReport* report = nullptr,
+        const Deadline& deadline = Deadline());
+    cv::Mat BlackWhiteThresholding(
+        const double scaleFactor,
+        const cv::Mat& circledDigitsImg,
+        Workspace& workspace);
+
+    // Crop and sharpen the circled digits at a rectangle known in advance, e.g., found in a
+    // near-duplicate cover, in the same way as ExtractCircledDigits does after locating them.
+    static cv::Mat CropCircledDigits(
+        const cv::Mat& bookCoverImg,
+        const cv::Rect& circledDigitsRect,
+        Workspace& workspace);
 };
 
 #endif /* INCLUDES_OCRPREPROCESSOR_H_ */
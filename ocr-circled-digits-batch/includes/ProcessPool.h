@@ -0,0 +1,90 @@
+/*
+ * ProcessPool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_PROCESSPOOL_H_
+#define INCLUDES_PROCESSPOOL_H_
+
+#include <sys/types.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Run the tasks in forked worker processes, so that a crash in one task takes down only
+// its worker. The workers take the tasks from a queue in an anonymous shared mapping and
+// put the result of each task into its slot there. The supervisor restarts a crashed
+// worker as long as tasks remain, and the task it was running is marked as crashed.
+//
+// The workers inherit the memory of the supervisor at the fork, so the read-only data
+// built before Run(), e.g., a mapped template bank, is shared instead of duplicated.
+class ProcessPool
+{
+public:
+    enum class TaskState {
+        Pending,
+        InFlight,
+        Done,
+        Crashed
+    };
+
+    // Run one task in a worker and put its serialized result into result.
+    typedef std::function<void(const size_t taskIndex, std::string& result)> Task;
+
+    // Called by the supervisor every pollMs while the tasks run, with the tasks done since
+    // the last call, and once more with the last ones after all the workers exit.
+    typedef std::function<void(const std::vector<size_t>& doneTaskIndices)> ProgressFunc;
+
+private:
+    struct QueueHeader;
+    struct TaskSlot;
+
+    unsigned int m_cntProcs;
+    size_t m_slotSize;
+    size_t m_cntTasks;
+    void* m_mapping;
+    size_t m_mappingSize;
+    size_t m_cntRestarts;
+
+    ProcessPool(const ProcessPool&) = delete;
+    ProcessPool& operator=(const ProcessPool&) = delete;
+
+    TaskSlot* GetSlot(const size_t taskIndex) const;
+
+    pid_t StartWorker(const Task& task);
+
+    void RunWorker(const Task& task);
+
+    void Unmap();
+
+public:
+    // maxResultSize is the maximum size of the serialized result of one task.
+    ProcessPool(
+        const unsigned int cntProcs,
+        const size_t maxResultSize = 64*1024);
+
+    ~ProcessPool();
+
+    // Run the tasks [0, cntTasks) and wait for all of them. With progress, the supervisor
+    // polls the workers instead of blocking until one exits.
+    bool Run(
+        const size_t cntTasks,
+        const Task& task,
+        const ProgressFunc& progress = ProgressFunc(),
+        const int pollMs = 100);
+
+    TaskState GetState(const size_t taskIndex) const;
+
+    size_t CountTasks(const TaskState state) const;
+
+    // Get the result of a task which is done.
+    std::string GetResult(const size_t taskIndex) const;
+
+    size_t GetRestartCount() const;
+};
+
+#endif /* INCLUDES_PROCESSPOOL_H_ */
@@ -0,0 +1,164 @@
+/*
+ * PrunedTemplateMatcher.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_PRUNEDTEMPLATEMATCHER_H_
+#define INCLUDES_PRUNEDTEMPLATEMATCHER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Workspace.h"
+
+// The counts of the positions of one search.
+struct PrunedMatchStats
+{
+    size_t cntPositions;    // All the positions of the template in the source image
+    size_t cntPruned;       // Rejected by the bound before the correlation was complete
+    size_t cntBands;        // The template bands correlated over all the positions
+    size_t cntCandidates;   // Tied with the best score and rescored at the end
+
+    PrunedMatchStats() :
+        cntPositions(0),
+        cntPruned(0),
+        cntBands(0),
+        cntCandidates(0)
+    {
+    }
+};
+
+// Find the maximum of TM_CCOEFF_NORMED by successive elimination, which skips the positions
+// that can't beat the best score found so far by more than the rounding.
+//
+// The template is made zero-mean per channel and split into bands of rows. For a position,
+// the correlation of a band with the window is the band mean times the window sum plus
+// the correlation of the centered band and the centered window, which is bounded by the
+// product of their norms (Cauchy-Schwarz). The sums and the centered norms of the windows
+// of each band height are computed once per image from the integral images, so the bound
+// of a whole row of positions is a few multiply-adds per band and position. The positions
+// whose bound reaches the best score correlate the bands in the order of decreasing norm,
+// each one replacing its bound, until the bound falls below the best score.
+//
+// The bound only prunes once a good score is known, so the best of the caller's guess, e.g.,
+// the title position in the previous cover, and the neighborhood of the maximum of a
+// downscaled matchTemplate is taken as the initial best score.
+//
+// The band by band scores are rounded differently depending on the order of the bands, so
+// the positions scored within the rounding of the best score are kept as the candidates.
+// At the end, they are rescored with the whole template correlated in the row-major order,
+// and the first maximum in the row-major order wins, like in minMaxLoc. The result is thus
+// the exact maximum of TM_CCOEFF_NORMED in double, which doesn't depend on the pruning or
+// the threads. matchTemplate rounds its scores in float, so it may pick another one of the
+// maxima closer than about 1e-5.
+class PrunedTemplateMatcher
+{
+private:
+    struct TemplateBand
+    {
+        int startRow;
+        int heightIndex;                // The index of the band height in m_bandHeights
+        std::vector<double> means;      // The mean of the zero-mean template in the band, per channel
+        double norm;                    // The norm of the band centered by its means, over the channels
+    };
+
+    int m_channels;
+    cv::Mat m_templ;                    // The template minus its mean per channel in CV_64F
+    double m_templNorm;
+    std::vector<int> m_bandHeights;     // The distinct heights of the bands, at most two
+    std::vector<TemplateBand> m_bands;  // In the order of decreasing norm
+
+    // The downscaled template of the initial guess, which is empty if the template is too
+    // small to be downscaled.
+    cv::Mat m_coarseTemplImg;
+    int m_coarseFactor;
+
+    // The sums per channel and the centered norms of the windows of each band height at
+    // all the positions of an image.
+    struct BandWindows
+    {
+        cv::Mat sums[2];
+        cv::Mat devs[2];
+    };
+
+    // The bound of the correlation of the band with the window at the position.
+    double BoundBand(
+        const TemplateBand& band,
+        const BandWindows& windows,
+        const cv::Point& position) const;
+
+    // Score the position like matchTemplate, replacing the bounds by the correlations band
+    // by band. Return false without the score as soon as it can't reach bestScore.
+    bool ScorePosition(
+        const cv::Mat& srcImg,
+        const BandWindows& windows,
+        const cv::Point& position,
+        const double denominator,
+        const double bestScore,
+        std::vector<double>& bandBounds,
+        double& score,
+        size_t& cntBands) const;
+
+    // Score the position with the template correlated in the row-major order. A flat window
+    // scores 0, like in matchTemplate.
+    double ScoreExactly(
+        const cv::Mat& srcImg,
+        const cv::Point& position,
+        const double denominator) const;
+
+    // Rescore the positions exactly and take the first maximum in the row-major order.
+    void RescoreCandidates(
+        const cv::Mat& srcImg,
+        const cv::Mat& sumImg,
+        const cv::Mat& sqSumImg,
+        const std::vector<cv::Point>& positions,
+        cv::Point& matchPoint,
+        double& maxScore) const;
+
+    // Score the guess and the neighborhood of the maximum of the downscaled matchTemplate.
+    void GuessBestPosition(
+        const cv::Mat& srcImg,
+        const cv::Mat& sumImg,
+        const cv::Mat& sqSumImg,
+        const BandWindows& windows,
+        const cv::Point& guess,
+        Workspace& workspace,
+        double& bestScore,
+        cv::Point& bestPosition) const;
+
+public:
+    // The template must have the type of the source images, i.e., CV_8U or CV_32F with
+    // at most 4 channels, and is split into bands of about bandHeight rows. The thinner
+    // the bands, the tighter their bounds, but the more of them to bound.
+    explicit PrunedTemplateMatcher(
+        const cv::Mat& templImg,
+        const int bandHeight = 5);
+
+    // Find the first maximum of TM_CCOEFF_NORMED of the template in srcImg. The guess, if
+    // it is a valid position, should be where the maximum is expected. Return false if
+    // srcImg is smaller than the template or of another type.
+    bool Match(
+        const cv::Mat& srcImg,
+        Workspace& workspace,
+        cv::Point& matchPoint,
+        double* maxScore = nullptr,
+        const cv::Point& guess = cv::Point(-1, -1),
+        PrunedMatchStats* stats = nullptr) const;
+
+    // Score the given positions in srcImg exactly like Match does its candidates, and find
+    // the first maximum in the row-major order, e.g., to check Match against the maxima of
+    // matchTemplate. Return false if a position is invalid or srcImg is not supported.
+    bool Rescore(
+        const cv::Mat& srcImg,
+        const std::vector<cv::Point>& positions,
+        Workspace& workspace,
+        cv::Point& matchPoint,
+        double& maxScore) const;
+};
+
+#endif /* INCLUDES_PRUNEDTEMPLATEMATCHER_H_ */
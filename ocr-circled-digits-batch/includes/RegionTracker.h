@@ -0,0 +1,59 @@
+/*
+ * RegionTracker.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_REGIONTRACKER_H_
+#define INCLUDES_REGIONTRACKER_H_
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Workspace.h"
+
+// Track a region, e.g., the circled digits of a book, across the frames of a fixed camera
+// in which it only translates by a small amount between consecutive frames.
+//
+// The region expanded by the search margin is cut out of the previous and the current
+// grayscale frames at the same place, and the shift between the two windows is found by
+// phase correlation, which costs two FFTs of the window instead of a full localization.
+// The track is lost once the correlation peak is too weak or the region leaves the frame.
+class RegionTracker
+{
+private:
+    int m_searchMargin;
+    double m_minResponse;
+    bool m_tracking;
+    cv::Rect m_rect;
+    cv::Mat m_prevGrayFrame;
+    cv::Mat m_hanningWindow;
+
+    void ToGray(
+        const cv::Mat& frame,
+        cv::Mat& grayFrame) const;
+
+public:
+    RegionTracker(
+        const int searchMargin = 32,
+        const double minResponse = 0.2);
+
+    // Start tracking the region of the frame.
+    void Start(
+        const cv::Mat& frame,
+        const cv::Rect& rect);
+
+    void Stop();
+
+    // Move the region to the next frame. Return false and stop if the track is lost.
+    bool Track(
+        const cv::Mat& frame,
+        Workspace& workspace);
+
+    bool IsTracking() const;
+
+    const cv::Rect& GetRect() const;
+};
+
+#endif /* INCLUDES_REGIONTRACKER_H_ */
@@ -0,0 +1,85 @@
+/*
+ * SeriesRouter.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_SERIESROUTER_H_
+#define INCLUDES_SERIESROUTER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/xfeatures2d.hpp>
+
+#include "Workspace.h"
+
+// Route a book cover to the most likely of many book series by its SURF descriptors.
+//
+// The descriptors of all the series titles are quantized into visual words by a
+// vocabulary tree built with hierarchical k-means, and each series is a TF-IDF
+// weighted histogram of its words kept in an inverted index. A cover descends the
+// tree with branchFactor comparisons per level and only touches the series sharing
+// its words, so the cost per cover grows with the depth of the tree and the number
+// of matching postings rather than with the number of series.
+class SeriesRouter
+{
+private:
+    struct VocabularyNode
+    {
+        cv::Mat centers;           // The centers of the children, one per row
+        std::vector<int> children; // The indices of the child nodes, empty for a leaf
+        int word;                  // The visual word of a leaf, or -1
+    };
+
+    // The weight of a word in the histogram of one series
+    struct Posting
+    {
+        int series;
+        float weight;
+    };
+
+    int m_branchFactor;
+    int m_maxDepth;
+    int m_maxKeyPoints;
+    std::vector<VocabularyNode> m_nodes;
+    std::vector<std::vector<Posting> > m_invertedIndex;
+    std::vector<float> m_idfs;
+    size_t m_cntSeries;
+
+    int BuildNode(
+        const cv::Mat& descriptors,
+        const int depth);
+
+    int Quantize(const float* descriptor) const;
+
+    // Compute the L2-normalized TF-IDF histogram of the descriptors as (word, weight).
+    void ComputeHistogram(
+        const cv::Mat& descriptors,
+        std::vector<std::pair<int, float> >& histogram,
+        Workspace& workspace) const;
+
+public:
+    SeriesRouter(
+        const std::vector<cv::Mat>& seriesDescriptors,
+        const int branchFactor = 8,
+        const int maxDepth = 4,
+        const int maxKeyPoints = 500);
+
+    size_t GetWordCount() const;
+
+    // Get the index of the series of the cover, or -1 if none of its words is known.
+    // score is the cosine similarity of the histograms in [0, 1].
+    int Route(
+        const cv::Mat& bookCoverImg,
+        Workspace& workspace,
+        double& score) const;
+};
+
+#endif /* INCLUDES_SERIESROUTER_H_ */
@@ -0,0 +1,78 @@
+/*
+ * TemplateBank.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_TEMPLATEBANK_H_
+#define INCLUDES_TEMPLATEBANK_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Workspace.h"
+
+// The digit templates of the same size, matched against an image in one pass.
+//
+// For every row of the results, each row of the image under the templates is
+// correlated with the corresponding row of all the templates before moving on, and
+// the image pixels of a block of results are loaded once per template column for all
+// the templates, so the image is streamed once for the whole bank instead of once per
+// template. The correlation kernel is specialized at compile time for the common
+// template widths and compiled for AVX-512, AVX2 and SSE4.1. The kernel matching the
+// template width and the CPU is selected when the bank is built, with a generic one
+// as the fallback.
+//
+// The scores are TM_CCOEFF_NORMED as computed by matchTemplate, but in integer
+// arithmetic up to the final normalization.
+class TemplateBank
+{
+private:
+    // Accumulate the correlations of one image row with one row of the given templates.
+    typedef void (*CorrelateRowFunc)(
+        const uchar* imgRow,
+        const int* templRows,
+        const int* templIndices,
+        const int cntTempls,
+        const int templCols,
+        const int resCols,
+        int* correlations);
+
+    cv::Size m_templSize;
+    int m_cntTempls;
+
+    // The template pixels ordered by row and then by template, so that one row of
+    // all the templates is contiguous.
+    std::vector<int> m_templPixels;
+    std::vector<double> m_templSums;
+    std::vector<double> m_templNorms;
+
+    CorrelateRowFunc m_correlateRow;
+    std::string m_kernelName;
+
+public:
+    // All the templates must be CV_8UC1 of the same size. Otherwise the bank is invalid.
+    TemplateBank(const std::vector<cv::Mat>& templImgs);
+
+    bool IsValid() const;
+
+    cv::Size GetTemplateSize() const;
+
+    // The instruction set and the template width of the selected kernel, e.g., "avx2/w32".
+    const std::string& GetKernelName() const;
+
+    // Get the maximum score of each given template over the CV_8UC1 image, which must
+    // not be smaller than the templates. maxScores[i] is the score of templIndices[i].
+    bool MatchAll(
+        const cv::Mat& img,
+        const std::vector<int>& templIndices,
+        std::vector<double>& maxScores,
+        Workspace& workspace) const;
+};
+
+#endif /* INCLUDES_TEMPLATEBANK_H_ */
@@ -0,0 +1,75 @@
+/*
+ * TemplateBankFile.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_TEMPLATEBANKFILE_H_
+#define INCLUDES_TEMPLATEBANKFILE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+#include "OcrPreprocessor.h"
+
+// A precompiled bank of the grayscale digit templates and the title data, so that
+// the batch tool doesn't decode the template images and compute the title keypoints
+// and Sobel derivative at every launch.
+//
+// The file starts with a header (magic, version and section count) and a table of
+// sections, each of which is a named matrix at a 64-byte aligned offset:
+//   "sources"        The title image file, the template directory and the size and
+//                    mtime of each source file, as text.
+//   "title"          The sharpened title image.
+//   "titleSobel"     Its float32 Sobel derivative.
+//   "titleKeyPoints" The keypoints as rows of (x, y, size, angle, response, octave, class_id).
+//   "titleDesc"      The descriptors.
+//   "templ:<digits>" One grayscale template, in the order of the file names.
+// The file is mapped read only, and the loaded images are headers pointing into the
+// mapping, so they are valid only as long as the TemplateBankFile is alive.
+class TemplateBankFile
+{
+private:
+    void* m_mapping;
+    size_t m_mappingSize;
+
+    TitleFeatures m_titleFeatures;
+    std::vector<std::pair<std::string, cv::Mat> > m_templDigitImgPairs;
+
+    TemplateBankFile(const TemplateBankFile&) = delete;
+    TemplateBankFile& operator=(const TemplateBankFile&) = delete;
+
+    // Check that the source files recorded in the bank haven't changed since it was built.
+    static bool CheckSources(const std::string& sources);
+
+    void Unmap();
+
+public:
+    TemplateBankFile();
+
+    ~TemplateBankFile();
+
+    // Write the bank of the given title image and templates, which were loaded from
+    // titleImgFile and templImgFiles in templImgDir.
+    static bool Build(
+        const std::string& bankFile,
+        const std::string& titleImgFile,
+        const cv::Mat& titleImg,
+        const std::string& templImgDir,
+        const std::vector<std::string>& templImgFiles,
+        const std::vector<std::pair<std::string, cv::Mat> >& templDigitImgPairs);
+
+    // Map the bank. Fail if it is corrupted, of another version, or out of date.
+    bool Load(const std::string& bankFile);
+
+    const TitleFeatures& GetTitleFeatures() const;
+
+    const std::vector<std::pair<std::string, cv::Mat> >& GetTemplDigitImgPairs() const;
+};
+
+#endif /* INCLUDES_TEMPLATEBANKFILE_H_ */
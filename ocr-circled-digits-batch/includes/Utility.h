@@ -26,7 +26,8 @@
 class Utility
 {
 public:
-    static int GetDirFiles(const std::string& dir, std::vector<std::string>& files);
+    // Get the names (not the paths) of the subdirectories in the given directory.
+    static int GetSubDirs(const std::string& dir, std::vector<std::string>& subDirs);
 
     static void SegmentFullFilename(
         const std::string& fullFilename,
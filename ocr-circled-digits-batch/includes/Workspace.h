@@ -0,0 +1,94 @@
+/*
+ * Workspace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#ifndef INCLUDES_WORKSPACE_H_
+#define INCLUDES_WORKSPACE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+// The reusable buffers of one worker. OcrPreprocessor and CircledDigitsOCRer take
+// the intermediate images and vectors from the workspace instead of allocating them
+// for each image. Each buffer keeps the largest size seen so far, and a request for
+// a smaller size returns a continuous header of exactly that size over the start of the
+// buffer, so that the buffers are only grown by the larger images. The header is not a
+// region of a larger image, so the border handling of OpenCV never reads the stale
+// pixels of an earlier image around it. The allocation count counts the growth of the
+// workspace buffers only: OpenCV still allocates its own temporaries inside the
+// functions, e.g., in matchTemplate and detectAndCompute, which aren't counted.
+//
+// A workspace must not be shared by the concurrent workers, and the images returned
+// by the APIs taking a workspace are only valid until the workspace is used again.
+// The buffer names are kept short so that they don't allocate as std::string keys.
+class Workspace
+{
+private:
+    std::map<std::string, cv::Mat> m_mats;
+    std::map<std::string, std::vector<int> > m_intVectors;
+    std::map<std::string, std::vector<double> > m_doubleVectors;
+    std::map<std::string, std::vector<cv::KeyPoint> > m_keyPointVectors;
+    std::map<std::string, std::vector<cv::DMatch> > m_matchVectors;
+    std::map<std::string, std::vector<cv::Point2f> > m_pointVectors;
+    std::map<std::string, std::vector<cv::Vec3f> > m_circleVectors;
+
+    // The workspaces of the parallel tasks of the worker, e.g., the tiles.
+    std::vector<std::unique_ptr<Workspace> > m_children;
+
+    // The capacities of the vectors when they were handed out last time.
+    std::map<const void*, size_t> m_vectorCapacities;
+
+    size_t m_cntMatAllocations;
+    size_t m_cntVectorAllocations;
+
+    template<typename T>
+    std::vector<T>& GetVector(
+        std::map<std::string, std::vector<T> >& vectors,
+        const std::string& name);
+
+    template<typename T>
+    size_t CountVectorAllocations(const std::map<std::string, std::vector<T> >& vectors) const;
+
+public:
+    Workspace();
+
+    // Get the named buffer of the given size and type as a continuous image, which shares
+    // the buffer. Its content is undefined.
+    cv::Mat GetMat(
+        const std::string& name,
+        const cv::Size& size,
+        const int type);
+
+    // Adopt the buffer which an OpenCV function has (re)allocated for the named output,
+    // e.g., the descriptors whose number isn't known in advance.
+    void AdoptMat(
+        const std::string& name,
+        const cv::Mat& mat);
+
+    // Get the named vector, which is cleared but keeps its capacity.
+    std::vector<int>& GetIntVector(const std::string& name);
+    std::vector<double>& GetDoubleVector(const std::string& name);
+    std::vector<cv::KeyPoint>& GetKeyPointVector(const std::string& name);
+    std::vector<cv::DMatch>& GetMatchVector(const std::string& name);
+    std::vector<cv::Point2f>& GetPointVector(const std::string& name);
+    std::vector<cv::Vec3f>& GetCircleVector(const std::string& name);
+
+    // Get the workspace of the index-th parallel task of the worker, which keeps its
+    // buffers like the workspace itself. The children must be got before the tasks start.
+    Workspace& GetChild(const size_t index);
+
+    // The number of times a buffer of the workspace or of its children had to be allocated
+    // or grown, which stays the same once the largest image has been processed.
+    size_t GetAllocationCount() const;
+};
+
+#endif /* INCLUDES_WORKSPACE_H_ */
@@ -5,6 +5,9 @@
  *      Author: renwei
  */
 
+#include <cmath>
+#include <algorithm>
+
 #include "CircledDigitsOCRer.h"
 
 using namespace std;
@@ -12,31 +15,294 @@ using namespace cv;
 
 // We assume that the pixel data type of the template images is CV_8UC1.
 CircledDigitsOCRer::CircledDigitsOCRer(const vector<pair<string, Mat> >& templDigitImgPairs) :
-    m_templDigitImgPairs(templDigitImgPairs)
+    m_templDigitImgPairs(templDigitImgPairs),
+    m_templBank(GetTemplImgs(templDigitImgPairs)),
+    m_useTemplBank(false),
+    m_topK(0),
+    m_verifyTopK(false),
+    m_cntVerified(0),
+    m_cntRecalled(0)
 {
+}
 
+vector<Mat> CircledDigitsOCRer::GetTemplImgs(const vector<pair<string, Mat> >& templDigitImgPairs)
+{
+    vector<Mat> templImgs;
+    for (const auto& templDigitImgPair: templDigitImgPairs)
+    {
+        templImgs.push_back(templDigitImgPair.second);
+    }
+
+    return templImgs;
+}
+
+bool CircledDigitsOCRer::SetTemplateBank(const bool enable)
+{
+    if (enable && !m_templBank.IsValid())
+    {
+        printf("[ERROR]: The digit templates can't be matched in one pass, since they are not of the same size.\n\n");
+        return false;
+    }
+
+    m_useTemplBank = enable;
+    if (m_useTemplBank)
+    {
+        printf("[INFO]: Match the %ld digit templates of %dx%d in one pass with kernel %s.\n",
+            m_templDigitImgPairs.size(), m_templBank.GetTemplateSize().width, m_templBank.GetTemplateSize().height,
+            m_templBank.GetKernelName().c_str());
+    }
+
+    return true;
+}
+
+void CircledDigitsOCRer::SetPrefilter(
+    const size_t topK,
+    const bool verify)
+{
+    m_topK = topK;
+    m_verifyTopK = verify;
+    if ((m_topK == 0) || !m_templSignatures.empty())
+    {
+        return;
+    }
+
+    Workspace workspace;
+    m_templSignatures.resize(m_templDigitImgPairs.size());
+    for (size_t templIndex = 0; templIndex < m_templDigitImgPairs.size(); ++templIndex)
+    {
+        ComputeSignature(m_templDigitImgPairs[templIndex].second, m_templSignatures[templIndex], workspace);
+    }
+}
+
+size_t CircledDigitsOCRer::GetVerifiedCount() const
+{
+    return m_cntVerified;
+}
+
+size_t CircledDigitsOCRer::GetRecalledCount() const
+{
+    return m_cntRecalled;
+}
+
+void CircledDigitsOCRer::ComputeSignature(
+    const Mat& img,
+    DigitSignature& signature,
+    Workspace& workspace)
+{
+    // The ink is the minority of the black-white pixels, so that the templates of
+    // either polarity can be compared with the thresholded images.
+    Mat inkImg = workspace.GetMat("sigInk", img.size(), CV_8UC1);
+    threshold(img, inkImg, 127, 255, THRESH_BINARY);
+    if (2*countNonZero(inkImg) > img.rows*img.cols)
+    {
+        threshold(img, inkImg, 127, 255, THRESH_BINARY_INV);
+    }
+
+    signature = DigitSignature();
+    const Rect inkRect = boundingRect(inkImg);
+    if (inkRect.empty())
+    {
+        return;
+    }
+
+    // Resample the ink bounding box, so that the margins and the size of the image
+    // don't change the signature.
+    Mat normImg = workspace.GetMat("sigNorm", Size(signatureSide, signatureSide), CV_8UC1);
+    resize(inkImg(inkRect), normImg, normImg.size(), 0, 0, INTER_AREA);
+    threshold(normImg, normImg, 127, 1, THRESH_BINARY);
+
+    const int inkCount = countNonZero(normImg);
+    if (inkCount == 0)
+    {
+        return;
+    }
+
+    // The projection profiles and the ink grid, normalized by the ink count.
+    Mat rowInk = workspace.GetMat("sigRows", Size(1, signatureSide), CV_32SC1);
+    Mat colInk = workspace.GetMat("sigCols", Size(signatureSide, 1), CV_32SC1);
+    reduce(normImg, rowInk, 1, REDUCE_SUM, CV_32S);
+    reduce(normImg, colInk, 0, REDUCE_SUM, CV_32S);
+
+    ComputeProfile(rowInk, inkCount, signature.rowProfile);
+    ComputeProfile(colInk, inkCount, signature.colProfile);
+
+    for (int row = 0; row < signatureSide; ++row)
+    {
+        const uchar* normRow = normImg.ptr<uchar>(row);
+        double* gridRow = signature.inkGrid + (row*gridSide/signatureSide)*gridSide;
+        for (int col = 0; col < signatureSide; ++col)
+        {
+            gridRow[col*gridSide/signatureSide] += normRow[col];
+        }
+    }
+
+    for (int cell = 0; cell < gridSide*gridSide; ++cell)
+    {
+        signature.inkGrid[cell] /= inkCount;
+    }
+}
+
+void CircledDigitsOCRer::ComputeProfile(
+    const Mat& lineInk,
+    const double inkCount,
+    double* profile)
+{
+    fill(profile, profile + cntProfileBins, 0.0);
+
+    const int len = static_cast<int>(lineInk.total());
+    int first = 0;
+    while ((first < len) && (lineInk.at<int>(first) == 0))
+    {
+        ++first;
+    }
+
+    int last = len - 1;
+    while ((last > first) && (lineInk.at<int>(last) == 0))
+    {
+        --last;
+    }
+
+    if ((first > last) || (inkCount <= 0))
+    {
+        return;
+    }
+
+    for (int index = first; index <= last; ++index)
+    {
+        const int bin = (index - first)*cntProfileBins/(last - first + 1);
+        profile[bin] += lineInk.at<int>(index)/inkCount;
+    }
+}
+
+double CircledDigitsOCRer::GetSignatureDistance(
+    const DigitSignature& signature1,
+    const DigitSignature& signature2)
+{
+    // Both terms are at most 2, i.e., of the order of 1 for the different digits. The
+    // ink count and the Hu moments aren't compared, since they change a lot with the
+    // stroke width of the thresholded images.
+    double distance = 0.0;
+    for (int bin = 0; bin < cntProfileBins; ++bin)
+    {
+        distance += (fabs(signature1.rowProfile[bin] - signature2.rowProfile[bin]) +
+            fabs(signature1.colProfile[bin] - signature2.colProfile[bin]))/2.0;
+    }
+
+    for (int cell = 0; cell < gridSide*gridSide; ++cell)
+    {
+        distance += fabs(signature1.inkGrid[cell] - signature2.inkGrid[cell]);
+    }
+
+    return distance;
+}
+
+void CircledDigitsOCRer::SelectCandidates(
+    const Mat& circledDigitsImg,
+    vector<int>& candidates,
+    Workspace& workspace) const
+{
+    candidates.resize(m_templDigitImgPairs.size());
+    for (size_t templIndex = 0; templIndex < candidates.size(); ++templIndex)
+    {
+        candidates[templIndex] = static_cast<int>(templIndex);
+    }
+
+    if ((m_topK == 0) || (m_topK >= candidates.size()))
+    {
+        return;
+    }
+
+    DigitSignature signature;
+    ComputeSignature(circledDigitsImg, signature, workspace);
+
+    vector<double>& distances = workspace.GetDoubleVector("sigDists");
+    for (const auto& templSignature: m_templSignatures)
+    {
+        distances.push_back(GetSignatureDistance(signature, templSignature));
+    }
+
+    partial_sort(candidates.begin(), candidates.begin() + m_topK, candidates.end(),
+        [&distances](const int templIndex1, const int templIndex2)
+        {
+            return distances[templIndex1] < distances[templIndex2];
+        });
+
+    // Keep the candidates in the order of the templates, so that the ties are resolved
+    // the same way as without the pre-filter.
+    candidates.resize(m_topK);
+    sort(candidates.begin(), candidates.end());
 }
 
-// We also assume that the pixel data type of the input image is CV_8UC1, too.
 void CircledDigitsOCRer::OCR(
     const Mat& circledDigitsImg,
     OcrResult& res)
+{
+    Workspace workspace;
+    OCR(circledDigitsImg, res, workspace);
+}
+
+// We also assume that the pixel data type of the input image is CV_8UC1, too.
+void CircledDigitsOCRer::OCR(
+    const Mat& circledDigitsImg,
+    OcrResult& res,
+    Workspace& workspace) const
 {
     res.evaluatedDigits.clear();
     res.digits2MatchResMap.clear();
 
     double maxDigitMatchVal = -1.0;
-    for (const auto& templDigitImgPair: m_templDigitImgPairs)
+
+    vector<int>& candidates = workspace.GetIntVector("digitCands");
+    SelectCandidates(circledDigitsImg, candidates, workspace);
+
+    if (candidates.size() < m_templDigitImgPairs.size())
     {
-        string digits = templDigitImgPair.first;
-        Mat templImg = templDigitImgPair.second;
+        for (const auto& templDigitImgPair: m_templDigitImgPairs)
+        {
+            res.digits2MatchResMap[templDigitImgPair.first] = prunedMatchRes;
+        }
+    }
 
-        Mat matchRes;
+    vector<double>& maxVals = workspace.GetDoubleVector("digitMaxVals");
+    MatchTemplates(circledDigitsImg, candidates, maxVals, workspace);
+    for (size_t candIndex = 0; candIndex < candidates.size(); ++candIndex)
+    {
+        const string& digits = m_templDigitImgPairs[candidates[candIndex]].first;
+        res.digits2MatchResMap[digits] = maxVals[candIndex];
+
+        if (maxDigitMatchVal < maxVals[candIndex])
+        {
+            maxDigitMatchVal = maxVals[candIndex];
+            res.evaluatedDigits = digits;
+        }
+    }
+
+    if (m_verifyTopK && (candidates.size() < m_templDigitImgPairs.size()))
+    {
+        VerifyCandidates(circledDigitsImg, candidates, workspace);
+    }
+}
+
+void CircledDigitsOCRer::MatchTemplates(
+    const Mat& circledDigitsImg,
+    const vector<int>& templIndices,
+    vector<double>& maxVals,
+    Workspace& workspace) const
+{
+    if (m_useTemplBank && m_templBank.MatchAll(circledDigitsImg, templIndices, maxVals, workspace))
+    {
+        return;
+    }
+
+    maxVals.clear();
+    for (const auto templIndex: templIndices)
+    {
+        const Mat& templImg = m_templDigitImgPairs[templIndex].second;
 
         const int matchResRows = circledDigitsImg.rows - templImg.rows + 1;
         const int matchResCols =  circledDigitsImg.cols - templImg.cols + 1;
 
-        matchRes.create(matchResRows, matchResCols, CV_32FC1);
+        Mat matchRes = workspace.GetMat("digitRes", Size(matchResCols, matchResRows), CV_32FC1);
 
         matchTemplate(circledDigitsImg, templImg, matchRes, TM_CCOEFF_NORMED);
 
@@ -44,12 +310,35 @@ void CircledDigitsOCRer::OCR(
         double maxVal = -1.0;
         minMaxLoc(matchRes, nullptr, &maxVal, nullptr, nullptr);
 
-        res.digits2MatchResMap.insert(make_pair(digits, maxVal));
+        maxVals.push_back(maxVal);
+    }
+}
 
-        if (maxDigitMatchVal < maxVal)
-        {
-            maxDigitMatchVal = maxVal;
-            res.evaluatedDigits = digits;
-        }
+void CircledDigitsOCRer::VerifyCandidates(
+    const Mat& circledDigitsImg,
+    const vector<int>& candidates,
+    Workspace& workspace) const
+{
+    vector<int>& templIndices = workspace.GetIntVector("digitAll");
+    for (size_t templIndex = 0; templIndex < m_templDigitImgPairs.size(); ++templIndex)
+    {
+        templIndices.push_back(static_cast<int>(templIndex));
+    }
+
+    vector<double>& maxVals = workspace.GetDoubleVector("digitAllVals");
+    MatchTemplates(circledDigitsImg, templIndices, maxVals, workspace);
+
+    // The first maximum wins, as in OCR.
+    const int bestTemplIndex = static_cast<int>(max_element(maxVals.begin(), maxVals.end()) - maxVals.begin());
+
+    ++m_cntVerified;
+    if (binary_search(candidates.begin(), candidates.end(), bestTemplIndex))
+    {
+        ++m_cntRecalled;
+    }
+    else
+    {
+        printf("[INFO]: The best digit template %s with score %f is not among the top %ld by signature.\n",
+            m_templDigitImgPairs[bestTemplIndex].first.c_str(), maxVals[bestTemplIndex], m_topK);
     }
 }
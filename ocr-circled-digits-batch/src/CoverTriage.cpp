@@ -0,0 +1,182 @@
+/*
+ * CoverTriage.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "CoverTriage.h"
+
+using namespace std;
+using namespace cv;
+
+// The titles smaller than this on the thumbnail are too coarse to be matched.
+static const int minThumbTitleSide = 8;
+
+CoverTriage::CoverTriage(
+    const TriageThresholds& thresholds,
+    const vector<Mat>& titleImgs,
+    const int thumbMaxSide) :
+    m_thresholds(thresholds),
+    m_thumbMaxSide(max(thumbMaxSide, 16))
+{
+    for (const auto& titleImg: titleImgs)
+    {
+        if (titleImg.empty())
+        {
+            continue;
+        }
+
+        Mat grayTitleImg;
+        if (titleImg.channels() == 1)
+        {
+            grayTitleImg = titleImg;
+        }
+        else
+        {
+            cvtColor(titleImg, grayTitleImg, COLOR_BGR2GRAY);
+        }
+
+        m_grayTitleImgs.push_back(grayTitleImg);
+    }
+}
+
+bool CoverTriage::Check(
+    const Mat& img,
+    Workspace& workspace,
+    TriageReport& report) const
+{
+    report = TriageReport();
+
+    char reason[128];
+    report.aspectRatio = static_cast<double>(img.cols)/max(img.rows, 1);
+    if (((m_thresholds.minAspectRatio >= 0.0) && (report.aspectRatio < m_thresholds.minAspectRatio)) ||
+        ((m_thresholds.maxAspectRatio >= 0.0) && (report.aspectRatio > m_thresholds.maxAspectRatio)))
+    {
+        snprintf(reason, sizeof(reason), "aspect ratio %.2f outside [%.2f, %.2f]",
+            report.aspectRatio, m_thresholds.minAspectRatio, m_thresholds.maxAspectRatio);
+        report.reason = reason;
+        report.passed = false;
+        return false;
+    }
+
+    // Downsample the gray image to the thumbnail.
+    const double scale = min(1.0, static_cast<double>(m_thumbMaxSide)/max(img.cols, img.rows));
+    const Size thumbSize(max(cvRound(img.cols*scale), 1), max(cvRound(img.rows*scale), 1));
+    Mat thumbImg = workspace.GetMat("triageThumb", thumbSize, img.type());
+    resize(img, thumbImg, thumbSize, 0, 0, INTER_AREA);
+
+    Mat grayThumbImg = thumbImg;
+    if (img.channels() != 1)
+    {
+        grayThumbImg = workspace.GetMat("triageGray", thumbSize, CV_8UC1);
+        cvtColor(thumbImg, grayThumbImg, COLOR_BGR2GRAY);
+    }
+
+    // The standard deviation and the entropy of the gray levels.
+    int histogram[256] = {0};
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for (int row = 0; row < grayThumbImg.rows; ++row)
+    {
+        const uchar* pixel = grayThumbImg.ptr<uchar>(row);
+        for (int col = 0; col < grayThumbImg.cols; ++col)
+        {
+            ++histogram[pixel[col]];
+            sum += pixel[col];
+            sumSquares += static_cast<double>(pixel[col])*pixel[col];
+        }
+    }
+
+    const double cntPixels = static_cast<double>(grayThumbImg.total());
+    const double mean = sum/cntPixels;
+    report.stdDev = sqrt(max(sumSquares/cntPixels - mean*mean, 0.0));
+
+    for (const int count: histogram)
+    {
+        if (count > 0)
+        {
+            const double p = count/cntPixels;
+            report.entropy -= p*log2(p);
+        }
+    }
+
+    if ((m_thresholds.minStdDev >= 0.0) && (report.stdDev < m_thresholds.minStdDev))
+    {
+        snprintf(reason, sizeof(reason), "blank (gray level deviation %.2f < %.2f)", report.stdDev, m_thresholds.minStdDev);
+        report.reason = reason;
+        report.passed = false;
+        return false;
+    }
+
+    if ((m_thresholds.minEntropy >= 0.0) && (report.entropy < m_thresholds.minEntropy))
+    {
+        snprintf(reason, sizeof(reason), "badly exposed (entropy %.2f < %.2f bits)", report.entropy, m_thresholds.minEntropy);
+        report.reason = reason;
+        report.passed = false;
+        return false;
+    }
+
+    // The density of the Canny edges.
+    Mat edgeImg = workspace.GetMat("triageEdges", thumbSize, CV_8UC1);
+    Canny(grayThumbImg, edgeImg, 50, 150);
+    report.edgeDensity = countNonZero(edgeImg)/cntPixels;
+
+    if ((m_thresholds.minEdgeDensity >= 0.0) && (report.edgeDensity < m_thresholds.minEdgeDensity))
+    {
+        snprintf(reason, sizeof(reason), "featureless (edge density %.4f < %.4f)", report.edgeDensity, m_thresholds.minEdgeDensity);
+        report.reason = reason;
+        report.passed = false;
+        return false;
+    }
+
+    // Match the titles scaled like the thumbnail, and keep the best score.
+    if ((m_thresholds.minTitleScore < 0.0) || m_grayTitleImgs.empty())
+    {
+        return true;
+    }
+
+    bool titleChecked = false;
+    double bestTitleScore = -1.0;
+    for (const auto& grayTitleImg: m_grayTitleImgs)
+    {
+        const Size titleThumbSize(cvRound(grayTitleImg.cols*scale), cvRound(grayTitleImg.rows*scale));
+        if ((titleThumbSize.width < minThumbTitleSide) || (titleThumbSize.height < minThumbTitleSide) ||
+            (titleThumbSize.width > thumbSize.width) || (titleThumbSize.height > thumbSize.height))
+        {
+            continue;
+        }
+
+        Mat titleThumbImg = workspace.GetMat("triageTitle", titleThumbSize, CV_8UC1);
+        resize(grayTitleImg, titleThumbImg, titleThumbSize, 0, 0, INTER_AREA);
+
+        Mat scoreImg = workspace.GetMat("triageScores",
+            Size(thumbSize.width - titleThumbSize.width + 1, thumbSize.height - titleThumbSize.height + 1), CV_32FC1);
+        matchTemplate(grayThumbImg, titleThumbImg, scoreImg, TM_CCOEFF_NORMED);
+
+        double maxScore = -1.0;
+        minMaxLoc(scoreImg, nullptr, &maxScore);
+        bestTitleScore = max(bestTitleScore, maxScore);
+        titleChecked = true;
+    }
+
+    if (!titleChecked)
+    {
+        return true;
+    }
+
+    report.titleScore = bestTitleScore;
+    if (report.titleScore < m_thresholds.minTitleScore)
+    {
+        snprintf(reason, sizeof(reason), "no title (score %.2f < %.2f)", report.titleScore, m_thresholds.minTitleScore);
+        report.reason = reason;
+        report.passed = false;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,27 @@
+/*
+ * Deadline.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include "Deadline.h"
+
+using namespace cv;
+
+Deadline::Deadline(const double budgetMs) :
+    m_startTick(getTickCount()),
+    m_budgetMs(budgetMs)
+{
+
+}
+
+double Deadline::ElapsedMs() const
+{
+    return (getTickCount() - m_startTick)*1000.0/getTickFrequency();
+}
+
+bool Deadline::Expired() const
+{
+    return (m_budgetMs > 0.0) && (ElapsedMs() > m_budgetMs);
+}
@@ -0,0 +1,156 @@
+/*
+ * DirWatcher.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include "DirWatcher.h"
+
+using namespace std;
+
+DirWatcher::DirWatcher() :
+    m_inotifyFd(-1),
+    m_watchDescriptor(-1)
+{
+}
+
+DirWatcher::~DirWatcher()
+{
+    if (m_inotifyFd >= 0)
+    {
+        close(m_inotifyFd);
+    }
+}
+
+bool DirWatcher::Open(const string& dir)
+{
+    m_dir = dir;
+    if (m_dir.back() != '/')
+    {
+        m_dir.push_back('/');
+    }
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0)
+    {
+        printf("[ERROR]: inotify_init1(%s).\n\n", strerror(errno));
+        return false;
+    }
+
+    // The files written in place are complete once closed, and the files written
+    // elsewhere and renamed into the directory are complete once moved.
+    m_watchDescriptor = inotify_add_watch(m_inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (m_watchDescriptor < 0)
+    {
+        printf("[ERROR]: inotify_add_watch(%s) for %s.\n\n", strerror(errno), dir.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool DirWatcher::ReadEvents(vector<string>& files)
+{
+    alignas(struct inotify_event) char buffer[16*1024];
+    while (true)
+    {
+        const ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                return true;
+            }
+
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("[ERROR]: read(%s) for the inotify events of %s.\n\n", strerror(errno), m_dir.c_str());
+            return false;
+        }
+
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if ((event->mask & IN_Q_OVERFLOW) != 0)
+            {
+                printf("[ERROR]: The inotify queue of %s overflowed and some new files are missed.\n\n", m_dir.c_str());
+                continue;
+            }
+
+            // Skip the directories and the hidden files, e.g., partial downloads.
+            if (((event->mask & IN_ISDIR) != 0) || (event->len == 0) || (event->name[0] == '.'))
+            {
+                continue;
+            }
+
+            // A file may be closed several times in one burst.
+            const string file = m_dir + event->name;
+            if (find(files.begin(), files.end(), file) == files.end())
+            {
+                files.push_back(file);
+            }
+        }
+    }
+}
+
+bool DirWatcher::WaitForFiles(
+    vector<string>& files,
+    const int timeoutMs,
+    const int debounceMs,
+    const size_t maxBatchSize)
+{
+    files.clear();
+
+    struct pollfd pollFd;
+    pollFd.fd = m_inotifyFd;
+    pollFd.events = POLLIN;
+
+    int waitMs = timeoutMs;
+    while (files.size() < max(maxBatchSize, static_cast<size_t>(1)))
+    {
+        pollFd.revents = 0;
+        const int ready = poll(&pollFd, 1, waitMs);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                return true;
+            }
+
+            printf("[ERROR]: poll(%s) for the inotify events of %s.\n\n", strerror(errno), m_dir.c_str());
+            return false;
+        }
+
+        // Timed out, either before any file or at the end of a burst.
+        if (ready == 0)
+        {
+            return true;
+        }
+
+        if (!ReadEvents(files))
+        {
+            return false;
+        }
+
+        if (!files.empty())
+        {
+            waitMs = debounceMs;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,173 @@
+/*
+ * DuplicateIndex.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cstdlib>
+#include <algorithm>
+
+#include "DuplicateIndex.h"
+
+using namespace std;
+using namespace cv;
+
+// The size of the downsample and of its lowest DCT frequencies in the hash.
+static const int hashImgSide = 32;
+static const int hashFreqSide = 8;
+
+DuplicateIndex::DuplicateIndex(const int maxDistance) :
+    m_maxDistance(max(maxDistance, 0))
+{
+}
+
+int DuplicateIndex::GetMaxDistance() const
+{
+    return m_maxDistance;
+}
+
+uint64_t DuplicateIndex::ComputeHash(
+    const Mat& img,
+    Workspace& workspace)
+{
+    Mat grayImg = img;
+    if (img.channels() != 1)
+    {
+        grayImg = workspace.GetMat("hashGray", img.size(), CV_8UC1);
+        cvtColor(img, grayImg, COLOR_BGR2GRAY);
+    }
+
+    Mat smallImg = workspace.GetMat("hashSmall", Size(hashImgSide, hashImgSide), CV_8UC1);
+    resize(grayImg, smallImg, smallImg.size(), 0, 0, INTER_AREA);
+
+    Mat floatImg = workspace.GetMat("hashFloat", smallImg.size(), CV_32FC1);
+    smallImg.convertTo(floatImg, CV_32F);
+
+    Mat dctImg = workspace.GetMat("hashDct", smallImg.size(), CV_32FC1);
+    dct(floatImg, dctImg);
+
+    // Skip the DC term, which only holds the mean brightness.
+    float freqs[hashFreqSide*hashFreqSide];
+    for (int row = 0; row < hashFreqSide; ++row)
+    {
+        const float* dctRow = dctImg.ptr<float>(row);
+        for (int col = 0; col < hashFreqSide; ++col)
+        {
+            freqs[row*hashFreqSide + col] = dctRow[col];
+        }
+    }
+
+    const int cntFreqs = hashFreqSide*hashFreqSide - 1;
+    float sortedFreqs[hashFreqSide*hashFreqSide - 1];
+    copy(freqs + 1, freqs + 1 + cntFreqs, sortedFreqs);
+    nth_element(sortedFreqs, sortedFreqs + cntFreqs/2, sortedFreqs + cntFreqs);
+    const float median = sortedFreqs[cntFreqs/2];
+
+    uint64_t hash = 0;
+    for (int freqIndex = 1; freqIndex <= cntFreqs; ++freqIndex)
+    {
+        if (freqs[freqIndex] > median)
+        {
+            hash |= (static_cast<uint64_t>(1) << freqIndex);
+        }
+    }
+
+    return hash;
+}
+
+int DuplicateIndex::HammingDistance(
+    const uint64_t lhs,
+    const uint64_t rhs)
+{
+    return __builtin_popcountll(lhs ^ rhs);
+}
+
+bool DuplicateIndex::Find(
+    const uint64_t hash,
+    DuplicateEntry& entry,
+    int& distance) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    if (m_nodes.empty())
+    {
+        return false;
+    }
+
+    // Search the subtrees whose distance to their parent is within the best distance so far
+    // of the distance between the hash and the parent.
+    int bestDistance = m_maxDistance + 1;
+    size_t bestEntryIndex = 0;
+    vector<size_t> pendingNodes(1, 0);
+    while (!pendingNodes.empty())
+    {
+        const Node& node = m_nodes[pendingNodes.back()];
+        pendingNodes.pop_back();
+
+        const int nodeDistance = HammingDistance(hash, node.hash);
+        if (nodeDistance < bestDistance)
+        {
+            bestDistance = nodeDistance;
+            bestEntryIndex = node.entryIndex;
+        }
+
+        const int radius = min(bestDistance, m_maxDistance);
+        for (const auto& child: node.children)
+        {
+            if (abs(child.first - nodeDistance) <= radius)
+            {
+                pendingNodes.push_back(child.second);
+            }
+        }
+    }
+
+    if (bestDistance > m_maxDistance)
+    {
+        return false;
+    }
+
+    entry = m_entries[bestEntryIndex];
+    distance = bestDistance;
+    return true;
+}
+
+void DuplicateIndex::Insert(
+    const uint64_t hash,
+    const DuplicateEntry& entry)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    Node newNode;
+    newNode.hash = hash;
+    newNode.entryIndex = m_entries.size();
+
+    if (m_nodes.empty())
+    {
+        m_nodes.push_back(newNode);
+        m_entries.push_back(entry);
+        return;
+    }
+
+    size_t nodeIndex = 0;
+    while (true)
+    {
+        const int nodeDistance = HammingDistance(hash, m_nodes[nodeIndex].hash);
+        if (nodeDistance == 0)
+        {
+            return;
+        }
+
+        const auto& children = m_nodes[nodeIndex].children;
+        auto itChild = find_if(children.begin(), children.end(),
+            [nodeDistance](const pair<int, size_t>& child) { return child.first == nodeDistance; });
+        if (itChild == children.end())
+        {
+            m_nodes[nodeIndex].children.push_back(make_pair(nodeDistance, m_nodes.size()));
+            m_nodes.push_back(newNode);
+            m_entries.push_back(entry);
+            return;
+        }
+
+        nodeIndex = itChild->second;
+    }
+}
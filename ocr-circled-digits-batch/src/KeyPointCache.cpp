@@ -0,0 +1,258 @@
+/*
+ * KeyPointCache.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <functional>
+
+#include "KeyPointCache.h"
+
+using namespace std;
+using namespace cv;
+
+static const char cacheMagic[8] = {'O', 'C', 'R', 'K', 'P', 'C', 'H', '\0'};
+static const uint32_t cacheVersion = 1;
+static const size_t sectionAlignment = 64;
+static const int keyPointFields = 7;
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t key;
+    int32_t cntKeyPoints;
+    int32_t descriptorCols;
+    int32_t descriptorType;
+    int32_t reserved2;
+    uint64_t keyPointsOffset;
+    uint64_t descriptorsOffset;
+    uint64_t fileSize;
+};
+
+static uint64_t AlignOffset(const uint64_t offset)
+{
+    return (offset + sectionAlignment - 1)/sectionAlignment*sectionAlignment;
+}
+
+// Mix 8 bytes into the hash. The multiply and the shift spread every input bit over the
+// whole hash, which is enough to tell the covers apart, though not against an adversary.
+static inline uint64_t MixHash(
+    const uint64_t hash,
+    const uint64_t value)
+{
+    uint64_t mixed = (hash ^ value)*0x9E3779B97F4A7C15ull;
+    return mixed ^ (mixed >> 29);
+}
+
+static uint64_t HashBytes(
+    uint64_t hash,
+    const uchar* data,
+    const size_t size)
+{
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+        uint64_t value = 0;
+        memcpy(&value, data + offset, sizeof(value));
+        hash = MixHash(hash, value);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + offset, size - offset);
+    return MixHash(hash, tail ^ (static_cast<uint64_t>(size) << 56));
+}
+
+KeyPointCache::KeyPointCache(const string& cacheDir) :
+    m_cacheDir(cacheDir),
+    m_cntHits(0),
+    m_cntMisses(0)
+{
+}
+
+string KeyPointCache::GetEntryFile(const uint64_t key) const
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%016llx.kpc", static_cast<unsigned long long>(key));
+    return m_cacheDir + '/' + filename;
+}
+
+uint64_t KeyPointCache::ComputeKey(
+    const Mat& img,
+    const string& detectorParams)
+{
+    uint64_t hash = HashBytes(0xCBF29CE484222325ull,
+        reinterpret_cast<const uchar*>(detectorParams.data()), detectorParams.size());
+    hash = MixHash(hash, (static_cast<uint64_t>(img.rows) << 32) | static_cast<uint32_t>(img.cols));
+    hash = MixHash(hash, static_cast<uint64_t>(img.type()));
+
+    const size_t rowBytes = img.cols*img.elemSize();
+    for (int row = 0; row < img.rows; ++row)
+    {
+        hash = HashBytes(hash, img.ptr(row), rowBytes);
+    }
+
+    return hash;
+}
+
+bool KeyPointCache::Load(
+    const uint64_t key,
+    Workspace& workspace,
+    vector<KeyPoint>& keyPoints,
+    Mat& descriptors) const
+{
+    const string entryFile = GetEntryFile(key);
+    const int fd = open(entryFile.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        ++m_cntMisses;
+        return false;
+    }
+
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (static_cast<size_t>(info.st_size) < sizeof(CacheHeader)))
+    {
+        close(fd);
+        ++m_cntMisses;
+        return false;
+    }
+
+    const size_t mappingSize = info.st_size;
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        printf("[ERROR]: mmap(%s) for the keypoint cache entry %s.\n\n", strerror(errno), entryFile.c_str());
+        ++m_cntMisses;
+        return false;
+    }
+
+    const uchar* data = static_cast<const uchar*>(mapping);
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+    const uint64_t keyPointsBytes = static_cast<uint64_t>(max(header->cntKeyPoints, 0))*keyPointFields*sizeof(float);
+    const uint64_t descriptorsBytes = static_cast<uint64_t>(max(header->cntKeyPoints, 0))*
+        max(header->descriptorCols, 0)*CV_ELEM_SIZE(header->descriptorType);
+    if ((memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) != 0) || (header->version != cacheVersion) ||
+        (header->key != key) || (header->cntKeyPoints < 0) || (header->descriptorCols <= 0) ||
+        (header->fileSize != mappingSize) ||
+        (header->keyPointsOffset + keyPointsBytes > mappingSize) ||
+        (header->descriptorsOffset + descriptorsBytes > mappingSize))
+    {
+        printf("[ERROR]: The keypoint cache entry %s is corrupted and ignored.\n\n", entryFile.c_str());
+        munmap(mapping, mappingSize);
+        ++m_cntMisses;
+        return false;
+    }
+
+    keyPoints.clear();
+    const float* keyPointsData = reinterpret_cast<const float*>(data + header->keyPointsOffset);
+    for (int keyPointIndex = 0; keyPointIndex < header->cntKeyPoints; ++keyPointIndex)
+    {
+        const float* row = keyPointsData + keyPointIndex*keyPointFields;
+        keyPoints.push_back(KeyPoint(row[0], row[1], row[2], row[3], row[4],
+            static_cast<int>(row[5]), static_cast<int>(row[6])));
+    }
+
+    // Copy the descriptors into the workspace, so that the entry is unmapped right away.
+    descriptors = workspace.GetMat("cachedDesc", Size(header->descriptorCols, header->cntKeyPoints), header->descriptorType);
+    const size_t rowBytes = descriptors.cols*descriptors.elemSize();
+    for (int row = 0; row < descriptors.rows; ++row)
+    {
+        memcpy(descriptors.ptr(row), data + header->descriptorsOffset + row*rowBytes, rowBytes);
+    }
+
+    munmap(mapping, mappingSize);
+    ++m_cntHits;
+    return true;
+}
+
+bool KeyPointCache::Store(
+    const uint64_t key,
+    const vector<KeyPoint>& keyPoints,
+    const Mat& descriptors) const
+{
+    if ((descriptors.rows != static_cast<int>(keyPoints.size())) || (descriptors.cols <= 0))
+    {
+        return false;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.key = key;
+    header.cntKeyPoints = descriptors.rows;
+    header.descriptorCols = descriptors.cols;
+    header.descriptorType = descriptors.type();
+    header.keyPointsOffset = AlignOffset(sizeof(CacheHeader));
+
+    const size_t keyPointsBytes = keyPoints.size()*keyPointFields*sizeof(float);
+    const size_t rowBytes = descriptors.cols*descriptors.elemSize();
+    header.descriptorsOffset = AlignOffset(header.keyPointsOffset + keyPointsBytes);
+    header.fileSize = header.descriptorsOffset + descriptors.rows*rowBytes;
+
+    vector<float> keyPointsData;
+    keyPointsData.reserve(keyPoints.size()*keyPointFields);
+    for (const auto& keyPoint: keyPoints)
+    {
+        keyPointsData.push_back(keyPoint.pt.x);
+        keyPointsData.push_back(keyPoint.pt.y);
+        keyPointsData.push_back(keyPoint.size);
+        keyPointsData.push_back(keyPoint.angle);
+        keyPointsData.push_back(keyPoint.response);
+        keyPointsData.push_back(static_cast<float>(keyPoint.octave));
+        keyPointsData.push_back(static_cast<float>(keyPoint.class_id));
+    }
+
+    // The temporary file is unique to the process and the thread.
+    const string entryFile = GetEntryFile(key);
+    const string tempFile = entryFile + '.' + to_string(getpid()) + '.' +
+        to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("[ERROR]: fopen(%s) for the keypoint cache entry %s.\n\n", strerror(errno), tempFile.c_str());
+        return false;
+    }
+
+    const char padding[sectionAlignment] = {0};
+    bool written = (fwrite(&header, sizeof(header), 1, file) == 1);
+    written = written && (fwrite(padding, 1, header.keyPointsOffset - sizeof(header), file) == header.keyPointsOffset - sizeof(header));
+    written = written && (fwrite(keyPointsData.data(), 1, keyPointsBytes, file) == keyPointsBytes);
+    const size_t descriptorsPadding = header.descriptorsOffset - header.keyPointsOffset - keyPointsBytes;
+    written = written && (fwrite(padding, 1, descriptorsPadding, file) == descriptorsPadding);
+    for (int row = 0; written && (row < descriptors.rows); ++row)
+    {
+        written = (fwrite(descriptors.ptr(row), 1, rowBytes, file) == rowBytes);
+    }
+
+    if ((fclose(file) != 0) || !written || (rename(tempFile.c_str(), entryFile.c_str()) != 0))
+    {
+        printf("[ERROR]: Failed to write the keypoint cache entry %s.\n\n", entryFile.c_str());
+        unlink(tempFile.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+size_t KeyPointCache::GetHitCount() const
+{
+    return m_cntHits;
+}
+
+size_t KeyPointCache::GetMissCount() const
+{
+    return m_cntMisses;
+}
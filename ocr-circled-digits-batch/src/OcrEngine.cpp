@@ -0,0 +1,426 @@
+/*
+ * OcrEngine.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "FileUtility.h"
+#include "Utility.h"
+#include "OcrEngine.h"
+
+using namespace std;
+using namespace cv;
+
+OcrEngine::OcrEngine()
+{
+}
+
+bool OcrEngine::Init(const OcrEngineOptions& options)
+{
+    m_options = options;
+    transform(m_options.method.begin(), m_options.method.end(), m_options.method.begin(), ::tolower);
+
+    // Load the title data and the templates from the template bank or from their files.
+    TitleFeatures titleFeatures;
+    vector<pair<string, Mat> > templDigitImgPairs;
+    if (!m_options.bankFile.empty())
+    {
+        if (!m_bankFile.Load(m_options.bankFile))
+        {
+            return false;
+        }
+
+        titleFeatures = m_bankFile.GetTitleFeatures();
+        templDigitImgPairs = m_bankFile.GetTemplDigitImgPairs();
+    }
+    else
+    {
+        // Hough Circle Transform needs no title, but its image is kept for the callers if given.
+        Mat titleImg;
+        if ((m_options.method != "hough") || !m_options.titleImgFile.empty())
+        {
+            titleImg = imread(m_options.titleImgFile, IMREAD_COLOR);
+            if (titleImg.empty())
+            {
+                printf("[ERROR]: Cannot load image %s.\n\n", m_options.titleImgFile.c_str());
+                return false;
+            }
+
+            titleFeatures = OcrPreprocessor::ComputeTitleFeatures(titleImg,
+                m_options.method == "homo", m_options.method == "templ");
+        }
+
+        vector<string> templImgFiles;
+        if (LoadTemplImgs(m_options.templImgDir, templImgFiles, templDigitImgPairs) != 0)
+        {
+            return false;
+        }
+    }
+
+    return Init(m_options, titleFeatures, templDigitImgPairs);
+}
+
+bool OcrEngine::Init(
+    const OcrEngineOptions& options,
+    const TitleFeatures& titleFeatures,
+    const vector<pair<string, Mat> >& templDigitImgPairs)
+{
+    m_options = options;
+    transform(m_options.method.begin(), m_options.method.end(), m_options.method.begin(), ::tolower);
+
+    m_preprocessor = CreatePreprocessor(m_options, titleFeatures);
+    if (!m_preprocessor)
+    {
+        return false;
+    }
+
+    m_ocrer.reset(new CircledDigitsOCRer(templDigitImgPairs));
+    if (m_options.templateBank && !m_ocrer->SetTemplateBank(true))
+    {
+        return false;
+    }
+
+    if (m_options.digitTopK > 0)
+    {
+        m_ocrer->SetPrefilter(m_options.digitTopK, m_options.verifyDigitTopK);
+    }
+
+    return true;
+}
+
+bool OcrEngine::IsInitialized() const
+{
+    return m_preprocessor && m_ocrer;
+}
+
+const OcrEngineOptions& OcrEngine::GetOptions() const
+{
+    return m_options;
+}
+
+const OcrPreprocessor& OcrEngine::GetPreprocessor() const
+{
+    return *m_preprocessor;
+}
+
+const CircledDigitsOCRer& OcrEngine::GetOcrer() const
+{
+    return *m_ocrer;
+}
+
+void OcrEngine::SetKeyPointCache(const KeyPointCache* keyPointCache)
+{
+    m_preprocessor->SetKeyPointCache(keyPointCache);
+}
+
+bool OcrEngine::CalibrateDetectionRegion(
+    const vector<Mat>& sampleBookCoverImgs,
+    const int margin)
+{
+    if (m_preprocessor->CalibrateDetectionRegion(sampleBookCoverImgs, margin, m_options.maxKeyPoints))
+    {
+        return true;
+    }
+
+    m_preprocessor->SetDetectionRegion(Rect(), m_options.maxKeyPoints);
+    return false;
+}
+
+unique_ptr<OcrSession> OcrEngine::CreateSession(Workspace* workspace) const
+{
+    if (!IsInitialized())
+    {
+        printf("[ERROR]: The OCR engine is not initialized.\n\n");
+        return nullptr;
+    }
+
+    return unique_ptr<OcrSession>(new OcrSession(*this, workspace));
+}
+
+unique_ptr<OcrPreprocessor> OcrEngine::CreatePreprocessor(
+    const OcrEngineOptions& options,
+    const TitleFeatures& titleFeatures)
+{
+    // Create the OcrPreprocessor based on the extraction method.
+    unique_ptr<OcrPreprocessor> preprocessor;
+    if ((options.method == "homo") || (options.method == "templ"))
+    {
+        const int centerDisplacementX = 0;
+        const int centerDisplacementY = 55;
+        const unsigned int width = 80;
+        const unsigned int height = 60;
+
+        preprocessor.reset(new OcrPreprocessor(
+            options.method,
+            titleFeatures,
+            centerDisplacementX,
+            centerDisplacementY,
+            width,
+            height));
+
+        if (options.priorMargin >= 0)
+        {
+            preprocessor->EnableSeriesPrior(options.priorMargin, options.priorMinScore);
+            preprocessor->SetPriorTolerance(options.priorTolerance);
+        }
+
+        if (!options.sobelPrecision.empty() && !preprocessor->SetSobelPrecision(options.sobelPrecision))
+        {
+            return nullptr;
+        }
+
+        if ((options.tileSize > 0) && !preprocessor->SetTileSize(options.tileSize))
+        {
+            return nullptr;
+        }
+    }
+    else if (options.method == "hough")
+    {
+        const unsigned int minRadius = 10;
+        const unsigned int maxRadius = 30;
+
+        preprocessor.reset(new OcrPreprocessor(
+            options.method,
+            minRadius,
+            maxRadius));
+
+        preprocessor->SetHoughSearchRegion(options.houghRegion, options.circleBufferWidth, options.houghAlt);
+    }
+    else
+    {
+        printf("[ERROR]: Unsupported extraction method %s.\n\n", options.method.c_str());
+        return nullptr;
+    }
+
+    if (options.maxSkewAngle > 0.0)
+    {
+        preprocessor->EnableDeskew(options.maxSkewAngle);
+    }
+
+    if (options.maxPixels > 0)
+    {
+        preprocessor->SetMaxPixels(options.maxPixels, options.downscaleOversized);
+    }
+
+    // Restrict the keypoint detection of Homography to a configured region. The region
+    // may instead be calibrated from the book covers later.
+    if ((options.method == "homo") && (!options.detectRegion.empty() || (options.maxKeyPoints > 0)))
+    {
+        preprocessor->SetDetectionRegion(options.detectRegion, options.maxKeyPoints);
+    }
+
+    return preprocessor;
+}
+
+int OcrEngine::LoadTemplImgs(
+    const string& templImgDir,
+    vector<string>& templImgFiles,
+    vector<pair<string, Mat> >& templDigitImgPairs)
+{
+    // Get all the template image file names in the given directory.
+    int error = FileUtility::GetDirFiles(templImgDir, templImgFiles);
+    if (error != 0)
+    {
+        printf("[ERROR]: Cannot get the template image file names in %s with error = %d", templImgDir.c_str(), error);
+        return error;
+    }
+
+    sort(templImgFiles.begin(), templImgFiles.end());
+
+    // Load the template images.
+    templDigitImgPairs.clear();
+    for (const auto& imgFile: templImgFiles)
+    {
+        // Note that each template image is named after the digits displayed inside.
+        string dir;
+        string digits;
+        string extension;
+        Utility::SegmentFullFilename(imgFile, dir, digits, extension);
+
+        Mat img = imread(imgFile, IMREAD_COLOR);
+        if (img.empty())
+        {
+            printf("[ERROR]: Cannot load template image %s.\n\n", imgFile.c_str());
+            continue;
+        }
+
+#ifdef DEBUG
+        printf("[DEBUG]: The pixel data type of the template image %s is %s.\n",
+            imgFile.c_str(), Utility::CvType2Str(img.type()).c_str());
+#endif
+
+        // The pixel data type of the loaded template image is usually CV_8UC3,
+        // so we need to convert it into gray scale (i.e., CV_8UC1) before doing
+        // the template matching.
+        Mat grayImg;
+        cvtColor(img, grayImg, COLOR_BGR2GRAY);
+
+#ifdef DEBUG
+        printf("[DEBUG]: The pixel data type of the gray-scale template image %s is %s.\n",
+            imgFile.c_str(), Utility::CvType2Str(grayImg.type()).c_str());
+#endif
+
+        templDigitImgPairs.push_back(make_pair(digits, grayImg));
+    }
+
+    return 0;
+}
+
+OcrSession::OcrSession(
+    const OcrEngine& engine,
+    Workspace* workspace) :
+    m_engine(engine),
+    m_preprocessor(engine.m_preprocessor->CloneForWorker()),
+    m_workspace((workspace != nullptr) ? *workspace : m_ownWorkspace)
+{
+}
+
+bool OcrSession::Recognize(
+    const Mat& bookCoverImg,
+    OcrOutput& output)
+{
+    // The time budget starts before the extraction.
+    const Deadline deadline(m_engine.m_options.timeBudgetMs);
+    return Recognize(bookCoverImg, deadline, output);
+}
+
+bool OcrSession::Recognize(
+    const Mat& bookCoverImg,
+    const Deadline& deadline,
+    OcrOutput& output)
+{
+    if (!Extract(bookCoverImg, deadline, output) || !Threshold(output))
+    {
+        return false;
+    }
+
+    if (deadline.Expired())
+    {
+        output.status = OcrStatus::Timeout;
+        return false;
+    }
+
+    return RecognizeThresholded(output);
+}
+
+bool OcrSession::Extract(
+    const Mat& bookCoverImg,
+    const Deadline& deadline,
+    OcrOutput& output)
+{
+    output = OcrOutput();
+
+    output.circledDigitsImg = m_preprocessor->ExtractCircledDigits(bookCoverImg, m_workspace, &output.report, deadline);
+    output.stageTimesMs = output.report.stageTimesMs;
+    switch (output.report.status)
+    {
+    case ExtractStatus::Timeout:
+        output.status = OcrStatus::Timeout;
+        return false;
+
+    case ExtractStatus::Rejected:
+        output.status = OcrStatus::Rejected;
+        return false;
+
+    default:
+        break;
+    }
+
+    if (output.circledDigitsImg.empty())
+    {
+        output.status = OcrStatus::NotFound;
+        return false;
+    }
+
+    return true;
+}
+
+bool OcrSession::Threshold(OcrOutput& output)
+{
+    if (output.circledDigitsImg.empty())
+    {
+        output.status = OcrStatus::NotFound;
+        return false;
+    }
+
+    const int64 startTick = getTickCount();
+    output.blackWhiteImg = m_preprocessor->BlackWhiteThresholding(m_engine.m_options.scaleFactor, output.circledDigitsImg, m_workspace);
+    output.stageTimesMs.push_back(make_pair("threshold", (getTickCount() - startTick)*1000.0/getTickFrequency()));
+
+    return true;
+}
+
+bool OcrSession::RecognizeThresholded(OcrOutput& output)
+{
+    if (output.blackWhiteImg.empty())
+    {
+        output.status = OcrStatus::NotFound;
+        return false;
+    }
+
+    const int64 startTick = getTickCount();
+    m_engine.m_ocrer->OCR(output.blackWhiteImg, output.result, m_workspace);
+    output.stageTimesMs.push_back(make_pair("ocr", (getTickCount() - startTick)*1000.0/getTickFrequency()));
+
+    output.status = OcrStatus::Success;
+    return true;
+}
+
+bool OcrSession::RecognizePixels(
+    const unsigned char* pixels,
+    const int width,
+    const int height,
+    const size_t stride,
+    const int channels,
+    OcrOutput& output)
+{
+    output = OcrOutput();
+    if ((pixels == nullptr) || (width <= 0) || (height <= 0) || (stride < static_cast<size_t>(width*channels))
+        || ((channels != 1) && (channels != 3) && (channels != 4)))
+    {
+        output.status = OcrStatus::InvalidInput;
+        return false;
+    }
+
+    // The extraction never writes into the cover, so the header may wrap the caller's
+    // buffer although Mat has no const pixels.
+    Mat img(height, width, CV_8UC(channels), const_cast<unsigned char*>(pixels), stride);
+    if (channels == 3)
+    {
+        return Recognize(img, output);
+    }
+
+    Mat bgrImg = m_workspace.GetMat("inputBgr", img.size(), CV_8UC3);
+    cvtColor(img, bgrImg, (channels == 1) ? COLOR_GRAY2BGR : COLOR_BGRA2BGR);
+    return Recognize(bgrImg, output);
+}
+
+bool OcrSession::RecognizeEncoded(
+    const unsigned char* bytes,
+    const size_t size,
+    OcrOutput& output)
+{
+    output = OcrOutput();
+    if ((bytes == nullptr) || (size == 0))
+    {
+        output.status = OcrStatus::InvalidInput;
+        return false;
+    }
+
+    // Decode straight from the caller's bytes wrapped by a header.
+    Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<unsigned char*>(bytes));
+    Mat img = imdecode(encoded, IMREAD_COLOR);
+    if (img.empty())
+    {
+        output.status = OcrStatus::DecodeFailed;
+        return false;
+    }
+
+    return Recognize(img, output);
+}
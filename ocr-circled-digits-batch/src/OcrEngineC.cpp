@@ -0,0 +1,302 @@
+/*
+ * OcrEngineC.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#include "OcrEngine.h"
+#include "OcrEngineC.h"
+
+using namespace std;
+using namespace cv;
+
+struct ocr_engine
+{
+    OcrEngine engine;
+};
+
+struct ocr_session
+{
+    unique_ptr<OcrSession> session;
+};
+
+static int OcrStatus2C(const OcrStatus status)
+{
+    switch (status)
+    {
+    case OcrStatus::Success:
+        return OCR_STATUS_SUCCESS;
+
+    case OcrStatus::DecodeFailed:
+        return OCR_STATUS_DECODE_FAILED;
+
+    case OcrStatus::InvalidInput:
+        return OCR_STATUS_INVALID_INPUT;
+
+    case OcrStatus::Timeout:
+        return OCR_STATUS_TIMEOUT;
+
+    case OcrStatus::Rejected:
+        return OCR_STATUS_REJECTED;
+
+    case OcrStatus::NotFound:
+        return OCR_STATUS_NOT_FOUND;
+
+    default:
+        return OCR_STATUS_INTERNAL_ERROR;
+    }
+}
+
+static ocr_rect Rect2C(const Rect& rect)
+{
+    ocr_rect cRect;
+    cRect.x = rect.x;
+    cRect.y = rect.y;
+    cRect.width = rect.width;
+    cRect.height = rect.height;
+    return cRect;
+}
+
+static Rect C2Rect(const ocr_rect& cRect)
+{
+    return Rect(cRect.x, cRect.y, cRect.width, cRect.height);
+}
+
+static int FillResult(
+    const OcrOutput& output,
+    ocr_result* result)
+{
+    const int status = OcrStatus2C(output.status);
+    if (result == nullptr)
+    {
+        return status;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->status = status;
+    result->skew_angle = output.report.skewAngle;
+    if (output.status == OcrStatus::Success)
+    {
+        strncpy(result->digits, output.result.evaluatedDigits.c_str(), sizeof(result->digits) - 1);
+
+        const auto itMatchRes = output.result.digits2MatchResMap.find(output.result.evaluatedDigits);
+        if (itMatchRes != output.result.digits2MatchResMap.end())
+        {
+            result->score = itMatchRes->second;
+        }
+    }
+
+    return status;
+}
+
+void ocr_engine_options_init(ocr_engine_options* options)
+{
+    if (options == nullptr)
+    {
+        return;
+    }
+
+    const OcrEngineOptions defaults;
+    memset(options, 0, sizeof(*options));
+    options->struct_size = sizeof(*options);
+    options->method = "homo";
+    options->prior_margin = defaults.priorMargin;
+    options->prior_min_score = defaults.priorMinScore;
+    options->tile_size = defaults.tileSize;
+    options->detect_region = Rect2C(defaults.detectRegion);
+    options->max_key_points = defaults.maxKeyPoints;
+    options->hough_region = Rect2C(defaults.houghRegion);
+    options->circle_buffer_width = defaults.circleBufferWidth;
+    options->hough_alt = defaults.houghAlt ? 1 : 0;
+    options->max_skew_angle = defaults.maxSkewAngle;
+    options->max_pixels = defaults.maxPixels;
+    options->downscale_oversized = defaults.downscaleOversized ? 1 : 0;
+    options->digit_top_k = defaults.digitTopK;
+    options->verify_digit_top_k = defaults.verifyDigitTopK ? 1 : 0;
+    options->time_budget_ms = defaults.timeBudgetMs;
+    options->scale_factor = defaults.scaleFactor;
+    options->template_bank = defaults.templateBank ? 1 : 0;
+    options->prior_tolerance = defaults.priorTolerance;
+}
+
+ocr_engine* ocr_engine_create(const ocr_engine_options* options)
+{
+    if ((options == nullptr) || (options->struct_size == 0))
+    {
+        printf("[ERROR]: The OCR engine options are not filled by ocr_engine_options_init.\n\n");
+        return nullptr;
+    }
+
+    // The options which the caller doesn't know of, i.e., beyond its struct_size, keep their defaults.
+    ocr_engine_options cOptions;
+    ocr_engine_options_init(&cOptions);
+    memcpy(&cOptions, options, min(options->struct_size, sizeof(cOptions)));
+
+    OcrEngineOptions engineOptions;
+    engineOptions.method = (cOptions.method != nullptr) ? cOptions.method : "homo";
+    engineOptions.bankFile = (cOptions.bank_file != nullptr) ? cOptions.bank_file : "";
+    engineOptions.titleImgFile = (cOptions.title_img_file != nullptr) ? cOptions.title_img_file : "";
+    engineOptions.templImgDir = (cOptions.templ_img_dir != nullptr) ? cOptions.templ_img_dir : "";
+    engineOptions.priorMargin = cOptions.prior_margin;
+    engineOptions.priorMinScore = cOptions.prior_min_score;
+    engineOptions.priorTolerance = cOptions.prior_tolerance;
+    engineOptions.tileSize = cOptions.tile_size;
+    engineOptions.detectRegion = C2Rect(cOptions.detect_region);
+    engineOptions.maxKeyPoints = cOptions.max_key_points;
+    engineOptions.houghRegion = C2Rect(cOptions.hough_region);
+    engineOptions.circleBufferWidth = cOptions.circle_buffer_width;
+    engineOptions.houghAlt = (cOptions.hough_alt != 0);
+    engineOptions.maxSkewAngle = cOptions.max_skew_angle;
+    engineOptions.maxPixels = cOptions.max_pixels;
+    engineOptions.downscaleOversized = (cOptions.downscale_oversized != 0);
+    engineOptions.digitTopK = cOptions.digit_top_k;
+    engineOptions.verifyDigitTopK = (cOptions.verify_digit_top_k != 0);
+    engineOptions.timeBudgetMs = cOptions.time_budget_ms;
+    engineOptions.scaleFactor = cOptions.scale_factor;
+    engineOptions.templateBank = (cOptions.template_bank != 0);
+    engineOptions.sobelPrecision = (cOptions.sobel_precision != nullptr) ? cOptions.sobel_precision : "";
+
+    // No C++ exception may cross the C boundary.
+    try
+    {
+        unique_ptr<ocr_engine> engine(new ocr_engine());
+        if (!engine->engine.Init(engineOptions))
+        {
+            return nullptr;
+        }
+
+        return engine.release();
+    }
+    catch (const exception& e)
+    {
+        printf("[ERROR]: Failed to create the OCR engine: %s.\n\n", e.what());
+        return nullptr;
+    }
+    catch (...)
+    {
+        printf("[ERROR]: Failed to create the OCR engine.\n\n");
+        return nullptr;
+    }
+}
+
+void ocr_engine_destroy(ocr_engine* engine)
+{
+    delete engine;
+}
+
+void ocr_engine_get_digit_recall(
+    const ocr_engine* engine,
+    size_t* cnt_verified,
+    size_t* cnt_recalled)
+{
+    const bool initialized = (engine != nullptr) && engine->engine.IsInitialized();
+    if (cnt_verified != nullptr)
+    {
+        *cnt_verified = initialized ? engine->engine.GetOcrer().GetVerifiedCount() : 0;
+    }
+
+    if (cnt_recalled != nullptr)
+    {
+        *cnt_recalled = initialized ? engine->engine.GetOcrer().GetRecalledCount() : 0;
+    }
+}
+
+ocr_session* ocr_session_create(const ocr_engine* engine)
+{
+    if (engine == nullptr)
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        unique_ptr<ocr_session> session(new ocr_session());
+        session->session = engine->engine.CreateSession();
+        return session->session ? session.release() : nullptr;
+    }
+    catch (const exception& e)
+    {
+        printf("[ERROR]: Failed to create the OCR session: %s.\n\n", e.what());
+        return nullptr;
+    }
+    catch (...)
+    {
+        printf("[ERROR]: Failed to create the OCR session.\n\n");
+        return nullptr;
+    }
+}
+
+void ocr_session_destroy(ocr_session* session)
+{
+    delete session;
+}
+
+int ocr_session_recognize_pixels(
+    ocr_session* session,
+    const unsigned char* pixels,
+    int width,
+    int height,
+    size_t stride,
+    int channels,
+    ocr_result* result)
+{
+    OcrOutput output;
+    output.status = OcrStatus::InvalidInput;
+    if (session != nullptr)
+    {
+        try
+        {
+            session->session->RecognizePixels(pixels, width, height, stride, channels, output);
+        }
+        catch (const exception& e)
+        {
+            printf("[ERROR]: Failed to recognize the pixels: %s.\n\n", e.what());
+            output = OcrOutput();
+            output.status = OcrStatus::InternalError;
+        }
+        catch (...)
+        {
+            printf("[ERROR]: Failed to recognize the pixels.\n\n");
+            output = OcrOutput();
+            output.status = OcrStatus::InternalError;
+        }
+    }
+
+    return FillResult(output, result);
+}
+
+int ocr_session_recognize_encoded(
+    ocr_session* session,
+    const unsigned char* bytes,
+    size_t size,
+    ocr_result* result)
+{
+    OcrOutput output;
+    output.status = OcrStatus::InvalidInput;
+    if (session != nullptr)
+    {
+        try
+        {
+            session->session->RecognizeEncoded(bytes, size, output);
+        }
+        catch (const exception& e)
+        {
+            printf("[ERROR]: Failed to recognize the encoded image: %s.\n\n", e.what());
+            output = OcrOutput();
+            output.status = OcrStatus::InternalError;
+        }
+        catch (...)
+        {
+            printf("[ERROR]: Failed to recognize the encoded image.\n\n");
+            output = OcrOutput();
+            output.status = OcrStatus::InternalError;
+        }
+    }
+
+    return FillResult(output, result);
+}
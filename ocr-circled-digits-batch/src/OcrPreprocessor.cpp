@@ -5,7 +5,9 @@
  *      Author: renwei
  */
 
+#include <cmath>
 #include <vector>
+#include <limits>
 
 #include "OcrPreprocessor.h"
 
@@ -13,6 +15,9 @@ using namespace std;
 using namespace cv;
 using namespace cv::xfeatures2d;
 
+// The Hessian threshold of the SURF detector.
+static const int minHessian = 400;
+
 OcrPreprocessor::OcrPreprocessor(
     const string& method,
     const Mat& titleImg,
@@ -20,11 +25,49 @@ OcrPreprocessor::OcrPreprocessor(
     const int centerDisplacementY,
     const unsigned int width,
     const unsigned int height) :
-    m_titleImg(titleImg),
+    OcrPreprocessor(
+        method,
+        ComputeTitleFeatures(
+            titleImg,
+            Str2ExtractMethod(method) == ExtractMethod::Homography,
+            Str2ExtractMethod(method) == ExtractMethod::TemplateMatching),
+        centerDisplacementX,
+        centerDisplacementY,
+        width,
+        height)
+{
+
+}
+
+OcrPreprocessor::OcrPreprocessor(
+    const string& method,
+    const TitleFeatures& titleFeatures,
+    const int centerDisplacementX,
+    const int centerDisplacementY,
+    const unsigned int width,
+    const unsigned int height) :
+    m_titleImg(titleFeatures.sharpenedImg),
+    m_sobelPrecision(SobelPrecision::Float32),
     m_centerDisplacementX(centerDisplacementX),
     m_centerDisplacementY(centerDisplacementY),
     m_width(width),
-    m_height(height)
+    m_height(height),
+    m_maxKeyPoints(0),
+    m_keyPointCache(nullptr),
+    m_circleBufferWidth(0),
+    m_useAltGradient(false),
+    m_priorEnabled(false),
+    m_priorMargin(0),
+    m_priorMinScore(1.0),
+    m_priorTolerance(-1),
+    m_priorHistoryLen(0),
+    m_priorNextIndex(0),
+    m_deskewEnabled(false),
+    m_maxSkewAngle(10.0),
+    m_minSkewAngle(0.2),
+    m_maxPixels(0),
+    m_downscaleOversized(false),
+    m_tileSize(0)
 {
     m_method = Str2ExtractMethod(method);
     if ((m_method != ExtractMethod::Homography) && (m_method != ExtractMethod::TemplateMatching))
@@ -33,16 +76,13 @@ OcrPreprocessor::OcrPreprocessor(
         return;
     }
 
-    m_titleImg = SharpenImg(titleImg);
     if (m_method == ExtractMethod::Homography)
     {
         m_matcher = BFMatcher::create();
-
-        // Compute the keypoints and the descriptors of titleImg.
-        const int minHessian = 400;
         m_detector = SURF::create(minHessian);
 
-        m_detector->detectAndCompute(titleImg, noArray(), m_titleImgKeyPoints, m_titleImgDescriptors);
+        m_titleImgKeyPoints = titleFeatures.keyPoints;
+        m_titleImgDescriptors = titleFeatures.descriptors;
 
         // List the four corners of the title image clockwisely.
         m_titleImgCorners.resize(4);
@@ -53,16 +93,60 @@ OcrPreprocessor::OcrPreprocessor(
     }
     else if (m_method == ExtractMethod::TemplateMatching)
     {
-        Sobel(m_titleImg, m_titleImgSobel, CV_32F, 1, 1);
+        m_titleImgSobel = titleFeatures.sobel;
+    }
+}
+
+TitleFeatures OcrPreprocessor::ComputeTitleFeatures(
+    const Mat& titleImg,
+    const bool withKeyPoints,
+    const bool withSobel)
+{
+    TitleFeatures titleFeatures;
+
+    Workspace workspace;
+    titleFeatures.sharpenedImg = SharpenImg(titleImg, workspace);
+    if (withKeyPoints)
+    {
+        // Compute the keypoints and the descriptors of titleImg.
+        Ptr<SURF> detector = SURF::create(minHessian);
+        detector->detectAndCompute(titleImg, noArray(), titleFeatures.keyPoints, titleFeatures.descriptors);
+    }
+
+    if (withSobel)
+    {
+        const Mat& sharpenedImg = titleFeatures.sharpenedImg;
+        titleFeatures.sobel = ComputeSobel(sharpenedImg, Rect(0, 0, sharpenedImg.cols, sharpenedImg.rows),
+            SobelPrecision::Float32, "titleSobel", workspace);
     }
+
+    return titleFeatures;
 }
 
 OcrPreprocessor::OcrPreprocessor(
     const string& method,
     const unsigned int minRadius,
     const unsigned int maxRadius) :
+    m_sobelPrecision(SobelPrecision::Float32),
+    m_maxKeyPoints(0),
+    m_keyPointCache(nullptr),
     m_minRadius(minRadius),
-    m_maxRadius(maxRadius)
+    m_maxRadius(maxRadius),
+    m_houghSearchRegion(DefaultHoughSearchRegion()),
+    m_circleBufferWidth(10),
+    m_useAltGradient(false),
+    m_priorEnabled(false),
+    m_priorMargin(0),
+    m_priorMinScore(1.0),
+    m_priorTolerance(-1),
+    m_priorHistoryLen(0),
+    m_priorNextIndex(0),
+    m_deskewEnabled(false),
+    m_maxSkewAngle(10.0),
+    m_minSkewAngle(0.2),
+    m_maxPixels(0),
+    m_downscaleOversized(false),
+    m_tileSize(0)
 {
     m_method = Str2ExtractMethod(method);
     if (m_method != ExtractMethod::HoughCircleTransform)
@@ -76,23 +160,428 @@ OcrPreprocessor::~OcrPreprocessor()
 
 }
 
-Mat OcrPreprocessor::ExtractCircledDigits(const Mat& bookCoverImg)
+unique_ptr<OcrPreprocessor> OcrPreprocessor::CloneForWorker() const
+{
+    unique_ptr<OcrPreprocessor> clone(new OcrPreprocessor(*this));
+
+    if (m_detector)
+    {
+        clone->m_detector = SURF::create(m_detector->getHessianThreshold());
+    }
+
+    if (m_matcher)
+    {
+        clone->m_matcher = BFMatcher::create();
+    }
+
+    clone->ResetSeriesPrior();
+    return clone;
+}
+
+const Mat& OcrPreprocessor::GetTitleImg() const
+{
+    return m_titleImg;
+}
+
+string OcrPreprocessor::GetMethodName() const
+{
+    return ExtractMethod2Str(m_method);
+}
+
+void OcrPreprocessor::EnableSeriesPrior(
+    const int margin,
+    const double minScore,
+    const size_t historyLen)
+{
+    if ((m_method != ExtractMethod::Homography) && (m_method != ExtractMethod::TemplateMatching))
+    {
+        printf("[ERROR]: The series prior is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return;
+    }
+
+    m_priorEnabled = true;
+    m_priorMargin = max(margin, 0);
+    m_priorMinScore = minScore;
+    m_priorHistoryLen = max(historyLen, static_cast<size_t>(1));
+    ResetSeriesPrior();
+}
+
+void OcrPreprocessor::ResetSeriesPrior()
 {
-    // Sharpen the book cover image.
-    Mat sharpenedBookCoverImg = SharpenImg(bookCoverImg);
+    m_priorTitleRects.clear();
+    m_priorTitleRects.reserve(m_priorHistoryLen);
+    m_priorNextIndex = 0;
+}
+
+void OcrPreprocessor::SetPriorTolerance(const int tolerance)
+{
+    m_priorTolerance = tolerance;
+}
+
+void OcrPreprocessor::SetDetectionRegion(
+    const Rect& region,
+    const int maxKeyPoints)
+{
+    if (m_method != ExtractMethod::Homography)
+    {
+        printf("[ERROR]: The detection region is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return;
+    }
+
+    m_detectionRegion = region;
+    m_maxKeyPoints = max(maxKeyPoints, 0);
+}
+
+void OcrPreprocessor::SetKeyPointCache(const KeyPointCache* keyPointCache)
+{
+    if (m_method != ExtractMethod::Homography)
+    {
+        printf("[ERROR]: The keypoint cache is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return;
+    }
+
+    m_keyPointCache = keyPointCache;
+}
+
+Rect OcrPreprocessor::DefaultHoughSearchRegion()
+{
+    return Rect(0, 0, numeric_limits<int>::max(), 171);
+}
+
+void OcrPreprocessor::SetHoughSearchRegion(
+    const Rect& region,
+    const unsigned int circleBufferWidth,
+    const bool useAltGradient)
+{
+    if (m_method != ExtractMethod::HoughCircleTransform)
+    {
+        printf("[ERROR]: The Hough search region is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return;
+    }
+
+    m_houghSearchRegion = region;
+    m_circleBufferWidth = circleBufferWidth;
+    m_useAltGradient = useAltGradient;
+
+#if !((CV_VERSION_MAJOR > 4) || ((CV_VERSION_MAJOR == 4) && (CV_VERSION_MINOR >= 3)))
+    if (m_useAltGradient)
+    {
+        printf("[INFO]: HOUGH_GRADIENT_ALT requires OpenCV 4.3+ and HOUGH_GRADIENT is used instead.\n");
+        m_useAltGradient = false;
+    }
+#endif
+}
+
+bool OcrPreprocessor::CalibrateDetectionRegion(
+    const vector<Mat>& sampleBookCoverImgs,
+    const int margin,
+    const int maxKeyPoints)
+{
+    if (m_method != ExtractMethod::Homography)
+    {
+        printf("[ERROR]: The detection region is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return false;
+    }
+
+    // Find the title in the whole sample covers without any restriction.
+    m_detectionRegion = Rect();
+    m_maxKeyPoints = 0;
+
+    Workspace workspace;
+    Rect unionRect;
+    size_t cntFound = 0;
+    for (const auto& sampleBookCoverImg: sampleBookCoverImgs)
+    {
+        Mat sharpenedImg = SharpenImg(sampleBookCoverImg, workspace);
+
+        Rect titleRect;
+        double inlierRatio = 0.0;
+        const Rect bookCoverRect(0, 0, sharpenedImg.cols, sharpenedImg.rows);
+        ExtractReport report;
+        if (!FindTitleRectViaHomography(sharpenedImg, bookCoverRect, false, workspace, Deadline(), report, titleRect, inlierRatio))
+        {
+            continue;
+        }
+
+        unionRect = (cntFound == 0) ? titleRect : (unionRect | titleRect);
+        ++cntFound;
+    }
+
+    if (cntFound == 0)
+    {
+        printf("[ERROR]: Unable to find the title in any of the %ld calibration covers.\n\n",
+            sampleBookCoverImgs.size());
+        return false;
+    }
+
+    // Note that the right and bottom sides of the region are clipped by each cover when it is used.
+    Point regionTopLeft(max(unionRect.x - margin, 0), max(unionRect.y - margin, 0));
+    Point regionBottomRight(unionRect.x + unionRect.width + margin, unionRect.y + unionRect.height + margin);
+    SetDetectionRegion(Rect(regionTopLeft, regionBottomRight), maxKeyPoints);
+
+    printf("[INFO]: Calibrate the detection region (%d, %d, %d, %d) from %ld of %ld covers.\n",
+        m_detectionRegion.x, m_detectionRegion.y, m_detectionRegion.width, m_detectionRegion.height,
+        cntFound, sampleBookCoverImgs.size());
+    return true;
+}
+
+void OcrPreprocessor::EnableDeskew(
+    const double maxSkewAngle,
+    const double minSkewAngle)
+{
+    m_deskewEnabled = true;
+    m_maxSkewAngle = fabs(maxSkewAngle);
+    m_minSkewAngle = fabs(minSkewAngle);
+}
+
+bool OcrPreprocessor::SetSobelPrecision(const string& precision)
+{
+    if (m_method != ExtractMethod::TemplateMatching)
+    {
+        printf("[ERROR]: The Sobel precision is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return false;
+    }
+
+    if (precision == "float32")
+    {
+        m_sobelPrecision = SobelPrecision::Float32;
+    }
+    else if (precision == "mag8u")
+    {
+        m_sobelPrecision = SobelPrecision::Magnitude8U;
+    }
+    else
+    {
+        printf("[ERROR]: Unsupported Sobel precision %s.\n\n", precision.c_str());
+        return false;
+    }
+
+    Workspace workspace;
+    m_titleImgSobel = ComputeSobel(m_titleImg, Rect(0, 0, m_titleImg.cols, m_titleImg.rows),
+        m_sobelPrecision, "titleSobel", workspace).clone();
+    return true;
+}
+
+bool OcrPreprocessor::CompareSobelPrecisions(
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    SobelComparison& comparison) const
+{
+    if (m_method != ExtractMethod::TemplateMatching)
+    {
+        printf("[ERROR]: The Sobel precision is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return false;
+    }
+
+    // The cover is sharpened once for both, and the titles are differentiated untimed,
+    // since they are computed once per series.
+    Mat sharpenedBookCoverImg = SharpenImg(bookCoverImg, workspace);
+    const Rect bookCoverRect(0, 0, sharpenedBookCoverImg.cols, sharpenedBookCoverImg.rows);
+    const Rect titleRect(0, 0, m_titleImg.cols, m_titleImg.rows);
+    if ((bookCoverRect.width < titleRect.width) || (bookCoverRect.height < titleRect.height))
+    {
+        printf("[ERROR]: The book cover with %d x %d pixels is smaller than the title.\n\n", bookCoverImg.cols, bookCoverImg.rows);
+        return false;
+    }
+
+    comparison = SobelComparison();
+    for (const auto precision: {SobelPrecision::Float32, SobelPrecision::Magnitude8U})
+    {
+        const Mat titleImgSobel = ComputeSobel(m_titleImg, titleRect, precision, "titleSobel", workspace);
+
+        const int64 startTick = getTickCount();
+        const Mat bookCoverImgSobel = ComputeSobel(sharpenedBookCoverImg, bookCoverRect, precision, "coverSobel", workspace);
+
+        Mat matchRes = workspace.GetMat("sobelRes", Size(bookCoverRect.width - titleRect.width + 1,
+            bookCoverRect.height - titleRect.height + 1), CV_32FC1);
+        matchTemplate(bookCoverImgSobel, titleImgSobel, matchRes, TM_CCOEFF_NORMED);
+
+        double maxScore = -1.0;
+        Point matchPoint;
+        minMaxLoc(matchRes, nullptr, &maxScore, nullptr, &matchPoint);
+        const double elapsedMs = (getTickCount() - startTick)*1000.0/getTickFrequency();
+
+        if (precision == SobelPrecision::Float32)
+        {
+            comparison.float32MatchPoint = matchPoint;
+            comparison.float32Score = maxScore;
+            comparison.float32Ms = elapsedMs;
+        }
+        else
+        {
+            comparison.magnitude8UMatchPoint = matchPoint;
+            comparison.magnitude8UScore = maxScore;
+            comparison.magnitude8UMs = elapsedMs;
+        }
+    }
+
+    return true;
+}
+
+bool OcrPreprocessor::SetTileSize(const int tileSize)
+{
+    if (m_method != ExtractMethod::TemplateMatching)
+    {
+        printf("[ERROR]: The tiled processing is not supported for method %s.\n\n",
+            ExtractMethod2Str(m_method).c_str());
+        return false;
+    }
+
+    m_tileSize = max(tileSize, 0);
+    return true;
+}
+
+void OcrPreprocessor::SetMaxPixels(
+    const size_t maxPixels,
+    const bool downscale)
+{
+    m_maxPixels = maxPixels;
+    m_downscaleOversized = downscale;
+}
+
+bool OcrPreprocessor::CheckDeadline(
+    const Deadline& deadline,
+    const char* stage,
+    ExtractReport& report)
+{
+    if (!deadline.Expired())
+    {
+        return false;
+    }
+
+    printf("[ERROR]: Exceeded the time budget after %f ms before the stage %s.\n\n", deadline.ElapsedMs(), stage);
+    report.status = ExtractStatus::Timeout;
+    return true;
+}
+
+Mat OcrPreprocessor::ExtractCircledDigits(
+    const Mat& bookCoverImg,
+    ExtractReport* report,
+    const Deadline& deadline)
+{
+    // The returned image keeps its buffer alive after the temporary workspace is gone.
+    Workspace workspace;
+    return ExtractCircledDigits(bookCoverImg, workspace, report, deadline);
+}
+
+Mat OcrPreprocessor::ExtractCircledDigits(
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    ExtractReport* report,
+    const Deadline& deadline)
+{
+    ExtractReport localReport;
+    if (report == nullptr)
+    {
+        report = &localReport;
+    }
+
+    *report = ExtractReport();
 
     Mat circledDigitsImg;
+    Mat srcImg = bookCoverImg;
+
+    // Reject or downscale the oversized covers before any expensive stage.
+    if ((m_maxPixels > 0) && (bookCoverImg.total() > m_maxPixels))
+    {
+        if (!m_downscaleOversized)
+        {
+            printf("[ERROR]: Reject the image with %d x %d pixels (> %ld).\n\n",
+                bookCoverImg.cols, bookCoverImg.rows, m_maxPixels);
+            report->status = ExtractStatus::Rejected;
+            return circledDigitsImg;
+        }
+
+        const int64 startTick = getTickCount();
+
+        report->downscaleFactor = std::sqrt(static_cast<double>(m_maxPixels)/bookCoverImg.total());
+        Size downscaledSize(
+            max(cvRound(bookCoverImg.cols*report->downscaleFactor), 1),
+            max(cvRound(bookCoverImg.rows*report->downscaleFactor), 1));
+        srcImg = workspace.GetMat("downscaled", downscaledSize, bookCoverImg.type());
+        resize(bookCoverImg, srcImg, downscaledSize, 0, 0, INTER_AREA);
+
+        report->AddStageTime("downscale", startTick);
+    }
+
+    if (m_deskewEnabled)
+    {
+        if (CheckDeadline(deadline, "deskew", *report))
+        {
+            return circledDigitsImg;
+        }
+
+        const int64 startTick = getTickCount();
+
+        report->skewAngle = EstimateSkewAngle(srcImg, workspace);
+        if (fabs(report->skewAngle) >= m_minSkewAngle)
+        {
+            // Rotate the cover back around its center, but only warp the region which the
+            // extraction method reads. Since the output of warpAffine has the size of the
+            // region, we shift the rotation by the top-left corner of the region.
+            Rect readRegion = GetReadRegion(srcImg.size());
+
+            Mat rotationMat = getRotationMatrix2D(
+                Point2f(srcImg.cols/2.0f, srcImg.rows/2.0f),
+                -report->skewAngle,
+                1.0);
+            rotationMat.at<double>(0, 2) -= readRegion.x;
+            rotationMat.at<double>(1, 2) -= readRegion.y;
+
+            Mat deskewedImg = workspace.GetMat("deskewed", srcImg.size(), srcImg.type());
+            deskewedImg.setTo(Scalar::all(0));
+            Mat readRegionImg = deskewedImg(readRegion);
+            warpAffine(srcImg, readRegionImg, rotationMat, readRegion.size(), INTER_LINEAR, BORDER_REPLICATE);
+            srcImg = deskewedImg;
+
+            report->deskewed = true;
+        }
+
+        report->deskewTimeMs = (getTickCount() - startTick)*1000.0/getTickFrequency();
+        report->AddStageTime("deskew", startTick);
+    }
+
+    if (CheckDeadline(deadline, "sharpen", *report))
+    {
+        return circledDigitsImg;
+    }
+
+    // Sharpen the book cover image. The tiled Template Matching sharpens the tiles itself, and
+    // the Hough circle transform only sharpens the region it transforms and the crop.
+    Mat sharpenedBookCoverImg = srcImg;
+    const bool sharpensRegions = ((m_tileSize > 0) && (m_method == ExtractMethod::TemplateMatching))
+        || (m_method == ExtractMethod::HoughCircleTransform);
+    if (!sharpensRegions)
+    {
+        const int64 sharpenStartTick = getTickCount();
+        sharpenedBookCoverImg = SharpenImg(srcImg, workspace);
+        report->AddStageTime("sharpen", sharpenStartTick);
+    }
+
+    if (CheckDeadline(deadline, "locate", *report))
+    {
+        return circledDigitsImg;
+    }
+
+    const int64 locateStartTick = getTickCount();
     switch (m_method)
     {
     case ExtractMethod::Homography:
-        circledDigitsImg = ExtractCircledDigitsViaHomography(sharpenedBookCoverImg);
+        circledDigitsImg = ExtractCircledDigitsViaHomography(sharpenedBookCoverImg, workspace, deadline, *report);
         break;
     case ExtractMethod::TemplateMatching:
-        circledDigitsImg = ExtractCircledDigitsViaTemplateMatching(sharpenedBookCoverImg);
+        circledDigitsImg = ExtractCircledDigitsViaTemplateMatching(sharpenedBookCoverImg, workspace, deadline, *report);
         break;
 
     case ExtractMethod::HoughCircleTransform:
-        circledDigitsImg = ExtractCircledDigitsViaHoughTransform(sharpenedBookCoverImg);
+        circledDigitsImg = ExtractCircledDigitsViaHoughTransform(sharpenedBookCoverImg, workspace, deadline, *report);
         break;
 
     default:
@@ -101,6 +590,13 @@ Mat OcrPreprocessor::ExtractCircledDigits(const Mat& bookCoverImg)
         break;
     }
 
+    report->AddStageTime("locate", locateStartTick);
+
+    if (circledDigitsImg.empty() && (report->status == ExtractStatus::Success))
+    {
+        report->status = ExtractStatus::NotFound;
+    }
+
     return circledDigitsImg;
 }
 
@@ -108,24 +604,49 @@ Mat OcrPreprocessor::BlackWhiteThresholding(
     const double scaleFactor,
     const Mat& circledDigitsImg)
 {
-    Mat grayImg;
+    Workspace workspace;
+    return BlackWhiteThresholding(scaleFactor, circledDigitsImg, workspace);
+}
+
+Mat OcrPreprocessor::BlackWhiteThresholding(
+    const double scaleFactor,
+    const Mat& circledDigitsImg,
+    Workspace& workspace)
+{
+    Mat grayImg = workspace.GetMat("bwGray", circledDigitsImg.size(), CV_8UC1);
     cvtColor(circledDigitsImg, grayImg, COLOR_BGR2GRAY);
 
     double minVal = 0.0;
     double maxVal = 0.0;
     minMaxLoc(grayImg, &minVal, &maxVal);
 
-    Mat resizedImg;
-    resize(grayImg, resizedImg, Size(0, 0), scaleFactor, scaleFactor);
+    // Note that resize() computes the same size from the scale factor.
+    Size resizedSize(cvRound(grayImg.cols*scaleFactor), cvRound(grayImg.rows*scaleFactor));
+    Mat resizedImg = workspace.GetMat("bwResized", resizedSize, CV_8UC1);
+    resize(grayImg, resizedImg, resizedSize);
 
     double thresh = minVal + 0.3*(maxVal - minVal);
 
-    Mat blackWhiteImg;
+    Mat blackWhiteImg = workspace.GetMat("bw", resizedSize, CV_8UC1);
     threshold(resizedImg, blackWhiteImg, thresh, 255, THRESH_BINARY_INV);
 
     return blackWhiteImg;
 }
 
+Mat OcrPreprocessor::CropCircledDigits(
+    const Mat& bookCoverImg,
+    const Rect& circledDigitsRect,
+    Workspace& workspace)
+{
+    const Rect rect = circledDigitsRect & Rect(0, 0, bookCoverImg.cols, bookCoverImg.rows);
+    if (rect.empty())
+    {
+        return Mat();
+    }
+
+    return SharpenRegion(bookCoverImg, rect, "cropSharpened", workspace);
+}
+
 string OcrPreprocessor::ExtractMethod2Str(const ExtractMethod method)
 {
     switch (method)
@@ -171,29 +692,350 @@ OcrPreprocessor::ExtractMethod OcrPreprocessor::Str2ExtractMethod(const string&
     }
 }
 
-Mat OcrPreprocessor::SharpenImg(const Mat& img)
+double OcrPreprocessor::EstimateSkewAngle(
+    const Mat& bookCoverImg,
+    Workspace& workspace)
+{
+    // Estimate the skew on a grayscale image downsampled such that its longer side is
+    // at most 512 pixels, which is accurate enough for a fraction of a degree.
+    const double scale = min(1.0, 512.0/max(bookCoverImg.cols, bookCoverImg.rows));
+
+    Size smallSize(max(cvRound(bookCoverImg.cols*scale), 1), max(cvRound(bookCoverImg.rows*scale), 1));
+    Mat smallImg = workspace.GetMat("skewSmall", smallSize, bookCoverImg.type());
+    resize(bookCoverImg, smallImg, smallSize, 0, 0, INTER_AREA);
+
+    Mat smallGrayImg;
+    if (smallImg.channels() == 3)
+    {
+        smallGrayImg = workspace.GetMat("skewGray", smallSize, CV_8UC1);
+        cvtColor(smallImg, smallGrayImg, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        smallGrayImg = smallImg;
+    }
+
+    Mat gradX = workspace.GetMat("skewGradX", smallSize, CV_32FC1);
+    Mat gradY = workspace.GetMat("skewGradY", smallSize, CV_32FC1);
+    Sobel(smallGrayImg, gradX, CV_32F, 1, 0);
+    Sobel(smallGrayImg, gradY, CV_32F, 0, 1);
+
+    // Since the cover edges, the text lines and the frames are mostly horizontal or vertical,
+    // we fold the gradient orientations into [-45, 45) degrees and find the dominant one in
+    // a histogram weighted by the gradient magnitude. Weak gradients from the noise or the
+    // flat areas are ignored.
+    const double binWidth = 0.25;
+    const int cntBins = cvRound(2*m_maxSkewAngle/binWidth) + 1;
+    const float minMagnitude = 32.0f;
+
+    vector<double>& hist = workspace.GetDoubleVector("skewHist");
+    hist.assign(cntBins, 0.0);
+    for (int row = 0; row < gradX.rows; ++row)
+    {
+        const float* gradXRow = gradX.ptr<float>(row);
+        const float* gradYRow = gradY.ptr<float>(row);
+        for (int col = 0; col < gradX.cols; ++col)
+        {
+            const float magnitude2 = gradXRow[col]*gradXRow[col] + gradYRow[col]*gradYRow[col];
+            if (magnitude2 < minMagnitude*minMagnitude)
+            {
+                continue;
+            }
+
+            const double angle = atan2(gradYRow[col], gradXRow[col])*180.0/CV_PI;
+            const double foldedAngle = fmod(angle + 405.0, 90.0) - 45.0;
+            if (fabs(foldedAngle) > m_maxSkewAngle)
+            {
+                continue;
+            }
+
+            const int bin = min(max(cvRound((foldedAngle + m_maxSkewAngle)/binWidth), 0), cntBins - 1);
+            hist[bin] += std::sqrt(magnitude2);
+        }
+    }
+
+    // Smooth the histogram with [1, 2, 1] and refine the peak by a parabola fit.
+    vector<double>& smoothedHist = workspace.GetDoubleVector("skewSmooth");
+    smoothedHist.assign(cntBins, 0.0);
+    for (int bin = 0; bin < cntBins; ++bin)
+    {
+        const double prev = (bin > 0) ? hist[bin - 1] : 0.0;
+        const double next = (bin < cntBins - 1) ? hist[bin + 1] : 0.0;
+        smoothedHist[bin] = 0.25*prev + 0.5*hist[bin] + 0.25*next;
+    }
+
+    const int peakBin = static_cast<int>(max_element(smoothedHist.begin(), smoothedHist.end()) - smoothedHist.begin());
+    if (smoothedHist[peakBin] <= 0.0)
+    {
+        return 0.0;
+    }
+
+    double peakOffset = 0.0;
+    if ((peakBin > 0) && (peakBin < cntBins - 1))
+    {
+        const double prev = smoothedHist[peakBin - 1];
+        const double next = smoothedHist[peakBin + 1];
+        const double denominator = prev - 2*smoothedHist[peakBin] + next;
+        if (denominator < 0.0)
+        {
+            peakOffset = 0.5*(prev - next)/denominator;
+        }
+    }
+
+    // A counter-clockwise skew of the scan rotates the gradient orientations clockwise in
+    // the image coordinates, whose y axis points downwards, so we negate the peak.
+    const double foldedPeak = (peakBin + peakOffset)*binWidth - m_maxSkewAngle;
+    return -foldedPeak;
+}
+
+Rect OcrPreprocessor::GetReadRegion(const Size& bookCoverSize) const
+{
+    const Rect bookCoverRect(0, 0, bookCoverSize.width, bookCoverSize.height);
+
+    // The halo covers the Gaussian kernel in SharpenImg and the Sobel kernel.
+    const int halo = 16;
+
+    Rect readRegion = bookCoverRect;
+    if (m_method == ExtractMethod::HoughCircleTransform)
+    {
+        // The circle may extend m_maxRadius pixels outside the region of its center, and
+        // we crop it with a buffer of m_circleBufferWidth pixels.
+        const Rect centerRect = m_houghSearchRegion & bookCoverRect;
+        const int expansion = static_cast<int>(m_maxRadius + m_circleBufferWidth) + halo;
+        readRegion = Rect(
+            centerRect.x - expansion,
+            centerRect.y - expansion,
+            centerRect.width + 2*expansion,
+            centerRect.height + 2*expansion);
+    }
+    else if ((m_method == ExtractMethod::Homography) && !m_detectionRegion.empty() && !m_priorEnabled)
+    {
+        // The circled digits are cropped around the center of the title shifted by the
+        // displacement, and the center of the title is inside the detection region. Note
+        // that the fallback of the series prior may search the whole cover, so we don't
+        // restrict the region if the series prior is enabled.
+        const Rect detectionRect = m_detectionRegion & bookCoverRect;
+        const int width = static_cast<int>(m_width);
+        const int height = static_cast<int>(m_height);
+        const Rect cropRect(
+            detectionRect.x + m_centerDisplacementX - width/2,
+            detectionRect.y + m_centerDisplacementY - height/2,
+            detectionRect.width + width,
+            detectionRect.height + height);
+        const Rect unionRect = detectionRect | cropRect;
+        readRegion = Rect(
+            unionRect.x - halo,
+            unionRect.y - halo,
+            unionRect.width + 2*halo,
+            unionRect.height + 2*halo);
+    }
+
+    return readRegion & bookCoverRect;
+}
+
+Mat OcrPreprocessor::SharpenImg(
+    const Mat& img,
+    Workspace& workspace)
 {
     // Sharpen the image using Unsharp Masking with a Gaussian blurred version of the image. Note that
     // srcImgGaussian = 1.5*srcImg - 0.5*srcImgGaussian, but to avoid overflow while multiplying srcImg
-    // by 1.5, we subtract srcImgGaussian from srcImg first and then add 0.5*srcImg.
-    Mat res;
-    GaussianBlur(img, res, Size(0, 0), 3);
+    // by 1.5, we subtract srcImgGaussian from srcImg first and then add 0.5*srcImg. The image
+    // may be a part of a larger workspace buffer, so the blur must not read beyond it.
+    Mat res = workspace.GetMat("sharpened", img.size(), img.type());
+    GaussianBlur(img, res, Size(0, 0), 3, 0, BORDER_DEFAULT | BORDER_ISOLATED);
     addWeighted(img, 1.0, res, -0.5, 0.0, res);
     addWeighted(img, 0.5, res, 1.0, 0.0, res);
 
     return res;
 }
 
+Mat OcrPreprocessor::SharpenRegion(
+    const Mat& img,
+    const Rect& rect,
+    const string& bufferName,
+    Workspace& workspace)
+{
+    // Blur the rect with a halo of the Gaussian kernel radius inside the image, which is
+    // 9 pixels for 8-bit images and 12 otherwise, and drop the halo. Since the halo ends
+    // only at the image edges, the result is identical to the corresponding part of
+    // SharpenImg on the whole image.
+    const int halo = 12;
+    const Rect haloRect = Rect(rect.x - halo, rect.y - halo, rect.width + 2*halo, rect.height + 2*halo) & Rect(0, 0, img.cols, img.rows);
+    Mat res = workspace.GetMat(bufferName, haloRect.size(), img.type());
+    GaussianBlur(img(haloRect), res, Size(0, 0), 3, 0, BORDER_DEFAULT | BORDER_ISOLATED);
+    addWeighted(img(haloRect), 1.0, res, -0.5, 0.0, res);
+    addWeighted(img(haloRect), 0.5, res, 1.0, 0.0, res);
+
+    return res(rect - haloRect.tl());
+}
+
+Mat OcrPreprocessor::ComputeSobel(
+    const Mat& img,
+    const Rect& rect,
+    const SobelPrecision precision,
+    const string& bufferName,
+    Workspace& workspace)
+{
+    // Differentiate the rect with a border of one pixel inside the image and drop the
+    // border, so that the Sobel derivative of the rect is identical to the corresponding
+    // part of the Sobel derivative of the whole image. Note that Sobel on a ROI would read
+    // its parent across the image edges if the image is a part of a larger workspace
+    // buffer, so the bordered rect is differentiated in isolation.
+    const Rect borderedRect = Rect(rect.x - 1, rect.y - 1, rect.width + 2, rect.height + 2) & Rect(0, 0, img.cols, img.rows);
+    const Rect innerRect = rect - borderedRect.tl();
+    if (precision == SobelPrecision::Float32)
+    {
+        Mat sobelImg = workspace.GetMat(bufferName, borderedRect.size(), CV_32FC(img.channels()));
+        Sobel(img(borderedRect), sobelImg, CV_32F, 1, 1, 3, 1.0, 0.0, BORDER_DEFAULT | BORDER_ISOLATED);
+        return sobelImg(innerRect);
+    }
+
+    Mat grayImg = workspace.GetMat(bufferName + "Gray", borderedRect.size(), CV_8UC1);
+    if (img.channels() == 3)
+    {
+        cvtColor(img(borderedRect), grayImg, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        img(borderedRect).copyTo(grayImg);
+    }
+
+    // The first derivatives of 8-bit pixels are within +/- 1020, so |dx|/4 and |dy|/4 fit
+    // into 8 bits, and their mean is the magnitude, rounded and saturated into CV_8U.
+    Mat dxImg = workspace.GetMat(bufferName + "Dx", borderedRect.size(), CV_16SC1);
+    Mat dyImg = workspace.GetMat(bufferName + "Dy", borderedRect.size(), CV_16SC1);
+    Sobel(grayImg, dxImg, CV_16S, 1, 0, 3, 1.0, 0.0, BORDER_DEFAULT | BORDER_ISOLATED);
+    Sobel(grayImg, dyImg, CV_16S, 0, 1, 3, 1.0, 0.0, BORDER_DEFAULT | BORDER_ISOLATED);
+
+    Mat absDxImg = workspace.GetMat(bufferName + "AbsDx", rect.size(), CV_8UC1);
+    Mat absDyImg = workspace.GetMat(bufferName + "AbsDy", rect.size(), CV_8UC1);
+    convertScaleAbs(dxImg(innerRect), absDxImg, 0.25);
+    convertScaleAbs(dyImg(innerRect), absDyImg, 0.25);
+
+    Mat sobelImg = workspace.GetMat(bufferName, rect.size(), CV_8UC1);
+    addWeighted(absDxImg, 0.5, absDyImg, 0.5, 0.0, sobelImg);
+    return sobelImg;
+}
+
+Mat OcrPreprocessor::ComputeSharpenedSobel(
+    const Mat& img,
+    const Rect& rect,
+    const SobelPrecision precision,
+    const string& bufferName,
+    Workspace& workspace)
+{
+    // Sharpen the rect with the border of one pixel read by the Sobel kernel.
+    const Rect sharpenRect = Rect(rect.x - 1, rect.y - 1, rect.width + 2, rect.height + 2) & Rect(0, 0, img.cols, img.rows);
+    Mat sharpenedImg = SharpenRegion(img, sharpenRect, bufferName + "Sh", workspace);
+
+    return ComputeSobel(sharpenedImg, rect - sharpenRect.tl(), precision, bufferName, workspace);
+}
+
+bool OcrPreprocessor::FindTitleInTiles(
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    Point& matchPoint)
+{
+    // The match positions are split into tiles, and each tile reads the region of the
+    // cover covered by the title at its positions.
+    const int cntPositionCols = bookCoverImg.cols - m_titleImgSobel.cols + 1;
+    const int cntPositionRows = bookCoverImg.rows - m_titleImgSobel.rows + 1;
+    if ((cntPositionCols <= 0) || (cntPositionRows <= 0))
+    {
+        printf("[ERROR]: The book cover with %d x %d pixels is smaller than the title.\n\n", bookCoverImg.cols, bookCoverImg.rows);
+        return false;
+    }
+
+    const int cntTileCols = (cntPositionCols + m_tileSize - 1)/m_tileSize;
+    const int cntTileRows = (cntPositionRows + m_tileSize - 1)/m_tileSize;
+    const int cntTiles = cntTileCols*cntTileRows;
+
+    vector<double> tileMaxScores(cntTiles, -numeric_limits<double>::max());
+    vector<Point> tileMatchPoints(cntTiles);
+    vector<char> tileMatched(cntTiles, 0);
+
+    // Each stripe processes every cntStripes-th tile with its own child workspace, so the
+    // peak memory is that of cntStripes tiles, and the buffers are kept for the next cover.
+    const int cntStripes = max(min(cntTiles, getNumThreads()), 1);
+    vector<Workspace*> stripeWorkspaces(cntStripes);
+    for (int stripe = 0; stripe < cntStripes; ++stripe)
+    {
+        stripeWorkspaces[stripe] = &workspace.GetChild(stripe);
+    }
+
+    parallel_for_(Range(0, cntStripes), [&](const Range& range)
+    {
+        for (int stripe = range.start; stripe < range.end; ++stripe)
+        {
+            Workspace& tileWorkspace = *stripeWorkspaces[stripe];
+            for (int tileIndex = stripe; tileIndex < cntTiles; tileIndex += cntStripes)
+            {
+                const Rect positionRect = Rect(
+                    (tileIndex % cntTileCols)*m_tileSize,
+                    (tileIndex/cntTileCols)*m_tileSize,
+                    m_tileSize,
+                    m_tileSize) & Rect(0, 0, cntPositionCols, cntPositionRows);
+                const Rect tileRect(
+                    positionRect.x,
+                    positionRect.y,
+                    positionRect.width + m_titleImgSobel.cols - 1,
+                    positionRect.height + m_titleImgSobel.rows - 1);
+
+                Mat tileSobel = ComputeSharpenedSobel(bookCoverImg, tileRect, m_sobelPrecision, "tileSobel", tileWorkspace);
+                Point tileMatchPoint;
+                if (MatchTitleSobel(tileSobel, tileWorkspace, tileMatchPoint, &tileMaxScores[tileIndex]))
+                {
+                    tileMatchPoints[tileIndex] = tileMatchPoint + tileRect.tl();
+                    tileMatched[tileIndex] = 1;
+                }
+            }
+        }
+    }, cntStripes);
+
+    // A tile below another one may hold a position of an earlier row, so equal maxima are
+    // ordered by their positions in the cover, which keeps the first one in the row-major
+    // order like minMaxLoc. Note that matchTemplate may round the scores of a tile slightly
+    // differently than those of the whole cover.
+    int bestTile = -1;
+    for (int tileIndex = 0; tileIndex < cntTiles; ++tileIndex)
+    {
+        if (!tileMatched[tileIndex])
+        {
+            continue;
+        }
+
+        const Point& tilePoint = tileMatchPoints[tileIndex];
+        if ((bestTile < 0) ||
+            (tileMaxScores[tileIndex] > tileMaxScores[bestTile]) ||
+            ((tileMaxScores[tileIndex] == tileMaxScores[bestTile]) &&
+                ((tilePoint.y < tileMatchPoints[bestTile].y) ||
+                ((tilePoint.y == tileMatchPoints[bestTile].y) && (tilePoint.x < tileMatchPoints[bestTile].x)))))
+        {
+            bestTile = tileIndex;
+        }
+    }
+
+    if (bestTile < 0)
+    {
+        return false;
+    }
+
+    matchPoint = tileMatchPoints[bestTile];
+    return true;
+}
+
 Point OcrPreprocessor::GetTemplateMatchingPoint(
     const Mat& srcImg,
     const Mat& templImg,
-    OutputArray result)
+    Workspace& workspace,
+    OutputArray result,
+    double* maxScore)
 {
     // Create the result matrix.
     const int resultRows = srcImg.rows - templImg.rows + 1;
     const int resultCols =  srcImg.cols - templImg.cols + 1;
 
-    Mat tmpResult(resultRows, resultCols, CV_32FC1);
+    Mat tmpResult = workspace.GetMat("matchRes", Size(resultCols, resultRows), CV_32FC1);
 
     // Do the Template Matching and Normalize.
     matchTemplate(srcImg, templImg, tmpResult, TM_CCOEFF_NORMED);
@@ -209,11 +1051,32 @@ Point OcrPreprocessor::GetTemplateMatchingPoint(
         tmpResult.copyTo(result);
     }
 
+    if (maxScore != nullptr)
+    {
+        *maxScore = maxVal;
+    }
+
     // For CCOEFF_NORMED, the best match is the maximum value.
     // Note that since result has been normalized into the range [0, 1], the maximum value is 1.
     return maxLoc;
 }
 
+bool OcrPreprocessor::MatchTitleSobel(
+    const Mat& srcImg,
+    Workspace& workspace,
+    Point& matchPoint,
+    double* maxScore)
+{
+    if ((srcImg.cols < m_titleImgSobel.cols) || (srcImg.rows < m_titleImgSobel.rows))
+    {
+        printf("[ERROR]: The image with %d x %d pixels is smaller than the title.\n\n", srcImg.cols, srcImg.rows);
+        return false;
+    }
+
+    matchPoint = GetTemplateMatchingPoint(srcImg, m_titleImgSobel, workspace, noArray(), maxScore);
+    return true;
+}
+
 Rect OcrPreprocessor::ShiftAndResizeRect(
     const int topLeftX,
     const int topLeftY)
@@ -230,35 +1093,257 @@ Rect OcrPreprocessor::ShiftAndResizeRect(
     return Rect(circledDigitsImgTopLeft.x, circledDigitsImgTopLeft.y, m_width, m_height);
 }
 
+bool OcrPreprocessor::GetPriorSearchRect(
+    const Size& bookCoverSize,
+    Workspace& workspace,
+    Rect& searchRect) const
+{
+    if (!m_priorEnabled || m_priorTitleRects.empty())
+    {
+        return false;
+    }
+
+    // Use the component-wise median of the recent title rectangles so that a single
+    // outlier in the history doesn't move the search window away.
+    vector<int>& xs = workspace.GetIntVector("priorXs");
+    vector<int>& ys = workspace.GetIntVector("priorYs");
+    vector<int>& widths = workspace.GetIntVector("priorWidths");
+    vector<int>& heights = workspace.GetIntVector("priorHeights");
+    for (const auto& rect: m_priorTitleRects)
+    {
+        xs.push_back(rect.x);
+        ys.push_back(rect.y);
+        widths.push_back(rect.width);
+        heights.push_back(rect.height);
+    }
+
+    const size_t mid = m_priorTitleRects.size()/2;
+    nth_element(xs.begin(), xs.begin() + mid, xs.end());
+    nth_element(ys.begin(), ys.begin() + mid, ys.end());
+    nth_element(widths.begin(), widths.begin() + mid, widths.end());
+    nth_element(heights.begin(), heights.begin() + mid, heights.end());
+
+    // Expand the prior rectangle by the margin and clip it by the cover.
+    searchRect = Rect(
+        xs[mid] - m_priorMargin,
+        ys[mid] - m_priorMargin,
+        widths[mid] + 2*m_priorMargin,
+        heights[mid] + 2*m_priorMargin);
+    searchRect &= Rect(0, 0, bookCoverSize.width, bookCoverSize.height);
+
+    return !searchRect.empty();
+}
+
+bool OcrPreprocessor::VerifyPriorMatch(
+    const Rect& priorTitleRect,
+    const Rect& titleRect,
+    ExtractReport& report) const
+{
+    report.priorVerified = true;
+    report.priorOffset = max(
+        max(abs(priorTitleRect.x - titleRect.x), abs(priorTitleRect.y - titleRect.y)),
+        max(abs(priorTitleRect.br().x - titleRect.br().x), abs(priorTitleRect.br().y - titleRect.br().y)));
+    report.priorMismatched = (report.priorOffset > m_priorTolerance);
+
+#ifdef DEBUG
+    if (report.priorMismatched)
+    {
+        printf("[DEBUG]: The match around the series prior is %d pixels away from the match in the whole cover.\n",
+            report.priorOffset);
+    }
+#endif
+
+    return !report.priorMismatched;
+}
+
+void OcrPreprocessor::UpdatePrior(const Rect& titleRect)
+{
+    if (!m_priorEnabled)
+    {
+        return;
+    }
+
+    // Replace the oldest rectangle once the history is full.
+    if (m_priorTitleRects.size() < m_priorHistoryLen)
+    {
+        m_priorTitleRects.push_back(titleRect);
+    }
+    else
+    {
+        m_priorTitleRects[m_priorNextIndex] = titleRect;
+    }
+
+    m_priorNextIndex = (m_priorNextIndex + 1) % m_priorHistoryLen;
+}
+
 Mat OcrPreprocessor::ExtractCircledDigitsViaTemplateMatching(
-    const Mat& bookCoverImg)
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    const Deadline& deadline,
+    ExtractReport& report)
 {
-    Mat bookCoverImgSobel;
-    Sobel(bookCoverImg, bookCoverImgSobel, CV_32F, 1, 1);
+    Point matchPoint;
+    bool matched = false;
+
+    Rect searchRect;
+    if (GetPriorSearchRect(bookCoverImg.size(), workspace, searchRect))
+    {
+        if ((searchRect.width >= m_titleImgSobel.cols) && (searchRect.height >= m_titleImgSobel.rows))
+        {
+            Mat searchImgSobel = (m_tileSize > 0)
+                ? ComputeSharpenedSobel(bookCoverImg, searchRect, m_sobelPrecision, "winSobel", workspace)
+                : ComputeSobel(bookCoverImg, searchRect, m_sobelPrecision, "winSobel", workspace);
+
+            double maxScore = -1.0;
+            Point windowMatchPoint;
+            const bool windowMatched = MatchTitleSobel(searchImgSobel, workspace, windowMatchPoint, &maxScore);
+
+            // A maximum on the edge of the window may be the slope of a better peak
+            // outside the window, so we reject it unless the window edge is the cover edge.
+            const int lastCol = searchRect.width - m_titleImgSobel.cols;
+            const int lastRow = searchRect.height - m_titleImgSobel.rows;
+            bool onWindowEdge =
+                ((windowMatchPoint.x == 0) && (searchRect.x > 0)) ||
+                ((windowMatchPoint.y == 0) && (searchRect.y > 0)) ||
+                ((windowMatchPoint.x == lastCol) && (searchRect.x + searchRect.width < bookCoverImg.cols)) ||
+                ((windowMatchPoint.y == lastRow) && (searchRect.y + searchRect.height < bookCoverImg.rows));
+
+            if (windowMatched && (maxScore >= m_priorMinScore) && !onWindowEdge)
+            {
+                matchPoint = windowMatchPoint + searchRect.tl();
+                matched = true;
+            }
+#ifdef DEBUG
+            else
+            {
+                printf("[DEBUG]: Reject the match around the series prior with score %f%s.\n",
+                    maxScore, onWindowEdge ? " on the window edge" : "");
+            }
+#endif
+        }
+    }
+
+    // The verification searches the whole cover even if the match around the prior is accepted.
+    const bool verifyPrior = matched && (m_priorTolerance >= 0);
+    const Point priorMatchPoint = matchPoint;
+    if ((!matched || verifyPrior) && (m_tileSize > 0))
+    {
+        if (CheckDeadline(deadline, "match", report))
+        {
+            return Mat();
+        }
+
+        if (!FindTitleInTiles(bookCoverImg, workspace, matchPoint))
+        {
+            return Mat();
+        }
+    }
+    else if (!matched || verifyPrior)
+    {
+        if (CheckDeadline(deadline, "sobel", report))
+        {
+            return Mat();
+        }
+
+        Mat bookCoverImgSobel = ComputeSobel(bookCoverImg, Rect(0, 0, bookCoverImg.cols, bookCoverImg.rows),
+            m_sobelPrecision, "coverSobel", workspace);
+
+        if (CheckDeadline(deadline, "match", report))
+        {
+            return Mat();
+        }
 
-    Point matchPoint = GetTemplateMatchingPoint(bookCoverImgSobel, m_titleImgSobel, noArray());
+        if (!MatchTitleSobel(bookCoverImgSobel, workspace, matchPoint))
+        {
+            return Mat();
+        }
+    }
+
+    if (verifyPrior && VerifyPriorMatch(Rect(priorMatchPoint, m_titleImgSobel.size()),
+        Rect(matchPoint, m_titleImgSobel.size()), report))
+    {
+        matchPoint = priorMatchPoint;
+    }
+
+    UpdatePrior(Rect(matchPoint.x, matchPoint.y, m_titleImgSobel.cols, m_titleImgSobel.rows));
 
     // Shift and resize the rectangle such that it will contain the circled digits.
     Rect circledDigitsRect = ShiftAndResizeRect(matchPoint.x, matchPoint.y);
+    report.circledDigitsRect = circledDigitsRect;
 
-    // Crop the patch of the source image which contains the circled digits.
-    Mat circledDigitsImg = bookCoverImg(circledDigitsRect);
+    // Crop the patch of the source image which contains the circled digits. The tiled
+    // search gets the unsharpened cover, so only the patch is sharpened.
+    Mat circledDigitsImg = (m_tileSize > 0) ? SharpenRegion(bookCoverImg, circledDigitsRect, "cropSharpened", workspace) : bookCoverImg(circledDigitsRect);
     return circledDigitsImg;
 }
 
-Mat OcrPreprocessor::ExtractCircledDigitsViaHomography(
-    const Mat& bookCoverImg)
+bool OcrPreprocessor::FindTitleRectViaHomography(
+    const Mat& bookCoverImg,
+    const Rect& searchRect,
+    const bool logErrors,
+    Workspace& workspace,
+    const Deadline& deadline,
+    ExtractReport& report,
+    Rect& titleRect,
+    double& inlierRatio)
 {
-    Mat circledDigitsImg;
-
-    // Compute the keypoints and the descriptors of bookCoverImg.
-    vector<KeyPoint> bookCoverImgKeyPoints;
+    // Compute the keypoints and the descriptors of the search region of bookCoverImg,
+    // and then map the keypoints back into the cover coordinates. We detect and compute
+    // separately, so that the number of the descriptors is known and they are written
+    // into the workspace buffer.
+    vector<KeyPoint>& bookCoverImgKeyPoints = workspace.GetKeyPointVector("coverKps");
+    Mat searchImg = bookCoverImg(searchRect);
     Mat bookCoverImgDescriptors;
-    m_detector->detectAndCompute(bookCoverImg, noArray(), bookCoverImgKeyPoints, bookCoverImgDescriptors);
+
+    // The cached keypoints are those of the same pixels detected with the same parameters.
+    uint64_t cacheKey = 0;
+    if (m_keyPointCache != nullptr)
+    {
+        const string detectorParams = format("surf %f %d %d %d %d max %d",
+            m_detector->getHessianThreshold(), m_detector->getNOctaves(), m_detector->getNOctaveLayers(),
+            m_detector->getExtended() ? 1 : 0, m_detector->getUpright() ? 1 : 0, m_maxKeyPoints);
+        cacheKey = KeyPointCache::ComputeKey(searchImg, detectorParams);
+    }
+
+    if ((m_keyPointCache == nullptr) || !m_keyPointCache->Load(cacheKey, workspace, bookCoverImgKeyPoints, bookCoverImgDescriptors))
+    {
+        m_detector->detect(searchImg, bookCoverImgKeyPoints);
+        if (m_maxKeyPoints > 0)
+        {
+            // Keep only the strongest keypoints before computing their descriptors, which
+            // saves both the descriptor computation and the matching.
+            KeyPointsFilter::retainBest(bookCoverImgKeyPoints, m_maxKeyPoints);
+        }
+
+        bookCoverImgDescriptors = workspace.GetMat(
+            "coverDesc",
+            Size(m_detector->descriptorSize(), static_cast<int>(bookCoverImgKeyPoints.size())),
+            m_detector->descriptorType());
+        m_detector->compute(searchImg, bookCoverImgKeyPoints, bookCoverImgDescriptors);
+
+        // Note that compute() may drop the keypoints near the border and reallocate the descriptors.
+        workspace.AdoptMat("coverDesc", bookCoverImgDescriptors);
+
+        if (m_keyPointCache != nullptr)
+        {
+            m_keyPointCache->Store(cacheKey, bookCoverImgKeyPoints, bookCoverImgDescriptors);
+        }
+    }
+
+    if (CheckDeadline(deadline, "match", report))
+    {
+        return false;
+    }
+
+    for (auto& keyPoint: bookCoverImgKeyPoints)
+    {
+        keyPoint.pt.x += searchRect.x;
+        keyPoint.pt.y += searchRect.y;
+    }
 
     // Use the brute-force matcher to find the matched descriptors for all the descriptors
     // of titleImg.
-    vector<DMatch> matches;
+    vector<DMatch>& matches = workspace.GetMatchVector("matches");
     m_matcher->match(m_titleImgDescriptors, bookCoverImgDescriptors, matches);
 
     // Sort the matches based on the distance and filter out the first few "good" matches to
@@ -268,31 +1353,127 @@ Mat OcrPreprocessor::ExtractCircledDigitsViaHomography(
     size_t cntGoodMatches = min(static_cast<size_t>(50), static_cast<size_t>(matches.size()*0.3));
     if (cntGoodMatches < 5)
     {
-        printf("[ERROR]: Unable to find enough (%ld < 5) good matches for computing the homography.\n\n",
-            cntGoodMatches);
-        return circledDigitsImg;
+        if (logErrors)
+        {
+            printf("[ERROR]: Unable to find enough (%ld < 5) good matches for computing the homography.\n\n",
+                cntGoodMatches);
+        }
+        return false;
     }
 
-    vector<DMatch> goodMatches(matches.begin(), matches.begin() + cntGoodMatches);
-
     // Find the homography and do the perspective transformation.
-    vector<Point2f> titleImgPoints;
-    vector<Point2f> bookCoverPoints;
+    vector<Point2f>& titleImgPoints = workspace.GetPointVector("titlePts");
+    vector<Point2f>& bookCoverPoints = workspace.GetPointVector("coverPts");
     for (size_t goodMatchIndex = 0; goodMatchIndex < cntGoodMatches; ++goodMatchIndex)
     {
-        titleImgPoints.push_back(m_titleImgKeyPoints[goodMatches[goodMatchIndex].queryIdx].pt);
-        bookCoverPoints.push_back(bookCoverImgKeyPoints[goodMatches[goodMatchIndex].trainIdx].pt);
+        titleImgPoints.push_back(m_titleImgKeyPoints[matches[goodMatchIndex].queryIdx].pt);
+        bookCoverPoints.push_back(bookCoverImgKeyPoints[matches[goodMatchIndex].trainIdx].pt);
     }
 
-    Mat homo = findHomography(titleImgPoints, bookCoverPoints, RANSAC);
+    Mat inlierMask = workspace.GetMat("inliers", Size(1, static_cast<int>(cntGoodMatches)), CV_8UC1);
+    Mat homo = findHomography(titleImgPoints, bookCoverPoints, RANSAC, 3, inlierMask);
+    if (homo.empty())
+    {
+        if (logErrors)
+        {
+            printf("[ERROR]: Unable to compute the homography from %ld good matches.\n\n", cntGoodMatches);
+        }
+        return false;
+    }
+
+    inlierRatio = static_cast<double>(countNonZero(inlierMask))/cntGoodMatches;
 
-    vector<Point2f> bookCoverCorners(4);
+    vector<Point2f>& bookCoverCorners = workspace.GetPointVector("corners");
+    bookCoverCorners.resize(4);
     perspectiveTransform(m_titleImgCorners, bookCoverCorners, homo);
 
-    Rect matchRect = boundingRect(bookCoverCorners);
+    titleRect = boundingRect(bookCoverCorners);
+    return true;
+}
+
+Mat OcrPreprocessor::ExtractCircledDigitsViaHomography(
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    const Deadline& deadline,
+    ExtractReport& report)
+{
+    const Rect bookCoverRect(0, 0, bookCoverImg.cols, bookCoverImg.rows);
+
+    Mat circledDigitsImg;
+    Rect matchRect;
+    bool matched = false;
+
+    Rect searchRect;
+    if (GetPriorSearchRect(bookCoverImg.size(), workspace, searchRect))
+    {
+        // Only detect the keypoints inside the window around the prior, and accept the
+        // homography if enough good matches are its inliers and the title lies inside the window.
+        double inlierRatio = 0.0;
+        if (FindTitleRectViaHomography(bookCoverImg, searchRect, false, workspace, deadline, report, matchRect, inlierRatio) &&
+            (inlierRatio >= m_priorMinScore) &&
+            ((matchRect & searchRect) == matchRect))
+        {
+            matched = true;
+        }
+#ifdef DEBUG
+        else
+        {
+            printf("[DEBUG]: Reject the homography around the series prior with inlier ratio %f.\n", inlierRatio);
+        }
+#endif
+    }
+
+    if (report.status == ExtractStatus::Timeout)
+    {
+        return circledDigitsImg;
+    }
+
+    // The verification searches the whole cover even if the match around the prior is accepted.
+    const bool verifyPrior = matched && (m_priorTolerance >= 0);
+    const Rect priorMatchRect = matchRect;
+    if (!matched || verifyPrior)
+    {
+        if (CheckDeadline(deadline, "detect", report))
+        {
+            return circledDigitsImg;
+        }
+
+        Rect detectionRect = bookCoverRect;
+        if (!m_detectionRegion.empty())
+        {
+            detectionRect &= m_detectionRegion;
+            if (detectionRect.empty())
+            {
+                printf("[ERROR]: The detection region is outside the book cover.\n\n");
+                return circledDigitsImg;
+            }
+        }
+
+        double inlierRatio = 0.0;
+        if (!FindTitleRectViaHomography(bookCoverImg, detectionRect, !matched, workspace, deadline, report, matchRect, inlierRatio))
+        {
+            if (!verifyPrior || (report.status == ExtractStatus::Timeout))
+            {
+                return circledDigitsImg;
+            }
+
+            // Nothing to fall back to, so keep the match around the prior but report it.
+            report.priorVerified = true;
+            report.priorMismatched = true;
+            report.priorOffset = -1;
+            matchRect = priorMatchRect;
+        }
+        else if (verifyPrior && VerifyPriorMatch(priorMatchRect, matchRect, report))
+        {
+            matchRect = priorMatchRect;
+        }
+    }
+
+    UpdatePrior(matchRect);
 
     // Shift and resize the rectangle such that it will contain the circled digits.
     Rect circledDigitsRect = ShiftAndResizeRect(matchRect.x, matchRect.y);
+    report.circledDigitsRect = circledDigitsRect;
 
     // Crop the patch of the source image which contains the circled digits.
     circledDigitsImg = bookCoverImg(circledDigitsRect);
@@ -300,29 +1481,77 @@ Mat OcrPreprocessor::ExtractCircledDigitsViaHomography(
 }
 
 Mat OcrPreprocessor::ExtractCircledDigitsViaHoughTransform(
-    const Mat& bookCoverImg)
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    const Deadline& deadline,
+    ExtractReport& report)
 {
-    // Convert the BGR image into grayscale.
-    Mat bookCoverGrayImg;
-    cvtColor(bookCoverImg, bookCoverGrayImg, COLOR_BGR2GRAY);
+    Mat circledDigitsImg;
+
+    const Rect bookCoverRect(0, 0, bookCoverImg.cols, bookCoverImg.rows);
+    const Rect centerRect = m_houghSearchRegion & bookCoverRect;
+    if (centerRect.empty())
+    {
+        printf("[ERROR]: The Hough search region is outside the book cover.\n\n");
+        return circledDigitsImg;
+    }
 
-    Mat bookCoverGrayEqualizedImg;
+    // A circle whose center is inside centerRect may extend m_maxRadius pixels outside,
+    // so we transform centerRect expanded by m_maxRadius.
+    const int maxRadius = static_cast<int>(m_maxRadius);
+    Rect transformRect(
+        centerRect.x - maxRadius,
+        centerRect.y - maxRadius,
+        centerRect.width + 2*maxRadius,
+        centerRect.height + 2*maxRadius);
+    transformRect &= bookCoverRect;
+
+    // Sharpen only the transformed region, and convert it into grayscale.
+    Mat sharpenedImg = SharpenRegion(bookCoverImg, transformRect, "houghSharpened", workspace);
+    Mat bookCoverGrayImg = workspace.GetMat("houghGray", transformRect.size(), CV_8UC1);
+    cvtColor(sharpenedImg, bookCoverGrayImg, COLOR_BGR2GRAY);
+
+    Mat bookCoverGrayEqualizedImg = workspace.GetMat("houghEq", transformRect.size(), CV_8UC1);
     equalizeHist(bookCoverGrayImg, bookCoverGrayEqualizedImg);
 
-    // Use the Hough circle transform to find the circle.
-    vector<Vec3f> circles;
-    HoughCircles(
-        bookCoverGrayEqualizedImg,
-        circles,
-        HOUGH_GRADIENT,
-        2,
-        bookCoverGrayEqualizedImg.cols/3,
-        50,
-        50,
-        m_minRadius,
-        m_maxRadius);
+    if (CheckDeadline(deadline, "hough", report))
+    {
+        return circledDigitsImg;
+    }
 
-    Mat circledDigitsImg;
+    // Use the Hough circle transform to find the circle.
+    vector<Vec3f>& circles = workspace.GetCircleVector("circles");
+#if (CV_VERSION_MAJOR > 4) || ((CV_VERSION_MAJOR == 4) && (CV_VERSION_MINOR >= 3))
+    if (m_useAltGradient)
+    {
+        // HOUGH_GRADIENT_ALT votes along the gradient direction only, so an accumulator at
+        // a quarter of the minimum radius is fine enough, and param2 is the circle "perfectness".
+        const double dp = max(1.0, min(2.0, m_minRadius/4.0));
+        HoughCircles(
+            bookCoverGrayEqualizedImg,
+            circles,
+            HOUGH_GRADIENT_ALT,
+            dp,
+            bookCoverImg.cols/3,
+            300,
+            0.8,
+            m_minRadius,
+            m_maxRadius);
+    }
+    else
+#endif
+    {
+        HoughCircles(
+            bookCoverGrayEqualizedImg,
+            circles,
+            HOUGH_GRADIENT,
+            2,
+            bookCoverImg.cols/3,
+            50,
+            50,
+            m_minRadius,
+            m_maxRadius);
+    }
 
     if (circles.empty())
     {
@@ -331,10 +1560,19 @@ Mat OcrPreprocessor::ExtractCircledDigitsViaHoughTransform(
     }
 
     Vec3f maxCircle;
-    for (const auto& circle: circles)
+    for (auto circle: circles)
     {
+        // Map the circle back into the cover coordinates.
+        circle[0] += transformRect.x;
+        circle[1] += transformRect.y;
+
+        // The centers are subpixel, so we compare them with the first and the last pixel of
+        // centerRect, e.g., the default region rejects the centers below the row 170.0.
+#ifdef DEBUG
         printf("[DEBUG]: Find a circle at (%f, %f) with radius %f.\n", circle[0], circle[1], circle[2]);
-        if (circle[1] > 170.0)
+#endif
+        if ((circle[0] < centerRect.x) || (circle[0] > centerRect.x + centerRect.width - 1) ||
+            (circle[1] < centerRect.y) || (circle[1] > centerRect.y + centerRect.height - 1))
         {
             continue;
         }
@@ -350,10 +1588,12 @@ Mat OcrPreprocessor::ExtractCircledDigitsViaHoughTransform(
         return circledDigitsImg;
     }
 
-    const unsigned int bufferWidth = 10;
+    const unsigned int bufferWidth = m_circleBufferWidth;
     Point rectTopLeft(maxCircle[0] - maxCircle[2] - bufferWidth, maxCircle[1] - maxCircle[2] - bufferWidth);
     Rect circledDigitsRect(rectTopLeft.x, rectTopLeft.y, 2*(maxCircle[2] + bufferWidth), 2*(maxCircle[2] + bufferWidth));
+    circledDigitsRect &= bookCoverRect;
+    report.circledDigitsRect = circledDigitsRect;
 
-    circledDigitsImg = bookCoverImg(circledDigitsRect);
+    circledDigitsImg = SharpenRegion(bookCoverImg, circledDigitsRect, "cropSharpened", workspace);
     return circledDigitsImg;
 }
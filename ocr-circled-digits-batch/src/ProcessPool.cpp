@@ -0,0 +1,291 @@
+/*
+ * ProcessPool.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <set>
+
+#include "ProcessPool.h"
+
+using namespace std;
+
+// Note that the atomics work across the processes since they are lock free.
+struct ProcessPool::QueueHeader
+{
+    atomic<size_t> nextTask;
+};
+
+struct ProcessPool::TaskSlot
+{
+    atomic<int> state;
+    atomic<int> owner;   // The pid of the worker running the task
+    size_t resultSize;
+    char result[1];      // The slot actually extends to m_slotSize bytes.
+};
+
+ProcessPool::ProcessPool(
+    const unsigned int cntProcs,
+    const size_t maxResultSize) :
+    m_cntProcs(max(cntProcs, 1u)),
+    m_cntTasks(0),
+    m_mapping(nullptr),
+    m_mappingSize(0),
+    m_cntRestarts(0)
+{
+    // Align the slots for the atomics.
+    const size_t slotSize = offsetof(TaskSlot, result) + maxResultSize;
+    m_slotSize = (slotSize + alignof(TaskSlot) - 1)/alignof(TaskSlot)*alignof(TaskSlot);
+}
+
+ProcessPool::~ProcessPool()
+{
+    Unmap();
+}
+
+void ProcessPool::Unmap()
+{
+    if (m_mapping != nullptr)
+    {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+}
+
+ProcessPool::TaskSlot* ProcessPool::GetSlot(const size_t taskIndex) const
+{
+    char* slots = static_cast<char*>(m_mapping) + sizeof(QueueHeader);
+    return reinterpret_cast<TaskSlot*>(slots + taskIndex*m_slotSize);
+}
+
+bool ProcessPool::Run(
+    const size_t cntTasks,
+    const Task& task,
+    const ProgressFunc& progress,
+    const int pollMs)
+{
+    Unmap();
+
+    // The pages of the slots are only committed when a result is written into them.
+    m_cntTasks = cntTasks;
+    m_mappingSize = sizeof(QueueHeader) + m_cntTasks*m_slotSize;
+    void* mapping = mmap(nullptr, m_mappingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        printf("[ERROR]: mmap(%s) for the task queue of %ld tasks.\n\n", strerror(errno), m_cntTasks);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+        return false;
+    }
+
+    m_mapping = mapping;
+    new (m_mapping) QueueHeader();
+    static_cast<QueueHeader*>(m_mapping)->nextTask = 0;
+    for (size_t taskIndex = 0; taskIndex < m_cntTasks; ++taskIndex)
+    {
+        TaskSlot* slot = new (GetSlot(taskIndex)) TaskSlot();
+        slot->state = static_cast<int>(TaskState::Pending);
+        slot->owner = 0;
+        slot->resultSize = 0;
+    }
+
+    set<pid_t> workers;
+    for (unsigned int procIndex = 0; procIndex < min(static_cast<size_t>(m_cntProcs), m_cntTasks); ++procIndex)
+    {
+        const pid_t pid = StartWorker(task);
+        if (pid > 0)
+        {
+            workers.insert(pid);
+        }
+    }
+
+    // A task is reported once its result is complete, i.e., once it is marked as done.
+    vector<bool> reported(m_cntTasks, false);
+    auto reportProgress = [&]()
+    {
+        vector<size_t> doneTaskIndices;
+        for (size_t taskIndex = 0; taskIndex < m_cntTasks; ++taskIndex)
+        {
+            if (!reported[taskIndex] && (GetState(taskIndex) == TaskState::Done))
+            {
+                reported[taskIndex] = true;
+                doneTaskIndices.push_back(taskIndex);
+            }
+        }
+
+        progress(doneTaskIndices);
+    };
+
+    QueueHeader* header = static_cast<QueueHeader*>(m_mapping);
+    while (!workers.empty())
+    {
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, progress ? WNOHANG : 0);
+        if (pid == 0)
+        {
+            reportProgress();
+            usleep(max(pollMs, 1)*1000);
+            continue;
+        }
+        else if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("[ERROR]: waitpid(%s) for the workers.\n\n", strerror(errno));
+            return false;
+        }
+
+        if (workers.erase(pid) == 0)
+        {
+            continue;
+        }
+
+        if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+        {
+            continue;
+        }
+
+        // Mark the task which the worker was running as crashed.
+        for (size_t taskIndex = 0; taskIndex < m_cntTasks; ++taskIndex)
+        {
+            TaskSlot* slot = GetSlot(taskIndex);
+            if ((slot->state == static_cast<int>(TaskState::InFlight)) && (slot->owner == pid))
+            {
+                slot->state = static_cast<int>(TaskState::Crashed);
+                printf("[ERROR]: Worker %d crashed (%s %d) in task %ld.\n\n", pid,
+                    WIFSIGNALED(status) ? "signal" : "exit code",
+                    WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status), taskIndex);
+            }
+        }
+
+        if (header->nextTask < m_cntTasks)
+        {
+            const pid_t newPid = StartWorker(task);
+            if (newPid > 0)
+            {
+                workers.insert(newPid);
+                ++m_cntRestarts;
+            }
+        }
+    }
+
+    // A worker may have crashed between taking a task and marking it.
+    for (size_t taskIndex = 0; taskIndex < m_cntTasks; ++taskIndex)
+    {
+        TaskSlot* slot = GetSlot(taskIndex);
+        if ((slot->state == static_cast<int>(TaskState::Pending)) || (slot->state == static_cast<int>(TaskState::InFlight)))
+        {
+            slot->state = static_cast<int>(TaskState::Crashed);
+        }
+    }
+
+    if (progress)
+    {
+        reportProgress();
+    }
+
+    return true;
+}
+
+pid_t ProcessPool::StartWorker(const Task& task)
+{
+    // Flush the buffered output, otherwise the worker would print it again.
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        printf("[ERROR]: fork(%s) for a worker.\n\n", strerror(errno));
+        return pid;
+    }
+
+    if (pid == 0)
+    {
+        RunWorker(task);
+
+        // Skip the destructors of the supervisor's objects which the worker inherited.
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+
+    return pid;
+}
+
+void ProcessPool::RunWorker(const Task& task)
+{
+    QueueHeader* header = static_cast<QueueHeader*>(m_mapping);
+    const int pid = static_cast<int>(getpid());
+
+    string result;
+    size_t taskIndex = 0;
+    while ((taskIndex = header->nextTask++) < m_cntTasks)
+    {
+        TaskSlot* slot = GetSlot(taskIndex);
+        slot->owner = pid;
+        slot->state = static_cast<int>(TaskState::InFlight);
+
+        result.clear();
+        task(taskIndex, result);
+
+        const size_t maxResultSize = m_slotSize - offsetof(TaskSlot, result);
+        if (result.size() > maxResultSize)
+        {
+            printf("[ERROR]: The result of task %ld has %ld bytes, more than %ld.\n\n",
+                taskIndex, result.size(), maxResultSize);
+            slot->state = static_cast<int>(TaskState::Crashed);
+            continue;
+        }
+
+        memcpy(slot->result, result.data(), result.size());
+        slot->resultSize = result.size();
+        slot->state = static_cast<int>(TaskState::Done);
+    }
+}
+
+ProcessPool::TaskState ProcessPool::GetState(const size_t taskIndex) const
+{
+    return static_cast<TaskState>(GetSlot(taskIndex)->state.load());
+}
+
+size_t ProcessPool::CountTasks(const TaskState state) const
+{
+    size_t cntTasks = 0;
+    for (size_t taskIndex = 0; taskIndex < m_cntTasks; ++taskIndex)
+    {
+        if (GetState(taskIndex) == state)
+        {
+            ++cntTasks;
+        }
+    }
+
+    return cntTasks;
+}
+
+string ProcessPool::GetResult(const size_t taskIndex) const
+{
+    const TaskSlot* slot = GetSlot(taskIndex);
+    return string(slot->result, slot->resultSize);
+}
+
+size_t ProcessPool::GetRestartCount() const
+{
+    return m_cntRestarts;
+}
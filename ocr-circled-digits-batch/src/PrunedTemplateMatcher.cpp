@@ -0,0 +1,733 @@
+/*
+ * PrunedTemplateMatcher.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+
+#include "PrunedTemplateMatcher.h"
+
+using namespace std;
+using namespace cv;
+
+// matchTemplate supports at most 4 channels.
+static const int maxChannels = 4;
+
+// The coarse template of the initial guess has at least this many pixels on its shorter side.
+static const int minCoarseSide = 8;
+static const int maxCoarseFactor = 4;
+
+// The bound and the score are both rounded, so a position is only pruned if its bound is
+// below the best score by more than the rounding. The centered sums of the squares of the
+// bands are rounded up by a fraction of the sums of the squares for the same reason.
+static const double boundTolerance = 1e-6;
+static const double deviationSlack = 1e-10;
+
+// The band by band scores of the same window differ from its exact score by far less than
+// this, so the positions scored within it of the best score are rescored exactly.
+static const double tieTolerance = 1e-9;
+
+// The sums of the rectangle per channel in the integral image.
+static inline void SumRect(
+    const Mat& integralImg,
+    const int channels,
+    const int x,
+    const int y,
+    const int width,
+    const int height,
+    double* sums)
+{
+    const double* top = integralImg.ptr<double>(y);
+    const double* bottom = integralImg.ptr<double>(y + height);
+    const int left = x*channels;
+    const int right = (x + width)*channels;
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        sums[channel] = bottom[right + channel] - bottom[left + channel] - top[right + channel] + top[left + channel];
+    }
+}
+
+// The sums per channel of the rectangles of width x height at the columns [0, cntCols) of
+// the row, interleaved like the image. They are rounded like those of SumRect.
+static void SumRowRects(
+    const Mat& integralImg,
+    const int channels,
+    const int row,
+    const int width,
+    const int height,
+    const int cntCols,
+    double* sums)
+{
+    const double* top = integralImg.ptr<double>(row);
+    const double* bottom = integralImg.ptr<double>(row + height);
+    const int offset = width*channels;
+    const int rowLength = cntCols*channels;
+    for (int index = 0; index < rowLength; ++index)
+    {
+        sums[index] = bottom[index + offset] - bottom[index] - top[index + offset] + top[index];
+    }
+}
+
+// Normalize the correlation like matchTemplate, which gives 0 for a flat window and clamps
+// the scores pushed slightly beyond [-1, 1] by the rounding.
+static inline double NormalizeScore(
+    const double numerator,
+    const double denominator)
+{
+    if (fabs(numerator) < denominator)
+    {
+        return numerator/denominator;
+    }
+    else if (fabs(numerator) < denominator*1.125)
+    {
+        return (numerator > 0.0) ? 1.0 : -1.0;
+    }
+
+    return 0.0;
+}
+
+// The first maximum in the row-major order wins, like in minMaxLoc.
+static inline bool IsBetter(
+    const double score,
+    const Point& position,
+    const double bestScore,
+    const Point& bestPosition)
+{
+    return (score > bestScore) ||
+        ((score == bestScore) && ((position.y < bestPosition.y) || ((position.y == bestPosition.y) && (position.x < bestPosition.x))));
+}
+
+template <typename SrcType>
+static double CorrelateRows(
+    const Mat& srcImg,
+    const Mat& templ,
+    const Point& position,
+    const int startRow,
+    const int endRow)
+{
+    const int channels = templ.channels();
+    const int rowLength = templ.cols*channels;
+
+    // Four independent sums, so that the multiply-adds are pipelined.
+    double sums[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int row = startRow; row < endRow; ++row)
+    {
+        const SrcType* srcRow = srcImg.ptr<SrcType>(position.y + row) + position.x*channels;
+        const double* templRow = templ.ptr<double>(row);
+        int index = 0;
+        for (; index + 4 <= rowLength; index += 4)
+        {
+            sums[0] += templRow[index]*srcRow[index];
+            sums[1] += templRow[index + 1]*srcRow[index + 1];
+            sums[2] += templRow[index + 2]*srcRow[index + 2];
+            sums[3] += templRow[index + 3]*srcRow[index + 3];
+        }
+
+        for (; index < rowLength; ++index)
+        {
+            sums[0] += templRow[index]*srcRow[index];
+        }
+    }
+
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+// The correlation of the whole template with a single sum in the row-major order, which is
+// rounded the same way wherever the window is.
+template <typename SrcType>
+static double CorrelateExactly(
+    const Mat& srcImg,
+    const Mat& templ,
+    const Point& position)
+{
+    const int rowLength = templ.cols*templ.channels();
+    double sum = 0.0;
+    for (int row = 0; row < templ.rows; ++row)
+    {
+        const SrcType* srcRow = srcImg.ptr<SrcType>(position.y + row) + position.x*templ.channels();
+        const double* templRow = templ.ptr<double>(row);
+        for (int index = 0; index < rowLength; ++index)
+        {
+            sum += templRow[index]*srcRow[index];
+        }
+    }
+
+    return sum;
+}
+
+static inline double Correlate(
+    const Mat& srcImg,
+    const Mat& templ,
+    const Point& position,
+    const int startRow,
+    const int endRow)
+{
+    return (srcImg.depth() == CV_8U)
+        ? CorrelateRows<uchar>(srcImg, templ, position, startRow, endRow)
+        : CorrelateRows<float>(srcImg, templ, position, startRow, endRow);
+}
+
+// The sums and the centered norm over the channels of the windows of bandSize at all the
+// positions of the rows of bandDevs. The sums of the channel of the row are in the row
+// row*channels + channel of bandSums, so that the bounds are summed along the rows.
+static void ComputeBandWindows(
+    const Mat& sumImg,
+    const Mat& sqSumImg,
+    const int channels,
+    const Size& bandSize,
+    Mat& bandSums,
+    Mat& bandDevs)
+{
+    const double cntPixels = static_cast<double>(bandSize.area());
+    const int cntCols = bandDevs.cols;
+    parallel_for_(Range(0, bandDevs.rows), [&](const Range& range)
+    {
+        vector<double> sums(cntCols*channels);
+        vector<double> sqSums(cntCols*channels);
+        for (int row = range.start; row < range.end; ++row)
+        {
+            SumRowRects(sumImg, channels, row, bandSize.width, bandSize.height, cntCols, sums.data());
+            SumRowRects(sqSumImg, channels, row, bandSize.width, bandSize.height, cntCols, sqSums.data());
+
+            double* devRow = bandDevs.ptr<double>(row);
+            for (int col = 0; col < cntCols; ++col)
+            {
+                double centeredSqSum = 0.0;
+                double sqSum = 0.0;
+                for (int channel = 0; channel < channels; ++channel)
+                {
+                    const double sum = sums[col*channels + channel];
+                    centeredSqSum += sqSums[col*channels + channel] - sum*sum/cntPixels;
+                    sqSum += sqSums[col*channels + channel];
+                }
+
+                devRow[col] = sqrt(max(centeredSqSum, 0.0) + deviationSlack*sqSum);
+            }
+
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                double* sumRow = bandSums.ptr<double>(row*channels + channel);
+                for (int col = 0; col < cntCols; ++col)
+                {
+                    sumRow[col] = sums[col*channels + channel];
+                }
+            }
+        }
+    });
+}
+
+// The norm of the centered window times that of the template, i.e., the denominator of
+// TM_CCOEFF_NORMED, from the sums of the window per channel.
+static inline double WindowDenominator(
+    const double* sums,
+    const double* sqSums,
+    const int channels,
+    const double cntPixels,
+    const double templNorm)
+{
+    double variance = 0.0;
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        variance += sqSums[channel] - sums[channel]*sums[channel]/cntPixels;
+    }
+
+    return sqrt(max(variance, 0.0))*templNorm;
+}
+
+PrunedTemplateMatcher::PrunedTemplateMatcher(
+    const Mat& templImg,
+    const int bandHeight) :
+    m_channels(templImg.channels()),
+    m_templNorm(0.0),
+    m_coarseFactor(1)
+{
+    templImg.convertTo(m_templ, CV_64F);
+
+    // Subtract the mean of each channel, so that the correlation with the window is that
+    // with the window minus its mean.
+    const int rowLength = m_templ.cols*m_channels;
+    const double cntPixels = static_cast<double>(m_templ.rows)*m_templ.cols;
+    vector<double> means(m_channels, 0.0);
+    for (int row = 0; row < m_templ.rows; ++row)
+    {
+        const double* templRow = m_templ.ptr<double>(row);
+        for (int index = 0; index < rowLength; ++index)
+        {
+            means[index % m_channels] += templRow[index];
+        }
+    }
+
+    for (auto& mean: means)
+    {
+        mean /= cntPixels;
+    }
+
+    for (int row = 0; row < m_templ.rows; ++row)
+    {
+        double* templRow = m_templ.ptr<double>(row);
+        for (int index = 0; index < rowLength; ++index)
+        {
+            templRow[index] -= means[index % m_channels];
+            m_templNorm += templRow[index]*templRow[index];
+        }
+    }
+
+    m_templNorm = sqrt(m_templNorm);
+
+    // Split the rows into bands of bandHeight rows, the last one taking the remaining rows,
+    // so that the windows of at most two heights are summed per image.
+    const int cntBandsUsed = max(m_templ.rows/max(bandHeight, 1), 1);
+    const int usedBandHeight = m_templ.rows/cntBandsUsed;
+    const int lastBandHeight = m_templ.rows - (cntBandsUsed - 1)*usedBandHeight;
+    m_bandHeights.push_back(usedBandHeight);
+    if (lastBandHeight != usedBandHeight)
+    {
+        m_bandHeights.push_back(lastBandHeight);
+    }
+
+    for (int bandIndex = 0; bandIndex < cntBandsUsed; ++bandIndex)
+    {
+        const bool isLast = (bandIndex == cntBandsUsed - 1);
+        TemplateBand band;
+        band.startRow = bandIndex*usedBandHeight;
+        band.heightIndex = (isLast && (lastBandHeight != usedBandHeight)) ? 1 : 0;
+        band.means.assign(m_channels, 0.0);
+        band.norm = 0.0;
+
+        const int endRow = isLast ? m_templ.rows : band.startRow + usedBandHeight;
+        const double cntBandPixels = static_cast<double>(endRow - band.startRow)*m_templ.cols;
+        for (int row = band.startRow; row < endRow; ++row)
+        {
+            const double* templRow = m_templ.ptr<double>(row);
+            for (int index = 0; index < rowLength; ++index)
+            {
+                band.means[index % m_channels] += templRow[index];
+            }
+        }
+
+        for (auto& mean: band.means)
+        {
+            mean /= cntBandPixels;
+        }
+
+        for (int row = band.startRow; row < endRow; ++row)
+        {
+            const double* templRow = m_templ.ptr<double>(row);
+            for (int index = 0; index < rowLength; ++index)
+            {
+                const double centered = templRow[index] - band.means[index % m_channels];
+                band.norm += centered*centered;
+            }
+        }
+
+        band.norm = sqrt(band.norm);
+        m_bands.push_back(band);
+    }
+
+    // Correlate the bands with the largest norms first, whose bounds are the loosest.
+    stable_sort(m_bands.begin(), m_bands.end(), [](const TemplateBand& band1, const TemplateBand& band2)
+    {
+        return band1.norm > band2.norm;
+    });
+
+    m_coarseFactor = min(min(templImg.rows, templImg.cols)/minCoarseSide, maxCoarseFactor);
+    if (m_coarseFactor >= 2)
+    {
+        resize(templImg, m_coarseTemplImg, Size(templImg.cols/m_coarseFactor, templImg.rows/m_coarseFactor), 0, 0, INTER_AREA);
+    }
+}
+
+double PrunedTemplateMatcher::BoundBand(
+    const TemplateBand& band,
+    const BandWindows& windows,
+    const Point& position) const
+{
+    const int bandRow = position.y + band.startRow;
+    double bound = band.norm*windows.devs[band.heightIndex].ptr<double>(bandRow)[position.x];
+    for (int channel = 0; channel < m_channels; ++channel)
+    {
+        bound += band.means[channel]*windows.sums[band.heightIndex].ptr<double>(bandRow*m_channels + channel)[position.x];
+    }
+
+    return bound;
+}
+
+bool PrunedTemplateMatcher::ScorePosition(
+    const Mat& srcImg,
+    const BandWindows& windows,
+    const Point& position,
+    const double denominator,
+    const double bestScore,
+    vector<double>& bandBounds,
+    double& score,
+    size_t& cntBands) const
+{
+    // A flat window scores 0, like in matchTemplate.
+    if (denominator <= 0.0)
+    {
+        score = 0.0;
+        return true;
+    }
+
+    // The bound of the bands from each one to the last.
+    bandBounds.assign(m_bands.size() + 1, 0.0);
+    for (size_t bandIndex = m_bands.size(); bandIndex > 0; --bandIndex)
+    {
+        bandBounds[bandIndex - 1] = bandBounds[bandIndex] + BoundBand(m_bands[bandIndex - 1], windows, position);
+    }
+
+    // Replace the bounds by the correlations band by band, until the bound of the score
+    // can't reach the best score.
+    double numerator = 0.0;
+    for (size_t bandIndex = 0; bandIndex < m_bands.size(); ++bandIndex)
+    {
+        if ((numerator + bandBounds[bandIndex])/denominator + boundTolerance < bestScore)
+        {
+            return false;
+        }
+
+        const TemplateBand& band = m_bands[bandIndex];
+        numerator += Correlate(srcImg, m_templ, position, band.startRow, band.startRow + m_bandHeights[band.heightIndex]);
+        ++cntBands;
+    }
+
+    score = NormalizeScore(numerator, denominator);
+    return true;
+}
+
+double PrunedTemplateMatcher::ScoreExactly(
+    const Mat& srcImg,
+    const Point& position,
+    const double denominator) const
+{
+    if (denominator <= 0.0)
+    {
+        return 0.0;
+    }
+
+    const double numerator = (srcImg.depth() == CV_8U)
+        ? CorrelateExactly<uchar>(srcImg, m_templ, position)
+        : CorrelateExactly<float>(srcImg, m_templ, position);
+
+    return NormalizeScore(numerator, denominator);
+}
+
+void PrunedTemplateMatcher::RescoreCandidates(
+    const Mat& srcImg,
+    const Mat& sumImg,
+    const Mat& sqSumImg,
+    const vector<Point>& positions,
+    Point& matchPoint,
+    double& maxScore) const
+{
+    const double cntPixels = static_cast<double>(m_templ.rows)*m_templ.cols;
+    maxScore = -numeric_limits<double>::infinity();
+    matchPoint = Point(0, 0);
+    for (const auto& position: positions)
+    {
+        double sums[maxChannels];
+        double sqSums[maxChannels];
+        SumRect(sumImg, m_channels, position.x, position.y, m_templ.cols, m_templ.rows, sums);
+        SumRect(sqSumImg, m_channels, position.x, position.y, m_templ.cols, m_templ.rows, sqSums);
+
+        const double score = ScoreExactly(srcImg, position,
+            WindowDenominator(sums, sqSums, m_channels, cntPixels, m_templNorm));
+        if (IsBetter(score, position, maxScore, matchPoint))
+        {
+            maxScore = score;
+            matchPoint = position;
+        }
+    }
+}
+
+void PrunedTemplateMatcher::GuessBestPosition(
+    const Mat& srcImg,
+    const Mat& sumImg,
+    const Mat& sqSumImg,
+    const BandWindows& windows,
+    const Point& guess,
+    Workspace& workspace,
+    double& bestScore,
+    Point& bestPosition) const
+{
+    const int lastCol = srcImg.cols - m_templ.cols;
+    const int lastRow = srcImg.rows - m_templ.rows;
+    const double cntPixels = static_cast<double>(m_templ.rows)*m_templ.cols;
+    vector<double> bandBounds;
+    size_t cntBands = 0;
+
+    // Start from the first position, so that the best position is always valid.
+    bestScore = -numeric_limits<double>::infinity();
+    bestPosition = Point(0, 0);
+
+    auto tryPosition = [&](const Point& position)
+    {
+        if ((position.x < 0) || (position.y < 0) || (position.x > lastCol) || (position.y > lastRow))
+        {
+            return;
+        }
+
+        double sums[maxChannels];
+        double sqSums[maxChannels];
+        SumRect(sumImg, m_channels, position.x, position.y, m_templ.cols, m_templ.rows, sums);
+        SumRect(sqSumImg, m_channels, position.x, position.y, m_templ.cols, m_templ.rows, sqSums);
+
+        double score = 0.0;
+        const double denominator = WindowDenominator(sums, sqSums, m_channels, cntPixels, m_templNorm);
+        if (ScorePosition(srcImg, windows, position, denominator, bestScore, bandBounds, score, cntBands) &&
+            IsBetter(score, position, bestScore, bestPosition))
+        {
+            bestScore = score;
+            bestPosition = position;
+        }
+    };
+
+    tryPosition(bestPosition);
+    tryPosition(guess);
+
+    // Search the neighborhood of the maximum of the downscaled images, which is near that of
+    // the full-size ones unless the title is blurred away by the downscaling. Most of it is
+    // pruned once the best position of the neighborhood is scored.
+    if (m_coarseTemplImg.empty())
+    {
+        return;
+    }
+
+    const Size coarseSize(srcImg.cols/m_coarseFactor, srcImg.rows/m_coarseFactor);
+    if ((coarseSize.width < m_coarseTemplImg.cols) || (coarseSize.height < m_coarseTemplImg.rows))
+    {
+        return;
+    }
+
+    Mat coarseImg = workspace.GetMat("pmCoarse", coarseSize, srcImg.type());
+    resize(srcImg, coarseImg, coarseSize, 0, 0, INTER_AREA);
+
+    Mat coarseScores = workspace.GetMat("pmCoarseScores",
+        Size(coarseSize.width - m_coarseTemplImg.cols + 1, coarseSize.height - m_coarseTemplImg.rows + 1), CV_32FC1);
+    matchTemplate(coarseImg, m_coarseTemplImg, coarseScores, TM_CCOEFF_NORMED);
+
+    Point coarseMaxLoc;
+    minMaxLoc(coarseScores, nullptr, nullptr, nullptr, &coarseMaxLoc);
+
+    for (int dy = -m_coarseFactor; dy <= m_coarseFactor; ++dy)
+    {
+        for (int dx = -m_coarseFactor; dx <= m_coarseFactor; ++dx)
+        {
+            tryPosition(Point(coarseMaxLoc.x*m_coarseFactor + dx, coarseMaxLoc.y*m_coarseFactor + dy));
+        }
+    }
+}
+
+bool PrunedTemplateMatcher::Match(
+    const Mat& srcImg,
+    Workspace& workspace,
+    Point& matchPoint,
+    double* maxScore,
+    const Point& guess,
+    PrunedMatchStats* stats) const
+{
+    const int cntPositionCols = srcImg.cols - m_templ.cols + 1;
+    const int cntPositionRows = srcImg.rows - m_templ.rows + 1;
+    if ((cntPositionCols <= 0) || (cntPositionRows <= 0))
+    {
+        printf("[ERROR]: The image with %d x %d pixels is smaller than the template.\n\n", srcImg.cols, srcImg.rows);
+        return false;
+    }
+
+    if ((srcImg.channels() != m_channels) || (m_channels > maxChannels) ||
+        ((srcImg.depth() != CV_8U) && (srcImg.depth() != CV_32F)))
+    {
+        printf("[ERROR]: Unsupported image type %d for the pruned template matching.\n\n", srcImg.type());
+        return false;
+    }
+
+    // The sums and the sums of the squares of the windows.
+    Mat sumImg = workspace.GetMat("pmSum", Size(srcImg.cols + 1, srcImg.rows + 1), CV_64FC(m_channels));
+    Mat sqSumImg = workspace.GetMat("pmSqSum", Size(srcImg.cols + 1, srcImg.rows + 1), CV_64FC(m_channels));
+    integral(srcImg, sumImg, sqSumImg, CV_64F, CV_64F);
+
+    // The sums and the centered norms of the windows of each band height.
+    BandWindows windows;
+    for (size_t heightIndex = 0; heightIndex < m_bandHeights.size(); ++heightIndex)
+    {
+        const Size bandSize(m_templ.cols, m_bandHeights[heightIndex]);
+        const int cntWindowRows = srcImg.rows - bandSize.height + 1;
+        windows.sums[heightIndex] = workspace.GetMat((heightIndex == 0) ? "pmBandSums0" : "pmBandSums1",
+            Size(cntPositionCols, cntWindowRows*m_channels), CV_64FC1);
+        windows.devs[heightIndex] = workspace.GetMat((heightIndex == 0) ? "pmBandDevs0" : "pmBandDevs1",
+            Size(cntPositionCols, cntWindowRows), CV_64FC1);
+        ComputeBandWindows(sumImg, sqSumImg, m_channels, bandSize, windows.sums[heightIndex], windows.devs[heightIndex]);
+    }
+
+    double guessScore = -1.0;
+    Point guessPosition;
+    GuessBestPosition(srcImg, sumImg, sqSumImg, windows, guess, workspace, guessScore, guessPosition);
+
+    // Each stripe of rows starts from the guess and keeps its own best score and the
+    // positions tied with it.
+    const int cntStripes = max(min(cntPositionRows, getNumThreads()), 1);
+    vector<double> stripeScores(cntStripes, guessScore);
+    vector<vector<pair<Point, double> > > stripeCandidates(cntStripes);
+    vector<PrunedMatchStats> stripeStats(cntStripes);
+
+    const double cntPixels = static_cast<double>(m_templ.rows)*m_templ.cols;
+    parallel_for_(Range(0, cntStripes), [&](const Range& range)
+    {
+        vector<double> rowBounds(cntPositionCols);
+        vector<double> rowDenominators(cntPositionCols);
+        vector<double> windowSums(cntPositionCols*m_channels);
+        vector<double> windowSqSums(cntPositionCols*m_channels);
+        vector<double> bandBounds;
+
+        for (int stripe = range.start; stripe < range.end; ++stripe)
+        {
+            double& bestScore = stripeScores[stripe];
+            vector<pair<Point, double> >& candidates = stripeCandidates[stripe];
+            PrunedMatchStats& stripeStat = stripeStats[stripe];
+
+            const int endRow = (stripe + 1)*cntPositionRows/cntStripes;
+            for (int row = stripe*cntPositionRows/cntStripes; row < endRow; ++row)
+            {
+                // Bound the whole row of positions at once, band by band and channel by channel.
+                fill(rowBounds.begin(), rowBounds.end(), 0.0);
+                for (const auto& band: m_bands)
+                {
+                    const int bandRow = row + band.startRow;
+                    const double* devs = windows.devs[band.heightIndex].ptr<double>(bandRow);
+                    for (int col = 0; col < cntPositionCols; ++col)
+                    {
+                        rowBounds[col] += band.norm*devs[col];
+                    }
+
+                    for (int channel = 0; channel < m_channels; ++channel)
+                    {
+                        const double mean = band.means[channel];
+                        const double* sums = windows.sums[band.heightIndex].ptr<double>(bandRow*m_channels + channel);
+                        for (int col = 0; col < cntPositionCols; ++col)
+                        {
+                            rowBounds[col] += mean*sums[col];
+                        }
+                    }
+                }
+
+                SumRowRects(sumImg, m_channels, row, m_templ.cols, m_templ.rows, cntPositionCols, windowSums.data());
+                SumRowRects(sqSumImg, m_channels, row, m_templ.cols, m_templ.rows, cntPositionCols, windowSqSums.data());
+                for (int col = 0; col < cntPositionCols; ++col)
+                {
+                    rowDenominators[col] = WindowDenominator(&windowSums[col*m_channels], &windowSqSums[col*m_channels],
+                        m_channels, cntPixels, m_templNorm);
+                }
+
+                stripeStat.cntPositions += cntPositionCols;
+                for (int col = 0; col < cntPositionCols; ++col)
+                {
+                    const Point position(col, row);
+                    const double denominator = rowDenominators[col];
+                    if ((denominator > 0.0) && (rowBounds[col]/denominator + boundTolerance < bestScore))
+                    {
+                        ++stripeStat.cntPruned;
+                        continue;
+                    }
+
+                    double score = 0.0;
+                    if (!ScorePosition(srcImg, windows, position, denominator, bestScore, bandBounds, score, stripeStat.cntBands))
+                    {
+                        ++stripeStat.cntPruned;
+                        continue;
+                    }
+
+                    if (score + tieTolerance < bestScore)
+                    {
+                        continue;
+                    }
+
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        const double minScore = bestScore - tieTolerance;
+                        candidates.erase(remove_if(candidates.begin(), candidates.end(),
+                            [minScore](const pair<Point, double>& candidate) { return candidate.second < minScore; }),
+                            candidates.end());
+                    }
+
+                    candidates.push_back(make_pair(position, score));
+                }
+            }
+        }
+    }, cntStripes);
+
+    // The candidates of all the stripes tied with the best score are rescored exactly. The
+    // stripes are in the row-major order, and so are the candidates of each one.
+    const double bestScore = *max_element(stripeScores.begin(), stripeScores.end());
+    vector<Point> candidates;
+    for (const auto& stripeCandidate: stripeCandidates)
+    {
+        for (const auto& candidate: stripeCandidate)
+        {
+            if (candidate.second + tieTolerance >= bestScore)
+            {
+                candidates.push_back(candidate.first);
+            }
+        }
+    }
+
+    double exactMaxScore = -1.0;
+    RescoreCandidates(srcImg, sumImg, sqSumImg, candidates, matchPoint, exactMaxScore);
+
+    if (stats != nullptr)
+    {
+        *stats = PrunedMatchStats();
+        for (const auto& stripeStat: stripeStats)
+        {
+            stats->cntPositions += stripeStat.cntPositions;
+            stats->cntPruned += stripeStat.cntPruned;
+            stats->cntBands += stripeStat.cntBands;
+        }
+
+        stats->cntCandidates = candidates.size();
+    }
+
+    if (maxScore != nullptr)
+    {
+        *maxScore = exactMaxScore;
+    }
+
+    return true;
+}
+
+bool PrunedTemplateMatcher::Rescore(
+    const Mat& srcImg,
+    const vector<Point>& positions,
+    Workspace& workspace,
+    Point& matchPoint,
+    double& maxScore) const
+{
+    if ((srcImg.channels() != m_channels) || (m_channels > maxChannels) ||
+        ((srcImg.depth() != CV_8U) && (srcImg.depth() != CV_32F)))
+    {
+        printf("[ERROR]: Unsupported image type %d for the pruned template matching.\n\n", srcImg.type());
+        return false;
+    }
+
+    const Rect positionRect(0, 0, srcImg.cols - m_templ.cols + 1, srcImg.rows - m_templ.rows + 1);
+    for (const auto& position: positions)
+    {
+        if (!positionRect.contains(position))
+        {
+            printf("[ERROR]: The position (%d, %d) of the template is outside the image.\n\n", position.x, position.y);
+            return false;
+        }
+    }
+
+    Mat sumImg = workspace.GetMat("pmSum", Size(srcImg.cols + 1, srcImg.rows + 1), CV_64FC(m_channels));
+    Mat sqSumImg = workspace.GetMat("pmSqSum", Size(srcImg.cols + 1, srcImg.rows + 1), CV_64FC(m_channels));
+    integral(srcImg, sumImg, sqSumImg, CV_64F, CV_64F);
+
+    RescoreCandidates(srcImg, sumImg, sqSumImg, positions, matchPoint, maxScore);
+    return true;
+}
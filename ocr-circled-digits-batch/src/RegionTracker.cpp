@@ -0,0 +1,121 @@
+/*
+ * RegionTracker.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cstdio>
+#include <algorithm>
+
+#include "RegionTracker.h"
+
+using namespace std;
+using namespace cv;
+
+RegionTracker::RegionTracker(
+    const int searchMargin,
+    const double minResponse) :
+    m_searchMargin(max(searchMargin, 1)),
+    m_minResponse(minResponse),
+    m_tracking(false)
+{
+}
+
+void RegionTracker::ToGray(
+    const Mat& frame,
+    Mat& grayFrame) const
+{
+    if (frame.channels() == 1)
+    {
+        frame.copyTo(grayFrame);
+    }
+    else
+    {
+        cvtColor(frame, grayFrame, COLOR_BGR2GRAY);
+    }
+}
+
+void RegionTracker::Start(
+    const Mat& frame,
+    const Rect& rect)
+{
+    m_rect = rect & Rect(0, 0, frame.cols, frame.rows);
+    m_tracking = !m_rect.empty();
+    if (m_tracking)
+    {
+        ToGray(frame, m_prevGrayFrame);
+    }
+}
+
+void RegionTracker::Stop()
+{
+    m_tracking = false;
+}
+
+bool RegionTracker::Track(
+    const Mat& frame,
+    Workspace& workspace)
+{
+    if (!m_tracking)
+    {
+        return false;
+    }
+
+    const Rect frameRect(0, 0, frame.cols, frame.rows);
+    if (frame.size() != m_prevGrayFrame.size())
+    {
+        m_tracking = false;
+        return false;
+    }
+
+    // Correlate the same window of both frames, which contains the region in the previous
+    // frame and any shift of up to the search margin.
+    const Rect window = Rect(
+        m_rect.x - m_searchMargin,
+        m_rect.y - m_searchMargin,
+        m_rect.width + 2*m_searchMargin,
+        m_rect.height + 2*m_searchMargin) & frameRect;
+
+    Mat grayFrame = workspace.GetMat("trackGray", frame.size(), CV_8UC1);
+    ToGray(frame, grayFrame);
+
+    Mat prevWindowImg = workspace.GetMat("trackPrev", window.size(), CV_32FC1);
+    Mat curWindowImg = workspace.GetMat("trackCur", window.size(), CV_32FC1);
+    m_prevGrayFrame(window).convertTo(prevWindowImg, CV_32F);
+    grayFrame(window).convertTo(curWindowImg, CV_32F);
+
+    if (m_hanningWindow.size() != window.size())
+    {
+        createHanningWindow(m_hanningWindow, window.size(), CV_32F);
+    }
+
+    double response = 0.0;
+    const Point2d shift = phaseCorrelate(prevWindowImg, curWindowImg, m_hanningWindow, &response);
+
+    grayFrame.copyTo(m_prevGrayFrame);
+
+    const Rect movedRect = m_rect + Point(cvRound(shift.x), cvRound(shift.y));
+    if ((response < m_minResponse) || (abs(shift.x) > m_searchMargin) || (abs(shift.y) > m_searchMargin)
+        || ((movedRect & frameRect) != movedRect))
+    {
+#ifdef DEBUG
+        printf("[DEBUG]: Lose the track with shift (%f, %f) and response %f.\n", shift.x, shift.y, response);
+#endif
+        m_tracking = false;
+        return false;
+    }
+
+    m_rect = movedRect;
+    return true;
+}
+
+bool RegionTracker::IsTracking() const
+{
+    return m_tracking;
+}
+
+const Rect& RegionTracker::GetRect() const
+{
+    return m_rect;
+}
@@ -0,0 +1,268 @@
+/*
+ * SeriesRouter.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "SeriesRouter.h"
+
+using namespace std;
+using namespace cv;
+using namespace cv::xfeatures2d;
+
+// The covers are downscaled to this many pixels on the longer side before routing,
+// which is enough to tell the series apart since SURF is scale invariant.
+static const int routeImgMaxSide = 640;
+
+SeriesRouter::SeriesRouter(
+    const vector<Mat>& seriesDescriptors,
+    const int branchFactor,
+    const int maxDepth,
+    const int maxKeyPoints) :
+    m_branchFactor(max(branchFactor, 2)),
+    m_maxDepth(max(maxDepth, 1)),
+    m_maxKeyPoints(maxKeyPoints),
+    m_cntSeries(seriesDescriptors.size())
+{
+    // Build the vocabulary tree over the descriptors of all the series.
+    Mat allDescriptors;
+    for (const auto& descriptors: seriesDescriptors)
+    {
+        if (!descriptors.empty())
+        {
+            allDescriptors.push_back(descriptors);
+        }
+    }
+
+    BuildNode(allDescriptors, 0);
+
+    // Count the words of each series and the number of series containing each word.
+    const size_t cntWords = m_invertedIndex.size();
+    vector<vector<int> > seriesWordCounts(m_cntSeries, vector<int>(cntWords, 0));
+    vector<int> documentFrequencies(cntWords, 0);
+    for (size_t seriesIndex = 0; seriesIndex < m_cntSeries; ++seriesIndex)
+    {
+        const Mat& descriptors = seriesDescriptors[seriesIndex];
+        for (int row = 0; row < descriptors.rows; ++row)
+        {
+            const int word = Quantize(descriptors.ptr<float>(row));
+            if (seriesWordCounts[seriesIndex][word]++ == 0)
+            {
+                ++documentFrequencies[word];
+            }
+        }
+    }
+
+    m_idfs.resize(cntWords);
+    for (size_t word = 0; word < cntWords; ++word)
+    {
+        m_idfs[word] = (documentFrequencies[word] > 0) ? log(static_cast<float>(m_cntSeries)/documentFrequencies[word]) : 0.0f;
+    }
+
+    // Store the normalized TF-IDF histogram of each series in the inverted index. Note
+    // that the words shared by all the series have no weight.
+    for (size_t seriesIndex = 0; seriesIndex < m_cntSeries; ++seriesIndex)
+    {
+        double norm = 0.0;
+        for (size_t word = 0; word < cntWords; ++word)
+        {
+            const double weight = seriesWordCounts[seriesIndex][word]*m_idfs[word];
+            norm += weight*weight;
+        }
+
+        norm = sqrt(norm);
+        if (norm <= 0.0)
+        {
+            printf("[INFO]: Series %ld has no distinctive keypoints and can't be routed to.\n", seriesIndex);
+            continue;
+        }
+
+        for (size_t word = 0; word < cntWords; ++word)
+        {
+            const double weight = seriesWordCounts[seriesIndex][word]*m_idfs[word];
+            if (weight > 0.0)
+            {
+                Posting posting;
+                posting.series = static_cast<int>(seriesIndex);
+                posting.weight = static_cast<float>(weight/norm);
+                m_invertedIndex[word].push_back(posting);
+            }
+        }
+    }
+}
+
+int SeriesRouter::BuildNode(
+    const Mat& descriptors,
+    const int depth)
+{
+    // Note that m_nodes may be reallocated by the recursion, so we refer to the node by index.
+    const int nodeIndex = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(VocabularyNode());
+    m_nodes[nodeIndex].word = -1;
+
+    if ((depth >= m_maxDepth) || (descriptors.rows <= m_branchFactor))
+    {
+        m_nodes[nodeIndex].word = static_cast<int>(m_invertedIndex.size());
+        m_invertedIndex.push_back(vector<Posting>());
+        return nodeIndex;
+    }
+
+    Mat labels;
+    Mat centers;
+    kmeans(descriptors, m_branchFactor, labels,
+        TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 20, 0.01), 3, KMEANS_PP_CENTERS, centers);
+    m_nodes[nodeIndex].centers = centers;
+
+    for (int branch = 0; branch < m_branchFactor; ++branch)
+    {
+        Mat branchDescriptors;
+        for (int row = 0; row < descriptors.rows; ++row)
+        {
+            if (labels.at<int>(row) == branch)
+            {
+                branchDescriptors.push_back(descriptors.row(row));
+            }
+        }
+
+        const int childIndex = BuildNode(branchDescriptors, depth + 1);
+        m_nodes[nodeIndex].children.push_back(childIndex);
+    }
+
+    return nodeIndex;
+}
+
+int SeriesRouter::Quantize(const float* descriptor) const
+{
+    int nodeIndex = 0;
+    while (!m_nodes[nodeIndex].children.empty())
+    {
+        const Mat& centers = m_nodes[nodeIndex].centers;
+
+        int nearestBranch = 0;
+        float nearestDistance = numeric_limits<float>::max();
+        for (int branch = 0; branch < centers.rows; ++branch)
+        {
+            const float* center = centers.ptr<float>(branch);
+            float distance = 0.0f;
+            for (int col = 0; col < centers.cols; ++col)
+            {
+                const float diff = descriptor[col] - center[col];
+                distance += diff*diff;
+            }
+
+            if (distance < nearestDistance)
+            {
+                nearestDistance = distance;
+                nearestBranch = branch;
+            }
+        }
+
+        nodeIndex = m_nodes[nodeIndex].children[nearestBranch];
+    }
+
+    return m_nodes[nodeIndex].word;
+}
+
+void SeriesRouter::ComputeHistogram(
+    const Mat& descriptors,
+    vector<pair<int, float> >& histogram,
+    Workspace& workspace) const
+{
+    vector<int>& wordCounts = workspace.GetIntVector("routeCounts");
+    wordCounts.resize(m_invertedIndex.size(), 0);
+
+    vector<int>& words = workspace.GetIntVector("routeWords");
+    for (int row = 0; row < descriptors.rows; ++row)
+    {
+        const int word = Quantize(descriptors.ptr<float>(row));
+        if (wordCounts[word]++ == 0)
+        {
+            words.push_back(word);
+        }
+    }
+
+    histogram.clear();
+    double norm = 0.0;
+    for (const auto word: words)
+    {
+        const double weight = wordCounts[word]*m_idfs[word];
+        if (weight > 0.0)
+        {
+            histogram.push_back(make_pair(word, static_cast<float>(weight)));
+            norm += weight*weight;
+        }
+    }
+
+    norm = sqrt(norm);
+    for (auto& wordWeight: histogram)
+    {
+        wordWeight.second = static_cast<float>(wordWeight.second/norm);
+    }
+}
+
+size_t SeriesRouter::GetWordCount() const
+{
+    return m_invertedIndex.size();
+}
+
+int SeriesRouter::Route(
+    const Mat& bookCoverImg,
+    Workspace& workspace,
+    double& score) const
+{
+    score = 0.0;
+
+    const double scale = min(1.0, static_cast<double>(routeImgMaxSide)/max(bookCoverImg.cols, bookCoverImg.rows));
+    const Size routeSize(cvRound(bookCoverImg.cols*scale), cvRound(bookCoverImg.rows*scale));
+    Mat routeImg = workspace.GetMat("routeImg", routeSize, bookCoverImg.type());
+    resize(bookCoverImg, routeImg, routeSize, 0, 0, INTER_AREA);
+
+    // The detector is created per cover since the concurrent workers can't share one.
+    const int minHessian = 400;
+    Ptr<SURF> detector = SURF::create(minHessian);
+
+    vector<KeyPoint>& keyPoints = workspace.GetKeyPointVector("routeKps");
+    detector->detect(routeImg, keyPoints);
+    if (m_maxKeyPoints > 0)
+    {
+        KeyPointsFilter::retainBest(keyPoints, m_maxKeyPoints);
+    }
+
+    Mat descriptors;
+    detector->compute(routeImg, keyPoints, descriptors);
+    if (descriptors.empty())
+    {
+        return -1;
+    }
+
+    vector<pair<int, float> > histogram;
+    ComputeHistogram(descriptors, histogram, workspace);
+
+    // Accumulate the cosine similarity over the postings of the words of the cover.
+    vector<double>& scores = workspace.GetDoubleVector("routeScores");
+    scores.resize(m_cntSeries, 0.0);
+    for (const auto& wordWeight: histogram)
+    {
+        for (const auto& posting: m_invertedIndex[wordWeight.first])
+        {
+            scores[posting.series] += wordWeight.second*posting.weight;
+        }
+    }
+
+    int bestSeries = -1;
+    for (size_t seriesIndex = 0; seriesIndex < scores.size(); ++seriesIndex)
+    {
+        if (scores[seriesIndex] > score)
+        {
+            score = scores[seriesIndex];
+            bestSeries = static_cast<int>(seriesIndex);
+        }
+    }
+
+    return bestSeries;
+}
@@ -0,0 +1,284 @@
+/*
+ * TemplateBank.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+
+#include "TemplateBank.h"
+
+using namespace std;
+using namespace cv;
+
+// The correlations of one template fit into int as long as it has no more pixels.
+static const int maxTemplPixels = INT_MAX/(255*255);
+
+// The number of results accumulated at once, whose image pixels and correlations of
+// all the candidates stay in L1.
+static const int blockCols = 64;
+
+// The generic kernel. templColsFixed is the template width known at compile time,
+// which lets the compiler unroll the loop over the template columns, or 0 for the
+// width known only at run time. For each block of results and template column, the
+// image pixels are widened once and then multiplied by the pixel of every candidate,
+// instead of being loaded again for each candidate. The innermost loop over the
+// results is contiguous so that the compiler vectorizes it for the instruction set
+// of the caller.
+template<int templColsFixed>
+static inline __attribute__((always_inline)) void CorrelateRowImpl(
+    const uchar* imgRow,
+    const int* templRows,
+    const int* templIndices,
+    const int cntTempls,
+    const int templCols,
+    const int resCols,
+    int* correlations)
+{
+    const int cols = (templColsFixed > 0) ? templColsFixed : templCols;
+    int imgPixels[blockCols];
+    for (int blockStart = 0; blockStart < resCols; blockStart += blockCols)
+    {
+        const int blockLen = min(blockCols, resCols - blockStart);
+        for (int col = 0; col < cols; ++col)
+        {
+            const uchar* imgBlock = imgRow + blockStart + col;
+            for (int resCol = 0; resCol < blockLen; ++resCol)
+            {
+                imgPixels[resCol] = imgBlock[resCol];
+            }
+
+            for (int candIndex = 0; candIndex < cntTempls; ++candIndex)
+            {
+                const int templPixel = templRows[templIndices[candIndex]*cols + col];
+                int* blockCorrelations = correlations + candIndex*resCols + blockStart;
+                for (int resCol = 0; resCol < blockLen; ++resCol)
+                {
+                    blockCorrelations[resCol] += imgPixels[resCol]*templPixel;
+                }
+            }
+        }
+    }
+}
+
+// Instantiate the kernels of the common template widths for one instruction set.
+#define DEFINE_CORRELATE_ROW_KERNELS(isa, target)                                       \
+    template<int templColsFixed>                                                        \
+    target static void CorrelateRow_##isa(                                              \
+        const uchar* imgRow,                                                            \
+        const int* templRows,                                                           \
+        const int* templIndices,                                                        \
+        const int cntTempls,                                                            \
+        const int templCols,                                                            \
+        const int resCols,                                                              \
+        int* correlations)                                                              \
+    {                                                                                   \
+        CorrelateRowImpl<templColsFixed>(imgRow, templRows, templIndices, cntTempls, templCols, resCols, correlations); \
+    }                                                                                   \
+                                                                                        \
+    static void (*SelectCorrelateRow_##isa(const int templCols, int& fixedCols))(       \
+        const uchar*, const int*, const int*, const int, const int, const int, int*)   \
+    {                                                                                   \
+        fixedCols = templCols;                                                          \
+        switch (templCols)                                                              \
+        {                                                                               \
+        case 16: return CorrelateRow_##isa<16>;                                         \
+        case 20: return CorrelateRow_##isa<20>;                                         \
+        case 24: return CorrelateRow_##isa<24>;                                         \
+        case 28: return CorrelateRow_##isa<28>;                                         \
+        case 32: return CorrelateRow_##isa<32>;                                         \
+        case 40: return CorrelateRow_##isa<40>;                                         \
+        case 48: return CorrelateRow_##isa<48>;                                         \
+        case 64: return CorrelateRow_##isa<64>;                                         \
+        default: fixedCols = 0; return CorrelateRow_##isa<0>;                           \
+        }                                                                               \
+    }
+
+DEFINE_CORRELATE_ROW_KERNELS(generic, )
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEMPLATE_BANK_X86_KERNELS
+DEFINE_CORRELATE_ROW_KERNELS(sse41, __attribute__((target("sse4.1"))))
+DEFINE_CORRELATE_ROW_KERNELS(avx2, __attribute__((target("avx2"))))
+DEFINE_CORRELATE_ROW_KERNELS(avx512, __attribute__((target("avx512f,avx512bw"))))
+#endif
+
+TemplateBank::TemplateBank(const vector<Mat>& templImgs) :
+    m_cntTempls(0),
+    m_correlateRow(nullptr)
+{
+    if (templImgs.empty())
+    {
+        return;
+    }
+
+    const Size templSize = templImgs[0].size();
+    for (const auto& templImg: templImgs)
+    {
+        if ((templImg.type() != CV_8UC1) || (templImg.size() != templSize))
+        {
+            printf("[INFO]: The digit templates differ in size or type, so they are matched one by one.\n");
+            return;
+        }
+    }
+
+    if ((templSize.area() <= 0) || (templSize.area() > maxTemplPixels))
+    {
+        return;
+    }
+
+    m_templSize = templSize;
+    m_cntTempls = static_cast<int>(templImgs.size());
+
+    m_templPixels.resize(static_cast<size_t>(m_cntTempls)*templSize.area());
+    m_templSums.resize(m_cntTempls);
+    m_templNorms.resize(m_cntTempls);
+    for (int templIndex = 0; templIndex < m_cntTempls; ++templIndex)
+    {
+        const Mat& templImg = templImgs[templIndex];
+
+        double templSum = 0.0;
+        double templSqSum = 0.0;
+        for (int row = 0; row < templSize.height; ++row)
+        {
+            const uchar* templRow = templImg.ptr<uchar>(row);
+            int* bankRow = &m_templPixels[(static_cast<size_t>(row)*m_cntTempls + templIndex)*templSize.width];
+            for (int col = 0; col < templSize.width; ++col)
+            {
+                bankRow[col] = templRow[col];
+                templSum += templRow[col];
+                templSqSum += static_cast<double>(templRow[col])*templRow[col];
+            }
+        }
+
+        m_templSums[templIndex] = templSum;
+        m_templNorms[templIndex] = sqrt(max(templSqSum - templSum*templSum/templSize.area(), 0.0));
+    }
+
+    int fixedCols = 0;
+    string isa = "generic";
+    m_correlateRow = SelectCorrelateRow_generic(templSize.width, fixedCols);
+#ifdef TEMPLATE_BANK_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+    {
+        isa = "avx512";
+        m_correlateRow = SelectCorrelateRow_avx512(templSize.width, fixedCols);
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        isa = "avx2";
+        m_correlateRow = SelectCorrelateRow_avx2(templSize.width, fixedCols);
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        isa = "sse4.1";
+        m_correlateRow = SelectCorrelateRow_sse41(templSize.width, fixedCols);
+    }
+#endif
+
+    m_kernelName = isa + "/" + ((fixedCols > 0) ? "w" + to_string(fixedCols) : string("any"));
+}
+
+bool TemplateBank::IsValid() const
+{
+    return m_correlateRow != nullptr;
+}
+
+Size TemplateBank::GetTemplateSize() const
+{
+    return m_templSize;
+}
+
+const string& TemplateBank::GetKernelName() const
+{
+    return m_kernelName;
+}
+
+bool TemplateBank::MatchAll(
+    const Mat& img,
+    const vector<int>& templIndices,
+    vector<double>& maxScores,
+    Workspace& workspace) const
+{
+    const int resRows = img.rows - m_templSize.height + 1;
+    const int resCols = img.cols - m_templSize.width + 1;
+    if (!IsValid() || (img.type() != CV_8UC1) || (resRows <= 0) || (resCols <= 0))
+    {
+        return false;
+    }
+
+    // The sums of the image under the templates come from the integral images.
+    Mat sumImg = workspace.GetMat("bankSum", Size(img.cols + 1, img.rows + 1), CV_32SC1);
+    Mat sqSumImg = workspace.GetMat("bankSqSum", Size(img.cols + 1, img.rows + 1), CV_64FC1);
+    integral(img, sumImg, sqSumImg, CV_32S, CV_64F);
+
+    vector<int>& correlations = workspace.GetIntVector("bankCorr");
+    const int cntCands = static_cast<int>(templIndices.size());
+    correlations.resize(static_cast<size_t>(cntCands)*resCols);
+
+    maxScores.assign(cntCands, -1.0);
+
+    const double area = m_templSize.area();
+    const size_t bankRowPixels = static_cast<size_t>(m_cntTempls)*m_templSize.width;
+    for (int resRow = 0; resRow < resRows; ++resRow)
+    {
+        fill(correlations.begin(), correlations.end(), 0);
+        for (int templRow = 0; templRow < m_templSize.height; ++templRow)
+        {
+            m_correlateRow(
+                img.ptr<uchar>(resRow + templRow),
+                &m_templPixels[templRow*bankRowPixels],
+                templIndices.data(),
+                cntCands,
+                m_templSize.width,
+                resCols,
+                correlations.data());
+        }
+
+        const int* sumTop = sumImg.ptr<int>(resRow);
+        const int* sumBottom = sumImg.ptr<int>(resRow + m_templSize.height);
+        const double* sqSumTop = sqSumImg.ptr<double>(resRow);
+        const double* sqSumBottom = sqSumImg.ptr<double>(resRow + m_templSize.height);
+        for (int resCol = 0; resCol < resCols; ++resCol)
+        {
+            const int right = resCol + m_templSize.width;
+            const double wndSum = sumBottom[right] - sumBottom[resCol] - sumTop[right] + sumTop[resCol];
+            const double wndSqSum = sqSumBottom[right] - sqSumBottom[resCol] - sqSumTop[right] + sqSumTop[resCol];
+            const double wndNorm = sqrt(max(wndSqSum - wndSum*wndSum/area, 0.0));
+
+            for (int candIndex = 0; candIndex < cntCands; ++candIndex)
+            {
+                const int templIndex = templIndices[candIndex];
+
+                // Normalize the same way as matchTemplate does with TM_CCOEFF_NORMED.
+                double score = 1.0;
+                if (m_templNorms[templIndex] >= DBL_EPSILON)
+                {
+                    const double num = correlations[candIndex*resCols + resCol] - wndSum*m_templSums[templIndex]/area;
+                    const double denom = wndNorm*m_templNorms[templIndex];
+                    if (fabs(num) < denom)
+                    {
+                        score = num/denom;
+                    }
+                    else if (fabs(num) < denom*1.125)
+                    {
+                        score = (num > 0) ? 1.0 : -1.0;
+                    }
+                    else
+                    {
+                        score = 0.0;
+                    }
+                }
+
+                maxScores[candIndex] = max(maxScores[candIndex], score);
+            }
+        }
+    }
+
+    return true;
+}
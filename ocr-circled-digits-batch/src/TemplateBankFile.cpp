@@ -0,0 +1,413 @@
+/*
+ * TemplateBankFile.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "FileUtility.h"
+#include "TemplateBankFile.h"
+
+using namespace std;
+using namespace cv;
+
+static const char bankMagic[8] = {'O', 'C', 'R', 'B', 'A', 'N', 'K', '\0'};
+static const uint32_t bankVersion = 1;
+static const size_t sectionAlignment = 64;
+
+struct BankHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t cntSections;
+};
+
+struct BankSection
+{
+    char name[48];
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    int32_t reserved;
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// Check the table entry of a section before it is used: the type is one that Save writes,
+// i.e., a depth up to CV_64F with 1 to 4 channels, the bytes are inside the mapping, and
+// the bytes are exactly those of a rows x cols image of the type. The sums and products
+// are arranged so that they can't wrap around on a corrupted or hostile file.
+static bool IsValidSection(
+    const BankSection& section,
+    const uint64_t mappingSize)
+{
+    if ((section.rows < 0) || (section.cols < 0) || (section.type < 0) ||
+        (section.type > CV_MAKETYPE(CV_64F, 4)) || (CV_MAT_DEPTH(section.type) > CV_64F))
+    {
+        return false;
+    }
+
+    if ((section.offset > mappingSize) || (section.bytes > mappingSize - section.offset))
+    {
+        return false;
+    }
+
+    // At most 2^31 x 32 bytes per row, so the row size can't wrap around.
+    const uint64_t rowBytes = static_cast<uint64_t>(section.cols)*CV_ELEM_SIZE(section.type);
+    if ((section.rows == 0) || (rowBytes == 0))
+    {
+        return section.bytes == 0;
+    }
+
+    return (section.bytes%rowBytes == 0) && (section.bytes/rowBytes == static_cast<uint64_t>(section.rows));
+}
+
+// Get the record "<kind> <size> <mtime> <path>" of a source file.
+static bool GetSourceRecord(
+    const string& kind,
+    const string& file,
+    string& record)
+{
+    struct stat info;
+    if (stat(file.c_str(), &info) != 0)
+    {
+        printf("[ERROR]: stat(%s) for %s.\n\n", strerror(errno), file.c_str());
+        return false;
+    }
+
+    record = kind + " " + to_string(static_cast<long long>(info.st_size)) + " " +
+        to_string(static_cast<long long>(info.st_mtime)) + " " + file;
+    return true;
+}
+
+TemplateBankFile::TemplateBankFile() :
+    m_mapping(nullptr),
+    m_mappingSize(0)
+{
+
+}
+
+TemplateBankFile::~TemplateBankFile()
+{
+    Unmap();
+}
+
+void TemplateBankFile::Unmap()
+{
+    // Drop the headers pointing into the mapping first.
+    m_titleFeatures = TitleFeatures();
+    m_templDigitImgPairs.clear();
+
+    if (m_mapping != nullptr)
+    {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+}
+
+bool TemplateBankFile::Build(
+    const string& bankFile,
+    const string& titleImgFile,
+    const Mat& titleImg,
+    const string& templImgDir,
+    const vector<string>& templImgFiles,
+    const vector<pair<string, Mat> >& templDigitImgPairs)
+{
+    // Record the source files, so that the bank can be rejected once any of them changes.
+    string record;
+    string sources;
+    if (!GetSourceRecord("title", titleImgFile, record))
+    {
+        return false;
+    }
+
+    sources += record + "\n";
+    sources += "dir " + templImgDir + "\n";
+    for (const auto& templImgFile: templImgFiles)
+    {
+        if (!GetSourceRecord("templ", templImgFile, record))
+        {
+            return false;
+        }
+
+        sources += record + "\n";
+    }
+
+    TitleFeatures titleFeatures = OcrPreprocessor::ComputeTitleFeatures(titleImg, true, true);
+
+    Mat keyPointsMat(static_cast<int>(titleFeatures.keyPoints.size()), 7, CV_32FC1);
+    for (int keyPointIndex = 0; keyPointIndex < keyPointsMat.rows; ++keyPointIndex)
+    {
+        const KeyPoint& keyPoint = titleFeatures.keyPoints[keyPointIndex];
+        float* row = keyPointsMat.ptr<float>(keyPointIndex);
+        row[0] = keyPoint.pt.x;
+        row[1] = keyPoint.pt.y;
+        row[2] = keyPoint.size;
+        row[3] = keyPoint.angle;
+        row[4] = keyPoint.response;
+        row[5] = static_cast<float>(keyPoint.octave);
+        row[6] = static_cast<float>(keyPoint.class_id);
+    }
+
+    vector<pair<string, Mat> > sections;
+    sections.push_back(make_pair(string("sources"), Mat(1, static_cast<int>(sources.size()), CV_8UC1, &sources[0])));
+    sections.push_back(make_pair(string("title"), titleFeatures.sharpenedImg));
+    sections.push_back(make_pair(string("titleSobel"), titleFeatures.sobel));
+    sections.push_back(make_pair(string("titleKeyPoints"), keyPointsMat));
+    sections.push_back(make_pair(string("titleDesc"), titleFeatures.descriptors));
+    for (const auto& templDigitImgPair: templDigitImgPairs)
+    {
+        sections.push_back(make_pair("templ:" + templDigitImgPair.first, templDigitImgPair.second));
+    }
+
+    // Lay out the sections after the header and the section table.
+    BankHeader header;
+    memcpy(header.magic, bankMagic, sizeof(bankMagic));
+    header.version = bankVersion;
+    header.cntSections = static_cast<uint32_t>(sections.size());
+
+    vector<BankSection> table(sections.size());
+    uint64_t offset = sizeof(BankHeader) + sizeof(BankSection)*table.size();
+    for (size_t sectionIndex = 0; sectionIndex < sections.size(); ++sectionIndex)
+    {
+        const string& name = sections[sectionIndex].first;
+        const Mat& mat = sections[sectionIndex].second;
+        if (name.size() >= sizeof(table[sectionIndex].name))
+        {
+            printf("[ERROR]: The section name %s is too long for the template bank.\n\n", name.c_str());
+            return false;
+        }
+
+        BankSection& section = table[sectionIndex];
+        memset(&section, 0, sizeof(section));
+        strcpy(section.name, name.c_str());
+        section.rows = mat.rows;
+        section.cols = mat.cols;
+        section.type = mat.empty() ? CV_8UC1 : mat.type();
+        section.bytes = mat.empty() ? 0 : static_cast<uint64_t>(mat.rows)*mat.cols*mat.elemSize();
+
+        offset = (offset + sectionAlignment - 1)/sectionAlignment*sectionAlignment;
+        section.offset = offset;
+        offset += section.bytes;
+    }
+
+    ofstream ofs(bankFile.c_str(), ios::binary | ios::trunc);
+    if (!ofs)
+    {
+        printf("[ERROR]: Cannot open the template bank %s for writing.\n\n", bankFile.c_str());
+        return false;
+    }
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(table.data()), sizeof(BankSection)*table.size());
+    for (size_t sectionIndex = 0; sectionIndex < sections.size(); ++sectionIndex)
+    {
+        const Mat& mat = sections[sectionIndex].second;
+
+        // Pad up to the aligned offset.
+        const uint64_t pos = static_cast<uint64_t>(ofs.tellp());
+        const string padding(table[sectionIndex].offset - pos, '\0');
+        ofs.write(padding.data(), padding.size());
+
+        for (int row = 0; row < mat.rows; ++row)
+        {
+            ofs.write(reinterpret_cast<const char*>(mat.ptr(row)), mat.cols*mat.elemSize());
+        }
+    }
+
+    if (!ofs)
+    {
+        printf("[ERROR]: Failed to write the template bank %s.\n\n", bankFile.c_str());
+        return false;
+    }
+
+    printf("[INFO]: Write the title and %ld digit templates into the template bank %s.\n",
+        templDigitImgPairs.size(), bankFile.c_str());
+    return true;
+}
+
+bool TemplateBankFile::Load(const string& bankFile)
+{
+    Unmap();
+
+    const int64 startTick = getTickCount();
+
+    const int fd = open(bankFile.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        printf("[ERROR]: open(%s) for the template bank %s.\n\n", strerror(errno), bankFile.c_str());
+        return false;
+    }
+
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (static_cast<size_t>(info.st_size) < sizeof(BankHeader)))
+    {
+        printf("[ERROR]: The template bank %s is truncated.\n\n", bankFile.c_str());
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        printf("[ERROR]: mmap(%s) for the template bank %s.\n\n", strerror(errno), bankFile.c_str());
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_mappingSize = info.st_size;
+
+    const uchar* data = static_cast<const uchar*>(m_mapping);
+    const BankHeader* header = reinterpret_cast<const BankHeader*>(data);
+    if ((memcmp(header->magic, bankMagic, sizeof(bankMagic)) != 0) || (header->version != bankVersion) ||
+        (sizeof(BankHeader) + sizeof(BankSection)*static_cast<uint64_t>(header->cntSections) > m_mappingSize))
+    {
+        printf("[ERROR]: %s is not a template bank of version %u.\n\n", bankFile.c_str(), bankVersion);
+        Unmap();
+        return false;
+    }
+
+    // Wrap the sections as images without copying them. The mapping is read only, so
+    // the images must never be written.
+    string sources;
+    const BankSection* table = reinterpret_cast<const BankSection*>(data + sizeof(BankHeader));
+    for (uint32_t sectionIndex = 0; sectionIndex < header->cntSections; ++sectionIndex)
+    {
+        const BankSection& section = table[sectionIndex];
+        const string name(section.name, strnlen(section.name, sizeof(section.name)));
+        if (!IsValidSection(section, m_mappingSize))
+        {
+            printf("[ERROR]: The section %s of the template bank %s is corrupted.\n\n", name.c_str(), bankFile.c_str());
+            Unmap();
+            return false;
+        }
+
+        Mat mat;
+        if (section.bytes > 0)
+        {
+            mat = Mat(section.rows, section.cols, section.type, const_cast<uchar*>(data + section.offset));
+        }
+
+        if (name == "sources")
+        {
+            sources.assign(reinterpret_cast<const char*>(data + section.offset), section.bytes);
+        }
+        else if (name == "title")
+        {
+            m_titleFeatures.sharpenedImg = mat;
+        }
+        else if (name == "titleSobel")
+        {
+            m_titleFeatures.sobel = mat;
+        }
+        else if (name == "titleKeyPoints")
+        {
+            m_titleFeatures.keyPoints.clear();
+            for (int keyPointIndex = 0; keyPointIndex < mat.rows; ++keyPointIndex)
+            {
+                const float* row = mat.ptr<float>(keyPointIndex);
+                m_titleFeatures.keyPoints.push_back(KeyPoint(row[0], row[1], row[2], row[3], row[4],
+                    static_cast<int>(row[5]), static_cast<int>(row[6])));
+            }
+        }
+        else if (name == "titleDesc")
+        {
+            m_titleFeatures.descriptors = mat;
+        }
+        else if (name.compare(0, 6, "templ:") == 0)
+        {
+            m_templDigitImgPairs.push_back(make_pair(name.substr(6), mat));
+        }
+    }
+
+    if (m_titleFeatures.sharpenedImg.empty() || m_titleFeatures.sobel.empty() || m_templDigitImgPairs.empty() ||
+        !CheckSources(sources))
+    {
+        printf("[ERROR]: The template bank %s is incomplete or out of date. Build it again.\n\n", bankFile.c_str());
+        Unmap();
+        return false;
+    }
+
+    printf("[INFO]: Load the title and %ld digit templates from the template bank %s in %f ms.\n",
+        m_templDigitImgPairs.size(), bankFile.c_str(), (getTickCount() - startTick)*1000.0/getTickFrequency());
+    return true;
+}
+
+bool TemplateBankFile::CheckSources(const string& sources)
+{
+    // Compare each record with the current state of the source file, and the recorded
+    // templates with the files now in the template directory.
+    vector<string> recordedTemplImgFiles;
+    string templImgDir;
+
+    istringstream iss(sources);
+    string line;
+    while (getline(iss, line))
+    {
+        istringstream lineStream(line);
+        string kind;
+        lineStream >> kind;
+        if (kind == "dir")
+        {
+            lineStream >> ws;
+            getline(lineStream, templImgDir);
+            continue;
+        }
+
+        long long size = 0;
+        long long mtime = 0;
+        string file;
+        lineStream >> size >> mtime >> ws;
+        getline(lineStream, file);
+
+        string record;
+        if (!GetSourceRecord(kind, file, record) || (record != line))
+        {
+            printf("[INFO]: The source file %s has changed since the template bank was built.\n", file.c_str());
+            return false;
+        }
+
+        if (kind == "templ")
+        {
+            recordedTemplImgFiles.push_back(file);
+        }
+    }
+
+    vector<string> templImgFiles;
+    if (templImgDir.empty() || (FileUtility::GetDirFiles(templImgDir, templImgFiles) != 0))
+    {
+        return false;
+    }
+
+    sort(templImgFiles.begin(), templImgFiles.end());
+    if (templImgFiles != recordedTemplImgFiles)
+    {
+        printf("[INFO]: The template files in %s have changed since the template bank was built.\n", templImgDir.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+const TitleFeatures& TemplateBankFile::GetTitleFeatures() const
+{
+    return m_titleFeatures;
+}
+
+const vector<pair<string, Mat> >& TemplateBankFile::GetTemplDigitImgPairs() const
+{
+    return m_templDigitImgPairs;
+}
@@ -9,40 +9,30 @@
 
 using namespace std;
 
-int Utility::GetDirFiles(const string& dir, vector<string>& files)
+int Utility::GetSubDirs(const string& dir, vector<string>& subDirs)
 {
-    DIR *dp = nullptr;
-    struct dirent *dirp = nullptr;
-
-    dp = opendir(dir.c_str());
+    DIR *dp = opendir(dir.c_str());
     if (dp == nullptr)
     {
         printf("Error: opendir(%s) opening %s.\n", strerror(errno), dir.c_str());
         return errno;
     }
 
+    struct dirent *dirp = nullptr;
     struct stat info;
 
-    files.clear();
-    string completedDir(dir);
-    if (completedDir.back() != '/')
-    {
-        completedDir.push_back('/');
-    }
-
+    subDirs.clear();
     while ((dirp = readdir(dp)) != nullptr)
     {
-        string fileFullPath = completedDir + string(dirp->d_name);
-
-        if (stat(fileFullPath.c_str(), &info) != 0)
+        string name(dirp->d_name);
+        if ((name == ".") || (name == ".."))
         {
-            printf("Error: stat(%s) for %s.\n", strerror(errno), dirp->d_name);
             continue;
         }
 
-        if (S_ISREG(info.st_mode))
+        if ((stat((dir + '/' + name).c_str(), &info) == 0) && S_ISDIR(info.st_mode))
         {
-            files.push_back(fileFullPath);
+            subDirs.push_back(name);
         }
     }
 
@@ -0,0 +1,160 @@
+/*
+ * Workspace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+#include <algorithm>
+
+#include "Workspace.h"
+
+using namespace std;
+using namespace cv;
+
+Workspace::Workspace() :
+    m_cntMatAllocations(0),
+    m_cntVectorAllocations(0)
+{
+
+}
+
+Mat Workspace::GetMat(
+    const string& name,
+    const Size& size,
+    const int type)
+{
+    const size_t cntElems = static_cast<size_t>(size.area());
+    if (cntElems == 0)
+    {
+        return Mat(size, type);
+    }
+
+    Mat& buffer = m_mats[name];
+    if (buffer.empty() || (buffer.type() != type) || !buffer.isContinuous() || (buffer.total() < cntElems))
+    {
+        // Grow the buffer to the largest number of elements seen so far.
+        const size_t cntBufferElems = (buffer.type() == type) ? max(buffer.total(), cntElems) : cntElems;
+        buffer.create(1, static_cast<int>(cntBufferElems), type);
+        ++m_cntMatAllocations;
+    }
+
+    // The first elements of the buffer as a continuous image of the size, which keeps the
+    // buffer alive like a region would.
+    return buffer.reshape(0, 1).colRange(0, static_cast<int>(cntElems)).reshape(0, size.height);
+}
+
+void Workspace::AdoptMat(
+    const string& name,
+    const Mat& mat)
+{
+    Mat& buffer = m_mats[name];
+    if (mat.empty() || (mat.datastart == buffer.datastart))
+    {
+        return;
+    }
+
+    // The output didn't fit into the buffer, so keep the new one if it is larger. The
+    // allocation by OpenCV itself isn't counted, like its other temporaries.
+    if (buffer.empty() || (mat.type() != buffer.type()) || (mat.total() > buffer.total()))
+    {
+        buffer = mat;
+        ++m_cntMatAllocations;
+    }
+}
+
+template<typename T>
+vector<T>& Workspace::GetVector(
+    map<string, vector<T> >& vectors,
+    const string& name)
+{
+    vector<T>& vec = vectors[name];
+    vec.clear();
+
+    // Count the growth of the vector since it was handed out last time.
+    size_t& lastCapacity = m_vectorCapacities[&vec];
+    if (vec.capacity() > lastCapacity)
+    {
+        ++m_cntVectorAllocations;
+    }
+
+    lastCapacity = vec.capacity();
+    return vec;
+}
+
+template<typename T>
+size_t Workspace::CountVectorAllocations(const map<string, vector<T> >& vectors) const
+{
+    // Count the growth of the vectors which are still in use since they were handed out.
+    size_t cntAllocations = 0;
+    for (const auto& nameVectorPair: vectors)
+    {
+        const vector<T>& vec = nameVectorPair.second;
+        auto itCapacity = m_vectorCapacities.find(&vec);
+        if ((itCapacity != m_vectorCapacities.end()) && (vec.capacity() > itCapacity->second))
+        {
+            ++cntAllocations;
+        }
+    }
+
+    return cntAllocations;
+}
+
+vector<int>& Workspace::GetIntVector(const string& name)
+{
+    return GetVector(m_intVectors, name);
+}
+
+vector<double>& Workspace::GetDoubleVector(const string& name)
+{
+    return GetVector(m_doubleVectors, name);
+}
+
+vector<KeyPoint>& Workspace::GetKeyPointVector(const string& name)
+{
+    return GetVector(m_keyPointVectors, name);
+}
+
+vector<DMatch>& Workspace::GetMatchVector(const string& name)
+{
+    return GetVector(m_matchVectors, name);
+}
+
+vector<Point2f>& Workspace::GetPointVector(const string& name)
+{
+    return GetVector(m_pointVectors, name);
+}
+
+vector<Vec3f>& Workspace::GetCircleVector(const string& name)
+{
+    return GetVector(m_circleVectors, name);
+}
+
+Workspace& Workspace::GetChild(const size_t index)
+{
+    while (m_children.size() <= index)
+    {
+        m_children.emplace_back(new Workspace());
+    }
+
+    return *m_children[index];
+}
+
+size_t Workspace::GetAllocationCount() const
+{
+    size_t cntAllocations = m_cntMatAllocations +
+        m_cntVectorAllocations +
+        CountVectorAllocations(m_intVectors) +
+        CountVectorAllocations(m_doubleVectors) +
+        CountVectorAllocations(m_keyPointVectors) +
+        CountVectorAllocations(m_matchVectors) +
+        CountVectorAllocations(m_pointVectors) +
+        CountVectorAllocations(m_circleVectors);
+
+    for (const auto& child: m_children)
+    {
+        cntAllocations += child->GetAllocationCount();
+    }
+
+    return cntAllocations;
+}
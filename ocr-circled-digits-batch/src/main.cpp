@@ -5,11 +5,32 @@
  *      Author: renwei
  */
 
+#include <sys/stat.h>
+
 #include <memory>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <opencv2/videoio.hpp>
 
+#include "FileUtility.h"
 #include "Utility.h"
 #include "OcrPreprocessor.h"
 #include "CircledDigitsOCRer.h"
+#include "TemplateBankFile.h"
+#include "OcrEngine.h"
+#include "SeriesRouter.h"
+#include "ProcessPool.h"
+#include "DirWatcher.h"
+#include "DuplicateIndex.h"
+#include "RegionTracker.h"
+#include "CoverTriage.h"
+#include "BatchMetrics.h"
+#include "KeyPointCache.h"
 
 using namespace std;
 using namespace cv;
@@ -23,31 +44,1477 @@ static void write(
     ocrResult.write(fs);
 }
 
-static void read(
-    const FileNode& node,
-    OcrResult& ocrResult,
-    const OcrResult& defaultValue = OcrResult())
+static void read(
+    const FileNode& node,
+    OcrResult& ocrResult,
+    const OcrResult& defaultValue = OcrResult())
+{
+    if (node.empty())
+    {
+        ocrResult = defaultValue;
+    }
+    else
+    {
+        ocrResult.read(node);
+    }
+}
+
+// The processing time of one image for the summary of the slowest images.
+struct ImageTiming
+{
+    string imgFile;
+    double totalMs;
+    vector<pair<string, double> > stageTimesMs;
+};
+
+static void AddStageTime(
+    ImageTiming& timing,
+    const string& stage,
+    const int64 startTick)
+{
+    timing.stageTimesMs.push_back(make_pair(stage, (getTickCount() - startTick)*1000.0/getTickFrequency()));
+}
+
+enum class ImageStatus {
+    Success,
+    LoadFailed,
+    NotFound,
+    Timeout,
+    Rejected,
+    WriteFailed,
+    Crashed,    // The worker process crashed on the image.
+    Triaged     // The image failed the triage before the localization.
+};
+
+// The outcome of processing one book cover image.
+struct ImageOutcome
+{
+    ImageStatus status;
+    int seriesIndex;      // The series which the image is routed to
+    double routeScore;
+    OcrResult ocrResult;
+    ExtractReport extractReport;
+    ImageTiming timing;
+    std::string duplicateOf;    // The near-duplicate cover whose results are reused
+    bool duplicateRejected;     // Whether the results of a near-duplicate failed the verification
+    std::string triageReason;   // Why the image failed the triage
+
+    ImageOutcome() :
+        status(ImageStatus::LoadFailed),
+        seriesIndex(-1),
+        routeScore(0.0),
+        duplicateRejected(false)
+    {
+    }
+};
+
+// The sessions of one worker, one per series, which share the workspace of the worker
+// with its routing, triage and hashing. The workspace must not move once the sessions
+// are created.
+struct OcrWorker
+{
+    Workspace workspace;
+    vector<unique_ptr<OcrSession> > sessions;
+
+    // The images processed by the worker, and the workspace allocations for the first one.
+    size_t cntImgs;
+    size_t cntFirstImgAllocations;
+
+    OcrWorker() :
+        cntImgs(0),
+        cntFirstImgAllocations(0)
+    {
+    }
+};
+
+// Create cntWorkers workers with a session of each engine.
+static bool CreateWorkers(
+    const vector<unique_ptr<OcrEngine> >& engines,
+    const unsigned int cntWorkers,
+    vector<OcrWorker>& workers)
+{
+    workers.clear();
+    workers.resize(cntWorkers);
+    for (auto& worker: workers)
+    {
+        for (const auto& engine: engines)
+        {
+            unique_ptr<OcrSession> session = engine->CreateSession(&worker.workspace);
+            if (!session)
+            {
+                return false;
+            }
+
+            worker.sessions.push_back(move(session));
+        }
+    }
+
+    return true;
+}
+
+template <typename T>
+static void AppendValue(
+    string& buffer,
+    const T& value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void AppendString(
+    string& buffer,
+    const string& str)
+{
+    AppendValue(buffer, str.size());
+    buffer.append(str);
+}
+
+template <typename T>
+static bool ExtractValue(
+    const string& buffer,
+    size_t& offset,
+    T& value)
+{
+    if (offset + sizeof(value) > buffer.size())
+    {
+        return false;
+    }
+
+    memcpy(&value, buffer.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+static bool ExtractString(
+    const string& buffer,
+    size_t& offset,
+    string& str)
+{
+    size_t size = 0;
+    if (!ExtractValue(buffer, offset, size) || (offset + size > buffer.size()))
+    {
+        return false;
+    }
+
+    str.assign(buffer, offset, size);
+    offset += size;
+    return true;
+}
+
+// Serialize the outcome of one image which a worker process passes back to the supervisor.
+// Note that the image file name is known to the supervisor and is not serialized.
+static void SerializeOutcome(
+    const ImageOutcome& outcome,
+    string& buffer)
+{
+    AppendValue(buffer, static_cast<int>(outcome.status));
+    AppendValue(buffer, outcome.seriesIndex);
+    AppendValue(buffer, outcome.routeScore);
+
+    AppendString(buffer, outcome.ocrResult.evaluatedDigits);
+    AppendValue(buffer, outcome.ocrResult.digits2MatchResMap.size());
+    for (const auto& digits2MatchResPair: outcome.ocrResult.digits2MatchResMap)
+    {
+        AppendString(buffer, digits2MatchResPair.first);
+        AppendValue(buffer, digits2MatchResPair.second);
+    }
+
+    const ExtractReport& report = outcome.extractReport;
+    AppendValue(buffer, static_cast<int>(report.status));
+    AppendValue(buffer, report.skewAngle);
+    AppendValue(buffer, report.deskewed);
+    AppendValue(buffer, report.deskewTimeMs);
+    AppendValue(buffer, report.downscaleFactor);
+    AppendValue(buffer, report.priorVerified);
+    AppendValue(buffer, report.priorMismatched);
+    AppendValue(buffer, report.priorOffset);
+
+    AppendValue(buffer, outcome.timing.totalMs);
+    AppendValue(buffer, outcome.timing.stageTimesMs.size());
+    for (const auto& stageTime: outcome.timing.stageTimesMs)
+    {
+        AppendString(buffer, stageTime.first);
+        AppendValue(buffer, stageTime.second);
+    }
+
+    AppendString(buffer, outcome.duplicateOf);
+    AppendValue(buffer, outcome.duplicateRejected);
+    AppendString(buffer, outcome.triageReason);
+}
+
+static bool DeserializeOutcome(
+    const string& buffer,
+    ImageOutcome& outcome)
+{
+    size_t offset = 0;
+    int status = 0;
+    if (!ExtractValue(buffer, offset, status)
+        || !ExtractValue(buffer, offset, outcome.seriesIndex)
+        || !ExtractValue(buffer, offset, outcome.routeScore))
+    {
+        return false;
+    }
+
+    outcome.status = static_cast<ImageStatus>(status);
+
+    size_t cntDigits = 0;
+    if (!ExtractString(buffer, offset, outcome.ocrResult.evaluatedDigits)
+        || !ExtractValue(buffer, offset, cntDigits))
+    {
+        return false;
+    }
+
+    outcome.ocrResult.digits2MatchResMap.clear();
+    for (size_t digitsIndex = 0; digitsIndex < cntDigits; ++digitsIndex)
+    {
+        string digits;
+        float matchRes = 0.0f;
+        if (!ExtractString(buffer, offset, digits) || !ExtractValue(buffer, offset, matchRes))
+        {
+            return false;
+        }
+
+        outcome.ocrResult.digits2MatchResMap.insert(make_pair(digits, matchRes));
+    }
+
+    ExtractReport& report = outcome.extractReport;
+    int extractStatus = 0;
+    if (!ExtractValue(buffer, offset, extractStatus)
+        || !ExtractValue(buffer, offset, report.skewAngle)
+        || !ExtractValue(buffer, offset, report.deskewed)
+        || !ExtractValue(buffer, offset, report.deskewTimeMs)
+        || !ExtractValue(buffer, offset, report.downscaleFactor)
+        || !ExtractValue(buffer, offset, report.priorVerified)
+        || !ExtractValue(buffer, offset, report.priorMismatched)
+        || !ExtractValue(buffer, offset, report.priorOffset))
+    {
+        return false;
+    }
+
+    report.status = static_cast<ExtractStatus>(extractStatus);
+
+    size_t cntStages = 0;
+    if (!ExtractValue(buffer, offset, outcome.timing.totalMs)
+        || !ExtractValue(buffer, offset, cntStages))
+    {
+        return false;
+    }
+
+    outcome.timing.stageTimesMs.clear();
+    for (size_t stageIndex = 0; stageIndex < cntStages; ++stageIndex)
+    {
+        string stage;
+        double timeMs = 0.0;
+        if (!ExtractString(buffer, offset, stage) || !ExtractValue(buffer, offset, timeMs))
+        {
+            return false;
+        }
+
+        outcome.timing.stageTimesMs.push_back(make_pair(stage, timeMs));
+    }
+
+    if (!ExtractString(buffer, offset, outcome.duplicateOf)
+        || !ExtractValue(buffer, offset, outcome.duplicateRejected)
+        || !ExtractString(buffer, offset, outcome.triageReason))
+    {
+        return false;
+    }
+
+    return (offset == buffer.size());
+}
+
+// Write the black-white image of the circled digits of the image file into the output directory.
+static bool WriteBlackWhiteImg(
+    const string& imgFile,
+    const string& outputDir,
+    const Mat& blackWhiteImg)
+{
+    string dir;
+    string filename;
+    string extension;
+    Utility::SegmentFullFilename(imgFile, dir, filename, extension);
+
+    string blackWhiteImgFile = outputDir + '/' + filename + "_circledDigits" + extension;
+    bool writeRes = imwrite(blackWhiteImgFile, blackWhiteImg);
+    if (writeRes)
+    {
+        printf("[INFO]: Successfully write the cropped black-white image of circled digits into %s.\n",
+            blackWhiteImgFile.c_str());
+    }
+    else
+    {
+        printf("[ERROR]: Failed to write the cropped black-white image of circled digits into %s.\n\n",
+            blackWhiteImgFile.c_str());
+    }
+
+    return writeRes;
+}
+
+// Reuse the series, the crop rectangle and the OCR result of a near-duplicate cover, so
+// that the routing and the localization are skipped. The rectangle is scaled to the size
+// of the cover. With verify, the reused crop is recognized again and the results are
+// reused only if the digits agree. Return false if the cover must be processed in full.
+static bool ReuseDuplicate(
+    const string& imgFile,
+    const Mat& img,
+    const DuplicateEntry& entry,
+    const int distance,
+    const string& outputDir,
+    const bool dryRun,
+    const bool verify,
+    OcrWorker& worker,
+    ImageOutcome& outcome)
+{
+    const double scaleX = static_cast<double>(img.cols)/entry.coverSize.width;
+    const double scaleY = static_cast<double>(img.rows)/entry.coverSize.height;
+    const Rect circledDigitsRect(
+        cvRound(entry.circledDigitsRect.x*scaleX),
+        cvRound(entry.circledDigitsRect.y*scaleY),
+        cvRound(entry.circledDigitsRect.width*scaleX),
+        cvRound(entry.circledDigitsRect.height*scaleY));
+
+    OcrSession& session = *worker.sessions[entry.seriesIndex];
+    OcrOutput output;
+    output.circledDigitsImg = OcrPreprocessor::CropCircledDigits(img, circledDigitsRect, worker.workspace);
+    if (!session.Threshold(output))
+    {
+        return false;
+    }
+
+    outcome.timing.stageTimesMs.push_back(output.stageTimesMs.back());
+
+    if (verify)
+    {
+        session.RecognizeThresholded(output);
+        outcome.timing.stageTimesMs.push_back(make_pair("verify", output.stageTimesMs.back().second));
+        outcome.ocrResult = output.result;
+
+        if (outcome.ocrResult.evaluatedDigits != entry.ocrResult.evaluatedDigits)
+        {
+            printf("[INFO]: Reject the results of the near-duplicate %s for %s: %s vs %s.\n", entry.imgFile.c_str(),
+                imgFile.c_str(), entry.ocrResult.evaluatedDigits.c_str(), outcome.ocrResult.evaluatedDigits.c_str());
+            outcome.ocrResult = OcrResult();
+            outcome.duplicateRejected = true;
+            return false;
+        }
+    }
+    else
+    {
+        outcome.ocrResult = entry.ocrResult;
+    }
+
+    if (!dryRun && !WriteBlackWhiteImg(imgFile, outputDir, output.blackWhiteImg))
+    {
+        outcome.status = ImageStatus::WriteFailed;
+        return true;
+    }
+
+    printf("[INFO]: The digits in image %s are %s, reused from the near-duplicate %s at distance %d.\n",
+        imgFile.c_str(), outcome.ocrResult.evaluatedDigits.c_str(), entry.imgFile.c_str(), distance);
+
+    outcome.seriesIndex = entry.seriesIndex;
+    outcome.routeScore = entry.routeScore;
+    outcome.duplicateOf = entry.imgFile;
+    outcome.status = ImageStatus::Success;
+    return true;
+}
+
+// Extract, threshold, write and OCR the circled digits of one book cover image with the
+// session of the series which the router chooses, or of the only series without a router.
+// The worker belongs to the calling thread, and the router, the duplicate index and the
+// triage are shared. Without a duplicate index, the near-duplicate covers are processed in
+// full, and without a triage, every image is localized. A dry run writes nothing into
+// outputDir.
+static void ProcessImage(
+    const string& imgFile,
+    const string& outputDir,
+    const bool dryRun,
+    const double timeBudgetMs,
+    const bool reportSkew,
+    const SeriesRouter* router,
+    DuplicateIndex* duplicateIndex,
+    const bool verifyDuplicates,
+    const CoverTriage* triage,
+    OcrWorker& worker,
+    ImageOutcome& outcome)
+{
+    // The time budget starts before decoding the image.
+    Deadline deadline(timeBudgetMs);
+
+    ImageTiming& imgTiming = outcome.timing;
+    imgTiming.imgFile = imgFile;
+
+    int64 startTick = getTickCount();
+    Mat img = imread(imgFile, IMREAD_COLOR);
+    AddStageTime(imgTiming, "decode", startTick);
+    imgTiming.totalMs = deadline.ElapsedMs();
+
+    if (img.empty())
+    {
+        printf("[ERROR]: Cannot load image %s.\n\n", imgFile.c_str());
+        outcome.status = ImageStatus::LoadFailed;
+        return;
+    }
+
+#ifdef DEBUG
+    printf("[DEBUG]: The pixel data type of the book cover image %s is %s.\n",
+        imgFile.c_str(), Utility::CvType2Str(img.type()).c_str());
+#endif
+
+    if (triage != nullptr)
+    {
+        startTick = getTickCount();
+        TriageReport triageReport;
+        const bool passed = triage->Check(img, worker.workspace, triageReport);
+        AddStageTime(imgTiming, "triage", startTick);
+        imgTiming.totalMs = deadline.ElapsedMs();
+
+        if (!passed)
+        {
+            printf("[INFO]: Skip %s which failed the triage: %s.\n", imgFile.c_str(), triageReport.reason.c_str());
+            outcome.triageReason = triageReport.reason;
+            outcome.status = ImageStatus::Triaged;
+            return;
+        }
+    }
+
+    uint64_t imgHash = 0;
+    if (duplicateIndex != nullptr)
+    {
+        startTick = getTickCount();
+        imgHash = DuplicateIndex::ComputeHash(img, worker.workspace);
+        AddStageTime(imgTiming, "hash", startTick);
+
+        DuplicateEntry entry;
+        int distance = 0;
+        if (duplicateIndex->Find(imgHash, entry, distance)
+            && ReuseDuplicate(imgFile, img, entry, distance, outputDir, dryRun, verifyDuplicates, worker, outcome))
+        {
+            imgTiming.totalMs = deadline.ElapsedMs();
+            return;
+        }
+    }
+
+    outcome.seriesIndex = 0;
+    if (router != nullptr)
+    {
+        startTick = getTickCount();
+        outcome.seriesIndex = router->Route(img, worker.workspace, outcome.routeScore);
+        AddStageTime(imgTiming, "route", startTick);
+        imgTiming.totalMs = deadline.ElapsedMs();
+
+        if (outcome.seriesIndex < 0)
+        {
+            printf("[ERROR]: Can't route %s to any series.\n\n", imgFile.c_str());
+            outcome.status = ImageStatus::NotFound;
+            return;
+        }
+    }
+
+    OcrSession& session = *worker.sessions[outcome.seriesIndex];
+    OcrOutput output;
+    const bool extracted = session.Extract(img, deadline, output);
+    ExtractReport& extractReport = outcome.extractReport;
+    extractReport = output.report;
+    imgTiming.stageTimesMs.insert(imgTiming.stageTimesMs.end(),
+        output.stageTimesMs.begin(), output.stageTimesMs.end());
+    imgTiming.totalMs = deadline.ElapsedMs();
+
+    if (reportSkew)
+    {
+        printf("[INFO]: The estimated skew of image %s is %f degrees (%s) in %f ms.\n",
+            imgFile.c_str(), extractReport.skewAngle, extractReport.deskewed ? "deskewed" : "not deskewed",
+            extractReport.deskewTimeMs);
+    }
+
+    if (extractReport.priorMismatched && (extractReport.priorOffset >= 0))
+    {
+        printf("[INFO]: The match of %s around the series prior is %d pixels away from the match in the whole cover, which is used instead.\n",
+            imgFile.c_str(), extractReport.priorOffset);
+    }
+    else if (extractReport.priorMismatched)
+    {
+        printf("[INFO]: The match of %s around the series prior is kept, since the whole cover has no match.\n",
+            imgFile.c_str());
+    }
+
+    if (output.status == OcrStatus::Timeout)
+    {
+        printf("[ERROR]: Exceeded the time budget of %f ms for %s.\n\n", timeBudgetMs, imgFile.c_str());
+        outcome.status = ImageStatus::Timeout;
+        return;
+    }
+    else if (output.status == OcrStatus::Rejected)
+    {
+        outcome.status = ImageStatus::Rejected;
+        return;
+    }
+    else if (!extracted)
+    {
+        printf("[ERROR]: Can't find the circled digits in %s.\n\n", imgFile.c_str());
+        outcome.status = ImageStatus::NotFound;
+        return;
+    }
+
+    session.Threshold(output);
+    imgTiming.stageTimesMs.push_back(output.stageTimesMs.back());
+#ifdef DEBUG
+    printf("[DEBUG]: The pixel data type of the preprocessed black-white book cover image %s is %s.\n",
+        imgFile.c_str(), Utility::CvType2Str(output.blackWhiteImg.type()).c_str());
+#endif
+
+    // Write the cropped image of circled digits into an image file.
+    if (!dryRun && !WriteBlackWhiteImg(imgFile, outputDir, output.blackWhiteImg))
+    {
+        outcome.status = ImageStatus::WriteFailed;
+        return;
+    }
+
+    if (deadline.Expired())
+    {
+        printf("[ERROR]: Exceeded the time budget of %f ms for %s.\n\n", timeBudgetMs, imgFile.c_str());
+        imgTiming.totalMs = deadline.ElapsedMs();
+        outcome.status = ImageStatus::Timeout;
+        return;
+    }
+
+    // Use the ocrer of the session to recognize the digits from the cropped image.
+    session.RecognizeThresholded(output);
+    imgTiming.stageTimesMs.push_back(output.stageTimesMs.back());
+    imgTiming.totalMs = deadline.ElapsedMs();
+    outcome.ocrResult = output.result;
+
+    printf("[INFO]: The digits in image %s are %s.\n", imgFile.c_str(), outcome.ocrResult.evaluatedDigits.c_str());
+    outcome.status = ImageStatus::Success;
+
+    // The crop rectangle of a downscaled or deskewed cover isn't in the cover coordinates.
+    if ((duplicateIndex != nullptr) && !extractReport.deskewed && (extractReport.downscaleFactor == 1.0))
+    {
+        DuplicateEntry entry;
+        entry.imgFile = imgFile;
+        entry.seriesIndex = outcome.seriesIndex;
+        entry.routeScore = outcome.routeScore;
+        entry.coverSize = img.size();
+        entry.circledDigitsRect = extractReport.circledDigitsRect;
+        entry.ocrResult = outcome.ocrResult;
+        duplicateIndex->Insert(imgHash, entry);
+    }
+}
+
+// Write the OCR result of one image into the yml file. The series is written if it is
+// not empty, i.e., with many series.
+static void WriteOcrResult(
+    FileStorage& fs,
+    const int resultIndex,
+    const string& imgFile,
+    const OcrResult& ocrResult,
+    const string& seriesName,
+    const double routeScore,
+    const ExtractReport& extractReport,
+    const bool reportSkew)
+{
+    // Key names must start with a letter or '_'. Since the image filename may start with a non-letter,
+    // e.g., a digit, we don't use the image filename as the key name.
+    fs << "imgfilename_" + to_string(resultIndex) << imgFile;
+    fs << "ocrresult_" + to_string(resultIndex) << ocrResult;
+
+    if (!seriesName.empty())
+    {
+        fs << "series_" + to_string(resultIndex) << seriesName;
+        fs << "routescore_" + to_string(resultIndex) << routeScore;
+    }
+
+    if (reportSkew)
+    {
+        fs << "skewangle_" + to_string(resultIndex) << extractReport.skewAngle;
+        fs << "deskewtimems_" + to_string(resultIndex) << extractReport.deskewTimeMs;
+    }
+}
+
+static string ImageStatus2Str(const ImageStatus status)
+{
+    switch (status)
+    {
+    case ImageStatus::Success:
+        return "success";
+
+    case ImageStatus::LoadFailed:
+        return "loadfailed";
+
+    case ImageStatus::NotFound:
+        return "notfound";
+
+    case ImageStatus::Timeout:
+        return "timeout";
+
+    case ImageStatus::Rejected:
+        return "rejected";
+
+    case ImageStatus::WriteFailed:
+        return "writefailed";
+
+    case ImageStatus::Crashed:
+        return "crashed";
+
+    case ImageStatus::Triaged:
+        return "triaged";
+
+    default:
+        return "unknown";
+    }
+}
+
+// Count the images whose results were reused from a near-duplicate, and those whose
+// near-duplicate failed the verification.
+static void CountDuplicates(
+    const vector<ImageOutcome>& outcomes,
+    size_t& cntReused,
+    size_t& cntRejected)
+{
+    for (const auto& outcome: outcomes)
+    {
+        if (!outcome.duplicateOf.empty())
+        {
+            ++cntReused;
+        }
+
+        if (outcome.duplicateRejected)
+        {
+            ++cntRejected;
+        }
+    }
+}
+
+static void PrintDuplicateHits(
+    const size_t cntImgs,
+    const size_t cntReused,
+    const size_t cntRejected)
+{
+    printf("[INFO]: Reused the results of a near-duplicate for %ld of %ld images (%f%%) and rejected %ld near-duplicates by the verification.\n",
+        cntReused, cntImgs, (cntImgs > 0) ? cntReused*100.0/cntImgs : 0.0, cntRejected);
+}
+
+// Count the images whose match around the series prior was checked against the whole cover,
+// and those where the two disagreed.
+static void PrintPriorVerification(const vector<ImageOutcome>& outcomes)
+{
+    size_t cntVerified = 0;
+    size_t cntMismatched = 0;
+    for (const auto& outcome: outcomes)
+    {
+        cntVerified += outcome.extractReport.priorVerified ? 1 : 0;
+        cntMismatched += outcome.extractReport.priorMismatched ? 1 : 0;
+    }
+
+    printf("[INFO]: Verified the match around the series prior of %ld images against the whole cover, and %ld (%f%%) disagreed.\n",
+        cntVerified, cntMismatched, (cntVerified > 0) ? cntMismatched*100.0/cntVerified : 0.0);
+}
+
+// Estimate the time which the triage saved as the time the processed images spent after it,
+// on average, times the number of the triaged images, less the time of the triage itself.
+// The images whose results were reused from a near-duplicate aren't representative.
+static void PrintTriageSavings(const vector<ImageOutcome>& outcomes)
+{
+    size_t cntTriaged = 0;
+    size_t cntProcessed = 0;
+    double triageMs = 0.0;
+    double processedMs = 0.0;
+    for (const auto& outcome: outcomes)
+    {
+        double imgTriageMs = 0.0;
+        double imgDecodeMs = 0.0;
+        for (const auto& stageTime: outcome.timing.stageTimesMs)
+        {
+            if (stageTime.first == "triage")
+            {
+                imgTriageMs += stageTime.second;
+            }
+            else if (stageTime.first == "decode")
+            {
+                imgDecodeMs += stageTime.second;
+            }
+        }
+
+        triageMs += imgTriageMs;
+        if (outcome.status == ImageStatus::Triaged)
+        {
+            ++cntTriaged;
+        }
+        else if ((outcome.status != ImageStatus::LoadFailed) && (outcome.status != ImageStatus::Crashed)
+            && outcome.duplicateOf.empty())
+        {
+            ++cntProcessed;
+            processedMs += max(outcome.timing.totalMs - imgDecodeMs - imgTriageMs, 0.0);
+        }
+    }
+
+    const double meanProcessedMs = (cntProcessed > 0) ? processedMs/cntProcessed : 0.0;
+    printf("[INFO]: The triage rejected %ld of %ld images in %f ms in total and saved about %f ms (%f ms per processed image).\n",
+        cntTriaged, outcomes.size(), triageMs, cntTriaged*meanProcessedMs - triageMs, meanProcessedMs);
+}
+
+// Record the outcome of one image in the metrics. A success is counted by the method of
+// its series, or as dedup if the results of a near-duplicate were reused, and a triaged
+// image as skipped.
+static void RecordMetrics(
+    BatchMetrics& metrics,
+    const ImageOutcome& outcome,
+    const vector<unique_ptr<OcrEngine> >& engines)
+{
+    if (outcome.status == ImageStatus::Success)
+    {
+        metrics.RecordImage(BatchMetrics::ImageResult::Succeeded,
+            outcome.duplicateOf.empty() ? engines[outcome.seriesIndex]->GetPreprocessor().GetMethodName() : "dedup",
+            "", outcome.timing.stageTimesMs, outcome.timing.totalMs);
+    }
+    else if (outcome.status == ImageStatus::Triaged)
+    {
+        metrics.RecordImage(BatchMetrics::ImageResult::Skipped, "", ImageStatus2Str(outcome.status),
+            outcome.timing.stageTimesMs, outcome.timing.totalMs);
+    }
+    else
+    {
+        metrics.RecordImage(BatchMetrics::ImageResult::Failed, "", ImageStatus2Str(outcome.status),
+            outcome.timing.stageTimesMs, outcome.timing.totalMs);
+    }
+}
+
+// Process the images with a thread per worker, or in the calling thread if there is only
+// one. The images are taken in order from a shared index and the outcome of each image is
+// put at its index, and recorded in the metrics if any. A dry run writes nothing.
+static void ProcessImages(
+    const vector<string>& imgFiles,
+    const string& outputDir,
+    const bool dryRun,
+    const double timeBudgetMs,
+    const bool reportSkew,
+    const SeriesRouter* router,
+    DuplicateIndex* duplicateIndex,
+    const bool verifyDuplicates,
+    const CoverTriage* triage,
+    BatchMetrics* metrics,
+    const vector<unique_ptr<OcrEngine> >& engines,
+    vector<OcrWorker>& workers,
+    vector<ImageOutcome>& outcomes)
+{
+    const unsigned int cntWorkers = static_cast<unsigned int>(workers.size());
+    atomic<size_t> nextImgIndex(0);
+    atomic<size_t> cntInFlight(0);
+
+    auto updateQueueDepths = [&]()
+    {
+        metrics->SetQueueDepth("pending", static_cast<double>(imgFiles.size() - min(nextImgIndex.load(), imgFiles.size())));
+        metrics->SetQueueDepth("inflight", static_cast<double>(cntInFlight.load()));
+    };
+
+    auto worker = [&](const unsigned int workerIndex)
+    {
+        size_t imgIndex = 0;
+        while ((imgIndex = nextImgIndex++) < imgFiles.size())
+        {
+            if (metrics != nullptr)
+            {
+                ++cntInFlight;
+                updateQueueDepths();
+            }
+
+            ProcessImage(
+                imgFiles[imgIndex],
+                outputDir,
+                dryRun,
+                timeBudgetMs,
+                reportSkew,
+                router,
+                duplicateIndex,
+                verifyDuplicates,
+                triage,
+                workers[workerIndex],
+                outcomes[imgIndex]);
+
+            if (metrics != nullptr)
+            {
+                --cntInFlight;
+                updateQueueDepths();
+                RecordMetrics(*metrics, outcomes[imgIndex], engines);
+            }
+
+            OcrWorker& ocrWorker = workers[workerIndex];
+            if (++ocrWorker.cntImgs == 1)
+            {
+                ocrWorker.cntFirstImgAllocations = ocrWorker.workspace.GetAllocationCount();
+            }
+        }
+    };
+
+    if (cntWorkers == 1)
+    {
+        worker(0);
+        return;
+    }
+
+    printf("[INFO]: Process %ld images with %u workers.\n", imgFiles.size(), cntWorkers);
+
+    vector<thread> workerThreads;
+    for (unsigned int workerIndex = 0; workerIndex < cntWorkers; ++workerIndex)
+    {
+        workerThreads.push_back(thread(worker, workerIndex));
+    }
+
+    for (auto& workerThread: workerThreads)
+    {
+        workerThread.join();
+    }
+}
+
+// Find the split of the cores between the number of images processed at once and the
+// number of threads of each OpenCV call with the best throughput on the sample images.
+// Each split runs the whole pipeline on the samples with fresh sessions, after an untimed
+// run which warms up the file cache. The runs are dry, so that the tuning doesn't write
+// any black-white images, which the real run would write again.
+static void AutoTuneExecutionPolicy(
+    const vector<string>& sampleImgFiles,
+    const double timeBudgetMs,
+    const bool reportSkew,
+    const SeriesRouter* router,
+    const vector<unique_ptr<OcrEngine> >& engines,
+    unsigned int& cntJobs,
+    int& cntCvThreads)
+{
+    if (sampleImgFiles.empty())
+    {
+        return;
+    }
+
+    const unsigned int cntCores = max(thread::hardware_concurrency(), 1u);
+
+    // The candidates are the powers of 2 up to the cores and the cores themselves.
+    vector<unsigned int> candidateJobs;
+    for (unsigned int jobs = 1; (jobs <= cntCores) && (jobs <= sampleImgFiles.size()); jobs *= 2)
+    {
+        candidateJobs.push_back(jobs);
+    }
+
+    if ((candidateJobs.back() != cntCores) && (cntCores <= sampleImgFiles.size()))
+    {
+        candidateJobs.push_back(cntCores);
+    }
+
+    auto runSamples = [&](const unsigned int jobs, const int cvThreads)
+    {
+        setNumThreads(cvThreads);
+
+        vector<OcrWorker> workers;
+        CreateWorkers(engines, jobs, workers);
+        vector<ImageOutcome> outcomes(sampleImgFiles.size());
+
+        const int64 startTick = getTickCount();
+        ProcessImages(sampleImgFiles, "", true, timeBudgetMs, reportSkew, router, nullptr, false, nullptr, nullptr,
+            engines, workers, outcomes);
+        return (getTickCount() - startTick)*1000.0/getTickFrequency();
+    };
+
+    printf("[INFO]: Auto-tune the execution policy on %ld sample images.\n", sampleImgFiles.size());
+    runSamples(1, static_cast<int>(cntCores));
+
+    double bestImgsPerSec = 0.0;
+    vector<pair<unsigned int, double> > jobsImgsPerSecs;
+    for (const auto jobs: candidateJobs)
+    {
+        const int cvThreads = static_cast<int>(max(cntCores/jobs, 1u));
+        const double elapsedMs = runSamples(jobs, cvThreads);
+        const double imgsPerSec = sampleImgFiles.size()*1000.0/max(elapsedMs, 1e-3);
+        jobsImgsPerSecs.push_back(make_pair(jobs, imgsPerSec));
+
+        if (imgsPerSec > bestImgsPerSec)
+        {
+            bestImgsPerSec = imgsPerSec;
+            cntJobs = jobs;
+            cntCvThreads = cvThreads;
+        }
+    }
+
+    for (const auto& jobsImgsPerSec: jobsImgsPerSecs)
+    {
+        printf("[INFO]:   %u images at once x %u threads per OpenCV call: %f images/s\n",
+            jobsImgsPerSec.first, max(cntCores/jobsImgsPerSec.first, 1u), jobsImgsPerSec.second);
+    }
+
+    printf("[INFO]: Choose %u images at once x %d threads per OpenCV call.\n", cntJobs, cntCvThreads);
+}
+
+static volatile sig_atomic_t stopWatching = 0;
+
+static void StopWatching(int)
+{
+    stopWatching = 1;
+}
+
+// Process the images as they arrive in imgDir until interrupted, with the warm sessions of
+// the workers. The files of a burst are processed together once no more arrive for
+// debounceMs, and their results are appended to OcrResult.yml right away.
+static int WatchImgDir(
+    const string& imgDir,
+    const string& outputDir,
+    const double timeBudgetMs,
+    const bool reportSkew,
+    const SeriesRouter* router,
+    DuplicateIndex* duplicateIndex,
+    const bool verifyDuplicates,
+    const CoverTriage* triage,
+    BatchMetrics* metrics,
+    const vector<string>& seriesNames,
+    const vector<unique_ptr<OcrEngine> >& engines,
+    vector<OcrWorker>& workers,
+    const int debounceMs,
+    const size_t maxBatchSize)
+{
+    DirWatcher watcher;
+    if (!watcher.Open(imgDir))
+    {
+        return -1;
+    }
+
+    // Start a new result file, which is then appended to after each burst.
+    const string ocrResultFile = outputDir + "/OcrResult.yml";
+    FileStorage fsResult(ocrResultFile, FileStorage::WRITE);
+    if (!fsResult.isOpened())
+    {
+        printf("[ERROR]: Cannot open %s.\n\n", ocrResultFile.c_str());
+        return -1;
+    }
+
+    fsResult.release();
+
+    signal(SIGINT, StopWatching);
+    signal(SIGTERM, StopWatching);
+    printf("[INFO]: Watching %s for new images. Press Ctrl+C to stop.\n", imgDir.c_str());
+
+    int cntResults = 0;
+    int cntFailures = 0;
+    size_t cntReused = 0;
+    size_t cntRejected = 0;
+    vector<string> imgFiles;
+    while (stopWatching == 0)
+    {
+        // Wake up regularly to check whether we are interrupted.
+        if (!watcher.WaitForFiles(imgFiles, 500, debounceMs, maxBatchSize))
+        {
+            return -1;
+        }
+
+        if (imgFiles.empty())
+        {
+            continue;
+        }
+
+        const int64 startTick = getTickCount();
+        vector<ImageOutcome> outcomes(imgFiles.size());
+        ProcessImages(imgFiles, outputDir, false, timeBudgetMs, reportSkew, router, duplicateIndex, verifyDuplicates, triage, metrics,
+            engines, workers, outcomes);
+
+        FileStorage fsAppend(ocrResultFile, FileStorage::APPEND);
+        for (size_t imgIndex = 0; imgIndex < imgFiles.size(); ++imgIndex)
+        {
+            const ImageOutcome& outcome = outcomes[imgIndex];
+            if (outcome.status == ImageStatus::Success)
+            {
+                WriteOcrResult(
+                    fsAppend,
+                    cntResults++,
+                    imgFiles[imgIndex],
+                    outcome.ocrResult,
+                    (router != nullptr) ? seriesNames[outcome.seriesIndex] : "",
+                    outcome.routeScore,
+                    outcome.extractReport,
+                    reportSkew);
+            }
+            else
+            {
+                fsAppend << "failedimgfilename_" + to_string(cntFailures) << imgFiles[imgIndex];
+                fsAppend << "failedstatus_" + to_string(cntFailures) << ImageStatus2Str(outcome.status);
+                if (outcome.status == ImageStatus::Triaged)
+                {
+                    fsAppend << "failedreason_" + to_string(cntFailures) << outcome.triageReason;
+                }
+                ++cntFailures;
+            }
+        }
+
+        fsAppend.release();
+
+        CountDuplicates(outcomes, cntReused, cntRejected);
+
+        printf("[INFO]: Processed %ld new images in %f ms.\n", imgFiles.size(),
+            (getTickCount() - startTick)*1000.0/getTickFrequency());
+    }
+
+    printf("[INFO]: Stopped watching %s. %d images succeeded and %d failed.\n", imgDir.c_str(), cntResults, cntFailures);
+    if (duplicateIndex != nullptr)
+    {
+        PrintDuplicateHits(static_cast<size_t>(cntResults + cntFailures), cntReused, cntRejected);
+    }
+    return 0;
+}
+
+// The book recognized in a run of consecutive video frames.
+struct VideoBook
+{
+    int firstFrame;
+    int lastFrame;
+    int seriesIndex;
+    double routeScore;
+    OcrResult ocrResult;
+    ExtractReport extractReport;
+};
+
+// Process the frames of a video file or of a numbered image sequence, e.g., frames/%04d.png,
+// captured by a fixed camera over a conveyor. The circled digits are fully localized only on
+// the keyframes and tracked in between, and each book is recognized once, on the keyframe
+// where it is first localized. A keyframe is taken whenever the track is lost, and every
+// keyframeInterval frames to check that the tracked book is still in view. A keyframe whose
+// circled digits overlap those of the previous frame shows the same book.
+static int ProcessVideo(
+    const string& videoSource,
+    const string& outputDir,
+    const double timeBudgetMs,
+    const bool reportSkew,
+    const SeriesRouter* router,
+    const vector<string>& seriesNames,
+    OcrWorker& worker,
+    const int keyframeInterval)
+{
+    VideoCapture capture(videoSource);
+    if (!capture.isOpened())
+    {
+        printf("[ERROR]: Cannot open the video %s.\n\n", videoSource.c_str());
+        return -1;
+    }
+
+    string dir;
+    string filename;
+    string extension;
+    Utility::SegmentFullFilename(videoSource, dir, filename, extension);
+
+    RegionTracker tracker;
+    vector<VideoBook> books;
+    Rect prevRect;
+    int cntFrames = 0;
+    int cntKeyframes = 0;
+    int lastKeyframe = 0;
+    const int64 startTick = getTickCount();
+
+    Mat frame;
+    for (int frameIndex = 0; capture.read(frame) && !frame.empty(); ++frameIndex)
+    {
+        ++cntFrames;
+        if (tracker.IsTracking() && (frameIndex - lastKeyframe < keyframeInterval) && tracker.Track(frame, worker.workspace))
+        {
+            prevRect = tracker.GetRect();
+            books.back().lastFrame = frameIndex;
+            continue;
+        }
+
+        ++cntKeyframes;
+        lastKeyframe = frameIndex;
+        tracker.Stop();
+
+        Deadline deadline(timeBudgetMs);
+        int seriesIndex = 0;
+        double routeScore = 0.0;
+        if (router != nullptr)
+        {
+            seriesIndex = router->Route(frame, worker.workspace, routeScore);
+            if (seriesIndex < 0)
+            {
+                continue;
+            }
+        }
+
+        // A frame without circled digits, e.g., between two books, ends the current book.
+        OcrSession& session = *worker.sessions[seriesIndex];
+        OcrOutput output;
+        if (!session.Extract(frame, deadline, output))
+        {
+            continue;
+        }
+
+        const ExtractReport& extractReport = output.report;
+        const Rect& rect = extractReport.circledDigitsRect;
+        const bool sameBook = !books.empty() && (books.back().lastFrame == frameIndex - 1)
+            && (books.back().seriesIndex == seriesIndex)
+            && ((rect & prevRect).area() >= 0.5*(rect | prevRect).area());
+        if (sameBook)
+        {
+            books.back().lastFrame = frameIndex;
+        }
+        else
+        {
+            VideoBook book;
+            book.firstFrame = frameIndex;
+            book.lastFrame = frameIndex;
+            book.seriesIndex = seriesIndex;
+            book.routeScore = routeScore;
+            book.extractReport = extractReport;
+
+            session.Threshold(output);
+            session.RecognizeThresholded(output);
+            book.ocrResult = output.result;
+
+            string blackWhiteImgFile = outputDir + '/' + filename + "_book" + to_string(books.size()) + "_circledDigits.png";
+            if (!imwrite(blackWhiteImgFile, output.blackWhiteImg))
+            {
+                printf("[ERROR]: Failed to write the cropped black-white image of circled digits into %s.\n\n",
+                    blackWhiteImgFile.c_str());
+                return -1;
+            }
+
+            printf("[INFO]: The digits of book %ld first seen in frame %d are %s.\n",
+                books.size(), frameIndex, book.ocrResult.evaluatedDigits.c_str());
+            books.push_back(book);
+        }
+
+        // The crop of a downscaled or deskewed frame isn't in the frame coordinates, so
+        // such a book is localized again in the next frame instead of being tracked.
+        prevRect = rect;
+        if (!extractReport.deskewed && (extractReport.downscaleFactor == 1.0))
+        {
+            tracker.Start(frame, rect);
+        }
+    }
+
+    const double elapsedMs = (getTickCount() - startTick)*1000.0/getTickFrequency();
+    printf("[INFO]: Processed %d frames in %f ms (%f ms per frame), of which %d were keyframes, and recognized %ld books.\n",
+        cntFrames, elapsedMs, elapsedMs/max(cntFrames, 1), cntKeyframes, books.size());
+
+    string ocrResultFile = outputDir + "/OcrResult.yml";
+    FileStorage fsResult(ocrResultFile, FileStorage::WRITE);
+
+    printf("[INFO]: Writing OCR results to %s.\n", ocrResultFile.c_str());
+    for (int bookIndex = 0; bookIndex < static_cast<int>(books.size()); ++bookIndex)
+    {
+        const VideoBook& book = books[bookIndex];
+        WriteOcrResult(
+            fsResult,
+            bookIndex,
+            videoSource,
+            book.ocrResult,
+            (router != nullptr) ? seriesNames[book.seriesIndex] : "",
+            book.routeScore,
+            book.extractReport,
+            reportSkew);
+
+        fsResult << "firstframe_" + to_string(bookIndex) << book.firstFrame;
+        fsResult << "lastframe_" + to_string(bookIndex) << book.lastFrame;
+    }
+
+    fsResult.release();
+    return 0;
+}
+
+static void PrintSlowestImages(
+    vector<ImageTiming>& imgTimings,
+    const size_t cntSlowest)
+{
+    const size_t cntPrinted = min(cntSlowest, imgTimings.size());
+    partial_sort(imgTimings.begin(), imgTimings.begin() + cntPrinted, imgTimings.end(),
+        [](const ImageTiming& lhs, const ImageTiming& rhs) { return lhs.totalMs > rhs.totalMs; });
+
+    printf("[INFO]: The slowest %ld images:\n", cntPrinted);
+    for (size_t imgIndex = 0; imgIndex < cntPrinted; ++imgIndex)
+    {
+        string stagesStr;
+        for (const auto& stageTime: imgTimings[imgIndex].stageTimesMs)
+        {
+            stagesStr += " " + stageTime.first + "=" + to_string(stageTime.second);
+        }
+
+        printf("[INFO]:   %f ms %s:%s\n", imgTimings[imgIndex].totalMs, imgTimings[imgIndex].imgFile.c_str(), stagesStr.c_str());
+    }
+}
+
+// Fill the triage thresholds from the command line options. Return false if any option is invalid.
+static bool GetTriageThresholds(
+    const po::variables_map& vm,
+    TriageThresholds& thresholds)
+{
+    if (vm.count("triageStdDev") > 0)
+    {
+        thresholds.minStdDev = vm["triageStdDev"].as<double>();
+    }
+
+    if (vm.count("triageEntropy") > 0)
+    {
+        thresholds.minEntropy = vm["triageEntropy"].as<double>();
+    }
+
+    if (vm.count("triageEdges") > 0)
+    {
+        thresholds.minEdgeDensity = vm["triageEdges"].as<double>();
+    }
+
+    if (vm.count("triageAspect") > 0)
+    {
+        string aspectStr = vm["triageAspect"].as<string>();
+        if (sscanf(aspectStr.c_str(), "%lf,%lf", &thresholds.minAspectRatio, &thresholds.maxAspectRatio) != 2)
+        {
+            printf("[ERROR]: Invalid triage aspect ratio range %s.\n\n", aspectStr.c_str());
+            return false;
+        }
+    }
+
+    if (vm.count("triageTitle") > 0)
+    {
+        thresholds.minTitleScore = vm["triageTitle"].as<double>();
+    }
+
+    return true;
+}
+
+// Fill the engine options from the command line options. Return false if any option is invalid.
+static bool GetEngineOptions(
+    const po::variables_map& vm,
+    const string& extractMethod,
+    OcrEngineOptions& options)
+{
+    options.method = extractMethod;
+
+    if (vm.count("priorMargin") > 0)
+    {
+        options.priorMargin = vm["priorMargin"].as<int>();
+    }
+
+    if (vm.count("priorMinScore") > 0)
+    {
+        options.priorMinScore = vm["priorMinScore"].as<double>();
+    }
+
+    if (vm.count("priorTolerance") > 0)
+    {
+        options.priorTolerance = vm["priorTolerance"].as<int>();
+        if (options.priorTolerance < 0)
+        {
+            printf("[ERROR]: The prior tolerance %d is negative.\n\n", options.priorTolerance);
+            return false;
+        }
+    }
+
+    if (vm.count("sobel") > 0)
+    {
+        options.sobelPrecision = vm["sobel"].as<string>();
+    }
+
+    if (vm.count("tileSize") > 0)
+    {
+        options.tileSize = vm["tileSize"].as<int>();
+    }
+
+    if (vm.count("houghRegion") > 0)
+    {
+        Rect& region = options.houghRegion;
+        string regionStr = vm["houghRegion"].as<string>();
+        if (sscanf(regionStr.c_str(), "%d,%d,%d,%d", &region.x, &region.y, &region.width, &region.height) != 4)
+        {
+            printf("[ERROR]: Invalid Hough search region %s.\n\n", regionStr.c_str());
+            return false;
+        }
+    }
+
+    if (vm.count("circleBuffer") > 0)
+    {
+        options.circleBufferWidth = vm["circleBuffer"].as<unsigned int>();
+    }
+
+    options.houghAlt = (vm.count("houghAlt") > 0);
+
+    if (vm.count("deskew") > 0)
+    {
+        options.maxSkewAngle = vm["deskew"].as<double>();
+    }
+
+    if (vm.count("maxPixels") > 0)
+    {
+        string oversize = (vm.count("oversize") > 0) ? vm["oversize"].as<string>() : "reject";
+        if ((oversize != "reject") && (oversize != "downscale"))
+        {
+            printf("[ERROR]: Unsupported oversize action %s.\n\n", oversize.c_str());
+            return false;
+        }
+
+        options.maxPixels = vm["maxPixels"].as<size_t>();
+        options.downscaleOversized = (oversize == "downscale");
+    }
+
+    if (vm.count("detectRegion") > 0)
+    {
+        Rect& region = options.detectRegion;
+        string regionStr = vm["detectRegion"].as<string>();
+        if (sscanf(regionStr.c_str(), "%d,%d,%d,%d", &region.x, &region.y, &region.width, &region.height) != 4)
+        {
+            printf("[ERROR]: Invalid detection region %s.\n\n", regionStr.c_str());
+            return false;
+        }
+    }
+
+    if (vm.count("maxKeyPoints") > 0)
+    {
+        options.maxKeyPoints = vm["maxKeyPoints"].as<int>();
+    }
+
+    options.templateBank = (vm.count("templBank") > 0);
+
+    if (vm.count("digitTopK") > 0)
+    {
+        options.digitTopK = vm["digitTopK"].as<size_t>();
+    }
+
+    options.verifyDigitTopK = (vm.count("verifyDigitTopK") > 0);
+
+    if (vm.count("timeBudget") > 0)
+    {
+        options.timeBudgetMs = vm["timeBudget"].as<double>();
+    }
+
+    return true;
+}
+
+// Load the book series in the subdirectories of the series directory, each of which
+// has a title image named title.* and the digit templates in digits/, and index the
+// descriptors of all the titles for routing the covers to their series.
+static bool LoadSeries(
+    const po::variables_map& vm,
+    const OcrEngineOptions& engineOptions,
+    vector<string>& seriesNames,
+    vector<unique_ptr<OcrEngine> >& seriesEngines,
+    unique_ptr<SeriesRouter>& router)
 {
-    if (node.empty())
+    const string seriesDir = vm["seriesDir"].as<string>();
+
+    vector<string> subDirs;
+    int error = Utility::GetSubDirs(seriesDir, subDirs);
+    if (error != 0)
     {
-        ocrResult = defaultValue;
+        printf("[ERROR]: Cannot get the series directories in %s with error = %d.\n\n", seriesDir.c_str(), error);
+        return false;
     }
-    else
+
+    sort(subDirs.begin(), subDirs.end());
+
+    vector<Mat> seriesDescriptors;
+    for (const auto& subDir: subDirs)
     {
-        ocrResult.read(node);
+        const string dir = seriesDir + '/' + subDir;
+
+        vector<string> files;
+        FileUtility::GetDirFiles(dir, files);
+
+        string titleImgFile;
+        for (const auto& file: files)
+        {
+            string fileDir;
+            string filename;
+            string extension;
+            Utility::SegmentFullFilename(file, fileDir, filename, extension);
+            if (filename == "title")
+            {
+                titleImgFile = file;
+                break;
+            }
+        }
+
+        Mat titleImg = titleImgFile.empty() ? Mat() : imread(titleImgFile, IMREAD_COLOR);
+        if (titleImg.empty())
+        {
+            printf("[INFO]: Skip %s without a title image.\n", dir.c_str());
+            continue;
+        }
+
+        // The keypoints are always needed for routing.
+        TitleFeatures titleFeatures = OcrPreprocessor::ComputeTitleFeatures(titleImg, true, engineOptions.method == "templ");
+
+        vector<string> templImgFiles;
+        vector<pair<string, Mat> > templDigitImgPairs;
+        if (OcrEngine::LoadTemplImgs(dir + "/digits", templImgFiles, templDigitImgPairs) != 0)
+        {
+            return false;
+        }
+
+        unique_ptr<OcrEngine> engine(new OcrEngine());
+        if (!engine->Init(engineOptions, titleFeatures, templDigitImgPairs))
+        {
+            return false;
+        }
+
+        seriesNames.push_back(subDir);
+        seriesEngines.push_back(move(engine));
+        seriesDescriptors.push_back(titleFeatures.descriptors);
+    }
+
+    if (seriesNames.empty())
+    {
+        printf("[ERROR]: No book series is found in %s.\n\n", seriesDir.c_str());
+        return false;
     }
+
+    const int64 startTick = getTickCount();
+    router.reset(new SeriesRouter(seriesDescriptors));
+    printf("[INFO]: Index the titles of %ld book series with %ld visual words in %f ms.\n",
+        seriesNames.size(), router->GetWordCount(), (getTickCount() - startTick)*1000.0/getTickFrequency());
+
+    return true;
 }
 
 int main(int argc, char** argv)
 {
     po::options_description opt("Options");
     opt.add_options()
-        ("imgDir,d", po::value<string>()->required(), "The directory containing all the book cover images")
+        ("imgDir,d", po::value<string>(), "The directory containing all the book cover images")
         ("help,h", "Display the help information")
-        ("titleImg,i", po::value<string>()->required(), "The baseline book series title image")
+        ("titleImg,i", po::value<string>(), "The baseline book series title image. Not needed with --bank.")
+        ("seriesDir", po::value<string>(), "Process the book covers of many series in one pass. Each subdirectory of this directory is a series with its title image title.* and its digit templates in digits/. Replaces -i and -t.")
+        ("buildBank", po::value<string>(), "Pack the title image and the digit templates into this template bank file and exit. Only -i and -t are needed.")
+        ("bank", po::value<string>(), "Load the title data and the digit templates from this template bank file instead of -i and -t.")
         ("method,m", po::value<string>(), "The method (homo | templ | hough) of extracting the book title from its cover. If not specified, default homo.")
-        ("outputDir,o", po::value<string>()->required(), "The output directory containing the images of circled digits extracted from the book cover images and the OCR results.")
-        ("templImgDir,t", po::value<string>()->required(), "The directory containing all the template images for OCRing circled digits");
+        ("priorMargin,p", po::value<int>(), "Search first within this many pixels around the title found in the recent covers (homo | templ only), and fall back to the whole cover if the match is not good enough. If not specified, always search the whole cover.")
+        ("priorMinScore", po::value<double>(), "The minimum score (TM_CCOEFF_NORMED for templ, RANSAC inlier ratio for homo) to accept a match around the prior. If not specified, default 0.6.")
+        ("priorTolerance", po::value<int>(), "Also search the whole of each cover matched around the prior, use the match in the whole cover and report the cover if the two are more than this many pixels apart, and print how many disagreed at the end. If not specified, the match around the prior is not verified.")
+        ("sobel", po::value<string>(), "The representation (float32 | mag8u) of the Sobel derivatives matched against the title (templ only): the mixed derivative of the three channels in 32-bit float, or the gradient magnitude of the grayscale image saturated into 8 bits. If not specified, default float32.")
+        ("validateSobel", "Find the title in each book cover with both Sobel representations, report the covers where the positions differ by more than one pixel and the times of both, and exit (templ only).")
+        ("tileSize", po::value<int>(), "Sharpen, differentiate and search the whole cover in tiles of at most N x N title positions with the same result, so that the memory depends on N instead of the cover size (templ only). If not specified, the whole cover at once.")
+        ("detectRegion", po::value<string>(), "The region \"x,y,width,height\" of the book covers in which the keypoints are detected (homo only). If not specified, the whole cover.")
+        ("calibrate", po::value<int>(), "Learn the detection region from the first N book covers (homo only). Ignored if --detectRegion is specified.")
+        ("maxKeyPoints", po::value<int>(), "Keep only the strongest N keypoints of each book cover (homo only). If not specified, keep all.")
+        ("houghRegion", po::value<string>(), "The region \"x,y,width,height\" of the book covers in which the circle centers are searched (hough only). If not specified, the rows [0, 170] of the cover.")
+        ("circleBuffer", po::value<unsigned int>(), "The buffer width in pixels around the found circle when cropping it (hough only). If not specified, default 10.")
+        ("houghAlt", "Use the HOUGH_GRADIENT_ALT accumulator of OpenCV 4.3+ (hough only).")
+        ("deskew", po::value<double>()->implicit_value(10.0), "Estimate the skew of each book cover within +/- this many degrees (default 10) and rotate it back before the extraction.")
+        ("timeBudget", po::value<double>(), "The time budget in milliseconds of each image. The image is recorded as a timeout once the budget is exceeded. If not specified, no budget.")
+        ("maxPixels", po::value<size_t>(), "The maximum number of pixels of each image. If not specified, no limit.")
+        ("oversize", po::value<string>(), "What to do with the images with more than maxPixels pixels (reject | downscale). If not specified, default reject.")
+        ("kpCache", po::value<string>(), "Load the keypoints and the descriptors of each book cover from this cache directory, keyed by the hash of the searched pixels and the detector parameters, instead of detecting them, and store those detected (homo only). The directory is created if needed.")
+        ("templBank", "Match the digit templates, if all of the same size, in one pass with the correlation kernel for the template width and the CPU instead of matchTemplate for each. Benchmark it with TemplateBankBenchmark first, since matchTemplate was faster on the sizes measured so far.")
+        ("digitTopK", po::value<size_t>(), "Match exactly only the N digit templates whose signatures are nearest to that of the image: the row and column projection profiles and the 8 x 8 ink grid of the ink box resampled to 32 x 32 pixels. The others are written as pruned (-2). If not specified, match all.")
+        ("verifyDigitTopK", "Also match all the digit templates and report the images whose best template is not among the --digitTopK nearest ones, and the recall at the end. Not reported with --procs.")
+        ("dedup", po::value<int>()->implicit_value(6), "Reuse the series, the crop and the OCR result of a processed cover whose perceptual hash is within this Hamming distance (default 6 of 63 bits) instead of locating the circled digits again. Not supported with --procs.")
+        ("dedupVerify", "Recognize the crop reused from a near-duplicate again and process the cover in full unless the digits agree (--dedup only).")
+        ("triage", "Reject the blank, non-cover and unusable images on a thumbnail before locating the circled digits. The rejected images and the reasons are listed in OcrResult.yml.")
+        ("triageStdDev", po::value<double>(), "The minimum standard deviation of the gray levels of the thumbnail (--triage only). Negative disables the check. If not specified, default 10.")
+        ("triageEntropy", po::value<double>(), "The minimum entropy in bits of the gray levels of the thumbnail (--triage only). Negative disables the check. If not specified, default 3.")
+        ("triageEdges", po::value<double>(), "The minimum fraction of Canny edge pixels of the thumbnail (--triage only). Negative disables the check. If not specified, default 0.01.")
+        ("triageAspect", po::value<string>(), "The range \"min,max\" of the width over the height of the image (--triage only). Negative disables the bound. If not specified, default 0.4,1.2.")
+        ("triageTitle", po::value<double>(), "The minimum TM_CCOEFF_NORMED score of the best title on the thumbnail (--triage only, not with hough). Negative disables the check. If not specified, default 0.3.")
+        ("jobs,j", po::value<unsigned int>(), "The number of worker threads processing the images in parallel. If not specified, default 1.")
+        ("cvThreads", po::value<int>(), "The number of threads of each OpenCV call (cv::setNumThreads). If not specified, the cores are split evenly between the -j workers, or the OpenCV default with one worker.")
+        ("autoTune", po::value<size_t>()->implicit_value(16), "Measure the throughput of the splits of the cores between -j and --cvThreads on the first N images (default 16) and use the best one.")
+        ("procs", po::value<unsigned int>(), "The number of worker processes processing the images in parallel instead of the worker threads. A crashed worker is restarted and its image is recorded as crashed. Best with --bank, whose mapping all the workers share. If not specified, no worker process.")
+        ("watch", "Keep watching the image directory and process each new image as soon as it is completely written, appending the results to OcrResult.yml, until interrupted. The images already there are not processed.")
+        ("debounce", po::value<int>(), "The milliseconds without new images which end a burst of them (--watch only). If not specified, default 20.")
+        ("maxBatch", po::value<size_t>(), "The maximum number of new images processed together (--watch only). If not specified, default 64.")
+        ("video", po::value<string>(), "Process the frames of this video file or numbered image sequence (e.g., frames/%04d.png) from a fixed camera instead of -d. The circled digits are localized on keyframes and tracked in between, and each book is recognized once.")
+        ("keyframeInterval", po::value<int>(), "The maximum number of frames between two keyframes (--video only). If not specified, default 30.")
+        ("metrics", po::value<string>(), "Write the progress, the throughput, the per-stage latency histograms, the queue depths and the memory of the run into this file in the Prometheus text format, e.g., for the textfile collector of the node exporter (-d and --watch only). Name it *.prom.")
+        ("metricsInterval", po::value<double>(), "The seconds between two snapshots of the metrics (--metrics only). If not specified, default 5.")
+        ("slowest", po::value<size_t>(), "The number of the slowest images listed in the summary. If not specified, default 5.")
+        ("outputDir,o", po::value<string>(), "The output directory containing the images of circled digits extracted from the book cover images and the OCR results.")
+        ("templImgDir,t", po::value<string>(), "The directory containing all the template images for OCRing circled digits. Not needed with --bank.");
 
     po::variables_map vm;
     try
@@ -70,16 +1537,72 @@ int main(int argc, char** argv)
         return -1;
     }
 
+    // The threads of OpenCV don't survive the fork of the worker processes, which then
+    // would wait for them forever. Each worker process runs single-threaded instead.
+    const bool watch = (vm.count("watch") > 0);
+    if (watch && (vm.count("procs") > 0))
+    {
+        printf("[INFO]: Ignore --procs with --watch.\n");
+    }
+
+    const unsigned int cntProcs = (!watch && (vm.count("procs") > 0)) ? vm["procs"].as<unsigned int>() : 0;
+
+    // Each worker process would insert the covers into its own copy of the index, so the
+    // duplicates processed by the other workers would never be found.
+    if ((cntProcs > 0) && (vm.count("dedup") > 0))
+    {
+        printf("[ERROR]: --dedup is not supported with --procs. Use -j instead.\n\n");
+        return -1;
+    }
+
+    if (cntProcs > 0)
+    {
+        setNumThreads(0);
+    }
+
     string titleImgFile;
     string bookCoverImgDir;
     string templImgDir;
     string outputDir;
     string extractMethod;
 
-    titleImgFile = vm["titleImg"].as<string>();
-    bookCoverImgDir = vm["imgDir"].as<string>();
-    templImgDir = vm["templImgDir"].as<string>();
-    outputDir = vm["outputDir"].as<string>();
+    // The title image and the templates come from either their files or a template bank,
+    // and building a template bank doesn't process any book cover.
+    const bool buildBank = (vm.count("buildBank") > 0);
+    const bool multiSeries = !buildBank && (vm.count("seriesDir") > 0);
+    const bool useBank = !buildBank && !multiSeries && (vm.count("bank") > 0);
+
+    vector<string> requiredOptions;
+    if (!useBank && !multiSeries)
+    {
+        requiredOptions.push_back("titleImg");
+        requiredOptions.push_back("templImgDir");
+    }
+
+    if (!buildBank)
+    {
+        if (vm.count("video") == 0)
+        {
+            requiredOptions.push_back("imgDir");
+        }
+
+        requiredOptions.push_back("outputDir");
+    }
+
+    for (const auto& requiredOption: requiredOptions)
+    {
+        if (vm.count(requiredOption) == 0)
+        {
+            cerr << "[ERROR]: the option '--" << requiredOption << "' is required but missing" << endl << endl;
+            cout << opt << endl;
+            return -1;
+        }
+    }
+
+    titleImgFile = (vm.count("titleImg") > 0) ? vm["titleImg"].as<string>() : "";
+    bookCoverImgDir = (vm.count("imgDir") > 0) ? vm["imgDir"].as<string>() : "";
+    templImgDir = (vm.count("templImgDir") > 0) ? vm["templImgDir"].as<string>() : "";
+    outputDir = (vm.count("outputDir") > 0) ? vm["outputDir"].as<string>() : "";
 
     if (vm.count("method") > 0)
     {
@@ -92,99 +1615,130 @@ int main(int argc, char** argv)
         printf("[INFO]: No extract method is specified and use the default method homography.\n");
     }
 
-    Mat titleImg = imread(titleImgFile, IMREAD_COLOR);
-    if (titleImg.empty())
+    OcrEngineOptions engineOptions;
+    if (!GetEngineOptions(vm, extractMethod, engineOptions))
     {
-        printf("[ERROR]: Cannot load image %s.\n\n", titleImgFile.c_str());
         return -1;
     }
 
-    // Create the OcrPreprocessor based on the extraction method.
-    unique_ptr<OcrPreprocessor> preprocessor;
-    if ((extractMethod == "homo") || (extractMethod == "templ"))
+    if (buildBank)
     {
-        const int centerDisplacementX = 0;
-        const int centerDisplacementY = 55;
-        const unsigned int width = 80;
-        const unsigned int height = 60;
+        Mat titleImg = imread(titleImgFile, IMREAD_COLOR);
+        if (titleImg.empty())
+        {
+            printf("[ERROR]: Cannot load image %s.\n\n", titleImgFile.c_str());
+            return -1;
+        }
+
+        vector<string> templImgFiles;
+        vector<pair<string, Mat> > templDigitImgPairs;
+        int error = OcrEngine::LoadTemplImgs(templImgDir, templImgFiles, templDigitImgPairs);
+        if (error != 0)
+        {
+            return error;
+        }
 
-        preprocessor.reset(new OcrPreprocessor(
-            extractMethod,
-            titleImg,
-            centerDisplacementX,
-            centerDisplacementY,
-            width,
-            height));
+        const string bankFileName = vm["buildBank"].as<string>();
+        return TemplateBankFile::Build(bankFileName, titleImgFile, titleImg, templImgDir, templImgFiles, templDigitImgPairs) ? 0 : -1;
     }
-    else if (extractMethod == "hough")
-    {
-        const unsigned int minRadius = 10;
-        const unsigned int maxRadius = 30;
 
-        preprocessor.reset(new OcrPreprocessor(
-            extractMethod,
-            minRadius,
-            maxRadius));
+    // Create the engine of each series. Without --seriesDir, there is only the series of
+    // the title image and the templates, or of the template bank, which the engine loads.
+    vector<string> seriesNames;
+    vector<unique_ptr<OcrEngine> > seriesEngines;
+    unique_ptr<SeriesRouter> router;
+    if (multiSeries)
+    {
+        if (!LoadSeries(vm, engineOptions, seriesNames, seriesEngines, router))
+        {
+            return -1;
+        }
     }
     else
     {
-        printf("[ERROR]: Unsupported extraction method %s.\n\n", extractMethod.c_str());
-        return -1;
+        engineOptions.bankFile = useBank ? vm["bank"].as<string>() : "";
+        engineOptions.titleImgFile = titleImgFile;
+        engineOptions.templImgDir = templImgDir;
+
+        unique_ptr<OcrEngine> engine(new OcrEngine());
+        if (!engine->Init(engineOptions))
+        {
+            return -1;
+        }
+
+        seriesEngines.push_back(move(engine));
     }
 
-    // Get all the template image file names in the given directory.
-    vector<string> templImgFiles;
-    int error = Utility::GetDirFiles(templImgDir, templImgFiles);
-    if (error != 0)
+    if ((vm.count("priorMargin") > 0) && (extractMethod != "hough"))
     {
-        printf("[ERROR]: Cannot get the template image file names in %s with error = %d", templImgDir.c_str(), error);
-        return error;
+        printf("[INFO]: Search first within %d pixels around the series prior and accept the score >= %f.\n",
+            vm["priorMargin"].as<int>(), (vm.count("priorMinScore") > 0) ? vm["priorMinScore"].as<double>() : 0.6);
+        if (vm.count("priorTolerance") > 0)
+        {
+            printf("[INFO]: Verify each match around the series prior against the whole cover with a tolerance of %d pixels.\n",
+                vm["priorTolerance"].as<int>());
+        }
     }
 
-    sort(templImgFiles.begin(), templImgFiles.end());
+    if ((vm.count("sobel") > 0) && (extractMethod == "templ"))
+    {
+        printf("[INFO]: Match the title with the %s Sobel derivatives.\n", vm["sobel"].as<string>().c_str());
+    }
 
-    // Load the template images.
-    vector<pair<string, Mat> > templDigitImgPairs;
-    for (const auto& imgFile: templImgFiles)
+    if (vm.count("digitTopK") > 0)
     {
-        // Note that each template image is named after the digits displayed inside.
-        string dir;
-        string digits;
-        string extension;
-        Utility::SegmentFullFilename(imgFile, dir, digits, extension);
+        printf("[INFO]: Match only the %ld digit templates nearest to each image by signature%s.\n",
+            vm["digitTopK"].as<size_t>(), engineOptions.verifyDigitTopK ? " and verify them against all the templates" : "");
+    }
 
-        Mat img = imread(imgFile, IMREAD_COLOR);
-        if (img.empty())
+    // The cache is shared by the engines of all the series and their sessions.
+    unique_ptr<KeyPointCache> keyPointCache;
+    if ((vm.count("kpCache") > 0) && (extractMethod == "homo"))
+    {
+        const string cacheDir = vm["kpCache"].as<string>();
+        if ((mkdir(cacheDir.c_str(), 0755) != 0) && (errno != EEXIST))
         {
-            printf("[ERROR]: Cannot load template image %s.\n\n", imgFile.c_str());
-            continue;
+            printf("[ERROR]: mkdir(%s) for the keypoint cache %s.\n\n", strerror(errno), cacheDir.c_str());
+            return -1;
         }
 
-#ifdef DEBUG
-        printf("[DEBUG]: The pixel data type of the template image %s is %s.\n",
-            imgFile.c_str(), Utility::CvType2Str(img.type()).c_str());
-#endif
+        keyPointCache.reset(new KeyPointCache(cacheDir));
+        for (auto& engine: seriesEngines)
+        {
+            engine->SetKeyPointCache(keyPointCache.get());
+        }
 
-        // The pixel data type of the loaded template image is usually CV_8UC3,
-        // so we need to convert it into gray scale (i.e., CV_8UC1) before doing
-        // the template matching.
-        Mat grayImg;
-        cvtColor(img, grayImg, COLOR_BGR2GRAY);
+        printf("[INFO]: Cache the keypoints and the descriptors of the book covers in %s.\n", cacheDir.c_str());
+    }
+    else if (vm.count("kpCache") > 0)
+    {
+        printf("[INFO]: Ignore --kpCache with method %s.\n", extractMethod.c_str());
+    }
 
-#ifdef DEBUG
-        printf("[DEBUG]: The pixel data type of the gray-scale template image %s is %s.\n",
-            imgFile.c_str(), Utility::CvType2Str(grayImg.type()).c_str());
-#endif
+    const double timeBudgetMs = (vm.count("timeBudget") > 0) ? vm["timeBudget"].as<double>() : 0.0;
 
-        templDigitImgPairs.push_back(make_pair(digits, grayImg));
-    }
+    if (vm.count("video") > 0)
+    {
+        vector<OcrWorker> videoWorkers;
+        if (!CreateWorkers(seriesEngines, 1, videoWorkers))
+        {
+            return -1;
+        }
 
-    // Create the CircledDigitsOCRer based on the template matching.
-    unique_ptr<CircledDigitsOCRer> ocrer(new CircledDigitsOCRer(templDigitImgPairs));
+        return ProcessVideo(
+            vm["video"].as<string>(),
+            outputDir,
+            timeBudgetMs,
+            vm.count("deskew") > 0,
+            router.get(),
+            seriesNames,
+            videoWorkers[0],
+            max((vm.count("keyframeInterval") > 0) ? vm["keyframeInterval"].as<int>() : 30, 1));
+    }
 
     // Get all the image file names in the given directory.
     vector<string> bookCoverImgFiles;
-    error = Utility::GetDirFiles(bookCoverImgDir, bookCoverImgFiles);
+    int error = FileUtility::GetDirFiles(bookCoverImgDir, bookCoverImgFiles);
     if (error != 0)
     {
         printf("[ERROR]: Cannot get the image file names in %s with error = %d", bookCoverImgDir.c_str(), error);
@@ -193,61 +1747,410 @@ int main(int argc, char** argv)
 
     sort(bookCoverImgFiles.begin(), bookCoverImgFiles.end());
 
-    vector<OcrResult> ocrResults;
-    for (const auto& imgFile: bookCoverImgFiles)
+    // Validate the mag8u Sobel representation against the float32 one. The title is found
+    // in the whole cover with both, so the series prior does not interfere.
+    if (vm.count("validateSobel") > 0)
     {
-        Mat img = imread(imgFile, IMREAD_COLOR);
-        if (img.empty())
+        if (multiSeries || (extractMethod != "templ"))
         {
-            printf("[ERROR]: Cannot load image %s.\n\n", imgFile.c_str());
-            continue;
+            printf("[ERROR]: --validateSobel supports only one series with method templ.\n\n");
+            return -1;
         }
 
-#ifdef DEBUG
-        printf("[DEBUG]: The pixel data type of the book cover image %s is %s.\n",
-            imgFile.c_str(), Utility::CvType2Str(img.type()).c_str());
-#endif
+        Workspace workspace;
+        size_t cntCompared = 0;
+        size_t cntAgreed = 0;
+        double float32Ms = 0.0;
+        double magnitude8UMs = 0.0;
+        for (const auto& imgFile: bookCoverImgFiles)
+        {
+            Mat img = imread(imgFile, IMREAD_COLOR);
+            if (img.empty())
+            {
+                printf("[ERROR]: Cannot load image %s.\n\n", imgFile.c_str());
+                continue;
+            }
+
+            SobelComparison comparison;
+            if (!seriesEngines[0]->GetPreprocessor().CompareSobelPrecisions(img, workspace, comparison))
+            {
+                continue;
+            }
+
+            ++cntCompared;
+            float32Ms += comparison.float32Ms;
+            magnitude8UMs += comparison.magnitude8UMs;
+
+            // Allow one pixel of difference due to the quantization.
+            const Point offset = comparison.magnitude8UMatchPoint - comparison.float32MatchPoint;
+            if ((abs(offset.x) <= 1) && (abs(offset.y) <= 1))
+            {
+                ++cntAgreed;
+            }
+            else
+            {
+                printf("[INFO]: %s: float32 (%d, %d) with score %f vs mag8u (%d, %d) with score %f\n", imgFile.c_str(),
+                    comparison.float32MatchPoint.x, comparison.float32MatchPoint.y, comparison.float32Score,
+                    comparison.magnitude8UMatchPoint.x, comparison.magnitude8UMatchPoint.y, comparison.magnitude8UScore);
+            }
+        }
+
+        printf("[INFO]: The mag8u Sobel agrees with the float32 Sobel within 1 pixel in %ld of %ld book covers.\n",
+            cntAgreed, cntCompared);
+        printf("[INFO]: Differentiating a cover and matching the title takes %.1f ms with float32 and %.1f ms with mag8u on average.\n",
+            float32Ms/max(cntCompared, static_cast<size_t>(1)), magnitude8UMs/max(cntCompared, static_cast<size_t>(1)));
+        return 0;
+    }
+
+    // Calibrate the detection region of Homography from the first covers of the series.
+    if ((extractMethod == "homo") && (vm.count("detectRegion") == 0) && (vm.count("calibrate") > 0))
+    {
+        const size_t cntSamples = min(static_cast<size_t>(max(vm["calibrate"].as<int>(), 0)), bookCoverImgFiles.size());
 
-        Mat circledDigitsImg = preprocessor->ExtractCircledDigits(img);
-        if (circledDigitsImg.empty())
+        vector<Mat> sampleImgs;
+        for (size_t sampleIndex = 0; (sampleIndex < cntSamples) && !multiSeries; ++sampleIndex)
         {
-            printf("[ERROR]: Can't find the circled digits in %s.\n\n", imgFile.c_str());
-            continue;
+            Mat img = imread(bookCoverImgFiles[sampleIndex], IMREAD_COLOR);
+            if (!img.empty())
+            {
+                sampleImgs.push_back(img);
+            }
         }
 
-        Mat blackWhiteImg = preprocessor->BlackWhiteThresholding(4.0, circledDigitsImg);
-#ifdef DEBUG
-        printf("[DEBUG]: The pixel data type of the preprocessed black-white book cover image %s is %s.\n",
-            imgFile.c_str(), Utility::CvType2Str(blackWhiteImg.type()).c_str());
-#endif
+        // The covers of many series can't be sampled for one of them.
+        if (multiSeries)
+        {
+            printf("[INFO]: Detect the keypoints in the whole book covers.\n");
+        }
+        else if (!seriesEngines[0]->CalibrateDetectionRegion(sampleImgs, 20))
+        {
+            printf("[INFO]: Detect the keypoints in the whole book covers.\n");
+        }
+    }
+
+    // Each worker owns a session of each series, whose series prior is per worker, and a
+    // workspace, which keeps the buffers for the largest image seen. The router and the
+    // engines are shared.
+    if ((cntProcs > 0) && ((vm.count("jobs") > 0) || (vm.count("cvThreads") > 0) || (vm.count("autoTune") > 0)))
+    {
+        printf("[INFO]: Ignore --jobs, --cvThreads and --autoTune with --procs.\n");
+    }
+
+    unsigned int cntJobs = (cntProcs > 0) ? 1u : max((vm.count("jobs") > 0) ? vm["jobs"].as<unsigned int>() : 1u, 1u);
+    int cntCvThreads = (vm.count("cvThreads") > 0) ? max(vm["cvThreads"].as<int>(), 1) : 0;
+    const bool reportSkew = (vm.count("deskew") > 0);
+
+    if ((cntProcs == 0) && (vm.count("autoTune") > 0))
+    {
+        const size_t cntSamples = min(vm["autoTune"].as<size_t>(), bookCoverImgFiles.size());
+        const vector<string> sampleImgFiles(bookCoverImgFiles.begin(), bookCoverImgFiles.begin() + cntSamples);
+        AutoTuneExecutionPolicy(
+            sampleImgFiles,
+            timeBudgetMs,
+            reportSkew,
+            router.get(),
+            seriesEngines,
+            cntJobs,
+            cntCvThreads);
+    }
 
-        // Write the cropped image of circled digits into an image file.
-        string dir;
-        string filename;
-        string extension;
-        Utility::SegmentFullFilename(imgFile, dir, filename, extension);
+    // Split the cores evenly between the images processed at once unless told otherwise,
+    // since the OpenCV calls of the concurrent workers would oversubscribe them.
+    if (cntProcs == 0)
+    {
+        const unsigned int cntCores = max(thread::hardware_concurrency(), 1u);
+        if ((cntCvThreads == 0) && (cntJobs > 1))
+        {
+            cntCvThreads = static_cast<int>(max(cntCores/cntJobs, 1u));
+        }
 
-        string blackWhiteImgFile = outputDir + '/' + filename + "_circledDigits" + extension;
-        bool writeRes = imwrite(blackWhiteImgFile, blackWhiteImg);
-        if (writeRes)
+        if (cntCvThreads > 0)
         {
-            printf("[INFO]: Successfully write the cropped black-white image of circled digits into %s.\n",
-                blackWhiteImgFile.c_str());
+            setNumThreads(cntCvThreads);
         }
-        else
+
+        printf("[INFO]: Process %u images at once with %d threads per OpenCV call on %u cores.\n",
+            cntJobs, getNumThreads(), cntCores);
+    }
+
+    vector<OcrWorker> workers;
+    if (!CreateWorkers(seriesEngines, cntJobs, workers))
+    {
+        return -1;
+    }
+
+    // The covers already processed, whose results are reused for their near-duplicates.
+    unique_ptr<DuplicateIndex> duplicateIndex;
+    const bool verifyDuplicates = (vm.count("dedupVerify") > 0);
+    if (vm.count("dedup") > 0)
+    {
+        duplicateIndex.reset(new DuplicateIndex(vm["dedup"].as<int>()));
+        printf("[INFO]: Reuse the results of the near-duplicate covers within a Hamming distance of %d%s.\n",
+            duplicateIndex->GetMaxDistance(), verifyDuplicates ? " after verifying the digits" : "");
+    }
+
+    // The triage matches the titles of all the series on the thumbnails.
+    unique_ptr<CoverTriage> triage;
+    if (vm.count("triage") > 0)
+    {
+        TriageThresholds thresholds;
+        if (!GetTriageThresholds(vm, thresholds))
+        {
+            return -1;
+        }
+
+        vector<Mat> titleImgs;
+        for (const auto& engine: seriesEngines)
+        {
+            titleImgs.push_back(engine->GetPreprocessor().GetTitleImg());
+        }
+
+        triage.reset(new CoverTriage(thresholds, titleImgs));
+        printf("[INFO]: Triage the images with gray level deviation >= %f, entropy >= %f bits, edge density >= %f, aspect ratio in [%f, %f] and title score >= %f.\n",
+            thresholds.minStdDev, thresholds.minEntropy, thresholds.minEdgeDensity,
+            thresholds.minAspectRatio, thresholds.maxAspectRatio, thresholds.minTitleScore);
+    }
+
+    // The metrics are written until the end of the run, when the last snapshot is written.
+    unique_ptr<BatchMetrics> metrics;
+    if (vm.count("metrics") > 0)
+    {
+        const double intervalSec = (vm.count("metricsInterval") > 0) ? vm["metricsInterval"].as<double>() : 5.0;
+        metrics.reset(new BatchMetrics(vm["metrics"].as<string>(), "ocr_circled_digits", intervalSec));
+        metrics->Start();
+        printf("[INFO]: Write the metrics into %s every %f seconds.\n", vm["metrics"].as<string>().c_str(), intervalSec);
+    }
+
+    if (watch)
+    {
+        return WatchImgDir(
+            bookCoverImgDir,
+            outputDir,
+            timeBudgetMs,
+            reportSkew,
+            router.get(),
+            duplicateIndex.get(),
+            verifyDuplicates,
+            triage.get(),
+            metrics.get(),
+            seriesNames,
+            seriesEngines,
+            workers,
+            (vm.count("debounce") > 0) ? vm["debounce"].as<int>() : 20,
+            (vm.count("maxBatch") > 0) ? vm["maxBatch"].as<size_t>() : 64);
+    }
+
+    vector<ImageOutcome> outcomes(bookCoverImgFiles.size());
+
+    if (cntProcs > 0)
+    {
+        printf("[INFO]: Process %ld images with %u worker processes.\n", bookCoverImgFiles.size(), cntProcs);
+
+        // Each worker process runs with its own copy of the sessions and the workspace of
+        // worker 0 and passes the outcome of each image back in its result.
+        ProcessPool processPool(cntProcs);
+        auto task = [&](const size_t imgIndex, string& result)
+        {
+            ImageOutcome outcome;
+            ProcessImage(
+                bookCoverImgFiles[imgIndex],
+                outputDir,
+                false,
+                timeBudgetMs,
+                reportSkew,
+                router.get(),
+                nullptr,
+                false,
+                triage.get(),
+                workers[0],
+                outcome);
+
+            SerializeOutcome(outcome, result);
+        };
+
+        // The supervisor records the outcomes in the metrics as the workers finish them.
+        ProcessPool::ProgressFunc progress;
+        if (metrics)
+        {
+            progress = [&](const vector<size_t>& doneImgIndices)
+            {
+                for (const auto imgIndex: doneImgIndices)
+                {
+                    ImageOutcome outcome;
+                    if (DeserializeOutcome(processPool.GetResult(imgIndex), outcome))
+                    {
+                        RecordMetrics(*metrics, outcome, seriesEngines);
+                    }
+                }
+
+                metrics->SetQueueDepth("pending", static_cast<double>(processPool.CountTasks(ProcessPool::TaskState::Pending)));
+                metrics->SetQueueDepth("inflight", static_cast<double>(processPool.CountTasks(ProcessPool::TaskState::InFlight)));
+            };
+        }
+
+        if (!processPool.Run(bookCoverImgFiles.size(), task, progress))
         {
-            printf("[ERROR]: Failed to write the cropped black-white image of circled digits into %s.\n\n",
-                blackWhiteImgFile.c_str());
             return -1;
         }
 
-        // Use CircledDigitsOCRer to recognize the digits from the cropped image.
-        OcrResult res;
-        ocrer->OCR(blackWhiteImg, res);
+        for (size_t imgIndex = 0; imgIndex < outcomes.size(); ++imgIndex)
+        {
+            ImageOutcome& outcome = outcomes[imgIndex];
+            outcome.timing.imgFile = bookCoverImgFiles[imgIndex];
+            outcome.timing.totalMs = 0.0;
+            if ((processPool.GetState(imgIndex) != ProcessPool::TaskState::Done)
+                || !DeserializeOutcome(processPool.GetResult(imgIndex), outcome))
+            {
+                outcome.status = ImageStatus::Crashed;
+                if (metrics)
+                {
+                    RecordMetrics(*metrics, outcome, seriesEngines);
+                }
+            }
+        }
+
+        if (processPool.GetRestartCount() > 0)
+        {
+            printf("[INFO]: Restarted %ld crashed worker processes.\n", processPool.GetRestartCount());
+        }
+    }
+    else
+    {
+        ProcessImages(
+            bookCoverImgFiles,
+            outputDir,
+            false,
+            timeBudgetMs,
+            reportSkew,
+            router.get(),
+            duplicateIndex.get(),
+            verifyDuplicates,
+            triage.get(),
+            metrics.get(),
+            seriesEngines,
+            workers,
+            outcomes);
+
+        // Show how often the workspace buffers grew after the first image of each worker,
+        // i.e., for the larger images only. The temporaries inside OpenCV aren't counted.
+        for (size_t workerIndex = 0; workerIndex < workers.size(); ++workerIndex)
+        {
+            const OcrWorker& worker = workers[workerIndex];
+            if (worker.cntImgs == 0)
+            {
+                continue;
+            }
+
+            printf("[INFO]: Worker %ld grew its workspace buffers %ld times for its first image and %ld times for its other %ld images.\n",
+                workerIndex, worker.cntFirstImgAllocations,
+                worker.workspace.GetAllocationCount() - worker.cntFirstImgAllocations, worker.cntImgs - 1);
+        }
+    }
+
+    if (duplicateIndex)
+    {
+        size_t cntReused = 0;
+        size_t cntRejected = 0;
+        CountDuplicates(outcomes, cntReused, cntRejected);
+        PrintDuplicateHits(outcomes.size(), cntReused, cntRejected);
+    }
+
+    if (triage)
+    {
+        PrintTriageSavings(outcomes);
+    }
+
+    if ((engineOptions.priorMargin >= 0) && (engineOptions.priorTolerance >= 0) && (engineOptions.method != "hough"))
+    {
+        PrintPriorVerification(outcomes);
+    }
+
+    // The worker processes count their own cache hits, which the supervisor doesn't see.
+    if (keyPointCache && (cntProcs == 0))
+    {
+        printf("[INFO]: The keypoint cache had %ld hits and %ld misses.\n",
+            keyPointCache->GetHitCount(), keyPointCache->GetMissCount());
+    }
+
+    // The same holds for the recall of the digit pre-filter.
+    if (engineOptions.verifyDigitTopK && (vm.count("digitTopK") > 0) && (cntProcs == 0))
+    {
+        size_t cntVerified = 0;
+        size_t cntRecalled = 0;
+        for (const auto& engine: seriesEngines)
+        {
+            cntVerified += engine->GetOcrer().GetVerifiedCount();
+            cntRecalled += engine->GetOcrer().GetRecalledCount();
+        }
+
+        printf("[INFO]: The top %ld digit templates by signature contain the best template in %ld of %ld images (recall %f).\n",
+            vm["digitTopK"].as<size_t>(), cntRecalled, cntVerified, static_cast<double>(cntRecalled)/max(cntVerified, static_cast<size_t>(1)));
+    }
+
+    // Collect the results in the order of the image files.
+    vector<OcrResult> ocrResults;
+    vector<ExtractReport> extractReports;
+    vector<string> ocrImgFiles;
+    vector<int> ocrSeriesIndices;
+    vector<double> ocrRouteScores;
+    vector<string> timeoutImgFiles;
+    vector<string> rejectedImgFiles;
+    vector<string> crashedImgFiles;
+    vector<string> triagedImgFiles;
+    vector<string> triageReasons;
+    vector<ImageTiming> imgTimings;
+    for (size_t imgIndex = 0; imgIndex < outcomes.size(); ++imgIndex)
+    {
+        const ImageOutcome& outcome = outcomes[imgIndex];
+        imgTimings.push_back(outcome.timing);
+
+        switch (outcome.status)
+        {
+        case ImageStatus::Success:
+            ocrResults.push_back(outcome.ocrResult);
+            extractReports.push_back(outcome.extractReport);
+            ocrImgFiles.push_back(bookCoverImgFiles[imgIndex]);
+            ocrSeriesIndices.push_back(outcome.seriesIndex);
+            ocrRouteScores.push_back(outcome.routeScore);
+            break;
+
+        case ImageStatus::Timeout:
+            timeoutImgFiles.push_back(bookCoverImgFiles[imgIndex]);
+            break;
+
+        case ImageStatus::Rejected:
+            rejectedImgFiles.push_back(bookCoverImgFiles[imgIndex]);
+            break;
+
+        case ImageStatus::Crashed:
+            crashedImgFiles.push_back(bookCoverImgFiles[imgIndex]);
+            break;
+
+        case ImageStatus::Triaged:
+            triagedImgFiles.push_back(bookCoverImgFiles[imgIndex]);
+            triageReasons.push_back(outcome.triageReason);
+            break;
 
-        printf("[INFO]: The digits in image %s are %s.\n", imgFile.c_str(), res.evaluatedDigits.c_str());
+        case ImageStatus::WriteFailed:
+            return -1;
+
+        default:
+            break;
+        }
+    }
+
+    if (multiSeries)
+    {
+        vector<size_t> cntImgsPerSeries(seriesNames.size(), 0);
+        for (const auto seriesIndex: ocrSeriesIndices)
+        {
+            ++cntImgsPerSeries[seriesIndex];
+        }
 
-        ocrResults.push_back(res);
+        for (size_t seriesIndex = 0; seriesIndex < seriesNames.size(); ++seriesIndex)
+        {
+            printf("[INFO]: Recognized %ld book covers of series %s.\n", cntImgsPerSeries[seriesIndex], seriesNames[seriesIndex].c_str());
+        }
     }
 
     // Write results to a yml file.
@@ -257,13 +2160,80 @@ int main(int argc, char** argv)
     printf("[INFO]: Writing OCR results to %s.\n", ocrResultFile.c_str());
     for (int resultIndex = 0; resultIndex < static_cast<int>(ocrResults.size()); ++resultIndex)
     {
-        // Key names must start with a letter or '_'. Since the image filename may start with a non-letter,
-        // e.g., a digit, we don't use the image filename as the key name.
-        fsResult << "imgfilename_" + to_string(resultIndex) << bookCoverImgFiles[resultIndex];
-        fsResult << "ocrresult_" + to_string(resultIndex) << ocrResults[resultIndex];
+        WriteOcrResult(
+            fsResult,
+            resultIndex,
+            ocrImgFiles[resultIndex],
+            ocrResults[resultIndex],
+            multiSeries ? seriesNames[ocrSeriesIndices[resultIndex]] : "",
+            ocrRouteScores[resultIndex],
+            extractReports[resultIndex],
+            vm.count("deskew") > 0);
+    }
+
+    if (!timeoutImgFiles.empty())
+    {
+        fsResult << "timeoutimgfilenames" << "[";
+        for (const auto& imgFile: timeoutImgFiles)
+        {
+            fsResult << imgFile;
+        }
+        fsResult << "]";
+    }
+
+    if (!rejectedImgFiles.empty())
+    {
+        fsResult << "rejectedimgfilenames" << "[";
+        for (const auto& imgFile: rejectedImgFiles)
+        {
+            fsResult << imgFile;
+        }
+        fsResult << "]";
+    }
+
+    if (!crashedImgFiles.empty())
+    {
+        fsResult << "crashedimgfilenames" << "[";
+        for (const auto& imgFile: crashedImgFiles)
+        {
+            fsResult << imgFile;
+        }
+        fsResult << "]";
+    }
+
+    // The reason of each triaged image is at the same index as its file name.
+    if (!triagedImgFiles.empty())
+    {
+        fsResult << "triagedimgfilenames" << "[";
+        for (const auto& imgFile: triagedImgFiles)
+        {
+            fsResult << imgFile;
+        }
+        fsResult << "]";
+
+        fsResult << "triagereasons" << "[";
+        for (const auto& reason: triageReasons)
+        {
+            fsResult << reason;
+        }
+        fsResult << "]";
     }
 
     fsResult.release();
 
+    printf("[INFO]: %ld images succeeded, %ld timed out and %ld were rejected out of %ld images.\n",
+        ocrResults.size(), timeoutImgFiles.size(), rejectedImgFiles.size(), bookCoverImgFiles.size());
+    if (!crashedImgFiles.empty())
+    {
+        printf("[INFO]: %ld images crashed their worker processes.\n", crashedImgFiles.size());
+    }
+
+    if (!triagedImgFiles.empty())
+    {
+        printf("[INFO]: %ld images failed the triage.\n", triagedImgFiles.size());
+    }
+
+    PrintSlowestImages(imgTimings, (vm.count("slowest") > 0) ? vm["slowest"].as<size_t>() : 5);
+
     return 0;
 }
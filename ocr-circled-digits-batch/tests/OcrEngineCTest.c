@@ -0,0 +1,168 @@
+/*
+ * OcrEngineCTest.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+/*
+ * A smoke test of the C API of OcrEngine, compiled as C to check that OcrEngineC.h is plain C:
+ *   - ocr_engine_options_init fills the defaults and struct_size, and the options without
+ *     struct_size are rejected,
+ *   - an engine without its template bank isn't created,
+ *   - with bankFile, a blank gray buffer isn't recognized, the invalid buffers, bytes and
+ *     sessions get their statuses, and no digits are recalled without verify_digit_top_k,
+ *   - coverImgFile, if given, is recognized from its encoded bytes, as expectedDigits if given.
+ *
+ * Usage: OcrEngineCTest [bankFile [coverImgFile [expectedDigits]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "OcrEngineC.h"
+
+static int cntChecks = 0;
+static int cntFailures = 0;
+
+static void Check(
+    const int passed,
+    const char* what)
+{
+    ++cntChecks;
+    if (!passed)
+    {
+        ++cntFailures;
+    }
+
+    printf("[%s]: %s\n", passed ? "INFO" : "ERROR", what);
+}
+
+/* Read the whole file into a buffer, which the caller frees, or return NULL. */
+static unsigned char* ReadFile(
+    const char* file,
+    size_t* size)
+{
+    FILE* fp = fopen(file, "rb");
+    unsigned char* bytes = NULL;
+    long fileSize = 0;
+
+    if (fp == NULL)
+    {
+        printf("[ERROR]: Cannot open %s.\n\n", file);
+        return NULL;
+    }
+
+    if ((fseek(fp, 0, SEEK_END) == 0) && ((fileSize = ftell(fp)) > 0) && (fseek(fp, 0, SEEK_SET) == 0))
+    {
+        bytes = (unsigned char*)malloc((size_t)fileSize);
+        if ((bytes != NULL) && (fread(bytes, 1, (size_t)fileSize, fp) != (size_t)fileSize))
+        {
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+
+    fclose(fp);
+    *size = (size_t)fileSize;
+    return bytes;
+}
+
+static void CheckRecognition(
+    ocr_engine* engine,
+    const char* coverImgFile,
+    const char* expectedDigits)
+{
+    ocr_session* session = ocr_session_create(engine);
+    unsigned char blankPixels[48][64];
+    const unsigned char garbage[] = "not an image";
+    ocr_result result;
+    size_t cntVerified = 1;
+    size_t cntRecalled = 1;
+    int status = 0;
+
+    Check(session != NULL, "A session is created.");
+    if (session == NULL)
+    {
+        return;
+    }
+
+    memset(blankPixels, 255, sizeof(blankPixels));
+    status = ocr_session_recognize_pixels(session, &blankPixels[0][0], 64, 48, 64, 1, &result);
+    Check((status != OCR_STATUS_SUCCESS) && (status != OCR_STATUS_INVALID_INPUT) && (result.status == status)
+        && (result.digits[0] == '\0'), "A blank gray buffer has no digits.");
+
+    Check(ocr_session_recognize_pixels(session, &blankPixels[0][0], 64, 48, 32, 1, &result) == OCR_STATUS_INVALID_INPUT,
+        "A stride shorter than a row is invalid.");
+    Check(ocr_session_recognize_pixels(session, &blankPixels[0][0], 32, 48, 64, 2, &result) == OCR_STATUS_INVALID_INPUT,
+        "A buffer of 2 channels is invalid.");
+    Check(ocr_session_recognize_pixels(NULL, &blankPixels[0][0], 64, 48, 64, 1, &result) == OCR_STATUS_INVALID_INPUT,
+        "A missing session is invalid.");
+    Check(ocr_session_recognize_encoded(session, garbage, sizeof(garbage), &result) == OCR_STATUS_DECODE_FAILED,
+        "Bytes which aren't an image can't be decoded.");
+
+    if (coverImgFile != NULL)
+    {
+        size_t size = 0;
+        unsigned char* bytes = ReadFile(coverImgFile, &size);
+        Check(bytes != NULL, "The cover image file is read.");
+        if (bytes != NULL)
+        {
+            status = ocr_session_recognize_encoded(session, bytes, size, &result);
+            printf("[INFO]: The cover %s has the status %d, the digits %s and the score %f.\n",
+                coverImgFile, status, result.digits, result.score);
+            Check(status == OCR_STATUS_SUCCESS, "The cover is recognized.");
+            if (expectedDigits != NULL)
+            {
+                Check(strcmp(result.digits, expectedDigits) == 0, "The cover has the expected digits.");
+            }
+
+            free(bytes);
+        }
+    }
+
+    ocr_engine_get_digit_recall(engine, &cntVerified, &cntRecalled);
+    Check((cntVerified == 0) && (cntRecalled == 0), "No digits are verified without verify_digit_top_k.");
+
+    ocr_session_destroy(session);
+}
+
+int main(int argc, char** argv)
+{
+    ocr_engine_options options;
+    ocr_engine* engine = NULL;
+
+    if (argc > 4)
+    {
+        printf("Usage: %s [bankFile [coverImgFile [expectedDigits]]]\n", argv[0]);
+        return 1;
+    }
+
+    ocr_engine_options_init(&options);
+    Check(options.struct_size == sizeof(options), "The options have their size.");
+    Check((options.method != NULL) && (strcmp(options.method, "homo") == 0) && (options.scale_factor > 0.0)
+        && (options.hough_region.height > 0), "The options have the defaults of ocr-circled-digits-batch.");
+
+    memset(&options, 0, sizeof(options));
+    Check(ocr_engine_create(&options) == NULL, "The options without their size are rejected.");
+
+    ocr_engine_options_init(&options);
+    options.bank_file = "/nonexistent/series.bank";
+    Check(ocr_engine_create(&options) == NULL, "An engine without its template bank isn't created.");
+
+    if (argc >= 2)
+    {
+        options.bank_file = argv[1];
+        engine = ocr_engine_create(&options);
+        Check(engine != NULL, "The engine is created from the template bank.");
+        if (engine != NULL)
+        {
+            CheckRecognition(engine, (argc >= 3) ? argv[2] : NULL, (argc >= 4) ? argv[3] : NULL);
+            ocr_engine_destroy(engine);
+        }
+    }
+
+    printf("[INFO]: %d checks, %d failed.\n", cntChecks, cntFailures);
+    return (cntFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * PrunedTemplateMatcherTest.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+// Check that PrunedTemplateMatcher finds the exact maximum of TM_CCOEFF_NORMED, and time it
+// against matchTemplate followed by minMaxLoc, for the CV_32F and the CV_8U Sobel derivatives:
+//   - on synthetic covers with a planted title, with and without the guess,
+//   - on synthetic covers with two identical copies of a patch, which tie exactly,
+//   - on a flat cover, where all the scores are 0,
+//   - on the real covers of bookCoversDir, if given, with the title image titleImgFile.
+//
+// The exact maximum is found by rescoring with PrunedTemplateMatcher::Rescore all the
+// positions whose score by matchTemplate is within its float rounding of its maximum. The
+// pruned search must find the same position with the same score, and that score must
+// agree with the maximum of matchTemplate.
+//
+// Usage: PrunedTemplateMatcherTest [titleImgFile bookCoversDir]
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "FileUtility.h"
+#include "Workspace.h"
+#include "PrunedTemplateMatcher.h"
+
+using namespace std;
+using namespace cv;
+
+// The positions scored by matchTemplate within this of its maximum may be the exact maximum,
+// since it rounds its scores in float.
+static const double candidateTolerance = 1e-4;
+
+// The exact maximum must agree with that of matchTemplate up to its float rounding.
+static const double scoreTolerance = 1e-5;
+
+// Sharpen like OcrPreprocessor::SharpenImg.
+static Mat Sharpen(const Mat& img)
+{
+    Mat res;
+    GaussianBlur(img, res, Size(0, 0), 3);
+    addWeighted(img, 1.0, res, -0.5, 0.0, res);
+    addWeighted(img, 0.5, res, 1.0, 0.0, res);
+
+    return res;
+}
+
+// The Sobel derivatives like OcrPreprocessor::ComputeSobel: the mixed derivative of the
+// three channels in CV_32F, or the gradient magnitude (|dx| + |dy|)/8 of the grayscale image
+// saturated into CV_8U.
+static Mat ComputeSobel(
+    const Mat& img,
+    const bool magnitude8U)
+{
+    Mat sobelImg;
+    if (!magnitude8U)
+    {
+        Sobel(img, sobelImg, CV_32F, 1, 1, 3);
+        return sobelImg;
+    }
+
+    Mat grayImg;
+    cvtColor(img, grayImg, COLOR_BGR2GRAY);
+
+    Mat dxImg;
+    Mat dyImg;
+    Sobel(grayImg, dxImg, CV_16S, 1, 0, 3);
+    Sobel(grayImg, dyImg, CV_16S, 0, 1, 3);
+
+    Mat absDxImg;
+    Mat absDyImg;
+    convertScaleAbs(dxImg, absDxImg, 0.25);
+    convertScaleAbs(dyImg, absDyImg, 0.25);
+    addWeighted(absDxImg, 0.5, absDyImg, 0.5, 0.0, sobelImg);
+
+    return sobelImg;
+}
+
+static double ElapsedMs(const int64 startTick)
+{
+    return (getTickCount() - startTick)*1000.0/getTickFrequency();
+}
+
+static bool RunCase(
+    const string& name,
+    const Mat& srcImg,
+    const Mat& templImg,
+    const Point& guess = Point(-1, -1))
+{
+    int64 startTick = getTickCount();
+    Mat scores;
+    matchTemplate(srcImg, templImg, scores, TM_CCOEFF_NORMED);
+
+    double exhaustiveMaxScore = 0.0;
+    Point exhaustiveMatchPoint;
+    minMaxLoc(scores, nullptr, &exhaustiveMaxScore, nullptr, &exhaustiveMatchPoint);
+    const double exhaustiveMs = ElapsedMs(startTick);
+
+    // The matcher is built once per title, so its construction is not timed.
+    const PrunedTemplateMatcher matcher(templImg);
+    Workspace workspace;
+    startTick = getTickCount();
+    Point matchPoint;
+    double maxScore = 0.0;
+    PrunedMatchStats stats;
+    if (!matcher.Match(srcImg, workspace, matchPoint, &maxScore, guess, &stats))
+    {
+        printf("[ERROR]: %s: the pruned matching failed.\n\n", name.c_str());
+        return false;
+    }
+
+    const double prunedMs = ElapsedMs(startTick);
+
+    // The exact maximum among the maxima of matchTemplate.
+    vector<Point> candidates;
+    for (int row = 0; row < scores.rows; ++row)
+    {
+        const float* scoreRow = scores.ptr<float>(row);
+        for (int col = 0; col < scores.cols; ++col)
+        {
+            if (scoreRow[col] >= exhaustiveMaxScore - candidateTolerance)
+            {
+                candidates.push_back(Point(col, row));
+            }
+        }
+    }
+
+    Point exactMatchPoint;
+    double exactMaxScore = 0.0;
+    if (!matcher.Rescore(srcImg, candidates, workspace, exactMatchPoint, exactMaxScore))
+    {
+        printf("[ERROR]: %s: the maxima of matchTemplate can't be rescored.\n\n", name.c_str());
+        return false;
+    }
+
+    const bool passed = (matchPoint == exactMatchPoint) && (maxScore == exactMaxScore) &&
+        (fabs(exactMaxScore - exhaustiveMaxScore) <= scoreTolerance);
+
+    printf("[%s]: %s: matchTemplate (%d, %d) %f in %.1f ms, exact (%d, %d) %.9f of %ld candidates, "
+        "pruned (%d, %d) %.9f in %.1f ms, %.1f%% pruned, %ld rescored\n",
+        passed ? "INFO" : "ERROR",
+        name.c_str(),
+        exhaustiveMatchPoint.x, exhaustiveMatchPoint.y, exhaustiveMaxScore, exhaustiveMs,
+        exactMatchPoint.x, exactMatchPoint.y, exactMaxScore, candidates.size(),
+        matchPoint.x, matchPoint.y, maxScore, prunedMs,
+        100.0*stats.cntPruned/max(stats.cntPositions, static_cast<size_t>(1)), stats.cntCandidates);
+
+    return passed;
+}
+
+// A cover with a gradient background, filled rectangles and text, like a book cover.
+static Mat MakeCover(
+    const Size& size,
+    RNG& rng)
+{
+    Mat coverImg(size, CV_8UC3);
+    const Vec3b topColor(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    const Vec3b bottomColor(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    for (int row = 0; row < size.height; ++row)
+    {
+        const double weight = static_cast<double>(row)/size.height;
+        const Vec3b color(
+            saturate_cast<uchar>(topColor[0]*(1.0 - weight) + bottomColor[0]*weight),
+            saturate_cast<uchar>(topColor[1]*(1.0 - weight) + bottomColor[1]*weight),
+            saturate_cast<uchar>(topColor[2]*(1.0 - weight) + bottomColor[2]*weight));
+        coverImg.row(row).setTo(Scalar(color[0], color[1], color[2]));
+    }
+
+    for (int index = 0; index < 30; ++index)
+    {
+        const Point topLeft(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        rectangle(coverImg, Rect(topLeft.x, topLeft.y, rng.uniform(10, 200), rng.uniform(10, 200)),
+            Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), FILLED);
+    }
+
+    for (int index = 0; index < 25; ++index)
+    {
+        string text;
+        for (int cntChars = rng.uniform(3, 10); cntChars > 0; --cntChars)
+        {
+            text.push_back(static_cast<char>(rng.uniform('A', 'Z' + 1)));
+        }
+
+        putText(coverImg, text, Point(rng.uniform(0, size.width), rng.uniform(0, size.height)),
+            FONT_HERSHEY_SIMPLEX, rng.uniform(0.5, 2.0),
+            Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), 2);
+    }
+
+    return coverImg;
+}
+
+static Mat MakeTitle(const Size& size)
+{
+    Mat titleImg(size, CV_8UC3, Scalar(240, 240, 240));
+    putText(titleImg, "SERIES", Point(5, size.height - 12), FONT_HERSHEY_DUPLEX, size.height/40.0, Scalar(20, 20, 120), 2);
+    circle(titleImg, Point(size.width - 25, size.height/2), size.height/3, Scalar(0, 0, 200), 2);
+
+    return titleImg;
+}
+
+// Round-trip through JPEG, like the scanned covers.
+static Mat Compress(const Mat& img)
+{
+    vector<uchar> buffer;
+    imencode(".jpg", img, buffer, vector<int>{IMWRITE_JPEG_QUALITY, 85});
+    return imdecode(buffer, IMREAD_COLOR);
+}
+
+static void RunSyntheticCases(
+    const bool magnitude8U,
+    vector<bool>& results)
+{
+    const char* precision = magnitude8U ? "mag8u" : "float32";
+    RNG rng(20261019);
+    const vector<pair<Size, Size> > sizes = {
+        make_pair(Size(450, 600), Size(160, 40)),
+        make_pair(Size(800, 1100), Size(240, 60))};
+
+    for (const auto& coverAndTitleSize: sizes)
+    {
+        const Size& coverSize = coverAndTitleSize.first;
+        const Size& titleSize = coverAndTitleSize.second;
+        char sizeName[32];
+        snprintf(sizeName, sizeof(sizeName), "%s %dx%d", precision, coverSize.width, coverSize.height);
+
+        Mat coverImg = MakeCover(coverSize, rng);
+        const Mat titleImg = MakeTitle(titleSize);
+        const Point titlePoint(rng.uniform(0, coverSize.width - titleSize.width), rng.uniform(0, coverSize.height/3));
+        titleImg.copyTo(coverImg(Rect(titlePoint, titleSize)));
+        coverImg = Compress(coverImg);
+
+        const Mat coverSobel = ComputeSobel(Sharpen(coverImg), magnitude8U);
+        const Mat titleSobel = ComputeSobel(Sharpen(titleImg), magnitude8U);
+        results.push_back(RunCase(string(sizeName) + " planted", coverSobel, titleSobel));
+        results.push_back(RunCase(string(sizeName) + " planted with the guess", coverSobel, titleSobel, titlePoint));
+
+        // Two identical copies of a patch of the cover with its border, so that the two
+        // windows inside them tie exactly and the first one in the row-major order wins.
+        Mat tieCoverImg = coverImg.clone();
+        const Rect patchRect(titlePoint, Size(titleSize.width + 2, titleSize.height + 2));
+        const Point copyPoint(
+            min(coverSize.width - patchRect.width, titlePoint.x + titleSize.width + 13),
+            min(coverSize.height - patchRect.height, titlePoint.y + titleSize.height + 50));
+        coverImg(patchRect).copyTo(tieCoverImg(Rect(copyPoint, patchRect.size())));
+
+        const Mat tieCoverSobel = ComputeSobel(Sharpen(tieCoverImg), magnitude8U);
+        const Mat tieTemplImg = tieCoverSobel(Rect(titlePoint.x + 1, titlePoint.y + 1, titleSize.width - 2, titleSize.height - 2)).clone();
+        results.push_back(RunCase(string(sizeName) + " planted tie", tieCoverSobel, tieTemplImg));
+
+        const Mat flatSobel(coverSobel.size(), coverSobel.type(), Scalar::all(0));
+        results.push_back(RunCase(string(sizeName) + " flat", flatSobel, titleSobel));
+    }
+}
+
+static bool RunRealCases(
+    const string& titleImgFile,
+    const string& bookCoversDir,
+    const bool magnitude8U,
+    vector<bool>& results)
+{
+    const Mat titleImg = imread(titleImgFile, IMREAD_COLOR);
+    if (titleImg.empty())
+    {
+        printf("[ERROR]: Cannot read the title image %s.\n\n", titleImgFile.c_str());
+        return false;
+    }
+
+    vector<string> bookCoverImgFiles;
+    if (FileUtility::GetDirFiles(bookCoversDir, bookCoverImgFiles) != 0)
+    {
+        return false;
+    }
+
+    const Mat titleSobel = ComputeSobel(Sharpen(titleImg), magnitude8U);
+    for (const auto& bookCoverImgFile: bookCoverImgFiles)
+    {
+        const Mat bookCoverImg = imread(bookCoverImgFile, IMREAD_COLOR);
+        if (bookCoverImg.empty() || (bookCoverImg.cols < titleImg.cols) || (bookCoverImg.rows < titleImg.rows))
+        {
+            continue;
+        }
+
+        results.push_back(RunCase(string(magnitude8U ? "mag8u " : "float32 ") + bookCoverImgFile,
+            ComputeSobel(Sharpen(bookCoverImg), magnitude8U), titleSobel));
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if ((argc != 1) && (argc != 3))
+    {
+        printf("Usage: %s [titleImgFile bookCoversDir]\n", argv[0]);
+        return 1;
+    }
+
+    vector<bool> results;
+    for (const bool magnitude8U: {false, true})
+    {
+        RunSyntheticCases(magnitude8U, results);
+        if ((argc == 3) && !RunRealCases(argv[1], argv[2], magnitude8U, results))
+        {
+            return 1;
+        }
+    }
+
+    const size_t cntDifferent = count(results.begin(), results.end(), false);
+    printf("[INFO]: %ld cases, %ld different.\n", results.size(), cntDifferent);
+    return (cntDifferent == 0) ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+/*
+ * SeriesPriorTest.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+// Check that the verification of the series prior makes the results independent of the
+// order of the covers. The synthetic covers of one series have the title at one position
+// in the first half, and moved to the right in the second half, where a faded copy of
+// the title stays at the old position:
+//   - the prior without verification finds the faded copy in the second half when the
+//     covers come in order, but not in the reverse order, i.e., the covers expose the
+//     order dependence (Template Matching),
+//   - with --priorTolerance, the covers processed in order and in the reverse order give
+//     the matches of the whole covers within the tolerance (Template Matching and
+//     Homography), and the faded copies are reported as mismatches (Template Matching).
+//
+// Usage: SeriesPriorTest
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "OcrEngine.h"
+
+using namespace std;
+using namespace cv;
+
+static const int cntCovers = 8;
+static const int titleShift = 120;
+static const int priorMargin = 30;
+static const int priorTolerance = 1;
+
+static size_t cntChecks = 0;
+static size_t cntFailures = 0;
+
+static void Check(
+    const bool passed,
+    const string& what)
+{
+    ++cntChecks;
+    cntFailures += passed ? 0 : 1;
+    printf("[%s]: %s\n", passed ? "INFO" : "ERROR", what.c_str());
+}
+
+static Mat MakeTitle()
+{
+    Mat titleImg(40, 160, CV_8UC3, Scalar(240, 240, 240));
+    putText(titleImg, "SERIES", Point(5, 28), FONT_HERSHEY_DUPLEX, 1.0, Scalar(20, 20, 120), 2);
+    rectangle(titleImg, Rect(130, 8, 24, 24), Scalar(0, 0, 200), 2);
+
+    return titleImg;
+}
+
+static Mat MakeDigitTemplate(const string& digits)
+{
+    Mat templImg(60, 90, CV_8UC1, Scalar(255));
+    putText(templImg, digits, Point(8, 45), FONT_HERSHEY_SIMPLEX, 1.5, Scalar(0), 4);
+
+    return templImg;
+}
+
+// A cover with the title at titlePoint and the circled digits below it, where the engine
+// crops them, over a noisy background with blocks below. If fadedPoint is inside the
+// cover, a faded copy of the title is blended into the background there.
+static Mat MakeCover(
+    const Size& size,
+    const Mat& titleImg,
+    const Point& titlePoint,
+    const Point& fadedPoint,
+    const string& digits,
+    RNG& rng)
+{
+    Mat coverImg(size, CV_8UC3);
+    randu(coverImg, Scalar::all(150), Scalar::all(230));
+    for (int index = 0; index < 20; ++index)
+    {
+        const Point topLeft(rng.uniform(0, size.width), rng.uniform(200, size.height));
+        rectangle(coverImg, Rect(topLeft.x, topLeft.y, rng.uniform(10, 120), rng.uniform(10, 120)),
+            Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), FILLED);
+    }
+
+    const Rect coverRect(0, 0, size.width, size.height);
+    const Rect fadedRect(fadedPoint, titleImg.size());
+    if ((fadedRect & coverRect) == fadedRect)
+    {
+        Mat fadedImg = coverImg(fadedRect);
+        addWeighted(fadedImg, 0.4, titleImg, 0.6, 0.0, fadedImg);
+    }
+
+    titleImg.copyTo(coverImg(Rect(titlePoint, titleImg.size())));
+
+    const Point center(titlePoint.x + titleImg.cols/2, titlePoint.y + titleImg.rows/2 + 55);
+    circle(coverImg, center, 22, Scalar(255, 255, 255), FILLED);
+    circle(coverImg, center, 22, Scalar(0, 0, 200), 2);
+    putText(coverImg, digits, Point(center.x - 15, center.y + 8), FONT_HERSHEY_SIMPLEX, 0.8, Scalar(0, 0, 0), 2);
+
+    return coverImg;
+}
+
+struct CoverResult
+{
+    OcrStatus status;
+    Rect circledDigitsRect;
+    bool priorMismatched;
+};
+
+// Process the covers with one session in the given order, and return the results in the
+// order of the covers.
+static vector<CoverResult> ProcessCovers(
+    const OcrEngine& engine,
+    const vector<Mat>& coverImgs,
+    const bool reverseOrder)
+{
+    vector<CoverResult> results(coverImgs.size());
+    unique_ptr<OcrSession> session = engine.CreateSession();
+    for (size_t step = 0; step < coverImgs.size(); ++step)
+    {
+        const size_t coverIndex = reverseOrder ? coverImgs.size() - 1 - step : step;
+
+        OcrOutput output;
+        session->Recognize(coverImgs[coverIndex], output);
+
+        CoverResult& result = results[coverIndex];
+        result.status = output.status;
+        result.circledDigitsRect = output.report.circledDigitsRect;
+        result.priorMismatched = output.report.priorMismatched;
+    }
+
+    return results;
+}
+
+// The largest difference between the crops of the covers which both found the circled
+// digits, or -1 if the statuses differ for any cover.
+static int MaxOffset(
+    const vector<CoverResult>& results1,
+    const vector<CoverResult>& results2)
+{
+    int maxOffset = 0;
+    for (size_t coverIndex = 0; coverIndex < results1.size(); ++coverIndex)
+    {
+        const CoverResult& result1 = results1[coverIndex];
+        const CoverResult& result2 = results2[coverIndex];
+        if (result1.status != result2.status)
+        {
+            return -1;
+        }
+
+        if (result1.status == OcrStatus::Success)
+        {
+            maxOffset = max(maxOffset, max(
+                abs(result1.circledDigitsRect.x - result2.circledDigitsRect.x),
+                abs(result1.circledDigitsRect.y - result2.circledDigitsRect.y)));
+        }
+    }
+
+    return maxOffset;
+}
+
+static size_t CountMismatches(const vector<CoverResult>& results)
+{
+    size_t cntMismatches = 0;
+    for (const auto& result: results)
+    {
+        cntMismatches += result.priorMismatched ? 1 : 0;
+    }
+
+    return cntMismatches;
+}
+
+static bool InitEngine(
+    const string& name,
+    const OcrEngineOptions& options,
+    const TitleFeatures& titleFeatures,
+    const vector<pair<string, Mat> >& templDigitImgPairs,
+    OcrEngine& engine)
+{
+    if (!engine.Init(options, titleFeatures, templDigitImgPairs))
+    {
+        Check(false, name + ": set up the engine.");
+        return false;
+    }
+
+    return true;
+}
+
+static void CheckCoverOrder(
+    const string& name,
+    OcrEngineOptions options,
+    const bool expectOrderDependence,
+    const TitleFeatures& titleFeatures,
+    const vector<pair<string, Mat> >& templDigitImgPairs,
+    const vector<Mat>& coverImgs)
+{
+    // The matches in the whole covers, which don't depend on the order.
+    OcrEngine wholeEngine;
+    if (!InitEngine(name, options, titleFeatures, templDigitImgPairs, wholeEngine))
+    {
+        return;
+    }
+
+    const vector<CoverResult> wholeResults = ProcessCovers(wholeEngine, coverImgs, false);
+
+    options.priorMargin = priorMargin;
+    OcrEngine priorEngine;
+    if (!InitEngine(name, options, titleFeatures, templDigitImgPairs, priorEngine))
+    {
+        return;
+    }
+
+    const int priorOrderOffset = MaxOffset(
+        ProcessCovers(priorEngine, coverImgs, false), ProcessCovers(priorEngine, coverImgs, true));
+    printf("[INFO]: %s: the unverified prior gives crops up to %d pixels apart in the two orders.\n",
+        name.c_str(), priorOrderOffset);
+    if (expectOrderDependence)
+    {
+        Check(priorOrderOffset != 0, name + ": the covers expose the order dependence of the unverified prior.");
+    }
+
+    options.priorTolerance = priorTolerance;
+    OcrEngine verifiedEngine;
+    if (!InitEngine(name, options, titleFeatures, templDigitImgPairs, verifiedEngine))
+    {
+        return;
+    }
+
+    const vector<CoverResult> forwardResults = ProcessCovers(verifiedEngine, coverImgs, false);
+    const vector<CoverResult> reverseResults = ProcessCovers(verifiedEngine, coverImgs, true);
+    printf("[INFO]: %s: the verified prior reported %ld mismatches in order and %ld in the reverse order.\n",
+        name.c_str(), CountMismatches(forwardResults), CountMismatches(reverseResults));
+
+    const int forwardOffset = MaxOffset(forwardResults, wholeResults);
+    const int reverseOffset = MaxOffset(reverseResults, wholeResults);
+    Check((forwardOffset >= 0) && (forwardOffset <= priorTolerance),
+        name + ": the verified prior in order agrees with the whole covers.");
+    Check((reverseOffset >= 0) && (reverseOffset <= priorTolerance),
+        name + ": the verified prior in the reverse order agrees with the whole covers.");
+    if (expectOrderDependence)
+    {
+        Check(CountMismatches(forwardResults) > 0, name + ": the verified prior reports the faded titles in order.");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 1)
+    {
+        printf("Usage: %s\n", argv[0]);
+        return 1;
+    }
+
+    const Mat titleImg = MakeTitle();
+    const TitleFeatures titleFeatures = OcrPreprocessor::ComputeTitleFeatures(titleImg, true, true);
+
+    vector<pair<string, Mat> > templDigitImgPairs;
+    for (const string digits: {"12", "34", "56", "78"})
+    {
+        templDigitImgPairs.push_back(make_pair(digits, MakeDigitTemplate(digits)));
+    }
+
+    // The title moves by more than the margin, so that the window around the old position
+    // holds only the faded copy.
+    const Size coverSize(600, 800);
+    const Point titlePoint((coverSize.width - titleImg.cols)/2 - titleShift/2, 40);
+    const Point movedTitlePoint(titlePoint.x + titleShift, titlePoint.y);
+    const Point noFadedPoint(-titleImg.cols, -titleImg.rows);
+
+    RNG rng(20261019);
+    vector<Mat> coverImgs;
+    for (int coverIndex = 0; coverIndex < cntCovers; ++coverIndex)
+    {
+        const string digits = templDigitImgPairs[coverIndex%templDigitImgPairs.size()].first;
+        coverImgs.push_back((coverIndex < cntCovers/2)
+            ? MakeCover(coverSize, titleImg, titlePoint, noFadedPoint, digits, rng)
+            : MakeCover(coverSize, titleImg, movedTitlePoint, titlePoint, digits, rng));
+    }
+
+    // A low minimum score, so that the faded copy is accepted around the prior.
+    OcrEngineOptions options;
+    options.priorMinScore = 0.3;
+
+    options.method = "templ";
+    CheckCoverOrder("templ", options, true, titleFeatures, templDigitImgPairs, coverImgs);
+
+    options.method = "homo";
+    CheckCoverOrder("homo", options, false, titleFeatures, templDigitImgPairs, coverImgs);
+
+    printf("[INFO]: %ld checks, %ld failed.\n", cntChecks, cntFailures);
+    return (cntFailures == 0) ? 0 : 1;
+}
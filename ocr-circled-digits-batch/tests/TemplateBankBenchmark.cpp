@@ -0,0 +1,300 @@
+/*
+ * TemplateBankBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+// Time TemplateBank::MatchAll against matchTemplate followed by minMaxLoc for each template,
+// which CircledDigitsOCRer uses unless --templBank is given, and check that their maximum
+// scores agree:
+//   - on synthetic black-white images of the size cropped by OcrPreprocessor (80 x 60) scaled
+//     by 2 and 4 (the default --scaleFactor), with 10 and 50 digit templates 16 to 64 pixels
+//     wide,
+//   - on the black-white images of blackWhiteImgsDir, if given, with the templates of
+//     templImgDir.
+//
+// The times are the means over the images and a few repetitions, and each case prints
+// which of the two is faster, so that --templBank is only enabled where the bank wins on
+// the target CPU.
+//
+// Usage: TemplateBankBenchmark [templImgDir blackWhiteImgsDir]
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "FileUtility.h"
+#include "Workspace.h"
+#include "TemplateBank.h"
+
+using namespace std;
+using namespace cv;
+
+// The integer correlation of the bank and the float one of matchTemplate round differently.
+static const double scoreTolerance = 1e-3;
+
+static const int cntRepeats = 5;
+
+struct CaseStats
+{
+    size_t cntCases;
+    size_t cntBankWins;
+    size_t cntDifferent;
+
+    CaseStats() :
+        cntCases(0),
+        cntBankWins(0),
+        cntDifferent(0)
+    {
+    }
+};
+
+static double ElapsedMs(const int64 startTick)
+{
+    return (getTickCount() - startTick)*1000.0/getTickFrequency();
+}
+
+// Match each template like CircledDigitsOCRer::MatchTemplates without the bank.
+static void MatchEach(
+    const Mat& img,
+    const vector<Mat>& templImgs,
+    vector<double>& maxScores,
+    Workspace& workspace)
+{
+    maxScores.clear();
+    for (const auto& templImg: templImgs)
+    {
+        Mat matchRes = workspace.GetMat("digitRes",
+            Size(img.cols - templImg.cols + 1, img.rows - templImg.rows + 1), CV_32FC1);
+        matchTemplate(img, templImg, matchRes, TM_CCOEFF_NORMED);
+
+        double maxScore = -1.0;
+        minMaxLoc(matchRes, nullptr, &maxScore, nullptr, nullptr);
+        maxScores.push_back(maxScore);
+    }
+}
+
+static void RunCase(
+    const string& name,
+    const vector<Mat>& imgs,
+    const vector<Mat>& templImgs,
+    CaseStats& stats)
+{
+    const TemplateBank bank(templImgs);
+    if (!bank.IsValid())
+    {
+        printf("[ERROR]: %s: the templates can't be put into a bank.\n\n", name.c_str());
+        ++stats.cntCases;
+        ++stats.cntDifferent;
+        return;
+    }
+
+    vector<int> templIndices;
+    for (size_t templIndex = 0; templIndex < templImgs.size(); ++templIndex)
+    {
+        templIndices.push_back(static_cast<int>(templIndex));
+    }
+
+    // Both get a warm workspace, as a worker has after its first image.
+    Workspace eachWorkspace;
+    Workspace bankWorkspace;
+    vector<double> eachScores;
+    vector<double> bankScores;
+    MatchEach(imgs[0], templImgs, eachScores, eachWorkspace);
+    bank.MatchAll(imgs[0], templIndices, bankScores, bankWorkspace);
+
+    double eachMs = 0.0;
+    double bankMs = 0.0;
+    double maxDiff = 0.0;
+    for (int repeat = 0; repeat < cntRepeats; ++repeat)
+    {
+        for (const auto& img: imgs)
+        {
+            int64 startTick = getTickCount();
+            MatchEach(img, templImgs, eachScores, eachWorkspace);
+            eachMs += ElapsedMs(startTick);
+
+            startTick = getTickCount();
+            if (!bank.MatchAll(img, templIndices, bankScores, bankWorkspace))
+            {
+                printf("[ERROR]: %s: the bank can't match an image of %dx%d.\n\n", name.c_str(), img.cols, img.rows);
+                ++stats.cntCases;
+                ++stats.cntDifferent;
+                return;
+            }
+
+            bankMs += ElapsedMs(startTick);
+
+            for (size_t templIndex = 0; templIndex < templImgs.size(); ++templIndex)
+            {
+                maxDiff = max(maxDiff, fabs(bankScores[templIndex] - eachScores[templIndex]));
+            }
+        }
+    }
+
+    const double cntMatches = static_cast<double>(cntRepeats)*imgs.size();
+    eachMs /= cntMatches;
+    bankMs /= cntMatches;
+
+    const bool different = (maxDiff > scoreTolerance);
+    ++stats.cntCases;
+    stats.cntBankWins += (bankMs < eachMs) ? 1 : 0;
+    stats.cntDifferent += different ? 1 : 0;
+
+    printf("[%s]: %s: %ld templates of %dx%d on %dx%d, matchTemplate %.2f ms (%.3f ms per template), "
+        "bank %s %.2f ms (%.3f ms per template), %.2fx, max score difference %g\n",
+        different ? "ERROR" : "INFO",
+        name.c_str(),
+        templImgs.size(), templImgs[0].cols, templImgs[0].rows, imgs[0].cols, imgs[0].rows,
+        eachMs, eachMs/templImgs.size(),
+        bank.GetKernelName().c_str(), bankMs, bankMs/templImgs.size(),
+        eachMs/max(bankMs, 1e-9), maxDiff);
+}
+
+// A black-white image of the given digits in black on white, like
+// OcrPreprocessor::BlackWhiteThresholding gives.
+static Mat MakeDigitsImg(
+    const Size& size,
+    const string& digits,
+    const double fontScale,
+    const int thickness)
+{
+    Mat img(size, CV_8UC1, Scalar(255));
+
+    int baseLine = 0;
+    const Size textSize = getTextSize(digits, FONT_HERSHEY_SIMPLEX, fontScale, thickness, &baseLine);
+    putText(img, digits, Point((size.width - textSize.width)/2, (size.height + textSize.height)/2),
+        FONT_HERSHEY_SIMPLEX, fontScale, Scalar(0), thickness);
+
+    return img;
+}
+
+static void RunSyntheticCases(CaseStats& stats)
+{
+    RNG rng(20261019);
+
+    for (const double scaleFactor: {2.0, 4.0})
+    {
+        const Size imgSize(cvRound(80*scaleFactor), cvRound(60*scaleFactor));
+        for (const int templWidth: {16, 24, 32, 48, 64})
+        {
+            const Size templSize(templWidth, templWidth*5/4);
+            if ((templSize.width > imgSize.width) || (templSize.height > imgSize.height))
+            {
+                continue;
+            }
+
+            const double fontScale = templSize.height/40.0;
+            const int thickness = max(1, templWidth/16);
+            for (const int cntTempls: {10, 50})
+            {
+                vector<Mat> templImgs;
+                for (int templIndex = 0; templIndex < cntTempls; ++templIndex)
+                {
+                    templImgs.push_back(MakeDigitsImg(templSize, to_string(templIndex + 1), fontScale, thickness));
+                }
+
+                // The cropped images hold a few digits drawn larger around the circle.
+                vector<Mat> imgs;
+                for (int imgIndex = 0; imgIndex < 8; ++imgIndex)
+                {
+                    Mat img = MakeDigitsImg(imgSize, to_string(rng.uniform(1, cntTempls + 1)), fontScale, thickness);
+                    circle(img, Point(imgSize.width/2, imgSize.height/2), min(imgSize.width, imgSize.height)*2/5,
+                        Scalar(0), max(1, cvRound(scaleFactor)));
+                    imgs.push_back(img);
+                }
+
+                RunCase("synthetic x" + to_string(cvRound(scaleFactor)), imgs, templImgs, stats);
+            }
+        }
+    }
+}
+
+static bool LoadGrayImgs(
+    const string& imgDir,
+    vector<Mat>& imgs)
+{
+    vector<string> imgFiles;
+    if (FileUtility::GetDirFiles(imgDir, imgFiles) != 0)
+    {
+        printf("[ERROR]: Cannot get the image file names in %s.\n\n", imgDir.c_str());
+        return false;
+    }
+
+    sort(imgFiles.begin(), imgFiles.end());
+    for (const auto& imgFile: imgFiles)
+    {
+        Mat img = imread(imgFile, IMREAD_GRAYSCALE);
+        if (!img.empty())
+        {
+            imgs.push_back(img);
+        }
+    }
+
+    if (imgs.empty())
+    {
+        printf("[ERROR]: No image in %s.\n\n", imgDir.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static bool RunRealCases(
+    const string& templImgDir,
+    const string& blackWhiteImgsDir,
+    CaseStats& stats)
+{
+    vector<Mat> templImgs;
+    vector<Mat> imgs;
+    if (!LoadGrayImgs(templImgDir, templImgs) || !LoadGrayImgs(blackWhiteImgsDir, imgs))
+    {
+        return false;
+    }
+
+    // Only the images which all the templates fit into are matched by OCR.
+    vector<Mat> fittingImgs;
+    for (const auto& img: imgs)
+    {
+        if ((img.cols >= templImgs[0].cols) && (img.rows >= templImgs[0].rows))
+        {
+            fittingImgs.push_back(img);
+        }
+    }
+
+    if (fittingImgs.empty())
+    {
+        printf("[ERROR]: No image in %s is as large as the templates.\n\n", blackWhiteImgsDir.c_str());
+        return false;
+    }
+
+    RunCase("real", fittingImgs, templImgs, stats);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if ((argc != 1) && (argc != 3))
+    {
+        printf("Usage: %s [templImgDir blackWhiteImgsDir]\n", argv[0]);
+        return 1;
+    }
+
+    CaseStats stats;
+    RunSyntheticCases(stats);
+    if ((argc == 3) && !RunRealCases(argv[1], argv[2], stats))
+    {
+        return 1;
+    }
+
+    printf("[INFO]: %ld cases, the bank is faster in %ld, %ld have different scores.\n",
+        stats.cntCases, stats.cntBankWins, stats.cntDifferent);
+    return (stats.cntDifferent == 0) ? 0 : 1;
+}
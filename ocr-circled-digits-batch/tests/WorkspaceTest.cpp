@@ -0,0 +1,326 @@
+/*
+ * WorkspaceTest.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: renwei
+ */
+
+// Check that the results don't depend on what the workspace processed before, and that the
+// workspace stops growing once it has seen the largest cover:
+//   - GetMat returns continuous images of exactly the requested size over the start of the
+//     buffer, also after a larger request, without growing the buffer,
+//   - GaussianBlur, Sobel and Canny of a small image in a buffer filled by a larger one are
+//     the same as those of a fresh image,
+//   - the triage of each cover gives the same report after a larger cover as with a fresh
+//     workspace,
+//   - for each extraction method, one session processes synthetic covers of several sizes,
+//     also skewed, and then again in the reverse order: both passes give the same results
+//     as a fresh session for each cover, and the second pass grows no workspace buffer.
+//
+// Usage: WorkspaceTest
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Workspace.h"
+#include "CoverTriage.h"
+#include "OcrEngine.h"
+
+using namespace std;
+using namespace cv;
+
+static size_t cntChecks = 0;
+static size_t cntFailures = 0;
+
+static void Check(
+    const bool passed,
+    const string& what)
+{
+    ++cntChecks;
+    cntFailures += passed ? 0 : 1;
+    printf("[%s]: %s\n", passed ? "INFO" : "ERROR", what.c_str());
+}
+
+static bool SameImg(
+    const Mat& img1,
+    const Mat& img2)
+{
+    return (img1.size() == img2.size()) && (img1.type() == img2.type()) &&
+        (img1.empty() || (norm(img1, img2, NORM_INF) == 0.0));
+}
+
+static void CheckGetMat()
+{
+    Workspace workspace;
+    const Mat largeImg = workspace.GetMat("img", Size(64, 48), CV_8UC3);
+    const size_t cntAllocations = workspace.GetAllocationCount();
+
+    const Mat smallImg = workspace.GetMat("img", Size(20, 10), CV_8UC3);
+    Check(smallImg.isContinuous() && (smallImg.size() == Size(20, 10)) && (smallImg.type() == CV_8UC3) &&
+        (smallImg.data == largeImg.data) && (workspace.GetAllocationCount() == cntAllocations),
+        "A smaller image is a continuous image of its size over the buffer.");
+
+    const Mat tallImg = workspace.GetMat("img", Size(10, 60), CV_8UC3);
+    Check(tallImg.isContinuous() && (tallImg.size() == Size(10, 60)) && (tallImg.data == largeImg.data) &&
+        (workspace.GetAllocationCount() == cntAllocations),
+        "An image taller than the largest one but with fewer pixels reuses the buffer.");
+
+    workspace.GetMat("img", Size(100, 48), CV_8UC3);
+    workspace.GetMat("img", Size(64, 48), CV_8UC3);
+    Check(workspace.GetAllocationCount() == cntAllocations + 1, "A larger image grows the buffer once.");
+
+    vector<int>& values = workspace.GetIntVector("values");
+    values.assign(100, 1);
+    const size_t cntGrownAllocations = workspace.GetAllocationCount();
+    workspace.GetIntVector("values").assign(50, 2);
+    Check(workspace.GetAllocationCount() == cntGrownAllocations, "A vector keeps its capacity.");
+}
+
+// The operations with borders on a small image in a buffer filled by a larger one, which
+// would read the pixels of the larger one around a region of it.
+static void CheckBorders()
+{
+    Mat smallImg(30, 40, CV_8UC1);
+    randu(smallImg, Scalar(0), Scalar(256));
+
+    Workspace workspace;
+    workspace.GetMat("gray", Size(80, 60), CV_8UC1).setTo(Scalar::all(255));
+    Mat grayImg = workspace.GetMat("gray", smallImg.size(), CV_8UC1);
+    smallImg.copyTo(grayImg);
+
+    Mat res;
+    Mat expectedRes;
+    GaussianBlur(grayImg, res, Size(0, 0), 3);
+    GaussianBlur(smallImg, expectedRes, Size(0, 0), 3);
+    Check(SameImg(res, expectedRes), "GaussianBlur of a workspace image reads no stale pixels.");
+
+    Sobel(grayImg, res, CV_32F, 1, 1, 3);
+    Sobel(smallImg, expectedRes, CV_32F, 1, 1, 3);
+    Check(SameImg(res, expectedRes), "Sobel of a workspace image reads no stale pixels.");
+
+    Canny(grayImg, res, 50, 150);
+    Canny(smallImg, expectedRes, 50, 150);
+    Check(SameImg(res, expectedRes), "Canny of a workspace image reads no stale pixels.");
+}
+
+static Mat MakeTitle()
+{
+    Mat titleImg(40, 160, CV_8UC3, Scalar(240, 240, 240));
+    putText(titleImg, "SERIES", Point(5, 28), FONT_HERSHEY_DUPLEX, 1.0, Scalar(20, 20, 120), 2);
+    rectangle(titleImg, Rect(130, 8, 24, 24), Scalar(0, 0, 200), 2);
+
+    return titleImg;
+}
+
+static Mat MakeDigitTemplate(const string& digits)
+{
+    Mat templImg(60, 90, CV_8UC1, Scalar(255));
+    putText(templImg, digits, Point(8, 45), FONT_HERSHEY_SIMPLEX, 1.5, Scalar(0), 4);
+
+    return templImg;
+}
+
+// A cover with the title at the top and the circled digits below it, where the engine
+// crops them, over a noisy background with blocks below.
+static Mat MakeCover(
+    const Size& size,
+    const Mat& titleImg,
+    const string& digits,
+    RNG& rng)
+{
+    Mat coverImg(size, CV_8UC3);
+    randu(coverImg, Scalar::all(150), Scalar::all(230));
+    for (int index = 0; index < 20; ++index)
+    {
+        const Point topLeft(rng.uniform(0, size.width), rng.uniform(200, size.height));
+        rectangle(coverImg, Rect(topLeft.x, topLeft.y, rng.uniform(10, 120), rng.uniform(10, 120)),
+            Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), FILLED);
+    }
+
+    const Point titlePoint((size.width - titleImg.cols)/2, 40);
+    titleImg.copyTo(coverImg(Rect(titlePoint, titleImg.size())));
+
+    const Point center(titlePoint.x + titleImg.cols/2, titlePoint.y + titleImg.rows/2 + 55);
+    circle(coverImg, center, 22, Scalar(255, 255, 255), FILLED);
+    circle(coverImg, center, 22, Scalar(0, 0, 200), 2);
+    putText(coverImg, digits, Point(center.x - 15, center.y + 8), FONT_HERSHEY_SIMPLEX, 0.8, Scalar(0, 0, 0), 2);
+
+    return coverImg;
+}
+
+static Mat Rotate(
+    const Mat& img,
+    const double angle)
+{
+    Mat rotatedImg;
+    const Point2f center(img.cols/2.0f, img.rows/2.0f);
+    warpAffine(img, rotatedImg, getRotationMatrix2D(center, angle, 1.0), img.size(), INTER_LINEAR, BORDER_REPLICATE);
+
+    return rotatedImg;
+}
+
+struct CoverResult
+{
+    OcrStatus status;
+    Rect circledDigitsRect;
+    string digits;
+    Mat blackWhiteImg;
+};
+
+static CoverResult RecognizeCover(
+    OcrSession& session,
+    const Mat& coverImg)
+{
+    OcrOutput output;
+    session.Recognize(coverImg, output);
+
+    CoverResult result;
+    result.status = output.status;
+    result.circledDigitsRect = output.report.circledDigitsRect;
+    result.digits = output.result.evaluatedDigits;
+    result.blackWhiteImg = output.blackWhiteImg.clone();
+
+    return result;
+}
+
+static bool SameResult(
+    const CoverResult& result1,
+    const CoverResult& result2)
+{
+    return (result1.status == result2.status) && (result1.circledDigitsRect == result2.circledDigitsRect) &&
+        (result1.digits == result2.digits) && SameImg(result1.blackWhiteImg, result2.blackWhiteImg);
+}
+
+// The triage of each cover after all the others, the larger ones included, and with a
+// fresh workspace. The thumbnails of the covers have different sizes.
+static void CheckTriage(
+    const Mat& titleImg,
+    const vector<Mat>& coverImgs)
+{
+    const CoverTriage triage(TriageThresholds(), vector<Mat>{titleImg});
+
+    Workspace workspace;
+    TriageReport report;
+    for (const auto& coverImg: coverImgs)
+    {
+        triage.Check(coverImg, workspace, report);
+    }
+
+    bool sameReports = true;
+    for (size_t coverIndex = coverImgs.size(); coverIndex-- > 0;)
+    {
+        Workspace freshWorkspace;
+        TriageReport freshReport;
+        triage.Check(coverImgs[coverIndex], freshWorkspace, freshReport);
+        triage.Check(coverImgs[coverIndex], workspace, report);
+
+        sameReports = (report.passed == freshReport.passed) && (report.reason == freshReport.reason) &&
+            (report.stdDev == freshReport.stdDev) && (report.entropy == freshReport.entropy) &&
+            (report.edgeDensity == freshReport.edgeDensity) && (report.titleScore == freshReport.titleScore) &&
+            sameReports;
+    }
+
+    Check(sameReports, "The triage reports don't depend on the covers triaged before.");
+}
+
+static void CheckSteadyState(
+    const string& name,
+    const OcrEngineOptions& options,
+    const TitleFeatures& titleFeatures,
+    const vector<pair<string, Mat> >& templDigitImgPairs,
+    const vector<Mat>& coverImgs)
+{
+    OcrEngine engine;
+    if (!engine.Init(options, titleFeatures, templDigitImgPairs))
+    {
+        Check(false, name + ": set up the engine.");
+        return;
+    }
+
+    // The results of fresh sessions, which have seen no other cover.
+    vector<CoverResult> freshResults;
+    for (const auto& coverImg: coverImgs)
+    {
+        unique_ptr<OcrSession> freshSession = engine.CreateSession();
+        freshResults.push_back(RecognizeCover(*freshSession, coverImg));
+    }
+
+    Workspace workspace;
+    unique_ptr<OcrSession> session = engine.CreateSession(&workspace);
+    bool sameResults = true;
+    for (size_t coverIndex = 0; coverIndex < coverImgs.size(); ++coverIndex)
+    {
+        sameResults = SameResult(RecognizeCover(*session, coverImgs[coverIndex]), freshResults[coverIndex]) && sameResults;
+    }
+
+    const size_t cntFirstPassAllocations = workspace.GetAllocationCount();
+    for (size_t coverIndex = coverImgs.size(); coverIndex-- > 0;)
+    {
+        sameResults = SameResult(RecognizeCover(*session, coverImgs[coverIndex]), freshResults[coverIndex]) && sameResults;
+    }
+
+    const size_t cntSecondPassAllocations = workspace.GetAllocationCount() - cntFirstPassAllocations;
+    printf("[INFO]: %s: the workspace grew %ld times in the first pass and %ld times in the second.\n",
+        name.c_str(), cntFirstPassAllocations, cntSecondPassAllocations);
+
+    Check(sameResults, name + ": the results don't depend on the covers processed before.");
+    Check(cntSecondPassAllocations == 0, name + ": the second pass grows no workspace buffer.");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 1)
+    {
+        printf("Usage: %s\n", argv[0]);
+        return 1;
+    }
+
+    CheckGetMat();
+    CheckBorders();
+
+    const Mat titleImg = MakeTitle();
+    const TitleFeatures titleFeatures = OcrPreprocessor::ComputeTitleFeatures(titleImg, true, true);
+
+    vector<pair<string, Mat> > templDigitImgPairs;
+    for (const string digits: {"12", "34", "56", "78"})
+    {
+        templDigitImgPairs.push_back(make_pair(digits, MakeDigitTemplate(digits)));
+    }
+
+    // The largest cover comes in the middle, so that the first pass grows the buffers
+    // both before and after it.
+    RNG rng(20261019);
+    vector<Mat> coverImgs;
+    coverImgs.push_back(MakeCover(Size(450, 600), titleImg, "12", rng));
+    coverImgs.push_back(MakeCover(Size(600, 800), titleImg, "34", rng));
+    coverImgs.push_back(Rotate(MakeCover(Size(500, 650), titleImg, "56", rng), 3.0));
+    coverImgs.push_back(MakeCover(Size(380, 500), titleImg, "78", rng));
+
+    CheckTriage(titleImg, coverImgs);
+
+    OcrEngineOptions options;
+    options.maxSkewAngle = 10.0;
+
+    options.method = "homo";
+    CheckSteadyState("homo", options, titleFeatures, templDigitImgPairs, coverImgs);
+
+    options.method = "templ";
+    CheckSteadyState("templ", options, titleFeatures, templDigitImgPairs, coverImgs);
+
+    options.tileSize = 128;
+    CheckSteadyState("templ in tiles", options, titleFeatures, templDigitImgPairs, coverImgs);
+
+    options.tileSize = 0;
+    options.maxSkewAngle = 0.0;
+    options.method = "hough";
+    CheckSteadyState("hough", options, titleFeatures, templDigitImgPairs, coverImgs);
+
+    printf("[INFO]: %ld checks, %ld failed.\n", cntChecks, cntFailures);
+    return (cntFailures == 0) ? 0 : 1;
+}
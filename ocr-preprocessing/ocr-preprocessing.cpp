@@ -6,31 +6,67 @@
  */
 
 #include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <utility>
+
+#include <boost/program_options.hpp>
 
 #include <opencv2/core.hpp>
-#include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "BatchMetrics.h"
+#include "FileUtility.h"
+
+// Define HEADLESS to build without highgui, e.g., for servers. Only the batch mode
+// and the single image mode with --headless are then available.
+#ifndef HEADLESS
+#include <opencv2/highgui.hpp>
+#endif
+
 using namespace std;
 using namespace cv;
+namespace po = boost::program_options;
 
-int main(int argc, char** argv)
+// Read the image files listed one per line in the given file.
+bool GetListedFiles(const string& listFile, vector<string>& files)
 {
-    if (argc < 3)
+    ifstream ifs(listFile);
+    if (!ifs)
     {
-        printf("[ERROR]: Either the input image or the output image or both are not specified.\n\n");
-        return -1;
+        printf("[ERROR]: Can't open the file list %s.\n\n", listFile.c_str());
+        return false;
     }
 
-    Mat srcImg = imread(argv[1]);
-    if (srcImg.empty())
+    files.clear();
+    string line;
+    while (getline(ifs, line))
     {
-        printf("[ERROR]: Can't load the input image file %s.\n\n", argv[1]);
-        return -1;
+        if (!line.empty())
+        {
+            files.push_back(line);
+        }
     }
 
+    return true;
+}
+
+// Sharpen the image, convert it into grayscale and threshold it at threshFraction of
+// its gray range. The grayscale image is kept for displaying.
+void PreprocessImg(
+    const Mat& srcImg,
+    const double threshFraction,
+    Mat& imgSharpGray,
+    Mat& imgThresholded)
+{
     // Sharpen the image using Unsharp Masking with a Gaussian blurred version of the image. Note that
     // srcImgGaussian = 1.5*srcImg - 0.5*srcImgGaussian, but to avoid overflow while multiplying srcImg
     // by 1.5, we subtract srcImgGaussian from srcImg first and then add 0.5*srcImg.
@@ -40,12 +76,56 @@ int main(int argc, char** argv)
     addWeighted(srcImg, 0.5, imgSharp, 1.0, 0.0, imgSharp);
 
     // Convert the color image after Gaussian Blur into grayscale.
-    Mat imgSharpGray;
-    cvtColor(imgSharp, imgSharpGray, COLOR_BGR2GRAY);
+    if (imgSharp.channels() == 3)
+    {
+        cvtColor(imgSharp, imgSharpGray, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        imgSharpGray = imgSharp;
+    }
+
+    double minVal = 0.0;
+    double maxVal = 0.0;
+    minMaxLoc(imgSharpGray, &minVal, &maxVal);
+
+    double thresh = minVal + threshFraction*(maxVal - minVal);
+    threshold(imgSharpGray, imgThresholded, thresh, 255, THRESH_BINARY);
+}
 
-    // Display the grayscale image.
-    namedWindow("The grayscale image", WINDOW_AUTOSIZE);
-    imshow("The grayscale image", imgSharpGray);
+// Get the output file of the input image in the output directory with the given extension.
+string GetOutputFile(
+    const string& imgFile,
+    const string& outputDir,
+    const string& format)
+{
+    string filename = imgFile.substr(imgFile.find_last_of('/') + 1);
+    const size_t dotPos = filename.find_last_of('.');
+    if (dotPos != string::npos)
+    {
+        filename = filename.substr(0, dotPos);
+    }
+
+    return outputDir + "/" + filename + "." + format;
+}
+
+// Preprocess one image and show the intermediate images unless headless.
+int ProcessSingleImage(
+    const string& inputFile,
+    const string& outputFile,
+    const double threshFraction,
+    const bool headless)
+{
+    Mat srcImg = imread(inputFile);
+    if (srcImg.empty())
+    {
+        printf("[ERROR]: Can't load the input image file %s.\n\n", inputFile.c_str());
+        return -1;
+    }
+
+    Mat imgSharpGray;
+    Mat imgThresholded;
+    PreprocessImg(srcImg, threshFraction, imgSharpGray, imgThresholded);
 
     double minVal = 0.0;
     double maxVal = 0.0;
@@ -53,30 +133,273 @@ int main(int argc, char** argv)
     printf("[INFO]: The grayscale image after Unsharp Masking: minVal = %f, maxVal = %f.\n",
         minVal, maxVal);
 
-    double thresh = minVal + 0.6*(maxVal - minVal);
-    Mat imgThresholded;
-    threshold(imgSharpGray, imgThresholded, thresh, 255, THRESH_BINARY);
+#ifndef HEADLESS
+    if (!headless)
+    {
+        // Display the grayscale image and the thresholded image.
+        namedWindow("The grayscale image", WINDOW_AUTOSIZE);
+        imshow("The grayscale image", imgSharpGray);
 
-    // Display the thresholded image.
-    namedWindow("The thresholded image", WINDOW_AUTOSIZE);
-    imshow("The thresholded image", imgThresholded);
+        namedWindow("The thresholded image", WINDOW_AUTOSIZE);
+        imshow("The thresholded image", imgThresholded);
+    }
+#endif
 
     // Write the thresholded image into the output file.
-    bool writeRes = imwrite(argv[2], imgThresholded);
+    bool writeRes = imwrite(outputFile, imgThresholded);
     if (writeRes)
     {
-        printf("[INFO]: Successfully write the thresholded image into %s.\n", argv[2]);
+        printf("[INFO]: Successfully write the thresholded image into %s.\n", outputFile.c_str());
     }
     else
     {
-        printf("[ERROR]: Failed to write the thresholded image into %s.\n\n", argv[2]);
+        printf("[ERROR]: Failed to write the thresholded image into %s.\n\n", outputFile.c_str());
         return -1;
     }
 
-    waitKey(0);
-    destroyAllWindows();
+#ifndef HEADLESS
+    if (!headless)
+    {
+        waitKey(0);
+        destroyAllWindows();
+    }
+#endif
 
     return 0;
 }
 
+// Preprocess the images with cntJobs worker threads without any window, and print the
+// throughput and the latency percentiles of the images at the end. The outcome and the
+// stage times of each image are recorded in the metrics if any.
+int ProcessBatch(
+    const vector<string>& imgFiles,
+    const string& outputDir,
+    const string& format,
+    const double threshFraction,
+    const unsigned int cntJobs,
+    BatchMetrics* metrics)
+{
+    // The images are processed in parallel, so each OpenCV call runs single-threaded.
+    setNumThreads(1);
+
+    vector<double> latenciesMs(imgFiles.size(), 0.0);
+    vector<char> succeeded(imgFiles.size(), 0);
+    atomic<size_t> nextImgIndex(0);
+
+    auto worker = [&]()
+    {
+        size_t imgIndex = 0;
+        while ((imgIndex = nextImgIndex++) < imgFiles.size())
+        {
+            if (metrics != nullptr)
+            {
+                metrics->SetQueueDepth("pending", static_cast<double>(imgFiles.size() - min(nextImgIndex.load(), imgFiles.size())));
+            }
+
+            const int64 startTick = getTickCount();
+            vector<pair<string, double> > stageTimesMs;
+            auto recordStage = [&](const string& stage, const int64 stageStartTick)
+            {
+                stageTimesMs.push_back(make_pair(stage, (getTickCount() - stageStartTick)*1000.0/getTickFrequency()));
+            };
+            auto recordFailure = [&](const string& reason)
+            {
+                if (metrics != nullptr)
+                {
+                    metrics->RecordImage(BatchMetrics::ImageResult::Failed, "", reason, stageTimesMs,
+                        (getTickCount() - startTick)*1000.0/getTickFrequency());
+                }
+            };
+
+            int64 stageStartTick = getTickCount();
+            Mat srcImg = imread(imgFiles[imgIndex]);
+            recordStage("decode", stageStartTick);
+            if (srcImg.empty())
+            {
+                printf("[ERROR]: Can't load the input image file %s.\n\n", imgFiles[imgIndex].c_str());
+                recordFailure("loadfailed");
+                continue;
+            }
+
+            stageStartTick = getTickCount();
+            Mat imgSharpGray;
+            Mat imgThresholded;
+            PreprocessImg(srcImg, threshFraction, imgSharpGray, imgThresholded);
+            recordStage("preprocess", stageStartTick);
+
+            stageStartTick = getTickCount();
+            const string outputFile = GetOutputFile(imgFiles[imgIndex], outputDir, format);
+            const bool written = imwrite(outputFile, imgThresholded);
+            recordStage("encode", stageStartTick);
+            if (!written)
+            {
+                printf("[ERROR]: Failed to write the thresholded image into %s.\n\n", outputFile.c_str());
+                recordFailure("writefailed");
+                continue;
+            }
+
+            latenciesMs[imgIndex] = (getTickCount() - startTick)*1000.0/getTickFrequency();
+            succeeded[imgIndex] = 1;
+
+            if (metrics != nullptr)
+            {
+                metrics->RecordImage(BatchMetrics::ImageResult::Succeeded, "threshold", "", stageTimesMs, latenciesMs[imgIndex]);
+            }
+        }
+    };
+
+    printf("[INFO]: Preprocess %ld images with %u workers.\n", imgFiles.size(), cntJobs);
+
+    const int64 batchStartTick = getTickCount();
+    vector<thread> workerThreads;
+    for (unsigned int workerIndex = 0; workerIndex < cntJobs; ++workerIndex)
+    {
+        workerThreads.push_back(thread(worker));
+    }
+
+    for (auto& workerThread: workerThreads)
+    {
+        workerThread.join();
+    }
+
+    const double batchMs = (getTickCount() - batchStartTick)*1000.0/getTickFrequency();
+
+    vector<double> successLatenciesMs;
+    for (size_t imgIndex = 0; imgIndex < imgFiles.size(); ++imgIndex)
+    {
+        if (succeeded[imgIndex] != 0)
+        {
+            successLatenciesMs.push_back(latenciesMs[imgIndex]);
+        }
+    }
+
+    printf("[INFO]: %ld of %ld images are preprocessed in %f ms (%f images/s).\n",
+        successLatenciesMs.size(), imgFiles.size(), batchMs,
+        successLatenciesMs.size()*1000.0/max(batchMs, 1e-3));
+
+    if (!successLatenciesMs.empty())
+    {
+        sort(successLatenciesMs.begin(), successLatenciesMs.end());
+        auto percentile = [&](const double fraction)
+        {
+            const size_t index = min(static_cast<size_t>(fraction*successLatenciesMs.size()), successLatenciesMs.size() - 1);
+            return successLatenciesMs[index];
+        };
+
+        double sumMs = 0.0;
+        for (const auto latencyMs: successLatenciesMs)
+        {
+            sumMs += latencyMs;
+        }
+
+        printf("[INFO]: The latency per image: mean = %f ms, p50 = %f ms, p95 = %f ms, p99 = %f ms, max = %f ms.\n",
+            sumMs/successLatenciesMs.size(), percentile(0.5), percentile(0.95), percentile(0.99), successLatenciesMs.back());
+    }
+
+    return (successLatenciesMs.size() == imgFiles.size()) ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description opt("Options");
+    opt.add_options()
+        ("help,h", "Display the help information")
+        ("input", po::value<string>(), "The input image file (single image mode)")
+        ("output", po::value<string>(), "The output image file (single image mode)")
+        ("headless", "Don't display the images in the single image mode. Always on in the batch mode.")
+        ("imgDir,d", po::value<string>(), "The directory containing the images to preprocess in the batch mode")
+        ("fileList,l", po::value<string>(), "The file listing the images to preprocess in the batch mode, one per line")
+        ("outputDir,o", po::value<string>(), "The output directory of the batch mode")
+        ("format,f", po::value<string>(), "The output image format (file extension) of the batch mode, e.g., png, tiff or jpg. If not specified, default png.")
+        ("thresh,t", po::value<double>(), "The threshold as the fraction of the gray range of each image. If not specified, default 0.6.")
+        ("jobs,j", po::value<unsigned int>(), "The number of worker threads of the batch mode. If not specified, the number of cores.")
+        ("metrics", po::value<string>(), "Write the progress, the throughput, the per-stage latency histograms, the queue depth and the memory of the batch mode into this file in the Prometheus text format, e.g., for the textfile collector of the node exporter. Name it *.prom.")
+        ("metricsInterval", po::value<double>(), "The seconds between two snapshots of the metrics (--metrics only). If not specified, default 5.");
+
+    po::positional_options_description positionalOpt;
+    positionalOpt.add("input", 1);
+    positionalOpt.add("output", 1);
+
+    po::variables_map vm;
+    try
+    {
+        po::store(po::command_line_parser(argc, argv).options(opt).positional(positionalOpt).run(), vm);
 
+        if (vm.count("help") > 0)
+        {
+            printf("Usage: ./ocr-preprocessing [input-image] [output-image]\n");
+            printf("       ./ocr-preprocessing -d [image-dir] | -l [file-list] -o [output-dir] -f [format] -t [thresh] -j [jobs] --metrics [metrics-file]\n\n");
+            cout << opt << endl;
+            return 0;
+        }
+
+        po::notify(vm);
+    }
+    catch (po::error& e)
+    {
+        cerr << "[ERROR]: " << e.what() << endl << endl;
+        cout << opt << endl;
+        return -1;
+    }
+
+    const double threshFraction = (vm.count("thresh") > 0) ? vm["thresh"].as<double>() : 0.6;
+    if ((threshFraction < 0.0) || (threshFraction > 1.0))
+    {
+        printf("[ERROR]: The threshold fraction %f is not in [0, 1].\n\n", threshFraction);
+        return -1;
+    }
+
+    const bool batch = (vm.count("imgDir") > 0) || (vm.count("fileList") > 0);
+    if (!batch)
+    {
+        if ((vm.count("input") == 0) || (vm.count("output") == 0))
+        {
+            printf("[ERROR]: Either the input image or the output image or both are not specified.\n\n");
+            return -1;
+        }
+
+        bool headless = (vm.count("headless") > 0);
+#ifdef HEADLESS
+        headless = true;
+#endif
+        return ProcessSingleImage(vm["input"].as<string>(), vm["output"].as<string>(), threshFraction, headless);
+    }
+
+    if (vm.count("outputDir") == 0)
+    {
+        printf("[ERROR]: The output directory is not specified.\n\n");
+        return -1;
+    }
+
+    vector<string> imgFiles;
+    if (vm.count("imgDir") > 0)
+    {
+        int error = FileUtility::GetDirFiles(vm["imgDir"].as<string>(), imgFiles);
+        if (error != 0)
+        {
+            printf("[ERROR]: Cannot get the image file names in %s with error = %d.\n\n", vm["imgDir"].as<string>().c_str(), error);
+            return error;
+        }
+
+        sort(imgFiles.begin(), imgFiles.end());
+    }
+    else if (!GetListedFiles(vm["fileList"].as<string>(), imgFiles))
+    {
+        return -1;
+    }
+
+    const string format = (vm.count("format") > 0) ? vm["format"].as<string>() : "png";
+    const unsigned int cntJobs = max((vm.count("jobs") > 0) ? vm["jobs"].as<unsigned int>() : thread::hardware_concurrency(), 1u);
+
+    // The metrics are written until the end of the batch, when the last snapshot is written.
+    unique_ptr<BatchMetrics> metrics;
+    if (vm.count("metrics") > 0)
+    {
+        const double intervalSec = (vm.count("metricsInterval") > 0) ? vm["metricsInterval"].as<double>() : 5.0;
+        metrics.reset(new BatchMetrics(vm["metrics"].as<string>(), "ocr_preprocessing", intervalSec));
+        metrics->Start();
+        printf("[INFO]: Write the metrics into %s every %f seconds.\n", vm["metrics"].as<string>().c_str(), intervalSec);
+    }
+
+    return ProcessBatch(imgFiles, vm["outputDir"].as<string>(), format, threshFraction, cntJobs, metrics.get());
+}